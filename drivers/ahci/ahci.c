@@ -86,6 +86,8 @@
 
 #define SECTOR_SIZE	512
 
+#define AHCI_MAX_TRANSFER	(PAGE_SIZE_2M * 2)
+
 struct ahci_recv_fis_t {
 	struct sata_fis_dma_setup_t dsfis;
 	uint32_t resv0;
@@ -183,149 +185,92 @@ static uint8_t find_slot(struct ahci_t* ahci, uint32_t port) {
 	return SLOT_NO_SLOT;
 }
 
-static enum disk_error_t ahci_read_lba(void* cntx, void* buffer, uint64_t lba, uint16_t count) {
-	struct ahci_disk_t* ahci_disk = cntx;
-	struct ahci_t* ahci = ahci_disk->ahci;
-	uint32_t port = ahci_disk->port;
+/* slots are shared by every port on the hba, wait for one to free up */
+static uint8_t claim_slot(struct ahci_t* ahci, uint32_t port) {
 	uint8_t slot;
-	enum disk_error_t error;
-
-	uint64_t vaddr_buf, i;
-	uint32_t paddr_buf;
-
-	const uint64_t size = (uint64_t)count * SECTOR_SIZE;
-
-	if (size > PAGE_SIZE_2M * 2) {
-		return DISK_ERROR;
-	}
 
-	paddr_buf = (uint32_t)mm_alloc_pmax(size, 0, ~0u);
-	if (!paddr_buf) {
-		logging_log_error("Failed to allocate memory for AHCI read buffer");
-		return DISK_ERROR;
-	}
-
-	vaddr_buf = mm_alloc_v(size);
-	if (!vaddr_buf) {
-		mm_free_p(paddr_buf, size);
-
-		logging_log_error("Failed to allocate memory for AHCI read buffer");
-		return DISK_ERROR;
-	}
+	while (1) {
+		lock_acquire(&ahci->lock);
+		slot = find_slot(ahci, port);
+		if (slot != SLOT_NO_SLOT) {
+			ahci->used_com |= 1u << slot;
+			lock_release(&ahci->lock);
+			return slot;
+		}
+		lock_release(&ahci->lock);
 
-	for (i = 0; i < size; i += PAGE_SIZE_4K) {
-		paging_map(vaddr_buf + i, paddr_buf + i, PAGE_PRESENT | PAGE_RW | PAT_MMIO_4K, PAGE_4K);
+		time_busy_wait(100);
 	}
+}
 
+static void release_slot(struct ahci_t* ahci, uint8_t slot) {
 	lock_acquire(&ahci->lock);
-	slot = find_slot(ahci, port);
-	ahci->used_com |= 1u << slot;
+	ahci->used_com &= ~(1u << slot);
 	lock_release(&ahci->lock);
+}
 
-	kmemset(&ahci->ports[port]->com_list[slot], 0, sizeof(struct ahci_command_header_t));
-	kmemset(ahci->com_tables_v[slot], 0, PAGE_SIZE_4K);
-
-	ahci->com_tables_v[slot]->cfis.h2d.fis_type = SATA_FIS_TYPE_H2D;
-	ahci->com_tables_v[slot]->cfis.h2d.flag = SATA_FIS_H2D_C;
-	ahci->com_tables_v[slot]->cfis.h2d.cmd = SATA_FIS_CMD_DMA_READ_EXT;
-	ahci->com_tables_v[slot]->cfis.h2d.lba0 = (lba >> 0) & 0xFF;
-	ahci->com_tables_v[slot]->cfis.h2d.lba1 = (lba >> 8) & 0xFF;
-	ahci->com_tables_v[slot]->cfis.h2d.lba2 = (lba >> 16) & 0xFF;
-	ahci->com_tables_v[slot]->cfis.h2d.lba3 = (lba >> 24) & 0xFF;
-	ahci->com_tables_v[slot]->cfis.h2d.lba4 = (lba >> 32) & 0xFF;
-	ahci->com_tables_v[slot]->cfis.h2d.lba5 = (lba >> 40) & 0xFF;
-	ahci->com_tables_v[slot]->cfis.h2d.dev = 1u << 6;
-	ahci->com_tables_v[slot]->cfis.h2d.count_lo = (count) & 0xFF;
-	ahci->com_tables_v[slot]->cfis.h2d.count_hi = (count >> 8) & 0xFF;
-	
-	ahci->com_tables_v[slot]->prdt[0].dba = paddr_buf;
-	ahci->com_tables_v[slot]->prdt[0].dbau = 0;
-	ahci->com_tables_v[slot]->prdt[0].dbc_i = (uint32_t)size - 1;
-
+/* the port lock only covers issuing, completion is polled per slot */
+static enum disk_error_t issue_slot(struct ahci_t* ahci, uint32_t port, uint8_t slot, uint16_t flg, uint16_t prdtl) {
 	lock_acquire(&ahci->ports[port]->lock);
 
-	port_clear_errors(ahci, port);
-
-	kmemset(ahci->ports[port]->recv_fis, 0, sizeof(struct ahci_recv_fis_t));
-
-	ahci->ports[port]->com_list[slot].flg = 5;
-	ahci->ports[port]->com_list[slot].prdtl = 1;
+	ahci->ports[port]->com_list[slot].flg = flg;
+	ahci->ports[port]->com_list[slot].prdtl = prdtl;
 	ahci->ports[port]->com_list[slot].ctba0 = ahci->com_tables_p[slot];
 	ahci->ports[port]->com_list[slot].ctba_u0 = 0;
 
+	if (!hba_read(ahci, PXCI_OFF(port))) {
+		port_clear_errors(ahci, port);
 
-	while (hba_read(ahci, PXTFD_OFF(port)) & TFD_STS_CON_MASK) {
-		time_busy_wait(100);
+		kmemset(ahci->ports[port]->recv_fis, 0, sizeof(struct ahci_recv_fis_t));
+
+		while (hba_read(ahci, PXTFD_OFF(port)) & TFD_STS_CON_MASK) {
+			time_busy_wait(100);
+		}
 	}
 
 	hba_write(ahci, PXCI_OFF(port), 1u << slot);
-	
+
+	lock_release(&ahci->ports[port]->lock);
+
 	while (hba_read(ahci, PXCI_OFF(port)) & (1u << slot)) {
 		time_busy_wait(100);
 
 		if (hba_read(ahci, PXIS_OFF(port)) & IS_TFES) {
-			logging_log_error("AHCI error while reading");
-			error = DISK_ERROR;
-			lock_release(&ahci->ports[port]->lock);
-
-			lock_acquire(&ahci->lock);
-			ahci->used_com &= ~(1u << slot);
-			lock_release(&ahci->lock);
-			goto cleanup;
+			return DISK_ERROR;
 		}
 	}
 
 	if (hba_read(ahci, PXIS_OFF(port)) & IS_TFES) {
-		logging_log_error("AHCI error while reading");
-		error = DISK_ERROR;
-
-		lock_release(&ahci->ports[port]->lock);
-
-		lock_acquire(&ahci->lock);
-		ahci->used_com &= ~(1u << slot);
-		lock_release(&ahci->lock);
-		goto cleanup;
-	}
-
-	lock_release(&ahci->ports[port]->lock);
-
-	lock_acquire(&ahci->lock);
-	ahci->used_com &= ~(1u << slot);
-	lock_release(&ahci->lock);
-
-	kmemcpy(buffer, (void*)vaddr_buf, size);
-
-	error = DISK_OK;
-cleanup:
-	for (i = 0; i < size; i += PAGE_SIZE_4K) {
-		paging_unmap(vaddr_buf + i, PAGE_4K);
+		return DISK_ERROR;
 	}
 
-	mm_free_v(vaddr_buf, size);
-	mm_free_p(paddr_buf, size);
-
-	return error;
+	return DISK_OK;
 }
 
-static enum disk_error_t ahci_write_lba(void* cntx, void* buffer, uint64_t lba, uint16_t count) {
+static enum disk_error_t ahci_transfer(void* cntx, const struct disk_sg_t* sg, uint64_t nsg, uint64_t lba, uint8_t write) {
 	struct ahci_disk_t* ahci_disk = cntx;
 	struct ahci_t* ahci = ahci_disk->ahci;
 	uint32_t port = ahci_disk->port;
 	uint8_t slot;
 	enum disk_error_t error;
 
-	uint64_t vaddr_buf, i;
+	uint64_t vaddr_buf, i, off, count;
 	uint32_t paddr_buf;
+	uint64_t size;
+
+	for (i = 0, count = 0; i < nsg; i++) {
+		count += sg[i].count;
+	}
 
-	const uint64_t size = (uint64_t)count * SECTOR_SIZE;
+	size = count * SECTOR_SIZE;
 
-	if (size > PAGE_SIZE_2M * 2) {
+	if (!size || size > AHCI_MAX_TRANSFER) {
 		return DISK_ERROR;
 	}
 
 	paddr_buf = (uint32_t)mm_alloc_pmax(size, 0, ~0u);
 	if (!paddr_buf) {
-		logging_log_error("Failed to allocate memory for AHCI read buffer");
+		logging_log_error("Failed to allocate memory for AHCI transfer buffer");
 		return DISK_ERROR;
 	}
 
@@ -333,7 +278,7 @@ static enum disk_error_t ahci_write_lba(void* cntx, void* buffer, uint64_t lba,
 	if (!vaddr_buf) {
 		mm_free_p(paddr_buf, size);
 
-		logging_log_error("Failed to allocate memory for AHCI read buffer");
+		logging_log_error("Failed to allocate memory for AHCI transfer buffer");
 		return DISK_ERROR;
 	}
 
@@ -341,19 +286,20 @@ static enum disk_error_t ahci_write_lba(void* cntx, void* buffer, uint64_t lba,
 		paging_map(vaddr_buf + i, paddr_buf + i, PAGE_PRESENT | PAGE_RW | PAT_MMIO_4K, PAGE_4K);
 	}
 
-	kmemcpy((void*)vaddr_buf, buffer, size);
+	if (write) {
+		for (i = 0, off = 0; i < nsg; off += sg[i].count * SECTOR_SIZE, i++) {
+			kmemcpy((void*)(vaddr_buf + off), sg[i].buffer, sg[i].count * SECTOR_SIZE);
+		}
+	}
 
-	lock_acquire(&ahci->lock);
-	slot = find_slot(ahci, port);
-	ahci->used_com |= 1u << slot;
-	lock_release(&ahci->lock);
+	slot = claim_slot(ahci, port);
 
 	kmemset(&ahci->ports[port]->com_list[slot], 0, sizeof(struct ahci_command_header_t));
 	kmemset(ahci->com_tables_v[slot], 0, PAGE_SIZE_4K);
 
 	ahci->com_tables_v[slot]->cfis.h2d.fis_type = SATA_FIS_TYPE_H2D;
 	ahci->com_tables_v[slot]->cfis.h2d.flag = SATA_FIS_H2D_C;
-	ahci->com_tables_v[slot]->cfis.h2d.cmd = SATA_FIS_CMD_DMA_WRITE_EXT;
+	ahci->com_tables_v[slot]->cfis.h2d.cmd = write ? SATA_FIS_CMD_DMA_WRITE_EXT : SATA_FIS_CMD_DMA_READ_EXT;
 	ahci->com_tables_v[slot]->cfis.h2d.lba0 = (lba >> 0) & 0xFF;
 	ahci->com_tables_v[slot]->cfis.h2d.lba1 = (lba >> 8) & 0xFF;
 	ahci->com_tables_v[slot]->cfis.h2d.lba2 = (lba >> 16) & 0xFF;
@@ -363,64 +309,24 @@ static enum disk_error_t ahci_write_lba(void* cntx, void* buffer, uint64_t lba,
 	ahci->com_tables_v[slot]->cfis.h2d.dev = 1u << 6;
 	ahci->com_tables_v[slot]->cfis.h2d.count_lo = (count) & 0xFF;
 	ahci->com_tables_v[slot]->cfis.h2d.count_hi = (count >> 8) & 0xFF;
-	
+
 	ahci->com_tables_v[slot]->prdt[0].dba = paddr_buf;
 	ahci->com_tables_v[slot]->prdt[0].dbau = 0;
 	ahci->com_tables_v[slot]->prdt[0].dbc_i = (uint32_t)size - 1;
 
-	lock_acquire(&ahci->ports[port]->lock);
-
-	port_clear_errors(ahci, port);
-
-	kmemset(ahci->ports[port]->recv_fis, 0, sizeof(struct ahci_recv_fis_t));
-
-	ahci->ports[port]->com_list[slot].flg = 5 | SATA_FIS_CMD_W;
-	ahci->ports[port]->com_list[slot].prdtl = 1;
-	ahci->ports[port]->com_list[slot].ctba0 = ahci->com_tables_p[slot];
-	ahci->ports[port]->com_list[slot].ctba_u0 = 0;
+	error = issue_slot(ahci, port, slot, write ? 5 | SATA_FIS_CMD_W : 5, 1);
 
+	release_slot(ahci, slot);
 
-	while (hba_read(ahci, PXTFD_OFF(port)) & TFD_STS_CON_MASK) {
-		time_busy_wait(100);
+	if (error != DISK_OK) {
+		logging_log_error(write ? "AHCI error while writing" : "AHCI error while reading");
 	}
-
-	hba_write(ahci, PXCI_OFF(port), 1u << slot);
-	
-	while (hba_read(ahci, PXCI_OFF(port)) & (1u << slot)) {
-		time_busy_wait(100);
-
-		if (hba_read(ahci, PXIS_OFF(port)) & IS_TFES) {
-			logging_log_error("AHCI error while reading");
-			error = DISK_ERROR;
-			lock_release(&ahci->ports[port]->lock);
-
-			lock_acquire(&ahci->lock);
-			ahci->used_com &= ~(1u << slot);
-			lock_release(&ahci->lock);
-			goto cleanup;
+	else if (!write) {
+		for (i = 0, off = 0; i < nsg; off += sg[i].count * SECTOR_SIZE, i++) {
+			kmemcpy(sg[i].buffer, (void*)(vaddr_buf + off), sg[i].count * SECTOR_SIZE);
 		}
 	}
 
-	if (hba_read(ahci, PXIS_OFF(port)) & IS_TFES) {
-		logging_log_error("AHCI error while reading");
-		error = DISK_ERROR;
-
-		lock_release(&ahci->ports[port]->lock);
-
-		lock_acquire(&ahci->lock);
-		ahci->used_com &= ~(1u << slot);
-		lock_release(&ahci->lock);
-		goto cleanup;
-	}
-
-	lock_release(&ahci->ports[port]->lock);
-
-	lock_acquire(&ahci->lock);
-	ahci->used_com &= ~(1u << slot);
-	lock_release(&ahci->lock);
-
-	error = DISK_OK;
-cleanup:
 	for (i = 0; i < size; i += PAGE_SIZE_4K) {
 		paging_unmap(vaddr_buf + i, PAGE_4K);
 	}
@@ -431,17 +337,22 @@ cleanup:
 	return error;
 }
 
+static enum disk_error_t ahci_read_lba(void* cntx, const struct disk_sg_t* sg, uint64_t nsg, uint64_t lba) {
+	return ahci_transfer(cntx, sg, nsg, lba, 0);
+}
+
+static enum disk_error_t ahci_write_lba(void* cntx, const struct disk_sg_t* sg, uint64_t nsg, uint64_t lba) {
+	return ahci_transfer(cntx, sg, nsg, lba, 1);
+}
+
 static enum disk_error_t ahci_flush_cache(void* cntx) {
 	struct ahci_disk_t* ahci_disk = cntx;
 	struct ahci_t* ahci = ahci_disk->ahci;
 	uint32_t port = ahci_disk->port;
 	uint8_t slot;
+	enum disk_error_t error;
 
-
-	lock_acquire(&ahci->lock);
-	slot = find_slot(ahci, port);
-	ahci->used_com |= 1u << slot;
-	lock_release(&ahci->lock);
+	slot = claim_slot(ahci, port);
 
 	kmemset(&ahci->ports[port]->com_list[slot], 0, sizeof(struct ahci_command_header_t));
 	kmemset(ahci->com_tables_v[slot], 0, PAGE_SIZE_4K);
@@ -450,45 +361,15 @@ static enum disk_error_t ahci_flush_cache(void* cntx) {
 	ahci->com_tables_v[slot]->cfis.h2d.flag = SATA_FIS_H2D_C;
 	ahci->com_tables_v[slot]->cfis.h2d.cmd = SATA_FIS_CMD_FLUSH_CACHE_EXT;
 
-	lock_acquire(&ahci->ports[port]->lock);
-
-	port_clear_errors(ahci, port);
+	error = issue_slot(ahci, port, slot, 5, 0);
 
-	kmemset(ahci->ports[port]->recv_fis, 0, sizeof(struct ahci_recv_fis_t));
+	release_slot(ahci, slot);
 
-	ahci->ports[port]->com_list[slot].flg   = 5;
-	ahci->ports[port]->com_list[slot].prdtl = 0;
-	ahci->ports[port]->com_list[slot].ctba0 = ahci->com_tables_p[slot];
-	ahci->ports[port]->com_list[slot].ctba_u0 = 0;
-
-	while (hba_read(ahci, PXTFD_OFF(port)) & TFD_STS_CON_MASK) {
-		time_busy_wait(100);
+	if (error != DISK_OK) {
+		logging_log_error("AHCI flush cache error");
 	}
 
-	hba_write(ahci, PXCI_OFF(port), 1u << slot);
-
-	while (hba_read(ahci, PXCI_OFF(port)) & (1u << slot)) {
-		time_busy_wait(100);
-
-		if (hba_read(ahci, PXIS_OFF(port)) & IS_TFES) {
-			logging_log_error("AHCI flush cache error");
-			lock_release(&ahci->ports[port]->lock);
-
-			lock_acquire(&ahci->lock);
-			ahci->used_com &= ~(1u << slot);
-			lock_release(&ahci->lock);
-
-			return DISK_ERROR;
-		}
-	}
-
-	lock_release(&ahci->ports[port]->lock);
-	
-	lock_acquire(&ahci->lock);
-	ahci->used_com &= ~(1u << slot);
-	lock_release(&ahci->lock);
-	
-	return DISK_OK;
+	return error;
 }
 
 static void port_identify(struct ahci_t* ahci, uint32_t port) {
@@ -808,7 +689,8 @@ static void ahci_init(void* cntx) {
 			ahci_disk = kmalloc(sizeof(struct ahci_disk_t));
 			ahci_disk->ahci = ahci;
 			ahci_disk->port = i;
-			disk_add(ahci_disk, ahci_read_lba, ahci_write_lba, ahci_flush_cache);
+			disk_add(ahci_disk, ahci_read_lba, ahci_write_lba, ahci_flush_cache,
+					AHCI_MAX_TRANSFER / SECTOR_SIZE, ahci->num_com_slots);
 		}
 		else {
 			ahci->ports[i] = 0;
@@ -19,6 +19,7 @@
 #include <stddef.h>
 
 #include <disk/disk.h>
+#include <disk/iosched.h>
 
 #ifdef GPT
 #include <gpt/gpt.h>
@@ -26,6 +27,13 @@
 
 #include <kernel/core/lock.h>
 #include <kernel/core/alloc.h>
+#include <kernel/core/signal.h>
+#include <kernel/core/process.h>
+#include <kernel/core/proc_data.h>
+#include <kernel/core/scheduler.h>
+#include <kernel/core/time.h>
+
+#include <kernel/lib/kmemset.h>
 
 struct disk_t {
 	disk_lba_read_t read;
@@ -33,6 +41,14 @@ struct disk_t {
 	disk_flush_t flush;
 	void* cntx;
 	uint64_t id;
+	uint32_t max_sectors;
+	uint32_t queue_depth;
+	uint32_t inflight;
+	struct iosched_t sched;
+	struct disk_stats_t stats;
+	struct signal_wait_t* pending;
+	struct signal_wait_t* complete;
+	uint8_t queue_lock;
 	struct disk_t* next;
 };
 
@@ -41,6 +57,177 @@ static uint8_t disk_lock;
 static struct disk_t* disk_list;
 static uint64_t disk_id;
 
+static void complete_request(struct disk_request_t* req, enum disk_error_t status) {
+	req->status = status;
+
+	if (req->callback) {
+		req->callback(req, status, req->cntx);
+		return;
+	}
+
+	// waiter may free req as soon as done is visible
+	__atomic_store_n(&req->done, 1, __ATOMIC_RELEASE);
+}
+
+/* describe sectors [off, off + count) of req as an sg list */
+static uint64_t slice_request(const struct disk_request_t* req, uint64_t off, uint64_t count, struct disk_sg_t* sg) {
+	uint64_t i, n, take;
+
+	for (i = 0, n = 0; i < req->num_segs && count; i++) {
+		if (off >= req->segs[i].count) {
+			off -= req->segs[i].count;
+			continue;
+		}
+
+		take = req->segs[i].count - off;
+		if (take > count) {
+			take = count;
+		}
+
+		sg[n].buffer = (uint8_t*)req->segs[i].buffer + off * SECTOR_SIZE;
+		sg[n].count = take;
+
+		n++;
+		count -= take;
+		off = 0;
+	}
+
+	return n;
+}
+
+static enum disk_error_t transfer(struct disk_t* disk, enum disk_op_t op,
+		const struct disk_sg_t* sg, uint64_t nsg, uint64_t lba) {
+	if (op == DISK_OP_WRITE) {
+		return disk->write(disk->cntx, sg, nsg, lba);
+	}
+
+	return disk->read(disk->cntx, sg, nsg, lba);
+}
+
+static void account(struct disk_t* disk, struct disk_request_t* head) {
+	const uint64_t now = time_since_init_ns();
+	struct disk_request_t* i;
+
+	lock_acquire(&disk->queue_lock);
+	for (i = head; i; i = i->next) {
+		switch (i->op) {
+			case DISK_OP_READ:
+				disk->stats.reads++;
+				disk->stats.sectors_read += i->count;
+				break;
+			case DISK_OP_WRITE:
+				disk->stats.writes++;
+				disk->stats.sectors_written += i->count;
+				break;
+			case DISK_OP_FLUSH:
+				disk->stats.flushes++;
+				break;
+		}
+
+		if (i->status != DISK_OK) {
+			disk->stats.errors++;
+		}
+
+		disk->stats.wait_ns += now - i->submit_time;
+	}
+	lock_release(&disk->queue_lock);
+}
+
+static void dispatch(struct disk_t* disk, struct disk_request_t* head, uint64_t count) {
+	struct disk_sg_t sg[DISK_DISPATCH_SEGMENTS];
+	struct disk_request_t* i, * next;
+	enum disk_error_t status;
+	uint64_t nsg, off, chunk, seq;
+
+	if (head->op == DISK_OP_FLUSH) {
+		// flush is a barrier for everything dispatched before it, the scheduler holds back the rest
+		while (1) {
+			seq = signal_seq(disk->complete);
+			if (!__atomic_load_n(&disk->inflight, __ATOMIC_ACQUIRE)) {
+				break;
+			}
+			signal_wait_seq(disk->complete, seq);
+		}
+
+		status = disk->flush(disk->cntx);
+	}
+	else if (count > disk->max_sectors) {
+		// never merged, split into backend sized commands
+		status = DISK_OK;
+		for (off = 0; off < count && status == DISK_OK; off += chunk) {
+			chunk = count - off;
+			if (chunk > disk->max_sectors) {
+				chunk = disk->max_sectors;
+			}
+
+			nsg = slice_request(head, off, chunk, sg);
+			status = transfer(disk, head->op, sg, nsg, head->lba + off);
+		}
+	}
+	else {
+		for (nsg = 0, i = head; i; i = i->next) {
+			nsg += slice_request(i, 0, i->count, &sg[nsg]);
+		}
+
+		status = transfer(disk, head->op, sg, nsg, head->lba);
+	}
+
+	for (i = head; i; i = i->next) {
+		i->status = status;
+	}
+
+	account(disk, head);
+
+	for (i = head; i; i = next) {
+		next = i->next;
+		complete_request(i, status);
+	}
+}
+
+static void disk_worker(void* cntx) {
+	struct disk_t* disk = cntx;
+	struct disk_request_t* req;
+	uint64_t seq, count, merged;
+	uint8_t barrier;
+
+	while (1) {
+		seq = signal_seq(disk->pending);
+
+		lock_acquire(&disk->queue_lock);
+		req = iosched_next(&disk->sched, disk->max_sectors, &count, &merged);
+		if (!req) {
+			lock_release(&disk->queue_lock);
+			signal_wait_seq(disk->pending, seq);
+			continue;
+		}
+
+		disk->stats.queued = disk->sched.queued;
+		disk->stats.dispatched++;
+		disk->stats.merged += merged;
+
+		// a flush is not counted, it waits for the count to drain
+		barrier = req->op == DISK_OP_FLUSH;
+		if (!barrier) {
+			__atomic_add_fetch(&disk->inflight, 1, __ATOMIC_ACQ_REL);
+		}
+		lock_release(&disk->queue_lock);
+
+		dispatch(disk, req, count);
+
+		// req may already be freed by its waiter, only the flag taken before dispatch is used
+		if (barrier) {
+			lock_acquire(&disk->queue_lock);
+			iosched_complete(&disk->sched);
+			lock_release(&disk->queue_lock);
+		}
+		else {
+			__atomic_sub_fetch(&disk->inflight, 1, __ATOMIC_ACQ_REL);
+		}
+		signal_awake(disk->complete);
+		signal_awake(disk->pending);
+	}
+}
+
 void disk_init(void) {
 	lock_init(&disk_lock);
 
@@ -48,13 +235,30 @@ void disk_init(void) {
 	disk_id = DISK_ID_FIRST;
 }
 
-struct disk_t* disk_add(void* cntx, disk_lba_read_t read, disk_lba_write_t write, disk_flush_t flush) {
+struct disk_t* disk_add(void* cntx, disk_lba_read_t read, disk_lba_write_t write, disk_flush_t flush,
+		uint32_t max_sectors, uint32_t queue_depth) {
 	struct disk_t* disk = kmalloc(sizeof(struct disk_t));
+	uint32_t i;
+
+	if (!queue_depth) {
+		queue_depth = 1;
+	}
+	else if (queue_depth > DISK_MAX_DEPTH) {
+		queue_depth = DISK_MAX_DEPTH;
+	}
 
 	disk->read = read;
 	disk->write = write;
 	disk->flush = flush;
 	disk->cntx = cntx;
+	disk->max_sectors = max_sectors ? max_sectors : ~0u;
+	disk->queue_depth = queue_depth;
+	disk->inflight = 0;
+	iosched_init(&disk->sched, DISK_IOSCHED_DEADLINE);
+	kmemset(&disk->stats, 0, sizeof(struct disk_stats_t));
+	disk->pending = signal_wait_alloc();
+	disk->complete = signal_wait_alloc();
+	lock_init(&disk->queue_lock);
 
 	lock_acquire(&disk_lock);
 	disk->id = disk_id++;
@@ -62,6 +266,11 @@ struct disk_t* disk_add(void* cntx, disk_lba_read_t read, disk_lba_write_t write
 	disk_list = disk;
 	lock_release(&disk_lock);
 
+	// one worker per command the backend can have outstanding
+	for (i = 0; i < queue_depth; i++) {
+		scheduler_schedule(process_from_func(disk_worker, disk));
+	}
+
 #ifdef GPT
 	if (gpt_find_partitions(disk)) {
 		return disk;
@@ -85,18 +294,126 @@ struct disk_t* disk_get(uint64_t id) {
 	return disk;
 }
 
-enum disk_error_t disk_read(struct disk_t* disk, void* buffer, uint64_t lba, uint16_t count) {
-	return disk->read(disk->cntx, buffer, lba, count);
+struct disk_request_t* disk_request_alloc(enum disk_op_t op, uint64_t lba, disk_callback_t callback, void* cntx) {
+	struct disk_request_t* req = kmalloc(sizeof(struct disk_request_t));
+	struct pcb_t* current;
+
+	req->op = op;
+	current = proc_data_get()->current_process;
+	// writeback threads queue behind anyone waiting on the disk
+	req->prio = current && current->io_background ? DISK_PRIO_BACKGROUND : DISK_PRIO_SYNC;
+	req->status = DISK_OK;
+	req->lba = lba;
+	req->count = 0;
+	req->num_segs = 0;
+	req->callback = callback;
+	req->cntx = cntx;
+	req->disk = 0;
+	req->done = 0;
+	req->next = 0;
+
+	return req;
+}
+
+enum disk_error_t disk_request_add(struct disk_request_t* req, void* buffer, uint64_t count) {
+	if (req->op == DISK_OP_FLUSH || req->num_segs == DISK_REQUEST_SEGMENTS) {
+		return DISK_ERROR;
+	}
+
+	req->segs[req->num_segs].buffer = buffer;
+	req->segs[req->num_segs].count = count;
+	req->num_segs++;
+	req->count += count;
+
+	return DISK_OK;
+}
+
+void disk_request_free(struct disk_request_t* req) {
+	kfree(req);
+}
+
+void disk_request_set_prio(struct disk_request_t* req, enum disk_prio_t prio) {
+	req->prio = prio;
+}
+
+void disk_submit(struct disk_t* disk, struct disk_request_t* req) {
+	req->disk = disk;
+	req->done = 0;
+	req->next = 0;
+
+	if (req->op != DISK_OP_FLUSH && !req->count) {
+		complete_request(req, DISK_OK);
+		return;
+	}
+
+	lock_acquire(&disk->queue_lock);
+	iosched_add(&disk->sched, req);
+	disk->stats.submitted++;
+	disk->stats.queued = disk->sched.queued;
+	if (disk->stats.queued > disk->stats.max_queued) {
+		disk->stats.max_queued = disk->stats.queued;
+	}
+	lock_release(&disk->queue_lock);
+
+	signal_awake(disk->pending);
 }
 
-enum disk_error_t disk_write(struct disk_t* disk, void* buffer, uint64_t lba, uint16_t count) {
-	return disk->write(disk->cntx, buffer, lba, count);
+enum disk_error_t disk_request_wait(struct disk_request_t* req) {
+	struct signal_wait_t* complete = req->disk->complete;
+	uint64_t seq;
+
+	while (1) {
+		seq = signal_seq(complete);
+		if (__atomic_load_n(&req->done, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		signal_wait_seq(complete, seq);
+	}
+
+	return req->status;
+}
+
+static enum disk_error_t disk_sync(struct disk_t* disk, enum disk_op_t op, void* buffer, uint64_t lba, uint32_t count) {
+	struct disk_request_t* req = disk_request_alloc(op, lba, 0, 0);
+	enum disk_error_t status;
+
+	if (op != DISK_OP_FLUSH) {
+		disk_request_add(req, buffer, count);
+	}
+
+	disk_submit(disk, req);
+	status = disk_request_wait(req);
+	disk_request_free(req);
+
+	return status;
+}
+
+enum disk_error_t disk_read(struct disk_t* disk, void* buffer, uint64_t lba, uint32_t count) {
+	return disk_sync(disk, DISK_OP_READ, buffer, lba, count);
+}
+
+enum disk_error_t disk_write(struct disk_t* disk, void* buffer, uint64_t lba, uint32_t count) {
+	return disk_sync(disk, DISK_OP_WRITE, buffer, lba, count);
 }
 
 enum disk_error_t disk_flush(struct disk_t* disk) {
-	return disk->flush(disk->cntx);
+	return disk_sync(disk, DISK_OP_FLUSH, 0, 0, 0);
 }
 
 uint64_t disk_get_id(struct disk_t* disk) {
 	return disk->id;
 }
+
+void disk_set_iosched(struct disk_t* disk, enum disk_iosched_t type) {
+	lock_acquire(&disk->queue_lock);
+	iosched_set(&disk->sched, type);
+	lock_release(&disk->queue_lock);
+}
+
+void disk_get_stats(struct disk_t* disk, struct disk_stats_t* stats) {
+	lock_acquire(&disk->queue_lock);
+	*stats = disk->stats;
+	stats->queued = disk->sched.queued;
+	stats->inflight = __atomic_load_n(&disk->inflight, __ATOMIC_ACQUIRE);
+	lock_release(&disk->queue_lock);
+}
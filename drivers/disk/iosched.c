@@ -0,0 +1,281 @@
+/* iosched.c - disk I/O schedulers */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+
+#include <disk/disk.h>
+#include <disk/iosched.h>
+
+#include <kernel/core/time.h>
+
+/* only writes are ordered against a pending flush */
+static inline uint8_t eligible(const struct disk_request_t* req, uint64_t limit) {
+	return req->op == DISK_OP_READ || req->seq < limit;
+}
+
+static void unlink_request(struct iosched_t* sched, struct disk_request_t* req) {
+	struct disk_request_t* i, * prev;
+
+	for (prev = 0, i = sched->sorted[req->prio]; i && i != req; prev = i, i = i->next);
+	if (prev) {
+		prev->next = req->next;
+	}
+	else {
+		sched->sorted[req->prio] = req->next;
+	}
+
+	for (prev = 0, i = sched->fifo[req->prio]; i && i != req; prev = i, i = i->fifo_next);
+	if (prev) {
+		prev->fifo_next = req->fifo_next;
+	}
+	else {
+		sched->fifo[req->prio] = req->fifo_next;
+	}
+
+	if (sched->fifo_tail[req->prio] == req) {
+		sched->fifo_tail[req->prio] = prev;
+	}
+
+	req->next = 0;
+	req->fifo_next = 0;
+	sched->queued--;
+}
+
+/* c-look over one class, continue upwards from the last dispatched lba then wrap */
+static struct disk_request_t* lba_select(struct iosched_t* sched, enum disk_prio_t prio, uint64_t limit) {
+	struct disk_request_t* i, * first = 0;
+
+	for (i = sched->sorted[prio]; i; i = i->next) {
+		if (!eligible(i, limit)) {
+			continue;
+		}
+
+		if (i->lba >= sched->pos) {
+			return i;
+		}
+
+		if (!first) {
+			first = i;
+		}
+	}
+
+	return first;
+}
+
+static struct disk_request_t* noop_select(struct iosched_t* sched, uint64_t limit) {
+	struct disk_request_t* i;
+	uint64_t prio;
+
+	for (prio = 0; prio < DISK_PRIO_COUNT; prio++) {
+		for (i = sched->fifo[prio]; i; i = i->fifo_next) {
+			if (eligible(i, limit)) {
+				return i;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static struct disk_request_t* elevator_select(struct iosched_t* sched, uint64_t limit) {
+	struct disk_request_t* req;
+	uint64_t prio;
+
+	for (prio = 0; prio < DISK_PRIO_COUNT; prio++) {
+		req = lba_select(sched, (enum disk_prio_t)prio, limit);
+		if (req) {
+			return req;
+		}
+	}
+
+	return 0;
+}
+
+static struct disk_request_t* deadline_select(struct iosched_t* sched, uint64_t limit) {
+	const uint64_t now = time_since_init_ns();
+	struct disk_request_t* req;
+	uint64_t prio;
+
+	// expired requests go first so background writeback is not starved
+	for (prio = 0; prio < DISK_PRIO_COUNT; prio++) {
+		req = sched->fifo[prio];
+		if (req && eligible(req, limit) && req->deadline <= now) {
+			return req;
+		}
+	}
+
+	return elevator_select(sched, limit);
+}
+
+static const struct iosched_ops_t iosched_ops[] = {
+	[DISK_IOSCHED_NOOP] = {"noop", noop_select},
+	[DISK_IOSCHED_DEADLINE] = {"deadline", deadline_select},
+	[DISK_IOSCHED_ELEVATOR] = {"elevator", elevator_select}
+};
+
+static struct disk_request_t* find_adjacent(struct iosched_t* sched, struct disk_request_t* head,
+		struct disk_request_t* tail, uint64_t count, uint64_t nsg, uint64_t max_sectors, uint64_t limit) {
+	struct disk_request_t* i;
+	uint64_t prio;
+
+	for (prio = 0; prio < DISK_PRIO_COUNT; prio++) {
+		for (i = sched->sorted[prio]; i; i = i->next) {
+			if (!eligible(i, limit) ||
+					i->op != head->op ||
+					count + i->count > max_sectors ||
+					nsg + i->num_segs > DISK_DISPATCH_SEGMENTS) {
+				continue;
+			}
+
+			if (i->lba == tail->lba + tail->count || i->lba + i->count == head->lba) {
+				return i;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void iosched_init(struct iosched_t* sched, enum disk_iosched_t type) {
+	uint64_t prio;
+
+	for (prio = 0; prio < DISK_PRIO_COUNT; prio++) {
+		sched->fifo[prio] = 0;
+		sched->fifo_tail[prio] = 0;
+		sched->sorted[prio] = 0;
+	}
+
+	sched->barriers = 0;
+	sched->barriers_tail = 0;
+	sched->barrier_out = 0;
+	sched->seq = 0;
+	sched->pos = 0;
+	sched->queued = 0;
+
+	iosched_set(sched, type);
+}
+
+void iosched_set(struct iosched_t* sched, enum disk_iosched_t type) {
+	sched->ops = &iosched_ops[type];
+}
+
+void iosched_add(struct iosched_t* sched, struct disk_request_t* req) {
+	const uint64_t now = time_since_init_ns();
+	struct disk_request_t* i, * prev;
+
+	req->seq = sched->seq++;
+	req->submit_time = now;
+	req->deadline = now + TIME_CONV_MS_TO_NS * (uint64_t)(req->prio == DISK_PRIO_SYNC ?
+			IOSCHED_SYNC_EXPIRE_MS : IOSCHED_BACKGROUND_EXPIRE_MS);
+	req->next = 0;
+	req->fifo_next = 0;
+
+	sched->queued++;
+
+	// flushes order against everything submitted before them
+	if (req->op == DISK_OP_FLUSH) {
+		if (sched->barriers_tail) {
+			sched->barriers_tail->fifo_next = req;
+		}
+		else {
+			sched->barriers = req;
+		}
+		sched->barriers_tail = req;
+		return;
+	}
+
+	if (sched->fifo_tail[req->prio]) {
+		sched->fifo_tail[req->prio]->fifo_next = req;
+	}
+	else {
+		sched->fifo[req->prio] = req;
+	}
+	sched->fifo_tail[req->prio] = req;
+
+	for (prev = 0, i = sched->sorted[req->prio]; i && i->lba <= req->lba; prev = i, i = i->next);
+	req->next = i;
+	if (prev) {
+		prev->next = req;
+	}
+	else {
+		sched->sorted[req->prio] = req;
+	}
+}
+
+struct disk_request_t* iosched_next(struct iosched_t* sched, uint64_t max_sectors,
+		uint64_t* count, uint64_t* merged) {
+	struct disk_request_t* barrier = sched->barriers;
+	struct disk_request_t* head, * tail, * i;
+	const uint64_t limit = barrier ? barrier->seq : ~0uLL;
+	uint64_t nsg;
+
+	*count = 0;
+	*merged = 0;
+
+	if (sched->barrier_out) {
+		return 0;
+	}
+
+	head = sched->ops->select(sched, limit);
+	if (!head) {
+		if (!barrier) {
+			return 0;
+		}
+
+		sched->barriers = barrier->fifo_next;
+		if (!sched->barriers) {
+			sched->barriers_tail = 0;
+		}
+
+		barrier->fifo_next = 0;
+		sched->barrier_out = barrier;
+		sched->queued--;
+		return barrier;
+	}
+
+	unlink_request(sched, head);
+
+	tail = head;
+	*count = head->count;
+	nsg = head->num_segs;
+
+	// build one command out of everything physically adjacent
+	while ((i = find_adjacent(sched, head, tail, *count, nsg, max_sectors, limit))) {
+		unlink_request(sched, i);
+
+		if (i->lba == tail->lba + tail->count) {
+			tail->next = i;
+			tail = i;
+		}
+		else {
+			i->next = head;
+			head = i;
+		}
+
+		*count += i->count;
+		nsg += i->num_segs;
+		(*merged)++;
+	}
+
+	sched->pos = tail->lba + tail->count;
+
+	return head;
+}
+
+void iosched_complete(struct iosched_t* sched) {
+	sched->barrier_out = 0;
+}
@@ -0,0 +1,282 @@
+/* bcache.c - ext2 block cache */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+
+#include <ext2/bcache.h>
+
+#include <disk/disk.h>
+
+#include <kernel/core/alloc.h>
+#include <kernel/core/lock.h>
+#include <kernel/core/mm.h>
+#include <kernel/core/paging.h>
+
+#include <kernel/lib/hash_table.h>
+#include <kernel/lib/kmemcpy.h>
+
+#define BCACHE_BUCKETS	1024
+#define BCACHE_WRITE_LOG	64
+
+struct bcache_entry_t {
+	uint64_t block;
+	void* data;
+	struct bcache_entry_t* prev;
+	struct bcache_entry_t* next;
+};
+
+struct bcache_write_t {
+	uint64_t block;
+	uint64_t count;
+};
+
+struct ext2_bcache_t {
+	struct disk_t* disk;
+	uint64_t start_lba;
+	uint64_t block_size;
+	uint64_t max_entries;
+	uint64_t gen;
+	// ranges of the most recent writes, the one making gen n is at n % BCACHE_WRITE_LOG
+	struct bcache_write_t writes[BCACHE_WRITE_LOG];
+	struct hash_table_t* table;
+	struct bcache_entry_t* lru_head;
+	struct bcache_entry_t* lru_tail;
+	uint8_t lock;
+};
+
+struct readahead_t {
+	struct ext2_bcache_t* cache;
+	uint64_t block;
+	uint64_t count;
+	uint64_t gen;
+	uint64_t paddr;
+};
+
+static void lru_unlink(struct ext2_bcache_t* cache, struct bcache_entry_t* entry) {
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	}
+	else {
+		cache->lru_head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	}
+	else {
+		cache->lru_tail = entry->prev;
+	}
+}
+
+static void lru_push(struct ext2_bcache_t* cache, struct bcache_entry_t* entry) {
+	entry->prev = 0;
+	entry->next = cache->lru_head;
+
+	if (cache->lru_head) {
+		cache->lru_head->prev = entry;
+	}
+	else {
+		cache->lru_tail = entry;
+	}
+
+	cache->lru_head = entry;
+}
+
+/* whether block was written or invalidated after gen was sampled, lock held */
+static uint8_t written_since(const struct ext2_bcache_t* cache, uint64_t block, uint64_t gen) {
+	const struct bcache_write_t* write;
+
+	if (cache->gen - gen > BCACHE_WRITE_LOG) {
+		// the log no longer reaches back that far
+		return 1;
+	}
+
+	for (uint64_t seq = gen + 1; seq <= cache->gen; seq++) {
+		write = &cache->writes[seq % BCACHE_WRITE_LOG];
+		if (block >= write->block && block - write->block < write->count) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void log_write(struct ext2_bcache_t* cache, uint64_t block, uint64_t count) {
+	cache->gen++;
+	cache->writes[cache->gen % BCACHE_WRITE_LOG].block = block;
+	cache->writes[cache->gen % BCACHE_WRITE_LOG].count = count;
+}
+
+static void insert_locked(struct ext2_bcache_t* cache, uint64_t block, const void* buffer, uint8_t overwrite) {
+	struct bcache_entry_t* entry;
+	void* out;
+
+	if (hash_table_get(cache->table, block, &out)) {
+		entry = out;
+		if (overwrite) {
+			kmemcpy(entry->data, buffer, cache->block_size);
+		}
+
+		lru_unlink(cache, entry);
+		lru_push(cache, entry);
+		return;
+	}
+
+	if (hash_table_count(cache->table) >= cache->max_entries) {
+		// recycle the least recently used entry
+		entry = cache->lru_tail;
+		lru_unlink(cache, entry);
+		hash_table_remove(cache->table, entry->block, &out);
+	}
+	else {
+		entry = kmalloc(sizeof(struct bcache_entry_t));
+		entry->data = kmalloc(cache->block_size);
+	}
+
+	entry->block = block;
+	kmemcpy(entry->data, buffer, cache->block_size);
+
+	hash_table_insert(cache->table, block, entry);
+	lru_push(cache, entry);
+}
+
+static void readahead_done(struct disk_request_t* req, enum disk_error_t status, void* cntx) {
+	struct readahead_t* ra = cntx;
+	struct ext2_bcache_t* cache = ra->cache;
+	const uint8_t* data = (const uint8_t*)paging_ident(ra->paddr);
+
+	if (status == DISK_OK) {
+		lock_acquire(&cache->lock);
+		for (uint64_t i = 0; i < ra->count; i++) {
+			if (!written_since(cache, ra->block + i, ra->gen)) {
+				insert_locked(cache, ra->block + i, data + i * cache->block_size, 0);
+			}
+		}
+		lock_release(&cache->lock);
+	}
+
+	mm_free_p(ra->paddr, ra->count * cache->block_size);
+	kfree(ra);
+	disk_request_free(req);
+}
+
+struct ext2_bcache_t* ext2_bcache_alloc(struct disk_t* disk, uint64_t start_lba, uint64_t block_size) {
+	struct ext2_bcache_t* cache = kmalloc(sizeof(struct ext2_bcache_t));
+
+	cache->disk = disk;
+	cache->start_lba = start_lba;
+	cache->block_size = block_size;
+	cache->max_entries = EXT2_BCACHE_MAX_BYTES / block_size;
+	cache->gen = 0;
+	cache->table = hash_table_alloc(BCACHE_BUCKETS);
+	cache->lru_head = 0;
+	cache->lru_tail = 0;
+	lock_init(&cache->lock);
+
+	return cache;
+}
+
+uint8_t ext2_bcache_read(struct ext2_bcache_t* cache, uint64_t block, void* buffer) {
+	struct bcache_entry_t* entry;
+	void* out;
+
+	lock_acquire(&cache->lock);
+	if (!hash_table_get(cache->table, block, &out)) {
+		lock_release(&cache->lock);
+		return 0;
+	}
+
+	entry = out;
+	kmemcpy(buffer, entry->data, cache->block_size);
+
+	lru_unlink(cache, entry);
+	lru_push(cache, entry);
+	lock_release(&cache->lock);
+
+	return 1;
+}
+
+uint64_t ext2_bcache_gen(struct ext2_bcache_t* cache) {
+	return __atomic_load_n(&cache->gen, __ATOMIC_ACQUIRE);
+}
+
+void ext2_bcache_fill(struct ext2_bcache_t* cache, uint64_t block, const void* buffer, uint64_t gen) {
+	lock_acquire(&cache->lock);
+	if (!written_since(cache, block, gen)) {
+		insert_locked(cache, block, buffer, 0);
+	}
+	lock_release(&cache->lock);
+}
+
+void ext2_bcache_write(struct ext2_bcache_t* cache, uint64_t block, const void* buffer) {
+	lock_acquire(&cache->lock);
+	log_write(cache, block, 1);
+	insert_locked(cache, block, buffer, 1);
+	lock_release(&cache->lock);
+}
+
+void ext2_bcache_invalidate(struct ext2_bcache_t* cache, uint64_t block, uint64_t count) {
+	struct bcache_entry_t* entry;
+	void* out;
+
+	lock_acquire(&cache->lock);
+	log_write(cache, block, count);
+	for (; count; count--, block++) {
+		if (hash_table_remove(cache->table, block, &out)) {
+			entry = out;
+			lru_unlink(cache, entry);
+			kfree(entry->data);
+			kfree(entry);
+		}
+	}
+	lock_release(&cache->lock);
+}
+
+void ext2_bcache_readahead(struct ext2_bcache_t* cache, uint64_t block, uint64_t count, uint8_t sync) {
+	const uint64_t size = count * cache->block_size;
+	struct disk_request_t* req;
+	struct readahead_t* ra;
+
+	if (!count) {
+		return;
+	}
+
+	const uint64_t paddr = mm_alloc_p(size);
+	if (!paddr) {
+		return;
+	}
+
+	ra = kmalloc(sizeof(struct readahead_t));
+	ra->cache = cache;
+	ra->block = block;
+	ra->count = count;
+	ra->gen = ext2_bcache_gen(cache);
+	ra->paddr = paddr;
+
+	req = disk_request_alloc(DISK_OP_READ, cache->start_lba + block * cache->block_size / SECTOR_SIZE,
+			sync ? 0 : readahead_done, ra);
+	if (!sync) {
+		// nobody waits on it yet, demand reads go first
+		disk_request_set_prio(req, DISK_PRIO_BACKGROUND);
+	}
+	disk_request_add(req, (void*)paging_ident(paddr), size / SECTOR_SIZE);
+	disk_submit(cache->disk, req);
+
+	if (sync) {
+		readahead_done(req, disk_request_wait(req), ra);
+	}
+}
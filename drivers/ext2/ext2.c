@@ -18,23 +18,34 @@
 #include <stdint.h>
 
 #include <ext2/ext2.h>
+#include <ext2/bcache.h>
+#include <ext2/htree.h>
+#include <ext2/journal.h>
+#include <ext2/extent.h>
 
 #include <disk/disk.h>
 
 #include <kernel/core/alloc.h>
 #include <kernel/core/logging.h>
 #include <kernel/core/fs.h>
+#include <kernel/core/dcache.h>
 #include <kernel/core/lock.h>
 #include <kernel/core/panic.h>
 #include <kernel/core/process.h>
 #include <kernel/core/scheduler.h>
 #include <kernel/core/kentry.h>
+#include <kernel/core/mm.h>
+#include <kernel/core/paging.h>
+#include <kernel/core/cpu_instr.h>
+#include <kernel/core/time.h>
 
 #include <kernel/lib/kmemcmp.h>
 #include <kernel/lib/kmemcpy.h>
 #include <kernel/lib/kmemset.h>
 #include <kernel/lib/kstrlen.h>
 #include <kernel/lib/kstrcmp.h>
+#include <kernel/lib/hash_table.h>
+#include <kernel/lib/hash.h>
 
 #define SUPERBLOCK_LBA			2
 #define SUPERBLOCK_SECTORS	2
@@ -48,14 +59,82 @@
 
 #define EXT2_ROOT_INO			2
 
+#define EXT2_NAME_LEN			255
+
+#define EXT2_S_IFMT		0xF000
 #define EXT2_S_IFREG	0x8000
 #define EXT2_S_IFDIR	0x4000
 
 #define EXT2_FT_REG_FILE	1
 #define EXT2_FT_DIR				2
 
+#define EXT2_FEATURE_COMPAT_HAS_JOURNAL	0x0004
+#define EXT2_FEATURE_COMPAT_DIR_INDEX		0x0020
+
+#define EXT2_FEATURE_INCOMPAT_FILETYPE		0x0002
+#define EXT2_FEATURE_INCOMPAT_RECOVER		0x0004
+#define EXT2_FEATURE_INCOMPAT_EXTENTS		0x0040
+#define EXT2_FEATURE_INCOMPAT_64BIT			0x0080
+#define EXT2_FEATURE_INCOMPAT_FLEX_BG		0x0200
+#define EXT2_FEATURE_INCOMPAT_CSUM_SEED	0x2000
+
+// the checksum seed only matters to checksummed filesystems, which are mounted read-only
+#define EXT2_FEATURE_INCOMPAT_SUPP	(EXT2_FEATURE_INCOMPAT_FILETYPE | EXT2_FEATURE_INCOMPAT_RECOVER \
+		| EXT2_FEATURE_INCOMPAT_EXTENTS | EXT2_FEATURE_INCOMPAT_64BIT | EXT2_FEATURE_INCOMPAT_FLEX_BG \
+		| EXT2_FEATURE_INCOMPAT_CSUM_SEED)
+
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE		0x0002
+#define EXT2_FEATURE_RO_COMPAT_HUGE_FILE		0x0008
+#define EXT2_FEATURE_RO_COMPAT_DIR_NLINK		0x0020
+#define EXT2_FEATURE_RO_COMPAT_EXTRA_ISIZE	0x0040
+
+// anything else, checksums in particular, is kept consistent only by not writing
+#define EXT2_FEATURE_RO_COMPAT_SUPP	(EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | EXT2_FEATURE_RO_COMPAT_LARGE_FILE \
+		| EXT2_FEATURE_RO_COMPAT_HUGE_FILE | EXT2_FEATURE_RO_COMPAT_DIR_NLINK | EXT2_FEATURE_RO_COMPAT_EXTRA_ISIZE)
+
+#define EXT2_GOOD_OLD_INODE_SIZE	128
+#define EXT2_MIN_DESC_SIZE				32
+#define EXT2_MAX_DESC_SIZE				1024
+#define EXT4_WANT_EXTRA_ISIZE			32
+
+#define EXT2_INDEX_FL							0x00001000
+
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002
+
+#define DX_ROOT_INFO_OFF	24
+#define DX_NODE_OFF				8
+#define DX_MAX_LEVELS			2
+#define DX_BLOCK_MASK			0x00FFFFFF
+
+#define DINDEX_MIN_BLOCKS		2
+#define DINDEX_BUCKETS			64
+#define DINDEX_NAME_BUCKETS	256
+#define DINDEX_MAX_NAMES		0x10000
+
 #define MODE_DIR			0x1
 
+#define RA_MIN_BLOCKS	4
+#define RA_MAX_BYTES	0x400000
+
+#define BMAP_SLOTS	8
+
+#define ICACHE_BUCKETS			256
+#define ICACHE_MAX_UNUSED		512
+#define ICACHE_SYNC_BATCH		32
+
+#define FLUSH_INTERVAL_MS	5000
+
+#define RSV_MIN_BLOCKS	8
+#define RSV_MAX_BLOCKS	1024
+
+#define DIRECT_MIN_BLOCKS	2
+#define DIRECT_BATCH			16
+
+#define MOUNT_PREFIX			"/mnt/"
+#define MOUNT_UNLABELLED	"ext2-"
+#define MOUNT_PATH_MAX		48
+
 struct ext2_superblock_t {
 	uint32_t s_inodes_count;
 	uint32_t s_blocks_count;
@@ -102,19 +181,30 @@ struct ext2_superblock_t {
 
 	/* journaling */
 	uint8_t s_journal_uuid[16];
-	uint32_t s_hournal_inum;
+	uint32_t s_journal_inum;
 	uint32_t s_journal_dev;
 	uint32_t s_last_orphan;
 
 	/* dir. indexing */
 	uint32_t s_hash_seed[4];
 	uint8_t s_def_hash_version;
-	uint8_t resv0[3];
+	uint8_t s_jnl_backup_type;
+	uint16_t s_desc_size;
 
 	/* other */
 	uint32_t s_default_mount_options;
 	uint32_t s_first_meta_bg;
-	uint8_t resv1[760];
+	uint32_t s_mkfs_time;
+	uint32_t s_jnl_blocks[17];
+
+	/* 64bit */
+	uint32_t s_blocks_count_hi;
+	uint32_t s_r_blocks_count_hi;
+	uint32_t s_free_blocks_count_hi;
+	uint16_t s_min_extra_isize;
+	uint16_t s_want_extra_isize;
+	uint32_t s_flags;
+	uint8_t resv2[668];
 } __attribute__((packed));
 
 struct ext2_bg_desc_t {
@@ -157,26 +247,155 @@ struct ext2_ll_dir_entry_t {
 	uint8_t name[];
 } __attribute__((packed));
 
+struct ext2_dx_root_info_t {
+	uint32_t reserved_zero;
+	uint8_t hash_version;
+	uint8_t info_length;
+	uint8_t indirect_levels;
+	uint8_t unused_flags;
+} __attribute__((packed));
+
+/* the first entry of every dx block holds the count and limit in place of its hash */
+struct ext2_dx_entry_t {
+	uint32_t hash;
+	uint32_t block;
+} __attribute__((packed));
+
+struct ext2_dx_countlimit_t {
+	uint16_t limit;
+	uint16_t count;
+} __attribute__((packed));
+
 _Static_assert(sizeof(struct ext2_superblock_t) == 1024, "Bad ext2 superblock size");
 _Static_assert(sizeof(struct ext2_superblock_t) == SUPERBLOCK_SECTORS * SECTOR_SIZE, "Bad ext2 superblock size");
 _Static_assert(sizeof(struct ext2_bg_desc_t) == 32, "Bad ext2 bg descriptor size");
 _Static_assert(sizeof(struct ext2_inode_t) == 128, "Bad exte2 inode size");
 
+struct ext2_dx_frame_t {
+	uint64_t block;
+	void* buffer;
+	struct ext2_dx_entry_t* entries;
+	struct ext2_dx_entry_t* at;
+};
+
+/* one level of an extent tree walk, the root level is the inode's i_block */
+struct ext2_extent_path_t {
+	uint64_t block;
+	struct ext2_extent_header_t* header;
+	uint64_t at;
+	uint8_t dirty;
+};
+
+struct ext2_dx_map_t {
+	uint32_t hash;
+	uint16_t off;
+	uint16_t size;
+};
+
+/* in-memory name index for directories without an htree */
+struct ext2_dname_t {
+	struct ext2_dname_t* next;
+	uint64_t ino;
+	uint8_t name_len;
+	char name[];
+};
+
+struct ext2_dindex_t {
+	struct hash_table_t* names;
+	uint64_t insert_hint;
+};
+
+/* bitmaps, dirty flags and the group's descriptor counters, group lock held */
+struct ext2_group_t {
+	uint64_t* block_bitmap;
+	uint64_t* inode_bitmap;
+	uint8_t block_dirty;
+	uint8_t inode_dirty;
+	uint8_t lock;
+
+	// inode table blocks hold several inodes, their read-modify-writes go one at a time
+	uint8_t itable_lock;
+};
+
+/* shared in-core copy of an on-disk inode */
+struct ext2_incore_t {
+	uint64_t index;
+	uint64_t refs;
+	struct ext2_inode_t inode;
+	uint8_t dirty;
+	uint8_t lock;
+	struct ext2_incore_t* prev;
+	struct ext2_incore_t* next;
+
+	// held across block map changes and directory updates
+	uint8_t map_lock;
+
+	// bumped on every block map change, handles drop their cached indirect blocks
+	uint64_t bmap_gen;
+
+	// allocation goal and reservation window [rsv_start, rsv_end), rsv lock held
+	uint64_t goal;
+	uint64_t rsv_start;
+	uint64_t rsv_end;
+	uint64_t rsv_size;
+	struct ext2_incore_t* rsv_prev;
+	struct ext2_incore_t* rsv_next;
+};
+
 struct ext2_t {
 	uint64_t start_lba;
 	uint64_t end_lba;
 	struct ext2_superblock_t* superblock;
 	struct ext2_bg_desc_t* bgdt;
+	uint64_t desc_size;
+	struct ext2_group_t* groups;
+	uint64_t num_groups;
+	uint64_t bgdt_lba;
+	uint32_t bgdt_sectors;
+	uint64_t free_blocks;
+	uint64_t free_inodes;
+	uint8_t meta_dirty;
+	struct ext2_incore_t* rsv_head;
+	uint8_t rsv_lock;
 	struct disk_t* disk;
+	struct ext2_bcache_t* bcache;
+	struct ext2_journal_t* journal;
+	uint8_t read_only;
 	uint64_t block_size;
+	struct hash_table_t* icache;
+	struct ext2_incore_t* icache_head;
+	struct ext2_incore_t* icache_tail;
+	uint64_t icache_unused;
+	uint8_t icache_lock;
+	struct hash_table_t* dindex;
+	uint64_t dindex_names;
+	uint64_t dir_gen;
+	uint8_t dindex_lock;
+
+	// journal commit barrier, updates counts the ones in progress
+	uint64_t updates;
 	uint8_t lock;
 };
 
+/* recently used indirect blocks, dropped whenever the inode's block map changes */
+struct ext2_bmap_slot_t {
+	uint64_t block;
+	uint64_t used;
+	uint32_t* data;
+};
+
 struct ext2_inode_handle_t {
 	struct ext2_t* ext2;
 	uint64_t inode_index;
 	uint64_t seek;
 	uint64_t seek_block;
+	uint64_t ra_next;
+	uint64_t ra_end;
+	uint64_t ra_window;
+	uint64_t bmap_gen;
+	uint64_t bmap_tick;
+	struct ext2_bmap_slot_t bmap[BMAP_SLOTS];
+	struct ext2_incore_t* incore;
 	uint8_t ext2_mode;
 };
 
@@ -186,8 +405,20 @@ enum ext2_block_state_t {
 	BLOCK_ERROR
 };
 
+enum ext2_dx_state_t {
+	DX_OK,
+	DX_DNE,
+	DX_LINEAR,
+	DX_ERROR
+};
+
 static uint8_t label_rootfs[16] = {'r', 'o', 'o', 't', 'f', 's', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
+/* descriptors are s_desc_size apart on 64bit filesystems, only their low halves are used */
+static inline struct ext2_bg_desc_t* bg_desc(const struct ext2_t* ext2, uint64_t group) {
+	return (struct ext2_bg_desc_t*)((uint64_t)ext2->bgdt + group * ext2->desc_size);
+}
+
 static void* read_block(uint64_t block, struct ext2_t* ext2) {
 	const uint64_t block_size = ext2->block_size;
 
@@ -197,15 +428,26 @@ static void* read_block(uint64_t block, struct ext2_t* ext2) {
 
 	if (lba > ext2->end_lba) {
 		logging_log_error("Attempt to read beyond ext2 end lba (0x%llx > 0x%llx)", lba, ext2->end_lba);
+		kfree(buffer);
 		return 0;
 	}
 
-	if (disk_read(ext2->disk, buffer, lba, (uint16_t)(block_size / SECTOR_SIZE)) != DISK_OK) {
+	// sampled before either lookup, a write landing after a miss must stop the fill
+	const uint64_t gen = ext2_bcache_gen(ext2->bcache);
+
+	if (ext2_bcache_read(ext2->bcache, block, buffer)
+			|| (ext2->journal && ext2_journal_read(ext2->journal, block, buffer))) {
+		return buffer;
+	}
+
+	if (disk_read(ext2->disk, buffer, lba, (uint32_t)(block_size / SECTOR_SIZE)) != DISK_OK) {
 		logging_log_error("Failed to read");
 		kfree(buffer);
 		return 0;
 	}
 
+	ext2_bcache_fill(ext2->bcache, block, buffer, gen);
+
 	return buffer;
 }
 
@@ -222,14 +464,17 @@ static void* write_block_free(uint64_t block, struct ext2_t* ext2, void* buffer,
 		return 0;
 	}
 
-	if (disk_write(ext2->disk, buffer, lba, (uint16_t)(block_size / SECTOR_SIZE)) != DISK_OK) {
+	if (disk_write(ext2->disk, buffer, lba, (uint32_t)(block_size / SECTOR_SIZE)) != DISK_OK) {
 		logging_log_error("Failed to write");
+		ext2_bcache_invalidate(ext2->bcache, block, 1);
 		if (free) {
 			kfree(buffer);
 		}
 		return 0;
 	}
 
+	ext2_bcache_write(ext2->bcache, block, buffer);
+
 	return buffer;
 }
 
@@ -237,23 +482,47 @@ static inline void* write_block(uint64_t block, struct ext2_t* ext2, void* buffe
 	return write_block_free(block, ext2, buffer, 1);
 }
 
-static uint8_t get_inode(const struct ext2_inode_handle_t* inode_handle, struct ext2_inode_t* inode) {
-	const struct ext2_superblock_t* superblock = inode_handle->ext2->superblock;
-	const struct ext2_bg_desc_t* bgdt = inode_handle->ext2->bgdt;
+/* metadata is logged when there is a journal and reaches its home location at checkpoint */
+static void* write_meta_free(uint64_t block, struct ext2_t* ext2, void* buffer, uint8_t free) {
+	const uint64_t lba = ext2->start_lba + block * ext2->block_size / SECTOR_SIZE;
 
-	const uint64_t block_size = inode_handle->ext2->block_size;
-	const uint64_t block_group = (inode_handle->inode_index - 1) / superblock->s_inodes_per_group;
-	const uint64_t lcl_inode_idx = (inode_handle->inode_index - 1) % superblock->s_inodes_per_group;
+	if (!ext2->journal) {
+		return write_block_free(block, ext2, buffer, free);
+	}
+
+	if (lba > ext2->end_lba) {
+		logging_log_error("Attempt to write beyond ext2 end lba (0x%x > 0x%x)", lba, ext2->end_lba);
+		if (free) {
+			kfree(buffer);
+		}
+		return 0;
+	}
+
+	ext2_journal_write(ext2->journal, block, buffer);
+	ext2_bcache_write(ext2->bcache, block, buffer);
+
+	return buffer;
+}
+
+static inline void* write_meta(uint64_t block, struct ext2_t* ext2, void* buffer) {
+	return write_meta_free(block, ext2, buffer, 1);
+}
+
+static uint8_t read_inode(struct ext2_t* ext2, uint64_t inode_index, struct ext2_inode_t* inode) {
+	const struct ext2_superblock_t* superblock = ext2->superblock;
+
+	const uint64_t block_size = ext2->block_size;
+	const uint64_t block_group = (inode_index - 1) / superblock->s_inodes_per_group;
+	const uint64_t lcl_inode_idx = (inode_index - 1) % superblock->s_inodes_per_group;
 	const uint64_t lcl_inode_off = lcl_inode_idx * superblock->s_inode_size;
 	const uint64_t lcl_inode_blk = lcl_inode_off / block_size;
 	const uint64_t inode_off = lcl_inode_off % block_size;
 
-	const uint64_t inode_table_block = bgdt[block_group].bg_inode_table + lcl_inode_blk;
-	void* buffer = read_block(inode_table_block, inode_handle->ext2);
+	const uint64_t inode_table_block = bg_desc(ext2, block_group)->bg_inode_table + lcl_inode_blk;
+	void* buffer = read_block(inode_table_block, ext2);
 
 	if (!buffer) {
-		logging_log_error("Failed to read inode %lu", inode_handle->inode_index);
-		kfree(buffer);
+		logging_log_error("Failed to read inode %lu", inode_index);
 		return 1;
 	}
 
@@ -262,29 +531,35 @@ static uint8_t get_inode(const struct ext2_inode_handle_t* inode_handle, struct
 	return 0;
 }
 
-static uint8_t set_inode(const struct ext2_inode_handle_t* inode_handle, struct ext2_inode_t* inode) {
-	const struct ext2_superblock_t* superblock = inode_handle->ext2->superblock;
-	const struct ext2_bg_desc_t* bgdt = inode_handle->ext2->bgdt;
+static uint8_t write_inode(struct ext2_t* ext2, uint64_t inode_index, const struct ext2_inode_t* inode) {
+	const struct ext2_superblock_t* superblock = ext2->superblock;
 
-	const uint64_t block_size = inode_handle->ext2->block_size;
-	const uint64_t block_group = (inode_handle->inode_index - 1) / superblock->s_inodes_per_group;
-	const uint64_t lcl_inode_idx = (inode_handle->inode_index - 1) % superblock->s_inodes_per_group;
+	const uint64_t block_size = ext2->block_size;
+	const uint64_t block_group = (inode_index - 1) / superblock->s_inodes_per_group;
+	const uint64_t lcl_inode_idx = (inode_index - 1) % superblock->s_inodes_per_group;
 	const uint64_t lcl_inode_off = lcl_inode_idx * superblock->s_inode_size;
 	const uint64_t lcl_inode_blk = lcl_inode_off / block_size;
 	const uint64_t inode_off = lcl_inode_off % block_size;
 
-	const uint64_t inode_table_block = bgdt[block_group].bg_inode_table + lcl_inode_blk;
-	void* buffer = read_block(inode_table_block, inode_handle->ext2);
+	const uint64_t inode_table_block = bg_desc(ext2, block_group)->bg_inode_table + lcl_inode_blk;
+	uint8_t* itable_lock = &ext2->groups[block_group].itable_lock;
+
+	lock_acquire(itable_lock);
+	void* buffer = read_block(inode_table_block, ext2);
 
 	if (!buffer) {
-		logging_log_error("Failed to read inode %lu", inode_handle->inode_index);
+		lock_release(itable_lock);
+		logging_log_error("Failed to read inode %lu", inode_index);
 		return 1;
 	}
 
 	*(struct ext2_inode_t*)((uint64_t)buffer + inode_off) = *inode;
 
-	if (!(buffer = write_block(inode_table_block, inode_handle->ext2, buffer))) {
-		logging_log_error("Failed to write inode %lu", inode_handle->inode_index);
+	buffer = write_meta(inode_table_block, ext2, buffer);
+	lock_release(itable_lock);
+
+	if (!buffer) {
+		logging_log_error("Failed to write inode %lu", inode_index);
 		return 1;
 	}
 
@@ -292,390 +567,491 @@ static uint8_t set_inode(const struct ext2_inode_handle_t* inode_handle, struct
 	return 0;
 }
 
-static void sync_meta(const struct ext2_t* ext2) {
-	// superblock
-	disk_write(ext2->disk, ext2->superblock, ext2->start_lba + SUPERBLOCK_LBA, SUPERBLOCK_SECTORS);
+/* zero a newly allocated inode's whole slot, large inodes get the extra fields current kernels expect */
+static uint8_t clear_inode(struct ext2_t* ext2, uint64_t inode_index) {
+	const struct ext2_superblock_t* superblock = ext2->superblock;
 
-	// bgdt
-	const uint64_t bgdt_start_lba = ext2->start_lba + (1u << (1 + ext2->superblock->s_log_block_size));
-	uint64_t bgdt_size = (1 + ext2->superblock->s_blocks_count / ext2->superblock->s_blocks_per_group)
-													* sizeof(struct ext2_bg_desc_t);
-	const uint64_t adj = bgdt_size % SECTOR_SIZE;
-	if (adj) {
-		bgdt_size += SECTOR_SIZE - adj;
+	const uint64_t block_size = ext2->block_size;
+	const uint64_t block_group = (inode_index - 1) / superblock->s_inodes_per_group;
+	const uint64_t lcl_inode_off = (inode_index - 1) % superblock->s_inodes_per_group * superblock->s_inode_size;
+	const uint64_t inode_table_block = bg_desc(ext2, block_group)->bg_inode_table + lcl_inode_off / block_size;
+	uint8_t* itable_lock = &ext2->groups[block_group].itable_lock;
+	uint64_t extra = superblock->s_want_extra_isize ? superblock->s_want_extra_isize : EXT4_WANT_EXTRA_ISIZE;
+	uint8_t* buffer;
+
+	lock_acquire(itable_lock);
+	if (!(buffer = read_block(inode_table_block, ext2))) {
+		lock_release(itable_lock);
+		return 1;
+	}
+
+	kmemset(buffer + lcl_inode_off % block_size, 0, superblock->s_inode_size);
+
+	if (superblock->s_inode_size > EXT2_GOOD_OLD_INODE_SIZE) {
+		if (extra > (uint64_t)superblock->s_inode_size - EXT2_GOOD_OLD_INODE_SIZE) {
+			extra = (uint64_t)superblock->s_inode_size - EXT2_GOOD_OLD_INODE_SIZE;
+		}
+
+		// i_extra_isize follows the old inode
+		*(uint16_t*)(buffer + lcl_inode_off % block_size + EXT2_GOOD_OLD_INODE_SIZE) = (uint16_t)extra;
+	}
+
+	buffer = write_meta(inode_table_block, ext2, buffer);
+	lock_release(itable_lock);
+
+	if (!buffer) {
+		return 1;
 	}
 
-	disk_write(ext2->disk, ext2->bgdt, bgdt_start_lba, (uint16_t)(bgdt_size / SECTOR_SIZE));
+	kfree(buffer);
+	return 0;
 }
 
-static uint32_t alloc_block(struct ext2_t* ext2, uint64_t group) {
-	const uint64_t start_group = group;
-	const uint64_t num_groups = ext2->superblock->s_inodes_count / ext2->superblock->s_inodes_per_group;
-	const uint64_t bitmap_bytes = ext2->superblock->s_blocks_per_group / 8;
+static void icache_unlink(struct ext2_t* ext2, struct ext2_incore_t* incore) {
+	if (incore->prev) {
+		incore->prev->next = incore->next;
+	}
+	else {
+		ext2->icache_head = incore->next;
+	}
 
-	do {
-		if (ext2->bgdt[group].bg_free_blocks_count) {
-			void* bitmap = 0;
-			for (uint64_t off = 0; off < bitmap_bytes; off += sizeof(uint64_t)) {
-				if (off % ext2->block_size == 0) {
-					kfree(bitmap);
+	if (incore->next) {
+		incore->next->prev = incore->prev;
+	}
+	else {
+		ext2->icache_tail = incore->prev;
+	}
+}
 
-					bitmap = read_block(ext2->bgdt[group].bg_block_bitmap + (off / ext2->block_size), ext2);
+static void icache_push(struct ext2_t* ext2, struct ext2_incore_t* incore) {
+	incore->prev = 0;
+	incore->next = ext2->icache_head;
 
-					if (!bitmap) {
-						// try next block on failure
-						off += ext2->block_size - sizeof(uint64_t);
-						continue;
-					}
-				}
+	if (ext2->icache_head) {
+		ext2->icache_head->prev = incore;
+	}
+	else {
+		ext2->icache_tail = incore;
+	}
 
-				uint64_t word = ~*(uint64_t*)((uint64_t)bitmap + (off % ext2->block_size));
-				if (word) {
-					for (uint8_t bit = 0; bit < 64; bit++) {
-						if (word & (1uLL << bit)) {
-							*(uint64_t*)((uint64_t)bitmap + (off % ext2->block_size)) = ~word | (1uLL << bit);
-							ext2->bgdt[group].bg_free_blocks_count--;
-							ext2->superblock->s_free_blocks_count--;
+	ext2->icache_head = incore;
+}
 
-							bitmap = write_block(ext2->bgdt[group].bg_block_bitmap + (off / ext2->block_size), ext2, bitmap);
+/* write the in-core inode back if dirty, returns 1 on failure */
+static uint8_t sync_inode(struct ext2_t* ext2, struct ext2_incore_t* incore) {
+	struct ext2_inode_t copy;
 
-							sync_meta(ext2);
+	lock_acquire(&incore->lock);
+	if (!incore->dirty) {
+		lock_release(&incore->lock);
+		return 0;
+	}
 
-							kfree(bitmap);
-							return (uint32_t)((group * ext2->superblock->s_blocks_per_group) + off * 8 + bit);
-						}
-					}
-				}
-			}
-		}
+	copy = incore->inode;
+	incore->dirty = 0;
+	lock_release(&incore->lock);
 
-		if (++group == num_groups - 1) { // TODO: support allocating from last group
-			group = 0;
-		}
-	} while (start_group != group);
+	if (write_inode(ext2, incore->index, &copy)) {
+		lock_acquire(&incore->lock);
+		incore->dirty = 1;
+		lock_release(&incore->lock);
+		return 1;
+	}
 
-	return 0;  // out of blocks
+	return 0;
 }
 
-static uint64_t alloc_inode(struct ext2_t* ext2, uint64_t group) {
-	const uint64_t start_group = group;
-	const uint64_t num_groups = ext2->superblock->s_inodes_count / ext2->superblock->s_inodes_per_group;
-	const uint64_t bitmap_bytes = ext2->superblock->s_inodes_per_group / 8;
+/* drop a reference, icache lock held, returns 1 if it was the last one */
+static uint8_t unpin_inode(struct ext2_t* ext2, struct ext2_incore_t* incore) {
+	if (--incore->refs) {
+		return 0;
+	}
 
-	do {
-		if (ext2->bgdt[group].bg_free_inodes_count) {
-			void* bitmap = 0;
-			for (uint64_t off = 0; off < bitmap_bytes; off += sizeof(uint64_t)) {
-				if (off % ext2->block_size == 0) {
-					kfree(bitmap);
+	ext2->icache_unused++;
+	return 1;
+}
 
-					bitmap = read_block(ext2->bgdt[group].bg_inode_bitmap + (off / ext2->block_size), ext2);
+/* rsv lock held */
+static void rsv_release(struct ext2_t* ext2, struct ext2_incore_t* incore) {
+	if (incore->rsv_end == incore->rsv_start) {
+		return;
+	}
 
-					if (!bitmap) {
-						// try next block on failure
-						off += ext2->block_size - sizeof(uint64_t);
-						continue;
-					}
-				}
+	if (incore->rsv_prev) {
+		incore->rsv_prev->rsv_next = incore->rsv_next;
+	}
+	else {
+		ext2->rsv_head = incore->rsv_next;
+	}
 
-				uint64_t word = ~*(uint64_t*)((uint64_t)bitmap + (off % ext2->block_size));
-				if (word) {
-					for (uint8_t bit = 0; bit < 64; bit++) {
-						if (word & (1uLL << bit)) {
-							*(uint64_t*)((uint64_t)bitmap + (off % ext2->block_size)) = ~word | (1uLL << bit);
-							ext2->bgdt[group].bg_free_inodes_count--;
-							ext2->superblock->s_free_inodes_count--;
+	if (incore->rsv_next) {
+		incore->rsv_next->rsv_prev = incore->rsv_prev;
+	}
 
-							bitmap = write_block(ext2->bgdt[group].bg_inode_bitmap + (off / ext2->block_size), ext2, bitmap);
+	incore->rsv_start = 0;
+	incore->rsv_end = 0;
+}
 
-							sync_meta(ext2);
+static void evict_inodes(struct ext2_t* ext2) {
+	struct ext2_incore_t* i, * prev, * victim;
+	uint8_t failed;
+	void* out;
 
-							kfree(bitmap);
-							return (uint32_t)((group * ext2->superblock->s_inodes_per_group) + off * 8 + bit + 1);
-						}
-					}
+	while (1) {
+		victim = 0;
+
+		lock_acquire(&ext2->icache_lock);
+		if (ext2->icache_unused > ICACHE_MAX_UNUSED) {
+			for (i = ext2->icache_tail; i; i = prev) {
+				prev = i->prev;
+				if (!i->refs) {
+					victim = i;
+					break;
 				}
 			}
 		}
 
-		if (++group == num_groups - 1) { // TODO: support allocating from last group
-			group = 0;
+		if (!victim) {
+			lock_release(&ext2->icache_lock);
+			return;
 		}
-	} while (start_group != group);
 
-	return 0;  // out of inodes
-}
+		// stays hashed and pinned while written back, so iget never reads the stale disk copy
+		victim->refs++;
+		ext2->icache_unused--;
+		lock_release(&ext2->icache_lock);
 
-static uint32_t alloc_and_zero_block(struct ext2_t* ext2, void* zeros, uint64_t group) {
-	uint32_t block = alloc_block(ext2, group);
+		failed = sync_inode(ext2, victim);
 
-	if (block) {
-		write_block_free(block, ext2, zeros, 0);
-	}
+		lock_acquire(&ext2->icache_lock);
+		if (!unpin_inode(ext2, victim) || victim->dirty) {
+			// taken again or dirtied meanwhile, it stays cached
+			lock_release(&ext2->icache_lock);
 
-	return block;
+			if (failed) {
+				return;
+			}
+			continue;
+		}
+
+		icache_unlink(ext2, victim);
+		hash_table_remove(ext2->icache, victim->index, &out);
+		ext2->icache_unused--;
+		lock_release(&ext2->icache_lock);
+
+		lock_acquire(&ext2->rsv_lock);
+		rsv_release(ext2, victim);
+		lock_release(&ext2->rsv_lock);
+
+		kfree(victim);
+	}
 }
 
-static uint64_t assign_block(struct ext2_inode_handle_t* handle, uint64_t index, struct ext2_inode_t* inode, uint8_t lock) {
-	const uint64_t group = (handle->inode_index - 1) / handle->ext2->superblock->s_inodes_per_group;
-	const uint64_t blocks_usage = handle->ext2->block_size / 512;
+static struct ext2_incore_t* iget(struct ext2_t* ext2, uint64_t inode_index) {
+	struct ext2_incore_t* incore;
+	struct ext2_inode_t inode;
+	void* out;
 
-	void* zeros = kmalloc(handle->ext2->block_size);
-	kmemset(zeros, 0, handle->ext2->block_size);
+	lock_acquire(&ext2->icache_lock);
+	if (hash_table_get(ext2->icache, inode_index, &out)) {
+		incore = out;
+		if (!incore->refs++) {
+			ext2->icache_unused--;
+		}
 
-	if (!lock) {
-		lock_acquire(&handle->ext2->lock);
+		icache_unlink(ext2, incore);
+		icache_push(ext2, incore);
+		lock_release(&ext2->icache_lock);
+		return incore;
 	}
+	lock_release(&ext2->icache_lock);
 
-	if (get_inode(handle, inode)) {
+	if (read_inode(ext2, inode_index, &inode)) {
 		return 0;
 	}
 
-	uint32_t block = 0;
-
-	if (index < DIRECT_BLOCKS) {
-		block = inode->i_block[index];
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
-			inode->i_block[index] = block;
-
-			if (block) {
-				inode->i_blocks += blocks_usage;
-			}
+	lock_acquire(&ext2->icache_lock);
+	if (hash_table_get(ext2->icache, inode_index, &out)) {
+		// raced with another reader
+		incore = out;
+		if (!incore->refs++) {
+			ext2->icache_unused--;
 		}
-		
-		goto cleanup;
+		lock_release(&ext2->icache_lock);
+		return incore;
 	}
 
-	index -= DIRECT_BLOCKS;
+	incore = kmalloc(sizeof(struct ext2_incore_t));
+	incore->index = inode_index;
+	incore->refs = 1;
+	incore->inode = inode;
+	incore->dirty = 0;
+	lock_init(&incore->lock);
+	incore->goal = 0;
+	incore->rsv_start = 0;
+	incore->rsv_end = 0;
+	incore->rsv_size = RSV_MIN_BLOCKS;
+	lock_init(&incore->map_lock);
+	incore->bmap_gen = 0;
+
+	hash_table_insert(ext2->icache, inode_index, incore);
+	icache_push(ext2, incore);
+	lock_release(&ext2->icache_lock);
+
+	return incore;
+}
 
-	uint32_t* buffer;
-	const uint64_t block_size = handle->ext2->block_size;
-	const uint64_t indir1 = block_size / sizeof(uint32_t);
-	uint64_t old_block;
+static void iput(struct ext2_t* ext2, struct ext2_incore_t* incore) {
+	uint8_t last;
 
-	if (index < indir1) {
-		block = inode->i_block[INDIR_1];
+	lock_acquire(&ext2->icache_lock);
+	last = unpin_inode(ext2, incore);
+	lock_release(&ext2->icache_lock);
 
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
+	if (last) {
+		// unused window blocks were never claimed, so dropping it frees them
+		lock_acquire(&ext2->rsv_lock);
+		rsv_release(ext2, incore);
+		lock_release(&ext2->rsv_lock);
 
-			if (!block) {
-				goto cleanup;
-			}
+		// write back once nobody has the file open
+		sync_inode(ext2, incore);
+		evict_inodes(ext2);
+	}
+}
 
-			inode->i_blocks += blocks_usage;
+static void bmap_reset(struct ext2_inode_handle_t* handle, uint64_t gen) {
+	for (uint64_t i = 0; i < BMAP_SLOTS; i++) {
+		handle->bmap[i].block = 0;
+		handle->bmap[i].used = 0;
+	}
 
-			inode->i_block[INDIR_1] = block;
-		}
+	handle->bmap_gen = gen;
+}
 
+/* resolve the in-core inode for wherever the handle currently points */
+static struct ext2_incore_t* handle_inode(struct ext2_inode_handle_t* handle) {
+	if (handle->incore && handle->incore->index != handle->inode_index) {
+		iput(handle->ext2, handle->incore);
+		handle->incore = 0;
+	}
 
-		old_block = block;
-		buffer = read_block(block, handle->ext2);
+	if (!handle->incore) {
+		handle->incore = iget(handle->ext2, handle->inode_index);
 
-		if (!buffer) {
-			block = 0;
-			goto cleanup;
-		}
+		// generations are per inode, the cached blocks belonged to the previous one
+		bmap_reset(handle, 0);
+	}
 
-		block = buffer[index];
+	return handle->incore;
+}
 
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
-			buffer[index] = block;
-			buffer = write_block(old_block, handle->ext2, buffer);
+static uint8_t get_inode(struct ext2_inode_handle_t* inode_handle, struct ext2_inode_t* inode) {
+	struct ext2_incore_t* incore = handle_inode(inode_handle);
 
-			if (block) {
-				inode->i_blocks += blocks_usage;
-			}
-		}
+	if (!incore) {
+		return 1;
+	}
 
-		kfree(buffer);
+	lock_acquire(&incore->lock);
+	*inode = incore->inode;
+	lock_release(&incore->lock);
 
-		goto cleanup;
-	}
+	return 0;
+}
 
-	index -= indir1;
+static uint8_t set_inode(struct ext2_inode_handle_t* inode_handle, struct ext2_inode_t* inode) {
+	struct ext2_incore_t* incore = handle_inode(inode_handle);
 
-	const uint64_t indir2 = indir1 * indir1;
+	if (!incore) {
+		return 1;
+	}
 
-	if (index < indir2) {
-		block = inode->i_block[INDIR_2];
+	lock_acquire(&incore->lock);
+	incore->inode = *inode;
+	incore->dirty = 1;
+	lock_release(&incore->lock);
 
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
+	return 0;
+}
 
-			if (!block) {
-				goto cleanup;
-			}
+/* write back every dirty in-core inode */
+static void ext2_sync(struct ext2_t* ext2) {
+	struct ext2_incore_t* batch[ICACHE_SYNC_BATCH];
+	struct ext2_incore_t* i;
+	uint64_t count, j;
 
-			inode->i_blocks += blocks_usage;
+	do {
+		count = 0;
 
-			inode->i_block[INDIR_2] = block;
+		lock_acquire(&ext2->icache_lock);
+		for (i = ext2->icache_head; i && count < ICACHE_SYNC_BATCH; i = i->next) {
+			if (__atomic_load_n(&i->dirty, __ATOMIC_ACQUIRE)) {
+				if (!i->refs++) {
+					ext2->icache_unused--;
+				}
+				batch[count++] = i;
+			}
 		}
+		lock_release(&ext2->icache_lock);
 
-		old_block = block;
-		buffer = read_block(block, handle->ext2);
+		for (j = 0; j < count; j++) {
+			sync_inode(ext2, batch[j]);
+		}
 
-		if (!buffer) {
-			block = 0;
-			goto cleanup;
+		lock_acquire(&ext2->icache_lock);
+		for (j = 0; j < count; j++) {
+			unpin_inode(ext2, batch[j]);
 		}
+		lock_release(&ext2->icache_lock);
+	} while (count == ICACHE_SYNC_BATCH);
+}
 
-		block = buffer[index / indir1];
+static uint32_t* bmap_read(struct ext2_inode_handle_t* handle, uint64_t block) {
+	struct ext2_incore_t* incore = handle_inode(handle);
+	struct ext2_bmap_slot_t* victim = &handle->bmap[0];
+	uint32_t* buffer;
+	uint64_t gen;
 
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
-			buffer[index / indir1] = block;
-			buffer = write_block(old_block, handle->ext2, buffer);
+	if (!incore) {
+		return 0;
+	}
 
-			if (block) {
-				inode->i_blocks += blocks_usage;
-			}
+	gen = __atomic_load_n(&incore->bmap_gen, __ATOMIC_ACQUIRE);
+	if (handle->bmap_gen != gen) {
+		bmap_reset(handle, gen);
+	}
+
+	for (uint64_t i = 0; i < BMAP_SLOTS; i++) {
+		if (handle->bmap[i].block == block) {
+			handle->bmap[i].used = ++handle->bmap_tick;
+			return handle->bmap[i].data;
 		}
 
-		kfree(buffer);
-
-		if (!block) {
-			goto cleanup;
-		}
-
-		old_block = block;
-		buffer = read_block(block, handle->ext2);
-
-		if (!buffer) {
-			block = 0;
-			goto cleanup;
-		}
-
-		block = buffer[index % indir1];
-
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
-			buffer[index % indir1] = block;
-			buffer = write_block(old_block, handle->ext2, buffer);
-
-			if (block) {
-				inode->i_blocks += blocks_usage;
-			}
+		if (handle->bmap[i].used < victim->used) {
+			victim = &handle->bmap[i];
 		}
-
-		kfree(buffer);
-
-		goto cleanup;
 	}
 
-	index -= indir2;
-
-	const uint64_t indir3 = indir2 * indir1;
+	buffer = read_block(block, handle->ext2);
+	if (!buffer) {
+		return 0;
+	}
 
-	if (index < indir3) {
-		block = inode->i_block[INDIR_3];
+	kfree(victim->data);
+	victim->data = buffer;
+	victim->block = block;
+	victim->used = ++handle->bmap_tick;
 
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
+	return buffer;
+}
 
-			if (!block) {
-				goto cleanup;
-			}
+static void bmap_init(struct ext2_inode_handle_t* handle) {
+	handle->bmap_gen = 0;
+	handle->bmap_tick = 0;
 
-			inode->i_blocks += blocks_usage;
+	for (uint64_t i = 0; i < BMAP_SLOTS; i++) {
+		handle->bmap[i].block = 0;
+		handle->bmap[i].used = 0;
+		handle->bmap[i].data = 0;
+	}
+}
 
-			inode->i_block[INDIR_3] = block;
-		}
+static void bmap_free(struct ext2_inode_handle_t* handle) {
+	for (uint64_t i = 0; i < BMAP_SLOTS; i++) {
+		kfree(handle->bmap[i].data);
+	}
+}
 
-		old_block = block;
-		buffer = read_block(block, handle->ext2);
+static inline uint64_t extent_start(const struct ext2_extent_t* extent) {
+	return extent->ee_start_lo | (uint64_t)extent->ee_start_hi << 32;
+}
 
-		if (!buffer) {
-			block = 0;
-			goto cleanup;
-		}
+static inline uint64_t extent_len(const struct ext2_extent_t* extent) {
+	return extent->ee_len > EXT4_EXT_INIT_MAX_LEN ? extent->ee_len - EXT4_EXT_INIT_MAX_LEN : extent->ee_len;
+}
 
-		block = buffer[index / indir2];
+static inline uint64_t extent_leaf(const struct ext2_extent_idx_t* idx) {
+	return idx->ei_leaf_lo | (uint64_t)idx->ei_leaf_hi << 32;
+}
 
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
-			buffer[index / indir2] = block;
-			buffer = write_block(old_block, handle->ext2, buffer);
+/* number of entries in a node starting at or before index, index and leaf entries both lead with it */
+static uint64_t extent_search(const struct ext2_extent_header_t* header, uint64_t index) {
+	const struct ext2_extent_t* entries = (const struct ext2_extent_t*)(header + 1);
+	uint64_t lo = 0, hi = header->eh_entries, mid;
 
-			if (block) {
-				inode->i_blocks += blocks_usage;
-			}
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (entries[mid].ee_block > index) {
+			hi = mid;
 		}
-
-		kfree(buffer);
-
-		if (!block) {
-			goto cleanup;
+		else {
+			lo = mid + 1;
 		}
+	}
 
-		old_block = block;
-		buffer = read_block(block, handle->ext2);
-
-		if (!buffer) {
-			block = 0;
-			goto cleanup;
-		}
+	return lo;
+}
 
-		block = buffer[(index % indir2) / indir1];
+static inline uint8_t extent_node_ok(const struct ext2_extent_header_t* header, uint64_t depth) {
+	return header->eh_magic == EXT4_EXT_MAGIC && header->eh_entries <= header->eh_max && header->eh_depth == depth;
+}
 
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
-			buffer[(index % indir2) / indir1] = block;
-			buffer = write_block(old_block, handle->ext2, buffer);
+/* resolve index through the inode's extent tree, len is what is left of its extent, unwritten extents read as holes */
+static enum ext2_block_state_t extent_get_block(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode,
+		uint64_t index, uint64_t* block, uint64_t* len) {
+	const struct ext2_extent_header_t* header = (const struct ext2_extent_header_t*)inode->i_block;
+	const struct ext2_extent_t* extent;
+	uint64_t depth = header->eh_depth;
+	uint64_t i;
+
+	if (depth > EXT4_EXT_MAX_DEPTH || !extent_node_ok(header, depth)) {
+		logging_log_error("Bad ext4 extent tree in inode %lu", handle->inode_index);
+		return BLOCK_ERROR;
+	}
 
-			if (block) {
-				inode->i_blocks += blocks_usage;
-			}
+	while (1) {
+		if (!(i = extent_search(header, index))) {
+			return BLOCK_SPARSE;
 		}
 
-		kfree(buffer);
-
-		if (!block) {
-			goto cleanup;
+		if (!depth--) {
+			break;
 		}
 
-		old_block = block;
-		buffer = read_block(block, handle->ext2);
+		header = (const struct ext2_extent_header_t*)bmap_read(handle,
+				extent_leaf((const struct ext2_extent_idx_t*)(header + 1) + i - 1));
 
-		if (!buffer) {
-			block = 0;
-			goto cleanup;
+		if (!header) {
+			return BLOCK_ERROR;
 		}
 
-		block = buffer[index % indir1];
-
-		if (!block) {
-			block = alloc_and_zero_block(handle->ext2, zeros, group);
-			buffer[index % indir1] = block;
-			buffer = write_block(old_block, handle->ext2, buffer);
-
-			if (block) {
-				inode->i_blocks += blocks_usage;
-			}
+		if (!extent_node_ok(header, depth)) {
+			logging_log_error("Bad ext4 extent tree in inode %lu", handle->inode_index);
+			return BLOCK_ERROR;
 		}
-
-		kfree(buffer);
-
-		goto cleanup;	
 	}
 
-cleanup:
-	set_inode(handle, inode);
-
-	if (!lock) {
-		lock_release(&handle->ext2->lock);
+	extent = (const struct ext2_extent_t*)(header + 1) + i - 1;
+	if (index >= extent->ee_block + extent_len(extent) || extent->ee_len > EXT4_EXT_INIT_MAX_LEN) {
+		return BLOCK_SPARSE;
 	}
-	kfree(zeros);
 
-	return block;
+	*block = extent_start(extent) + index - extent->ee_block;
+	*len = extent_len(extent) - (index - extent->ee_block);
+	return BLOCK_OK;
 }
 
-static enum ext2_block_state_t get_block(struct ext2_t* ext2,
+static enum ext2_block_state_t get_block(struct ext2_inode_handle_t* handle,
 																	struct ext2_inode_t* inode,
 																	uint64_t index,
 																	uint64_t* block) {
+	uint64_t len;
+
+	if (inode->i_flags & EXT4_EXTENTS_FL) {
+		return extent_get_block(handle, inode, index, block, &len);
+	}
+
 	if (index < DIRECT_BLOCKS) {
 		*block = inode->i_block[index];
 		if (!*block) {
@@ -687,7 +1063,7 @@ static enum ext2_block_state_t get_block(struct ext2_t* ext2,
 	index -= DIRECT_BLOCKS;
 
 	uint32_t* buffer;
-	const uint64_t block_size = ext2->block_size;
+	const uint64_t block_size = handle->ext2->block_size;
 	const uint64_t indir1 = block_size / sizeof(uint32_t);
 
 	if (index < indir1) {
@@ -697,14 +1073,13 @@ static enum ext2_block_state_t get_block(struct ext2_t* ext2,
 			return BLOCK_SPARSE;
 		}
 
-		buffer = read_block(*block, ext2);
+		buffer = bmap_read(handle, *block);
 
 		if (!buffer) {
 			return BLOCK_ERROR;
 		}
 
 		*block = buffer[index];
-		kfree(buffer);
 
 		if (!*block) {
 			return BLOCK_SPARSE;
@@ -724,27 +1099,25 @@ static enum ext2_block_state_t get_block(struct ext2_t* ext2,
 			return BLOCK_SPARSE;
 		}
 
-		buffer = read_block(*block, ext2);
+		buffer = bmap_read(handle, *block);
 
 		if (!buffer) {
 			return BLOCK_ERROR;
 		}
 
 		*block = buffer[index / indir1];
-		kfree(buffer);
 
 		if (!*block) {
 			return BLOCK_SPARSE;
 		}
 
-		buffer = read_block(*block, ext2);
+		buffer = bmap_read(handle, *block);
 
 		if (!buffer) {
 			return BLOCK_ERROR;
 		}
 
 		*block = buffer[index % indir1];
-		kfree(buffer);
 
 		if (!*block) {
 			return BLOCK_SPARSE;
@@ -760,53 +1133,2078 @@ static enum ext2_block_state_t get_block(struct ext2_t* ext2,
 	if (index < indir3) {
 		*block = inode->i_block[INDIR_3];
 
-		if (!*block) {
-			return BLOCK_SPARSE;
+		if (!*block) {
+			return BLOCK_SPARSE;
+		}
+
+		buffer = bmap_read(handle, *block);
+
+		if (!buffer) {
+			return BLOCK_ERROR;
+		}
+
+		*block = buffer[index / indir2];
+
+		if (!*block) {
+			return BLOCK_SPARSE;
+		}
+
+		buffer = bmap_read(handle, *block);
+
+		if (!buffer) {
+			return BLOCK_ERROR;
+		}
+
+		*block = buffer[(index % indir2) / indir1];
+
+		if (!*block) {
+			return BLOCK_SPARSE;
+		}
+
+		buffer = bmap_read(handle, *block);
+
+		if (!buffer) {
+			return BLOCK_ERROR;
+		}
+
+		*block = buffer[index % indir1];
+
+		if (!*block) {
+			return BLOCK_SPARSE;
+		}
+
+		return BLOCK_OK;
+	}
+
+	return BLOCK_ERROR;
+}
+
+/* get_block, with len set to how many blocks from index are known to follow block on disk */
+static enum ext2_block_state_t map_block(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode,
+		uint64_t index, uint64_t* block, uint64_t* len) {
+	if (inode->i_flags & EXT4_EXTENTS_FL) {
+		return extent_get_block(handle, inode, index, block, len);
+	}
+
+	*len = 1;
+	return get_block(handle, inode, index, block);
+}
+
+/* length of the physically contiguous run mapped at index, at most max, 0 if index is not mapped */
+static uint64_t block_run(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode, uint64_t index, uint64_t max,
+		uint64_t* first) {
+	uint64_t block, len, run;
+
+	if (map_block(handle, inode, index, first, &run) != BLOCK_OK) {
+		return 0;
+	}
+
+	// whole extents at a time
+	while (run < max && map_block(handle, inode, index + run, &block, &len) == BLOCK_OK && block == *first + run) {
+		run += len;
+	}
+
+	return run < max ? run : max;
+}
+
+static inline uint64_t group_blocks(const struct ext2_t* ext2, uint64_t group) {
+	const uint64_t per_group = ext2->superblock->s_blocks_per_group;
+	const uint64_t rem = ext2->superblock->s_blocks_count - ext2->superblock->s_first_data_block - group * per_group;
+
+	return rem < per_group ? rem : per_group;
+}
+
+/* first clear bit in [start, end), end if none */
+static uint64_t bitmap_find_zero(const uint64_t* bitmap, uint64_t start, uint64_t end) {
+	for (uint64_t i = start / 64; i * 64 < end; i++) {
+		uint64_t word = ~bitmap[i];
+
+		if (i == start / 64) {
+			word &= ~0uLL << (start % 64);
+		}
+
+		if (word) {
+			const uint64_t bit = i * 64 + (uint64_t)__builtin_ctzll(word);
+			return bit < end ? bit : end;
+		}
+	}
+
+	return end;
+}
+
+/* first set bit in [start, end), end if none */
+static uint64_t bitmap_find_set(const uint64_t* bitmap, uint64_t start, uint64_t end) {
+	for (uint64_t i = start / 64; i * 64 < end; i++) {
+		uint64_t word = bitmap[i];
+
+		if (i == start / 64) {
+			word &= ~0uLL << (start % 64);
+		}
+
+		if (word) {
+			const uint64_t bit = i * 64 + (uint64_t)__builtin_ctzll(word);
+			return bit < end ? bit : end;
+		}
+	}
+
+	return end;
+}
+
+static void bitmap_update(uint64_t* bitmap, uint64_t start, uint64_t count, uint8_t set) {
+	uint64_t bit, n, mask;
+
+	while (count) {
+		bit = start % 64;
+		n = count < 64 - bit ? count : 64 - bit;
+		mask = (n == 64 ? ~0uLL : (1uLL << n) - 1) << bit;
+
+		if (set) {
+			bitmap[start / 64] |= mask;
+		}
+		else {
+			bitmap[start / 64] &= ~mask;
+		}
+
+		start += n;
+		count -= n;
+	}
+}
+
+/* bitmaps stay cached for the life of the mount, written back by sync_meta */
+static uint64_t* group_bitmap(struct ext2_t* ext2, uint64_t group, uint8_t inodes) {
+	struct ext2_group_t* grp = &ext2->groups[group];
+	uint64_t** bitmap = inodes ? &grp->inode_bitmap : &grp->block_bitmap;
+	uint64_t* loaded = __atomic_load_n(bitmap, __ATOMIC_ACQUIRE);
+
+	if (loaded) {
+		return loaded;
+	}
+
+	loaded = read_block(inodes ? bg_desc(ext2, group)->bg_inode_bitmap : bg_desc(ext2, group)->bg_block_bitmap, ext2);
+
+	lock_acquire(&grp->lock);
+	if (*bitmap) {
+		// raced with another loader
+		if (loaded) {
+			kfree(loaded);
+		}
+		loaded = *bitmap;
+	}
+	else {
+		__atomic_store_n(bitmap, loaded, __ATOMIC_RELEASE);
+	}
+	lock_release(&grp->lock);
+
+	return loaded;
+}
+
+/* write back dirty bitmaps and descriptors, under the commit barrier when journaling */
+static void sync_meta(struct ext2_t* ext2) {
+	struct ext2_group_t* grp;
+
+	for (uint64_t group = 0; group < ext2->num_groups; group++) {
+		grp = &ext2->groups[group];
+
+		lock_acquire(&grp->lock);
+		if (grp->block_dirty && write_meta_free(bg_desc(ext2, group)->bg_block_bitmap, ext2, grp->block_bitmap, 0)) {
+			grp->block_dirty = 0;
+		}
+
+		if (grp->inode_dirty && write_meta_free(bg_desc(ext2, group)->bg_inode_bitmap, ext2, grp->inode_bitmap, 0)) {
+			grp->inode_dirty = 0;
+		}
+		lock_release(&grp->lock);
+	}
+
+	if (!__atomic_exchange_n(&ext2->meta_dirty, 0, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+
+	ext2->superblock->s_free_blocks_count = (uint32_t)__atomic_load_n(&ext2->free_blocks, __ATOMIC_RELAXED);
+	ext2->superblock->s_free_inodes_count = (uint32_t)__atomic_load_n(&ext2->free_inodes, __ATOMIC_RELAXED);
+
+	if (ext2->journal) {
+		// the superblock shares its block with the boot sectors when blocks are larger than 1K
+		const uint64_t sb_block = SUPERBLOCK_LBA * SECTOR_SIZE / ext2->block_size;
+		const uint64_t bgdt_block = ext2->superblock->s_first_data_block + 1;
+		uint8_t* buffer = read_block(sb_block, ext2);
+
+		if (buffer) {
+			kmemcpy(buffer + SUPERBLOCK_LBA * SECTOR_SIZE % ext2->block_size, ext2->superblock, sizeof(struct ext2_superblock_t));
+			write_meta_free(sb_block, ext2, buffer, 0);
+			kfree(buffer);
+		}
+
+		for (uint64_t i = 0; i < ext2->bgdt_sectors * SECTOR_SIZE / ext2->block_size; i++) {
+			write_meta_free(bgdt_block + i, ext2, (uint8_t*)ext2->bgdt + i * ext2->block_size, 0);
+		}
+
+		return;
+	}
+
+	// superblock
+	disk_write(ext2->disk, ext2->superblock, ext2->start_lba + SUPERBLOCK_LBA, SUPERBLOCK_SECTORS);
+
+	// bgdt
+	disk_write(ext2->disk, ext2->bgdt, ext2->bgdt_lba, ext2->bgdt_sectors);
+}
+
+static uint64_t alloc_inode(struct ext2_t* ext2, uint64_t group) {
+	const uint64_t start_group = group;
+	const uint64_t per_group = ext2->superblock->s_inodes_per_group;
+	uint64_t* bitmap;
+	uint64_t bit;
+
+	do {
+		if (bg_desc(ext2, group)->bg_free_inodes_count && (bitmap = group_bitmap(ext2, group, 1))) {
+			lock_acquire(&ext2->groups[group].lock);
+			bit = bitmap_find_zero(bitmap, 0, per_group);
+
+			if (bit < per_group) {
+				bitmap_update(bitmap, bit, 1, 1);
+				ext2->groups[group].inode_dirty = 1;
+				bg_desc(ext2, group)->bg_free_inodes_count--;
+				lock_release(&ext2->groups[group].lock);
+
+				__atomic_sub_fetch(&ext2->free_inodes, 1, __ATOMIC_RELAXED);
+				__atomic_store_n(&ext2->meta_dirty, 1, __ATOMIC_RELEASE);
+
+				return group * per_group + bit + 1;
+			}
+			lock_release(&ext2->groups[group].lock);
+		}
+
+		if (++group == ext2->num_groups) {
+			group = 0;
+		}
+	} while (start_group != group);
+
+	return 0;  // out of inodes
+}
+
+/* log everything dirty as one transaction, ext2 lock held so no update is half done */
+static void journal_commit(struct ext2_t* ext2) {
+	while (__atomic_load_n(&ext2->updates, __ATOMIC_ACQUIRE)) {
+		cpu_pause();
+	}
+
+	ext2_sync(ext2);
+	sync_meta(ext2);
+	ext2_journal_commit(ext2->journal);
+}
+
+/* bracket a multi-block update so a commit never sees it half done, must not nest */
+static void update_start(struct ext2_t* ext2) {
+	if (!ext2->journal) {
+		return;
+	}
+
+	lock_acquire(&ext2->lock);
+	if (ext2_journal_full(ext2->journal)) {
+		journal_commit(ext2);
+	}
+	__atomic_add_fetch(&ext2->updates, 1, __ATOMIC_ACQUIRE);
+	lock_release(&ext2->lock);
+}
+
+static inline void update_end(struct ext2_t* ext2) {
+	if (ext2->journal) {
+		__atomic_sub_fetch(&ext2->updates, 1, __ATOMIC_RELEASE);
+	}
+}
+
+static void ext2_flusher(void* cntx) {
+	struct ext2_t* ext2 = cntx;
+
+	process_io_background(1);
+
+	while (1) {
+		time_sleep(FLUSH_INTERVAL_MS);
+
+		if (ext2->journal) {
+			lock_acquire(&ext2->lock);
+			journal_commit(ext2);
+			lock_release(&ext2->lock);
+
+			// in-place writes happen outside the lock, reads are served from the log until then
+			ext2_journal_checkpoint(ext2->journal);
+			continue;
+		}
+
+		ext2_sync(ext2);
+
+		// allocator metadata is batched here instead of written per allocation
+		sync_meta(ext2);
+	}
+}
+
+/* find a free run near goal without claiming it, honouring other inodes' windows */
+static uint64_t search_run(struct ext2_t* ext2, uint64_t goal, uint64_t count, const struct ext2_incore_t* owner,
+		uint8_t honour_rsv, uint64_t* len) {
+	const uint64_t first_data = ext2->superblock->s_first_data_block;
+	const uint64_t per_group = ext2->superblock->s_blocks_per_group;
+	const struct ext2_incore_t* rsv;
+	uint64_t* bitmap;
+	uint64_t bit, end, limit, base;
+	uint8_t blocked;
+
+	if (goal < first_data || goal >= ext2->superblock->s_blocks_count) {
+		goal = first_data;
+	}
+
+	uint64_t group = (goal - first_data) / per_group;
+
+	// one extra pass covers the start of the goal group
+	for (uint64_t n = 0; n <= ext2->num_groups; n++) {
+		if (bg_desc(ext2, group)->bg_free_blocks_count && (bitmap = group_bitmap(ext2, group, 0))) {
+			limit = group_blocks(ext2, group);
+			base = first_data + group * per_group;
+			bit = n ? 0 : (goal - first_data) % per_group;
+
+			while ((bit = bitmap_find_zero(bitmap, bit, limit)) < limit) {
+				end = bitmap_find_set(bitmap, bit, bit + count < limit ? bit + count : limit);
+				blocked = 0;
+
+				for (rsv = honour_rsv ? ext2->rsv_head : 0; rsv; rsv = rsv->rsv_next) {
+					if (rsv == owner || rsv->rsv_end <= base + bit || rsv->rsv_start >= base + end) {
+						continue;
+					}
+
+					if (rsv->rsv_start <= base + bit) {
+						bit = rsv->rsv_end - base;
+						blocked = 1;
+						break;
+					}
+
+					end = rsv->rsv_start - base;
+				}
+
+				if (!blocked) {
+					*len = end - bit;
+					return base + bit;
+				}
+			}
+		}
+
+		if (++group == ext2->num_groups) {
+			group = 0;
+		}
+	}
+
+	return 0;
+}
+
+/* claim the free prefix of a run found without the group lock, returns its length */
+static uint64_t claim_blocks(struct ext2_t* ext2, uint64_t block, uint64_t count) {
+	const uint64_t rel = block - ext2->superblock->s_first_data_block;
+	const uint64_t group = rel / ext2->superblock->s_blocks_per_group;
+	const uint64_t bit = rel % ext2->superblock->s_blocks_per_group;
+	struct ext2_group_t* grp = &ext2->groups[group];
+
+	lock_acquire(&grp->lock);
+	count = bitmap_find_set(grp->block_bitmap, bit, bit + count) - bit;
+	if (count) {
+		bitmap_update(grp->block_bitmap, bit, count, 1);
+		grp->block_dirty = 1;
+		bg_desc(ext2, group)->bg_free_blocks_count = (uint16_t)(bg_desc(ext2, group)->bg_free_blocks_count - count);
+	}
+	lock_release(&grp->lock);
+
+	if (count) {
+		__atomic_sub_fetch(&ext2->free_blocks, count, __ATOMIC_RELAXED);
+		__atomic_store_n(&ext2->meta_dirty, 1, __ATOMIC_RELEASE);
+	}
+
+	return count;
+}
+
+/* allocate up to count contiguous blocks near goal */
+static uint32_t alloc_blocks(struct ext2_t* ext2, uint64_t goal, uint64_t count, uint64_t* allocated) {
+	uint64_t block;
+
+	do {
+		lock_acquire(&ext2->rsv_lock);
+		block = search_run(ext2, goal, count, 0, 1, allocated);
+
+		if (!block) {
+			// only reserved blocks are left
+			block = search_run(ext2, goal, count, 0, 0, allocated);
+		}
+		lock_release(&ext2->rsv_lock);
+
+		// lost the run to another group user, search again
+		if (block) {
+			*allocated = claim_blocks(ext2, block, *allocated);
+		}
+	} while (block && !*allocated);
+
+	return (uint32_t)block;
+}
+
+static void free_blocks(struct ext2_t* ext2, uint64_t block, uint64_t count) {
+	const uint64_t rel = block - ext2->superblock->s_first_data_block;
+	const uint64_t group = rel / ext2->superblock->s_blocks_per_group;
+	uint64_t* bitmap = group_bitmap(ext2, group, 0);
+
+	if (!bitmap) {
+		return;
+	}
+
+	lock_acquire(&ext2->groups[group].lock);
+	bitmap_update(bitmap, rel % ext2->superblock->s_blocks_per_group, count, 0);
+	ext2->groups[group].block_dirty = 1;
+	bg_desc(ext2, group)->bg_free_blocks_count = (uint16_t)(bg_desc(ext2, group)->bg_free_blocks_count + count);
+	lock_release(&ext2->groups[group].lock);
+
+	__atomic_add_fetch(&ext2->free_blocks, count, __ATOMIC_RELAXED);
+	__atomic_store_n(&ext2->meta_dirty, 1, __ATOMIC_RELEASE);
+}
+
+/* take blocks from the window, free blocks inside it stay unclaimed on disk until used, map lock held */
+static uint32_t rsv_alloc(struct ext2_t* ext2, struct ext2_incore_t* incore, uint64_t count, uint64_t* allocated) {
+	const uint64_t first_data = ext2->superblock->s_first_data_block;
+	const uint64_t per_group = ext2->superblock->s_blocks_per_group;
+	const uint64_t from = incore->goal > incore->rsv_start ? incore->goal : incore->rsv_start;
+
+	if (from >= incore->rsv_end) {
+		return 0;
+	}
+
+	const uint64_t group = (incore->rsv_start - first_data) / per_group;
+	const uint64_t base = first_data + group * per_group;
+	const uint64_t limit = incore->rsv_end - base;
+	const uint64_t* bitmap = ext2->groups[group].block_bitmap;
+	uint64_t bit = from - base;
+
+	// allocators ignoring windows can still take blocks inside it
+	while ((bit = bitmap_find_zero(bitmap, bit, limit)) < limit) {
+		*allocated = bitmap_find_set(bitmap, bit, bit + count < limit ? bit + count : limit) - bit;
+
+		if ((*allocated = claim_blocks(ext2, base + bit, *allocated))) {
+			return (uint32_t)(base + bit);
+		}
+	}
+
+	return 0;
+}
+
+/* allocate for a file from its reservation window, opening a new one near the goal when used up, map lock held */
+static uint32_t alloc_file_blocks(struct ext2_inode_handle_t* handle, uint64_t count, uint64_t* allocated) {
+	struct ext2_t* ext2 = handle->ext2;
+	struct ext2_incore_t* incore = handle_inode(handle);
+	uint64_t goal, block, len;
+
+	if (!incore) {
+		return 0;
+	}
+
+	goal = incore->goal;
+	if (!goal) {
+		goal = ext2->superblock->s_first_data_block
+			+ (handle->inode_index - 1) / ext2->superblock->s_inodes_per_group * ext2->superblock->s_blocks_per_group;
+	}
+
+	// only the owner moves its window, so using it needs no rsv lock
+	if ((block = rsv_alloc(ext2, incore, count, allocated))) {
+		incore->goal = block + *allocated;
+		return (uint32_t)block;
+	}
+
+	lock_acquire(&ext2->rsv_lock);
+
+	if (incore->rsv_end != incore->rsv_start) {
+		// the window was used up, so the writer is streaming
+		rsv_release(ext2, incore);
+		incore->rsv_size = incore->rsv_size * 2 < RSV_MAX_BLOCKS ? incore->rsv_size * 2 : RSV_MAX_BLOCKS;
+	}
+
+	len = incore->rsv_size > count ? incore->rsv_size : count;
+	if ((block = search_run(ext2, goal, len, incore, 1, &len))) {
+		incore->rsv_start = block;
+		incore->rsv_end = block + len;
+		incore->rsv_prev = 0;
+		incore->rsv_next = ext2->rsv_head;
+		if (ext2->rsv_head) {
+			ext2->rsv_head->rsv_prev = incore;
+		}
+		ext2->rsv_head = incore;
+		incore->goal = block;
+	}
+	lock_release(&ext2->rsv_lock);
+
+	if (block) {
+		block = rsv_alloc(ext2, incore, count, allocated);
+	}
+
+	if (!block) {
+		block = alloc_blocks(ext2, goal, count, allocated);
+	}
+
+	if (block) {
+		incore->goal = block + *allocated;
+	}
+
+	return (uint32_t)block;
+}
+
+/* one block for the handle's file, zeroed unless zeros is 0, through the journal if it is an indirect block */
+static uint32_t alloc_file_block(struct ext2_inode_handle_t* handle, void* zeros, uint8_t meta) {
+	uint64_t allocated;
+	uint32_t block = alloc_file_blocks(handle, 1, &allocated);
+
+	if (block && zeros) {
+		if (meta) {
+			write_meta_free(block, handle->ext2, zeros, 0);
+		}
+		else {
+			write_block_free(block, handle->ext2, zeros, 0);
+		}
+	}
+
+	return block;
+}
+
+static inline uint64_t extent_node_max(const struct ext2_t* ext2) {
+	return (ext2->block_size - sizeof(struct ext2_extent_header_t)) / sizeof(struct ext2_extent_t);
+}
+
+/* write back and drop the tree blocks of a path, returns 1 on failure */
+static uint8_t extent_release(struct ext2_t* ext2, struct ext2_extent_path_t* path, uint64_t levels) {
+	uint8_t status = 0;
+
+	// the root goes out with the inode
+	for (uint64_t i = 1; i < levels; i++) {
+		if (path[i].dirty && !write_meta_free(path[i].block, ext2, path[i].header, 0)) {
+			status = 1;
+		}
+
+		kfree(path[i].header);
+	}
+
+	return status;
+}
+
+/* follow index down the tree on private copies of its blocks, at is the entry followed or the insert position in the leaf */
+static uint8_t extent_path(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode, uint64_t index,
+		struct ext2_extent_path_t* path, uint64_t* levels) {
+	struct ext2_extent_header_t* header = (struct ext2_extent_header_t*)inode->i_block;
+	uint64_t depth = header->eh_depth;
+	uint64_t i;
+
+	*levels = 0;
+	path[0].block = 0;
+
+	if (depth > EXT4_EXT_MAX_DEPTH) {
+		goto bad;
+	}
+
+	while (1) {
+		if (!extent_node_ok(header, depth) || (depth && !header->eh_entries)) {
+			if (*levels) {
+				kfree(header);
+			}
+			goto bad;
+		}
+
+		i = extent_search(header, index);
+		path[*levels].header = header;
+		path[*levels].dirty = 0;
+
+		if (!depth--) {
+			path[(*levels)++].at = i;
+			return 0;
+		}
+
+		// left of the whole tree still goes through the first entry
+		path[*levels].at = i ? i - 1 : 0;
+		path[*levels + 1].block = extent_leaf((struct ext2_extent_idx_t*)(header + 1) + path[*levels].at);
+		(*levels)++;
+
+		if (!(header = read_block(path[*levels].block, handle->ext2))) {
+			return 1;
+		}
+	}
+
+bad:
+	logging_log_error("Bad ext4 extent tree in inode %lu", handle->inode_index);
+	return 1;
+}
+
+/* open a gap at pos in a node with room and fill it, index and leaf entries are the same size */
+static void extent_node_insert(struct ext2_extent_header_t* header, uint64_t pos, const void* entry) {
+	struct ext2_extent_t* entries = (struct ext2_extent_t*)(header + 1);
+
+	for (uint64_t i = header->eh_entries; i > pos; i--) {
+		entries[i] = entries[i - 1];
+	}
+
+	kmemcpy(&entries[pos], entry, sizeof(struct ext2_extent_t));
+	header->eh_entries++;
+}
+
+/* the first block of a level's node moved down to key, keep the index entries above it in step */
+static void extent_fix_keys(struct ext2_extent_path_t* path, uint64_t level, uint64_t key) {
+	struct ext2_extent_idx_t* idx;
+
+	while (level--) {
+		idx = (struct ext2_extent_idx_t*)(path[level].header + 1) + path[level].at;
+		if (idx->ei_block <= key) {
+			return;
+		}
+
+		idx->ei_block = (uint32_t)key;
+		path[level].dirty = 1;
+
+		if (path[level].at) {
+			return;
+		}
+	}
+}
+
+/* move the root's entries into a new block below it, deepening the tree by one */
+static uint8_t extent_grow(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode) {
+	struct ext2_t* ext2 = handle->ext2;
+	struct ext2_extent_header_t* root = (struct ext2_extent_header_t*)inode->i_block;
+	struct ext2_extent_idx_t* idx = (struct ext2_extent_idx_t*)(root + 1);
+	struct ext2_extent_header_t* node;
+	const uint32_t block = alloc_file_block(handle, 0, 1);
+
+	if (!block) {
+		return 1;
+	}
+
+	node = kmalloc(ext2->block_size);
+	kmemset(node, 0, ext2->block_size);
+	kmemcpy(node, root, sizeof(struct ext2_extent_header_t) + root->eh_entries * sizeof(struct ext2_extent_t));
+	node->eh_max = (uint16_t)extent_node_max(ext2);
+
+	if (!(node = write_meta(block, ext2, node))) {
+		free_blocks(ext2, block, 1);
+		return 1;
+	}
+
+	kfree(node);
+
+	// the first key stays where it is
+	idx->ei_leaf_lo = block;
+	idx->ei_leaf_hi = 0;
+	idx->ei_unused = 0;
+	root->eh_entries = 1;
+	root->eh_depth++;
+	inode->i_blocks += (uint32_t)(ext2->block_size / 512);
+
+	return 0;
+}
+
+/* split a full leaf at its insert position into a new block after it, taking the new extent along,
+ * appends start an empty leaf so sequential files fill theirs completely */
+static uint8_t extent_split(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode,
+		struct ext2_extent_path_t* path, uint64_t depth, const struct ext2_extent_t* extent) {
+	struct ext2_t* ext2 = handle->ext2;
+	struct ext2_extent_path_t* leaf = &path[depth];
+	struct ext2_extent_t* entries = (struct ext2_extent_t*)(leaf->header + 1);
+	const uint64_t pos = leaf->at;
+	const uint64_t count = leaf->header->eh_entries;
+	struct ext2_extent_header_t* node;
+	struct ext2_extent_t* moved;
+	struct ext2_extent_idx_t idx;
+	const uint32_t block = alloc_file_block(handle, 0, 1);
+
+	if (!block) {
+		return 1;
+	}
+
+	node = kmalloc(ext2->block_size);
+	kmemset(node, 0, ext2->block_size);
+	*node = (struct ext2_extent_header_t){
+		.eh_magic = EXT4_EXT_MAGIC,
+		.eh_entries = 0,
+		.eh_max = (uint16_t)extent_node_max(ext2),
+		.eh_depth = 0,
+		.eh_generation = 0
+	};
+	moved = (struct ext2_extent_t*)(node + 1);
+
+	if (pos) {
+		moved[0] = *extent;
+		kmemcpy(moved + 1, entries + pos, (count - pos) * sizeof(struct ext2_extent_t));
+		node->eh_entries = (uint16_t)(count - pos + 1);
+	}
+	else {
+		// only left of the whole tree, the new extent stays behind alone
+		kmemcpy(moved, entries, count * sizeof(struct ext2_extent_t));
+		node->eh_entries = (uint16_t)count;
+	}
+
+	idx = (struct ext2_extent_idx_t){
+		.ei_block = moved[0].ee_block,
+		.ei_leaf_lo = block,
+		.ei_leaf_hi = 0,
+		.ei_unused = 0
+	};
+
+	if (!(node = write_meta(block, ext2, node))) {
+		free_blocks(ext2, block, 1);
+		return 1;
+	}
+
+	kfree(node);
+
+	if (pos) {
+		leaf->header->eh_entries = (uint16_t)pos;
+	}
+	else {
+		entries[0] = *extent;
+		leaf->header->eh_entries = 1;
+		extent_fix_keys(path, depth, extent->ee_block);
+	}
+
+	extent_node_insert(path[depth - 1].header, path[depth - 1].at + 1, &idx);
+	path[depth - 1].dirty = 1;
+	leaf->dirty = 1;
+	inode->i_blocks += (uint32_t)(ext2->block_size / 512);
+
+	return 0;
+}
+
+/* map count blocks from first at index in the inode's extent tree, returns 1 on failure, map lock held */
+static uint8_t extent_insert(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode, uint64_t index,
+		uint64_t first, uint64_t count) {
+	struct ext2_extent_path_t path[EXT4_EXT_MAX_DEPTH + 1];
+	struct ext2_extent_header_t* header;
+	struct ext2_extent_t* entries, * prev;
+	const struct ext2_extent_t extent = {
+		.ee_block = (uint32_t)index,
+		.ee_len = (uint16_t)count,
+		.ee_start_hi = (uint16_t)(first >> 32),
+		.ee_start_lo = (uint32_t)first
+	};
+	uint64_t levels, depth, pos;
+	uint8_t status = 0;
+
+again:
+	if (extent_path(handle, inode, index, path, &levels)) {
+		extent_release(handle->ext2, path, levels);
+		return 1;
+	}
+
+	depth = levels - 1;
+	header = path[depth].header;
+	entries = (struct ext2_extent_t*)(header + 1);
+	pos = path[depth].at;
+	prev = pos ? &entries[pos - 1] : 0;
+
+	if ((prev && prev->ee_block + extent_len(prev) > index) || (pos < header->eh_entries && entries[pos].ee_block < index + count)) {
+		// holes are the only thing mapped here, so this is an unwritten extent
+		logging_log_error("Writing to unwritten ext4 extents is not supported (inode %lu)", handle->inode_index);
+		status = 1;
+	}
+	else if (prev && prev->ee_len + count <= EXT4_EXT_INIT_MAX_LEN && prev->ee_block + prev->ee_len == index
+			&& extent_start(prev) + prev->ee_len == first) {
+		// a file growing in place only lengthens its last extent
+		prev->ee_len = (uint16_t)(prev->ee_len + count);
+		path[depth].dirty = 1;
+	}
+	else if (header->eh_entries < header->eh_max) {
+		extent_node_insert(header, pos, &extent);
+		path[depth].dirty = 1;
+
+		if (!pos) {
+			extent_fix_keys(path, depth, index);
+		}
+	}
+	else if (depth && path[depth - 1].header->eh_entries < path[depth - 1].header->eh_max) {
+		status = extent_split(handle, inode, path, depth, &extent);
+	}
+	else if (depth <= 1) {
+		// room is made at the root, where it is needed first
+		if (extent_release(handle->ext2, path, levels) || extent_grow(handle, inode)) {
+			return 1;
+		}
+		goto again;
+	}
+	else {
+		logging_log_error("ext4 extent tree of inode %lu is full", handle->inode_index);
+		status = 1;
+	}
+
+	if (extent_release(handle->ext2, path, levels)) {
+		status = 1;
+	}
+
+	return status;
+}
+
+/* map one block of an extent mapped file, data or a fresh block as for assign_block_to */
+static uint32_t extent_assign(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode, uint64_t index,
+		uint32_t data, void* zeros) {
+	uint64_t block, len;
+
+	switch (extent_get_block(handle, inode, index, &block, &len)) {
+		case BLOCK_OK:
+			return (uint32_t)block;
+		case BLOCK_SPARSE:
+			break;
+		case BLOCK_ERROR:
+			return 0;
+	}
+
+	if (!(block = data ? data : alloc_file_block(handle, zeros, 0))) {
+		return 0;
+	}
+
+	if (extent_insert(handle, inode, index, block, 1)) {
+		if (!data) {
+			free_blocks(handle->ext2, block, 1);
+		}
+		return 0;
+	}
+
+	inode->i_blocks += (uint32_t)(handle->ext2->block_size / 512);
+	return (uint32_t)block;
+}
+
+/* map index to data, or to a fresh block (zeroed if zero is set) if data is 0,
+ * lock set if the caller holds the map lock inside an update */
+static uint64_t assign_block_to(struct ext2_inode_handle_t* handle, uint64_t index, struct ext2_inode_t* inode, uint8_t lock,
+		uint32_t data, uint8_t zero) {
+	const uint64_t blocks_usage = handle->ext2->block_size / 512;
+	struct ext2_incore_t* incore = handle_inode(handle);
+
+	if (!incore) {
+		return 0;
+	}
+
+	void* zeros = kmalloc(handle->ext2->block_size);
+	kmemset(zeros, 0, handle->ext2->block_size);
+
+	if (!lock) {
+		update_start(handle->ext2);
+		lock_acquire(&incore->map_lock);
+	}
+
+	if (get_inode(handle, inode)) {
+		if (!lock) {
+			lock_release(&incore->map_lock);
+			update_end(handle->ext2);
+		}
+		kfree(zeros);
+		return 0;
+	}
+
+	uint32_t block = 0;
+	uint64_t prev;
+
+	if (!handle->incore->goal && index && get_block(handle, inode, index - 1, &prev) == BLOCK_OK) {
+		// reopened file, continue after its last block
+		handle->incore->goal = prev + 1;
+	}
+
+	if (inode->i_flags & EXT4_EXTENTS_FL) {
+		block = extent_assign(handle, inode, index, data, zero ? zeros : 0);
+		goto cleanup;
+	}
+
+	if (index < DIRECT_BLOCKS) {
+		block = inode->i_block[index];
+		if (!block) {
+			block = data ? data : alloc_file_block(handle, zero ? zeros : 0, 0);
+			inode->i_block[index] = block;
+
+			if (block) {
+				inode->i_blocks += blocks_usage;
+			}
+		}
+		
+		goto cleanup;
+	}
+
+	index -= DIRECT_BLOCKS;
+
+	uint32_t* buffer;
+	const uint64_t block_size = handle->ext2->block_size;
+	const uint64_t indir1 = block_size / sizeof(uint32_t);
+	uint64_t old_block;
+
+	if (index < indir1) {
+		block = inode->i_block[INDIR_1];
+
+		if (!block) {
+			block = alloc_file_block(handle, zeros, 1);
+
+			if (!block) {
+				goto cleanup;
+			}
+
+			inode->i_blocks += blocks_usage;
+
+			inode->i_block[INDIR_1] = block;
+		}
+
+
+		old_block = block;
+		buffer = read_block(block, handle->ext2);
+
+		if (!buffer) {
+			block = 0;
+			goto cleanup;
+		}
+
+		block = buffer[index];
+
+		if (!block) {
+			block = data ? data : alloc_file_block(handle, zero ? zeros : 0, 0);
+			buffer[index] = block;
+			buffer = write_meta(old_block, handle->ext2, buffer);
+
+			if (block) {
+				inode->i_blocks += blocks_usage;
+			}
+		}
+
+		kfree(buffer);
+
+		goto cleanup;
+	}
+
+	index -= indir1;
+
+	const uint64_t indir2 = indir1 * indir1;
+
+	if (index < indir2) {
+		block = inode->i_block[INDIR_2];
+
+		if (!block) {
+			block = alloc_file_block(handle, zeros, 1);
+
+			if (!block) {
+				goto cleanup;
+			}
+
+			inode->i_blocks += blocks_usage;
+
+			inode->i_block[INDIR_2] = block;
+		}
+
+		old_block = block;
+		buffer = read_block(block, handle->ext2);
+
+		if (!buffer) {
+			block = 0;
+			goto cleanup;
+		}
+
+		block = buffer[index / indir1];
+
+		if (!block) {
+			block = alloc_file_block(handle, zeros, 1);
+			buffer[index / indir1] = block;
+			buffer = write_meta(old_block, handle->ext2, buffer);
+
+			if (block) {
+				inode->i_blocks += blocks_usage;
+			}
+		}
+
+		kfree(buffer);
+
+		if (!block) {
+			goto cleanup;
+		}
+
+		old_block = block;
+		buffer = read_block(block, handle->ext2);
+
+		if (!buffer) {
+			block = 0;
+			goto cleanup;
+		}
+
+		block = buffer[index % indir1];
+
+		if (!block) {
+			block = data ? data : alloc_file_block(handle, zero ? zeros : 0, 0);
+			buffer[index % indir1] = block;
+			buffer = write_meta(old_block, handle->ext2, buffer);
+
+			if (block) {
+				inode->i_blocks += blocks_usage;
+			}
+		}
+
+		kfree(buffer);
+
+		goto cleanup;
+	}
+
+	index -= indir2;
+
+	const uint64_t indir3 = indir2 * indir1;
+
+	if (index < indir3) {
+		block = inode->i_block[INDIR_3];
+
+		if (!block) {
+			block = alloc_file_block(handle, zeros, 1);
+
+			if (!block) {
+				goto cleanup;
+			}
+
+			inode->i_blocks += blocks_usage;
+
+			inode->i_block[INDIR_3] = block;
+		}
+
+		old_block = block;
+		buffer = read_block(block, handle->ext2);
+
+		if (!buffer) {
+			block = 0;
+			goto cleanup;
+		}
+
+		block = buffer[index / indir2];
+
+		if (!block) {
+			block = alloc_file_block(handle, zeros, 1);
+			buffer[index / indir2] = block;
+			buffer = write_meta(old_block, handle->ext2, buffer);
+
+			if (block) {
+				inode->i_blocks += blocks_usage;
+			}
+		}
+
+		kfree(buffer);
+
+		if (!block) {
+			goto cleanup;
+		}
+
+		old_block = block;
+		buffer = read_block(block, handle->ext2);
+
+		if (!buffer) {
+			block = 0;
+			goto cleanup;
+		}
+
+		block = buffer[(index % indir2) / indir1];
+
+		if (!block) {
+			block = alloc_file_block(handle, zeros, 1);
+			buffer[(index % indir2) / indir1] = block;
+			buffer = write_meta(old_block, handle->ext2, buffer);
+
+			if (block) {
+				inode->i_blocks += blocks_usage;
+			}
+		}
+
+		kfree(buffer);
+
+		if (!block) {
+			goto cleanup;
+		}
+
+		old_block = block;
+		buffer = read_block(block, handle->ext2);
+
+		if (!buffer) {
+			block = 0;
+			goto cleanup;
+		}
+
+		block = buffer[index % indir1];
+
+		if (!block) {
+			block = data ? data : alloc_file_block(handle, zero ? zeros : 0, 0);
+			buffer[index % indir1] = block;
+			buffer = write_meta(old_block, handle->ext2, buffer);
+
+			if (block) {
+				inode->i_blocks += blocks_usage;
+			}
+		}
+
+		kfree(buffer);
+
+		goto cleanup;	
+	}
+
+cleanup:
+	set_inode(handle, inode);
+	__atomic_add_fetch(&incore->bmap_gen, 1, __ATOMIC_RELEASE);
+
+	if (!lock) {
+		lock_release(&incore->map_lock);
+		update_end(handle->ext2);
+	}
+	kfree(zeros);
+
+	return block;
+}
+
+static inline uint64_t assign_block(struct ext2_inode_handle_t* handle, uint64_t index, struct ext2_inode_t* inode, uint8_t lock) {
+	return assign_block_to(handle, index, inode, lock, 0, 1);
+}
+
+/* map count blocks from first at index, returns how many were mapped, map lock held inside an update */
+static uint64_t assign_run(struct ext2_inode_handle_t* handle, uint64_t index, struct ext2_inode_t* inode,
+		uint64_t first, uint64_t count) {
+	uint64_t done, len;
+
+	if (get_inode(handle, inode)) {
+		return 0;
+	}
+
+	if (!(inode->i_flags & EXT4_EXTENTS_FL)) {
+		for (done = 0; done < count; done++) {
+			if (!assign_block_to(handle, index + done, inode, 1, (uint32_t)(first + done), 0)) {
+				break;
+			}
+		}
+
+		return done;
+	}
+
+	// one extent per run instead of one update per block
+	for (done = 0; done < count; done += len) {
+		len = count - done < EXT4_EXT_INIT_MAX_LEN ? count - done : EXT4_EXT_INIT_MAX_LEN;
+
+		if (extent_insert(handle, inode, index + done, first + done, len)) {
+			break;
+		}
+
+		inode->i_blocks += (uint32_t)(len * handle->ext2->block_size / 512);
+	}
+
+	set_inode(handle, inode);
+	__atomic_add_fetch(&handle->incore->bmap_gen, 1, __ATOMIC_RELEASE);
+
+	return done;
+}
+
+/* prefetch the next window from start on, waiting for it only when sync */
+static void readahead_window(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode, uint64_t size,
+		uint64_t start, uint8_t sync) {
+	struct ext2_t* ext2 = handle->ext2;
+	const uint64_t num_blocks = (size + ext2->block_size - 1) / ext2->block_size;
+	const uint64_t max_window = RA_MAX_BYTES / ext2->block_size;
+	uint64_t count, first, run;
+
+	if (start >= num_blocks) {
+		return;
+	}
+
+	count = num_blocks - start;
+	if (count > handle->ra_window) {
+		count = handle->ra_window;
+	}
+
+	if (!(run = block_run(handle, inode, start, count, &first))) {
+		handle->ra_end = start + 1;
+		return;
+	}
+
+	ext2_bcache_readahead(ext2->bcache, first, run, sync);
+
+	handle->ra_end = start + run;
+	handle->ra_window *= 2;
+	if (handle->ra_window > max_window) {
+		handle->ra_window = max_window;
+	}
+}
+
+/* prefetch the physically contiguous run following a sequential reader */
+static void readahead(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode, uint64_t size) {
+	const uint64_t index = handle->seek_block;
+	const uint64_t start = index > handle->ra_end ? index : handle->ra_end;
+
+	if (index != handle->ra_next) {
+		// random access, start over with a small window
+		handle->ra_next = index + 1;
+		handle->ra_end = index;
+		handle->ra_window = RA_MIN_BLOCKS;
+		return;
+	}
+
+	handle->ra_next = index + 1;
+
+	// keep half a window in flight ahead of the reader
+	if (index + handle->ra_window / 2 < handle->ra_end) {
+		return;
+	}
+
+	// the reader waits on the window only if it has caught up with it
+	readahead_window(handle, inode, size, start, start == index);
+}
+
+static enum disk_error_t direct_wait(struct disk_request_t** reqs, uint64_t num_reqs) {
+	enum disk_error_t status = DISK_OK;
+
+	for (uint64_t i = 0; i < num_reqs; i++) {
+		if (disk_request_wait(reqs[i]) != DISK_OK) {
+			status = DISK_ERROR;
+		}
+
+		disk_request_free(reqs[i]);
+	}
+
+	return status;
+}
+
+/* append one physical run to the current request, submitting it once full */
+static enum disk_error_t direct_segment(struct ext2_t* ext2, enum disk_op_t op, struct disk_request_t** req,
+		struct disk_request_t** reqs, uint64_t* num_reqs, uint64_t* lba, uint64_t paddr, uint64_t len) {
+	enum disk_error_t status = DISK_OK;
+
+	if (!*req || disk_request_add(*req, (void*)paging_ident(paddr), len / SECTOR_SIZE) != DISK_OK) {
+		if (*req) {
+			disk_submit(ext2->disk, *req);
+			reqs[(*num_reqs)++] = *req;
+
+			if (*num_reqs == DIRECT_BATCH) {
+				status = direct_wait(reqs, *num_reqs);
+				*num_reqs = 0;
+			}
+		}
+
+		*req = disk_request_alloc(op, *lba, 0, 0);
+		disk_request_add(*req, (void*)paging_ident(paddr), len / SECTOR_SIZE);
+	}
+
+	*lba += len / SECTOR_SIZE;
+	return status;
+}
+
+/* transfer whole blocks straight between disk and a buffer of the current address space */
+static enum disk_error_t direct_io(struct ext2_t* ext2, enum disk_op_t op, void* buffer, uint64_t block, uint64_t count) {
+	uint64_t* pml4 = (uint64_t*)(cpu_get_cr3() & PAGE_BASE_MASK);
+	const uint64_t size = count * ext2->block_size;
+	const uint64_t vaddr = (uint64_t)buffer;
+	struct disk_request_t* reqs[DIRECT_BATCH];
+	struct disk_request_t* req = 0;
+	enum disk_error_t status = DISK_OK;
+	uint64_t lba = ext2->start_lba + block * ext2->block_size / SECTOR_SIZE;
+	uint64_t off, len, paddr, seg_paddr = 0, seg_len = 0, num_reqs = 0;
+
+	if (lba + size / SECTOR_SIZE - 1 > ext2->end_lba) {
+		logging_log_error("Attempt to access beyond ext2 end lba (0x%lx > 0x%lx)", lba, ext2->end_lba);
+		return DISK_ERROR;
+	}
+
+	if (vaddr % SECTOR_SIZE) {
+		// runs would not split on sector boundaries, stage through one physical run
+		paddr = mm_alloc_p(size);
+		if (!paddr) {
+			return DISK_ERROR;
+		}
+
+		if (op == DISK_OP_WRITE) {
+			kmemcpy((void*)paging_ident(paddr), buffer, size);
+			status = disk_write(ext2->disk, (void*)paging_ident(paddr), lba, (uint32_t)(size / SECTOR_SIZE));
+		}
+		else if ((status = disk_read(ext2->disk, (void*)paging_ident(paddr), lba, (uint32_t)(size / SECTOR_SIZE))) == DISK_OK) {
+			kmemcpy(buffer, (void*)paging_ident(paddr), size);
+		}
+
+		mm_free_p(paddr, size);
+		return status;
+	}
+
+	// disk workers run in other address spaces, so address the buffer through the identity map
+	for (off = 0; off < size; off += len) {
+		len = PAGE_SIZE_4K - ((vaddr + off) % PAGE_SIZE_4K);
+		if (len > size - off) {
+			len = size - off;
+		}
+
+		paddr = paging_translate(vaddr + off, pml4);
+		if (!paddr) {
+			status = DISK_ERROR;
+			break;
+		}
+
+		if (seg_len && paddr == seg_paddr + seg_len) {
+			seg_len += len;
+			continue;
+		}
+
+		if (seg_len && direct_segment(ext2, op, &req, reqs, &num_reqs, &lba, seg_paddr, seg_len) != DISK_OK) {
+			status = DISK_ERROR;
+		}
+
+		seg_paddr = paddr;
+		seg_len = len;
+	}
+
+	if (status == DISK_OK && direct_segment(ext2, op, &req, reqs, &num_reqs, &lba, seg_paddr, seg_len) != DISK_OK) {
+		status = DISK_ERROR;
+	}
+
+	if (req) {
+		if (status == DISK_OK) {
+			disk_submit(ext2->disk, req);
+			reqs[num_reqs++] = req;
+		}
+		else {
+			disk_request_free(req);
+		}
+	}
+
+	if (direct_wait(reqs, num_reqs) != DISK_OK) {
+		status = DISK_ERROR;
+	}
+
+	return status;
+}
+
+/* read the run of whole, physically contiguous blocks at the seek position, 0 if not worth it */
+static uint64_t read_run(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode, void* buffer,
+		uint64_t count, uint64_t size) {
+	struct ext2_t* ext2 = handle->ext2;
+	const uint64_t remaining = size - handle->seek_block * ext2->block_size;
+	uint64_t max = (count < remaining ? count : remaining) / ext2->block_size;
+	uint64_t first, run;
+
+	if (handle->seek_block == handle->ra_next && handle->seek_block < handle->ra_end) {
+		// already prefetched, the block cache serves it
+		return 0;
+	}
+
+	if (max < DIRECT_MIN_BLOCKS || !(run = block_run(handle, inode, handle->seek_block, max, &first))) {
+		return 0;
+	}
+
+	if (run < DIRECT_MIN_BLOCKS || direct_io(ext2, DISK_OP_READ, buffer, first, run) != DISK_OK) {
+		return 0;
+	}
+
+	// keep readahead in step with the reader, with the next window in flight for its following read
+	handle->ra_next = handle->seek_block + run;
+	if (handle->ra_end < handle->ra_next) {
+		handle->ra_end = handle->ra_next;
+		readahead_window(handle, inode, size, handle->ra_end, 0);
+	}
+
+	return run;
+}
+
+/* write whole blocks at the seek position without reading them first, 0 on failure */
+static uint64_t write_run(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode, const void* buffer, uint64_t count) {
+	struct ext2_t* ext2 = handle->ext2;
+	struct ext2_incore_t* incore;
+	const uint64_t max = count / ext2->block_size;
+	uint64_t first, block, run, mapped;
+
+	switch (get_block(handle, inode, handle->seek_block, &first)) {
+		case BLOCK_SPARSE:
+			// allocate the whole hole at once, it is about to be overwritten so skip zeroing
+			for (run = 1; run < max; run++) {
+				if (get_block(handle, inode, handle->seek_block + run, &block) != BLOCK_SPARSE) {
+					break;
+				}
+			}
+
+			if (!(incore = handle_inode(handle))) {
+				return 0;
+			}
+
+			update_start(ext2);
+			lock_acquire(&incore->map_lock);
+
+			if (!(first = alloc_file_blocks(handle, run, &run))) {
+				lock_release(&incore->map_lock);
+				update_end(ext2);
+				return 0;
+			}
+
+			mapped = assign_run(handle, handle->seek_block, inode, first, run);
+
+			if (mapped < run) {
+				free_blocks(ext2, first + mapped, run - mapped);
+			}
+
+			lock_release(&incore->map_lock);
+			update_end(ext2);
+
+			if (!(run = mapped)) {
+				return 0;
+			}
+
+			break;
+		case BLOCK_OK:
+			run = block_run(handle, inode, handle->seek_block, max, &first);
+			break;
+		case BLOCK_ERROR:
+			return 0;
+	}
+
+	if (direct_io(ext2, DISK_OP_WRITE, (void*)(uint64_t)buffer, first, run) != DISK_OK) {
+		ext2_bcache_invalidate(ext2->bcache, first, run);
+		return 0;
+	}
+
+	ext2_bcache_invalidate(ext2->bcache, first, run);
+	return run;
+}
+
+static inline uint64_t dir_rec_len(uint64_t name_len) {
+	return (8 + name_len + 3) & ~(uint64_t)3;
+}
+
+static void* read_dir_block(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode, uint64_t index, uint64_t* block) {
+	if (get_block(handle, inode, index, block) != BLOCK_OK) {
+		return 0;
+	}
+
+	return read_block(*block, handle->ext2);
+}
+
+static inline struct ext2_ll_dir_entry_t* dir_entry_at(void* buffer, uint64_t off, uint64_t block_size) {
+	struct ext2_ll_dir_entry_t* entry = (struct ext2_ll_dir_entry_t*)((uint64_t)buffer + off);
+
+	if (off + 8 > block_size || entry->rec_len < 8 || off + entry->rec_len > block_size) {
+		return 0;
+	}
+
+	return entry;
+}
+
+static uint8_t block_find(const struct ext2_t* ext2, void* buffer, const char* name, uint64_t len, uint64_t* ino) {
+	struct ext2_ll_dir_entry_t* entry;
+
+	for (uint64_t off = 0; (entry = dir_entry_at(buffer, off, ext2->block_size)); off += entry->rec_len) {
+		if (entry->inode && entry->name_len == len && kmemcmp(entry->name, name, len) == 0) {
+			*ino = entry->inode;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* place a new entry in the slack of a directory block, returns 1 on success */
+static uint8_t block_insert(const struct ext2_t* ext2, void* buffer, const char* name, uint64_t len, uint64_t ino) {
+	const uint64_t need = dir_rec_len(len);
+	struct ext2_ll_dir_entry_t* entry;
+	uint64_t used, rec_len;
+
+	for (uint64_t off = 0; (entry = dir_entry_at(buffer, off, ext2->block_size)); off += rec_len) {
+		rec_len = entry->rec_len;
+		used = entry->inode ? dir_rec_len(entry->name_len) : 0;
+
+		if (rec_len >= used + need) {
+			if (used) {
+				entry->rec_len = (uint16_t)used;
+				entry = (struct ext2_ll_dir_entry_t*)((uint64_t)entry + used);
+				entry->rec_len = (uint16_t)(rec_len - used);
+			}
+
+			entry->inode = (uint32_t)ino;
+			entry->name_len = (uint8_t)len;
+			entry->file_type = EXT2_FT_REG_FILE;
+			kmemcpy(entry->name, name, len);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static inline uint16_t dx_count(const struct ext2_dx_entry_t* entries) {
+	return ((const struct ext2_dx_countlimit_t*)entries)->count;
+}
+
+static inline uint16_t dx_limit(const struct ext2_dx_entry_t* entries) {
+	return ((const struct ext2_dx_countlimit_t*)entries)->limit;
+}
+
+static uint8_t dx_hash(const struct ext2_t* ext2, uint8_t version, const char* name, uint64_t len, uint32_t* hash) {
+	uint32_t seed[4];
+
+	kmemcpy(seed, ext2->superblock->s_hash_seed, sizeof(seed));
+
+	if (version <= EXT2_HTREE_TEA && (ext2->superblock->s_flags & EXT2_FLAGS_UNSIGNED_HASH)) {
+		version += EXT2_HTREE_LEGACY_UNSIGNED;
+	}
+
+	return ext2_htree_hash(name, len, seed, version, hash);
+}
+
+/* last entry whose hash is not above the target */
+static struct ext2_dx_entry_t* dx_search(struct ext2_dx_entry_t* entries, uint32_t hash) {
+	struct ext2_dx_entry_t* p = entries + 1;
+	struct ext2_dx_entry_t* q = entries + dx_count(entries) - 1;
+	struct ext2_dx_entry_t* m;
+
+	while (p <= q) {
+		m = p + (q - p) / 2;
+		if (m->hash > hash) {
+			q = m - 1;
+		}
+		else {
+			p = m + 1;
+		}
+	}
+
+	return p - 1;
+}
+
+static void dx_release(struct ext2_dx_frame_t* frames, uint64_t levels) {
+	for (uint64_t i = 0; i < levels; i++) {
+		kfree(frames[i].buffer);
+	}
+}
+
+/* walk the htree down to the leaf that would hold name */
+static enum ext2_dx_state_t dx_probe(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode,
+		const char* name, uint64_t len, uint32_t* hash, struct ext2_dx_frame_t* frames, uint64_t* levels) {
+	struct ext2_t* ext2 = handle->ext2;
+	const uint64_t block_size = ext2->block_size;
+	struct ext2_dx_entry_t* entries;
+	uint64_t block, limit, i;
+	void* buffer;
+
+	if (!(ext2->superblock->s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) || !(inode->i_flags & EXT2_INDEX_FL)) {
+		return DX_LINEAR;
+	}
+
+	if (!(buffer = read_dir_block(handle, inode, 0, &block))) {
+		return DX_ERROR;
+	}
+
+	const struct ext2_dx_root_info_t* info = (const struct ext2_dx_root_info_t*)((uint64_t)buffer + DX_ROOT_INFO_OFF);
+
+	if (info->reserved_zero || info->indirect_levels >= DX_MAX_LEVELS ||
+			DX_ROOT_INFO_OFF + info->info_length + sizeof(struct ext2_dx_entry_t) > block_size ||
+			dx_hash(ext2, info->hash_version, name, len, hash)) {
+		kfree(buffer);
+		return DX_LINEAR;
+	}
+
+	*levels = info->indirect_levels + 1u;
+	entries = (struct ext2_dx_entry_t*)((uint64_t)buffer + DX_ROOT_INFO_OFF + info->info_length);
+	limit = (block_size - DX_ROOT_INFO_OFF - info->info_length) / sizeof(struct ext2_dx_entry_t);
+
+	for (i = 0;; i++) {
+		if (dx_limit(entries) != limit || !dx_count(entries) || dx_count(entries) > limit) {
+			// damaged index, the leaves are still a valid linear directory
+			kfree(buffer);
+			dx_release(frames, i);
+			return DX_LINEAR;
+		}
+
+		frames[i].block = block;
+		frames[i].buffer = buffer;
+		frames[i].entries = entries;
+		frames[i].at = dx_search(entries, *hash);
+
+		if (i + 1 == *levels) {
+			return DX_OK;
+		}
+
+		if (!(buffer = read_dir_block(handle, inode, frames[i].at->block & DX_BLOCK_MASK, &block))) {
+			dx_release(frames, i + 1);
+			return DX_ERROR;
+		}
+
+		entries = (struct ext2_dx_entry_t*)((uint64_t)buffer + DX_NODE_OFF);
+		limit = (block_size - DX_NODE_OFF) / sizeof(struct ext2_dx_entry_t);
+	}
+}
+
+/* step to the next leaf if it continues the same hash, returns 1 if it does */
+static uint8_t dx_next_leaf(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode,
+		struct ext2_dx_frame_t* frames, uint64_t levels, uint32_t hash) {
+	uint64_t i = levels - 1;
+	uint64_t block;
+	void* buffer;
+
+	while (++frames[i].at >= frames[i].entries + dx_count(frames[i].entries)) {
+		if (!i) {
+			return 0;
+		}
+		i--;
+	}
+
+	if ((frames[i].at->hash & ~1u) != hash) {
+		return 0;
+	}
+
+	for (; i + 1 < levels; i++) {
+		if (!(buffer = read_dir_block(handle, inode, frames[i].at->block & DX_BLOCK_MASK, &block))) {
+			return 0;
+		}
+
+		kfree(frames[i + 1].buffer);
+		frames[i + 1].block = block;
+		frames[i + 1].buffer = buffer;
+		frames[i + 1].entries = (struct ext2_dx_entry_t*)((uint64_t)buffer + DX_NODE_OFF);
+		frames[i + 1].at = frames[i + 1].entries;
+	}
+
+	return 1;
+}
+
+static enum ext2_dx_state_t dx_lookup(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode,
+		const char* name, uint64_t len, uint64_t* ino) {
+	struct ext2_dx_frame_t frames[DX_MAX_LEVELS];
+	enum ext2_dx_state_t sts;
+	uint64_t levels, block;
+	uint32_t hash;
+	void* buffer;
+
+	if ((sts = dx_probe(handle, inode, name, len, &hash, frames, &levels)) != DX_OK) {
+		return sts;
+	}
+
+	sts = DX_DNE;
+	do {
+		if (!(buffer = read_dir_block(handle, inode, frames[levels - 1].at->block & DX_BLOCK_MASK, &block))) {
+			sts = DX_ERROR;
+			break;
+		}
+
+		if (block_find(handle->ext2, buffer, name, len, ino)) {
+			sts = DX_OK;
+		}
+
+		kfree(buffer);
+	} while (sts == DX_DNE && dx_next_leaf(handle, inode, frames, levels, hash));
+
+	dx_release(frames, levels);
+	return sts;
+}
+
+static void compact_entries(void* dst, void* src, const struct ext2_dx_map_t* map, uint64_t count, uint64_t block_size) {
+	struct ext2_ll_dir_entry_t* entry = 0;
+	uint64_t off = 0;
+
+	for (uint64_t i = 0; i < count; i++) {
+		kmemcpy((void*)((uint64_t)dst + off), (void*)((uint64_t)src + map[i].off), map[i].size);
+		entry = (struct ext2_ll_dir_entry_t*)((uint64_t)dst + off);
+		entry->rec_len = map[i].size;
+		off += map[i].size;
+	}
+
+	entry->rec_len = (uint16_t)(entry->rec_len + block_size - off);
+}
+
+/* split a full leaf by hash into a new block and add it to the parent dx block */
+static enum ext2_dx_state_t dx_split(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode,
+		struct ext2_dx_frame_t* frame, void* buffer, uint64_t block, uint32_t hash, uint8_t version,
+		const char* name, uint64_t len, uint64_t ino, uint64_t* index) {
+	struct ext2_t* ext2 = handle->ext2;
+	const uint64_t block_size = ext2->block_size;
+	struct ext2_dx_map_t* map = kmalloc(sizeof(struct ext2_dx_map_t) * (block_size / 12 + 1));
+	struct ext2_dx_map_t tmp;
+	struct ext2_ll_dir_entry_t* entry;
+	enum ext2_dx_state_t sts = DX_ERROR;
+	uint64_t count = 0, i, j, off;
+	void* lo = 0, * hi = 0;
+
+	for (off = 0; (entry = dir_entry_at(buffer, off, block_size)); off += entry->rec_len) {
+		if (entry->inode) {
+			dx_hash(ext2, version, (const char*)entry->name, entry->name_len, &map[count].hash);
+			map[count].off = (uint16_t)off;
+			map[count].size = (uint16_t)dir_rec_len(entry->name_len);
+			count++;
+		}
+	}
+
+	if (count < 2) {
+		sts = DX_LINEAR;
+		goto cleanup;
+	}
+
+	for (i = 1; i < count; i++) {
+		tmp = map[i];
+		for (j = i; j > 0 && map[j - 1].hash > tmp.hash; j--) {
+			map[j] = map[j - 1];
+		}
+		map[j] = tmp;
+	}
+
+	const uint64_t split = count / 2;
+	const uint32_t split_hash = map[split].hash;
+	const uint32_t continued = split_hash == map[split - 1].hash;
+	const uint64_t new_index = inode->i_size / block_size;
+	const uint64_t new_block = assign_block(handle, new_index, inode, 1);
+
+	if (!new_block) {
+		goto cleanup;
+	}
+
+	inode->i_size += (uint32_t)block_size;
+	set_inode(handle, inode);
+
+	lo = kmalloc(block_size);
+	hi = kmalloc(block_size);
+	compact_entries(lo, buffer, map, split, block_size);
+	compact_entries(hi, buffer, map + split, count - split, block_size);
+
+	if (hash >= split_hash + continued) {
+		*index = new_index;
+		i = block_insert(ext2, hi, name, len, ino);
+	}
+	else {
+		i = block_insert(ext2, lo, name, len, ino);
+	}
+
+	if (!i || !write_meta_free(new_block, ext2, hi, 0) || !write_meta_free(block, ext2, lo, 0)) {
+		goto cleanup;
+	}
+
+	struct ext2_dx_entry_t* end = frame->entries + dx_count(frame->entries);
+	for (struct ext2_dx_entry_t* e = end; e > frame->at + 1; e--) {
+		*e = *(e - 1);
+	}
+
+	(frame->at + 1)->hash = split_hash + continued;
+	(frame->at + 1)->block = (uint32_t)new_index;
+	((struct ext2_dx_countlimit_t*)frame->entries)->count++;
+
+	if (write_meta_free(frame->block, ext2, frame->buffer, 0)) {
+		sts = DX_OK;
+	}
+
+cleanup:
+	kfree(hi);
+	kfree(lo);
+	kfree(map);
+	return sts;
+}
+
+/* insert through the htree, DX_LINEAR if the directory is not (or can no longer be) indexed */
+static enum ext2_dx_state_t dx_insert(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode,
+		const char* name, uint64_t len, uint64_t ino, uint64_t* index) {
+	struct ext2_dx_frame_t frames[DX_MAX_LEVELS];
+	enum ext2_dx_state_t sts;
+	uint64_t levels, block;
+	uint32_t hash;
+	void* buffer;
+
+	if ((sts = dx_probe(handle, inode, name, len, &hash, frames, &levels)) != DX_OK) {
+		return sts;
+	}
+
+	struct ext2_dx_frame_t* frame = &frames[levels - 1];
+	*index = frame->at->block & DX_BLOCK_MASK;
+
+	if (!(buffer = read_dir_block(handle, inode, *index, &block))) {
+		sts = DX_ERROR;
+	}
+	else if (block_insert(handle->ext2, buffer, name, len, ino)) {
+		sts = write_meta_free(block, handle->ext2, buffer, 0) ? DX_OK : DX_ERROR;
+	}
+	else if (dx_count(frame->entries) >= dx_limit(frame->entries)) {
+		// growing the tree is left to fsck, fall back to a linear directory
+		sts = DX_LINEAR;
+	}
+	else {
+		const struct ext2_dx_root_info_t* info = (const struct ext2_dx_root_info_t*)((uint64_t)frames[0].buffer + DX_ROOT_INFO_OFF);
+		sts = dx_split(handle, inode, frame, buffer, block, hash, info->hash_version, name, len, ino, index);
+	}
+
+	kfree(buffer);
+	dx_release(frames, levels);
+	return sts;
+}
+
+static void dname_free(void* value) {
+	struct ext2_dname_t* dname = value;
+	struct ext2_dname_t* next;
+
+	for (; dname; dname = next) {
+		next = dname->next;
+		kfree(dname);
+	}
+}
+
+static void dindex_free(void* value) {
+	struct ext2_dindex_t* dindex = value;
+
+	hash_table_free(dindex->names, dname_free);
+	kfree(dindex);
+}
+
+static void dname_add(struct ext2_dindex_t* dindex, const char* name, uint64_t len, uint64_t ino) {
+	const uint64_t key = fnv64_1a(name, len);
+	struct ext2_dname_t* dname = kmalloc(sizeof(struct ext2_dname_t) + len);
+	void* head;
+
+	dname->next = hash_table_get(dindex->names, key, &head) ? head : 0;
+	dname->ino = ino;
+	dname->name_len = (uint8_t)len;
+	kmemcpy(dname->name, name, len);
+
+	hash_table_insert(dindex->names, key, dname);
+}
+
+/* returns 1 if the directory is indexed, ino is 0 if name is absent */
+static uint8_t dindex_lookup(struct ext2_t* ext2, uint64_t dir, const char* name, uint64_t len, uint64_t* ino) {
+	struct ext2_dname_t* dname;
+	void* out;
+
+	lock_acquire(&ext2->dindex_lock);
+	if (!hash_table_get(ext2->dindex, dir, &out)) {
+		lock_release(&ext2->dindex_lock);
+		return 0;
+	}
+
+	*ino = 0;
+	if (hash_table_get(((struct ext2_dindex_t*)out)->names, fnv64_1a(name, len), &out)) {
+		for (dname = out; dname; dname = dname->next) {
+			if (dname->name_len == len && kmemcmp(dname->name, name, len) == 0) {
+				*ino = dname->ino;
+				break;
+			}
+		}
+	}
+	lock_release(&ext2->dindex_lock);
+
+	return 1;
+}
+
+/* scan a linear directory once and publish its name index */
+static void dindex_build(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode) {
+	struct ext2_t* ext2 = handle->ext2;
+	const uint64_t block_size = ext2->block_size;
+	const uint64_t num_blocks = inode->i_size / block_size;
+	struct ext2_ll_dir_entry_t* entry;
+	uint64_t gen, block, count = 0;
+	void* buffer;
+
+	lock_acquire(&ext2->dindex_lock);
+	gen = ext2->dir_gen;
+	lock_release(&ext2->dindex_lock);
+
+	struct ext2_dindex_t* dindex = kmalloc(sizeof(struct ext2_dindex_t));
+	dindex->names = hash_table_alloc(DINDEX_NAME_BUCKETS);
+	dindex->insert_hint = num_blocks - 1;
+
+	for (uint64_t i = 0; i < num_blocks; i++) {
+		switch (get_block(handle, inode, i, &block)) {
+			case BLOCK_OK:
+				break;
+			case BLOCK_SPARSE:
+				continue;
+			case BLOCK_ERROR:
+				dindex_free(dindex);
+				return;
+		}
+
+		if (!(buffer = read_block(block, ext2))) {
+			dindex_free(dindex);
+			return;
+		}
+
+		for (uint64_t off = 0; (entry = dir_entry_at(buffer, off, block_size)); off += entry->rec_len) {
+			if (entry->inode) {
+				dname_add(dindex, (const char*)entry->name, entry->name_len, entry->inode);
+				count++;
+			}
+		}
+
+		kfree(buffer);
+	}
+
+	lock_acquire(&ext2->dindex_lock);
+	if (gen != ext2->dir_gen) {
+		// a directory changed while scanning
+		lock_release(&ext2->dindex_lock);
+		dindex_free(dindex);
+		return;
+	}
+
+	if (ext2->dindex_names + count > DINDEX_MAX_NAMES) {
+		hash_table_clear(ext2->dindex, dindex_free);
+		ext2->dindex_names = 0;
+	}
+
+	hash_table_insert(ext2->dindex, handle->inode_index, dindex);
+	ext2->dindex_names += count;
+	lock_release(&ext2->dindex_lock);
+}
+
+static enum file_status_t dir_lookup(struct ext2_inode_handle_t* handle, const char* name, uint64_t len, uint64_t* ino) {
+	struct ext2_t* ext2 = handle->ext2;
+	struct ext2_inode_t inode;
+	uint64_t block;
+	void* buffer;
+
+	if (get_inode(handle, &inode)) {
+		return FILE_ERROR;
+	}
+
+	if (!(inode.i_mode & EXT2_S_IFDIR)) {
+		return FILE_NOT_DIR;
+	}
+
+	switch (dx_lookup(handle, &inode, name, len, ino)) {
+		case DX_OK:
+			return FILE_OK;
+		case DX_DNE:
+			return FILE_DNE;
+		case DX_ERROR:
+			return FILE_ERROR;
+		case DX_LINEAR:
+			break;
+	}
+
+	const uint64_t num_blocks = inode.i_size / ext2->block_size;
+
+	if (!dindex_lookup(ext2, handle->inode_index, name, len, ino) && num_blocks >= DINDEX_MIN_BLOCKS) {
+		dindex_build(handle, &inode);
+	}
+
+	if (dindex_lookup(ext2, handle->inode_index, name, len, ino)) {
+		return *ino ? FILE_OK : FILE_DNE;
+	}
+
+	for (uint64_t i = 0; i < num_blocks; i++) {
+		switch (get_block(handle, &inode, i, &block)) {
+			case BLOCK_OK:
+				break;
+			case BLOCK_SPARSE:
+				continue;
+			case BLOCK_ERROR:
+				return FILE_ERROR;
+		}
+
+		if (!(buffer = read_block(block, ext2))) {
+			return FILE_ERROR;
+		}
+
+		if (block_find(ext2, buffer, name, len, ino)) {
+			kfree(buffer);
+			return FILE_OK;
+		}
+
+		kfree(buffer);
+	}
+
+	return FILE_DNE;
+}
+
+/* first fit from the last insertion point, appending a block if every one is full */
+static enum file_status_t linear_insert(struct ext2_inode_handle_t* handle, struct ext2_inode_t* inode,
+		const char* name, uint64_t len, uint64_t ino, uint64_t* index) {
+	struct ext2_t* ext2 = handle->ext2;
+	const uint64_t block_size = ext2->block_size;
+	const uint64_t num_blocks = inode->i_size / block_size;
+	uint64_t hint = 0, block, i;
+	void* buffer;
+	void* out;
+
+	lock_acquire(&ext2->dindex_lock);
+	if (hash_table_get(ext2->dindex, handle->inode_index, &out)) {
+		hint = ((struct ext2_dindex_t*)out)->insert_hint;
+	}
+	lock_release(&ext2->dindex_lock);
+
+	for (uint64_t n = 0; n < num_blocks; n++) {
+		i = (hint + n) % num_blocks;
+
+		switch (get_block(handle, inode, i, &block)) {
+			case BLOCK_OK:
+				break;
+			case BLOCK_SPARSE:
+				continue;
+			case BLOCK_ERROR:
+				return FILE_ERROR;
+		}
+
+		if (!(buffer = read_block(block, ext2))) {
+			return FILE_ERROR;
 		}
 
-		buffer = read_block(*block, ext2);
+		if (block_insert(ext2, buffer, name, len, ino)) {
+			if (!(buffer = write_meta(block, ext2, buffer))) {
+				return FILE_ERROR;
+			}
 
-		if (!buffer) {
-			return BLOCK_ERROR;
+			kfree(buffer);
+			*index = i;
+			return FILE_OK;
 		}
 
-		*block = buffer[index / indir2];
 		kfree(buffer);
+	}
 
-		if (!*block) {
-			return BLOCK_SPARSE;
-		}
+	if (!(block = assign_block(handle, num_blocks, inode, 1))) {
+		return FILE_ERROR;
+	}
 
-		buffer = read_block(*block, ext2);
+	buffer = kmalloc(block_size);
+	*(struct ext2_ll_dir_entry_t*)buffer = (struct ext2_ll_dir_entry_t){
+		.inode = 0,
+		.rec_len = (uint16_t)block_size,
+		.name_len = 0,
+		.file_type = 0
+	};
+	block_insert(ext2, buffer, name, len, ino);
 
-		if (!buffer) {
-			return BLOCK_ERROR;
-		}
+	if (!(buffer = write_meta(block, ext2, buffer))) {
+		return FILE_ERROR;
+	}
+	kfree(buffer);
 
-		*block = buffer[(index % indir2) / indir1];
-		kfree(buffer);
+	inode->i_size += (uint32_t)block_size;
+	set_inode(handle, inode);
 
-		if (!*block) {
-			return BLOCK_SPARSE;
-		}
+	*index = num_blocks;
+	return FILE_OK;
+}
 
-		buffer = read_block(*block, ext2);
+/* add name to the directory, keeping the htree or in-memory index current */
+static enum file_status_t dir_insert(struct ext2_inode_handle_t* handle, const char* name, uint64_t len, uint64_t ino) {
+	struct ext2_t* ext2 = handle->ext2;
+	struct ext2_inode_t inode;
+	enum file_status_t sts = FILE_OK;
+	uint64_t index = 0;
+	void* out;
 
-		if (!buffer) {
-			return BLOCK_ERROR;
-		}
+	if (get_inode(handle, &inode)) {
+		return FILE_ERROR;
+	}
 
-		*block = buffer[index % indir1];
-		kfree(buffer);
+	switch (dx_insert(handle, &inode, name, len, ino, &index)) {
+		case DX_OK:
+			break;
+		case DX_ERROR:
+			return FILE_ERROR;
+		case DX_DNE:
+		case DX_LINEAR:
+			if (inode.i_flags & EXT2_INDEX_FL) {
+				// a stale index must not be trusted once unindexed entries exist
+				inode.i_flags &= ~(uint32_t)EXT2_INDEX_FL;
+				set_inode(handle, &inode);
+			}
 
-		if (!*block) {
-			return BLOCK_SPARSE;
-		}
+			sts = linear_insert(handle, &inode, name, len, ino, &index);
+			break;
+	}
 
-		return BLOCK_OK;
+	lock_acquire(&ext2->dindex_lock);
+	ext2->dir_gen++;
+	if (hash_table_get(ext2->dindex, handle->inode_index, &out)) {
+		if (sts == FILE_OK) {
+			dname_add(out, name, len, ino);
+			((struct ext2_dindex_t*)out)->insert_hint = index;
+			ext2->dindex_names++;
+		}
+		else {
+			hash_table_remove(ext2->dindex, handle->inode_index, &out);
+			dindex_free(out);
+		}
 	}
+	lock_release(&ext2->dindex_lock);
 
-	return BLOCK_ERROR;
+	return sts;
 }
 
 static inline size_t path_entry_len(const char* path) {
@@ -876,6 +3274,26 @@ static void ext2_reset_dir(struct file_handle_t* handle) {
 	inode_handle->ext2_mode &= ~MODE_DIR;
 }
 
+static void dir_entry_info(const struct ext2_ll_dir_entry_t* entry, struct dir_info_t* info) {
+	info->inode_num = entry->inode;
+	info->rec_len = entry->rec_len;
+
+	switch (entry->file_type) {
+		case EXT2_FT_REG_FILE:
+			info->type = FILE_INFO_REG;
+			break;
+		case EXT2_FT_DIR:
+			info->type = FILE_INFO_DIR;
+			break;
+		default:
+			info->type = FILE_INFO_UNK;
+			break;
+	}
+
+	kmemcpy(info->name, entry->name, entry->name_len);
+	info->name[entry->name_len] = 0;
+}
+
 static enum file_status_t ext2_read_dir(struct file_handle_t* handle, struct dir_info_t* info) {
 	struct ext2_inode_handle_t* inode_handle = (struct ext2_inode_handle_t*)handle;
 	struct ext2_inode_t inode;
@@ -898,7 +3316,7 @@ static enum file_status_t ext2_read_dir(struct file_handle_t* handle, struct dir
 			return FILE_DNE;
 		}
 
-		switch (get_block(inode_handle->ext2, &inode, inode_handle->seek_block, &block)) {
+		switch (get_block(inode_handle, &inode, inode_handle->seek_block, &block)) {
 			case BLOCK_OK:
 				void* buffer = read_block(block, inode_handle->ext2);
 
@@ -915,23 +3333,7 @@ static enum file_status_t ext2_read_dir(struct file_handle_t* handle, struct dir
 				}
 
 				if (entry->inode != 0) {
-					info->inode_num = entry->inode;
-					info->rec_len = entry->rec_len;
-
-					switch (entry->file_type) {
-						case EXT2_FT_REG_FILE:
-							info->type = FILE_INFO_REG;
-							break;
-						case EXT2_FT_DIR:
-							info->type = FILE_INFO_DIR;
-							break;
-						default:
-							info->type = FILE_INFO_UNK;
-							break;
-					}
-
-					kmemcpy(info->name, entry->name, entry->name_len);
-					info->name[entry->name_len] = 0;
+					dir_entry_info(entry, info);
 
 					kfree(buffer);
 					return FILE_OK;
@@ -949,47 +3351,141 @@ static enum file_status_t ext2_read_dir(struct file_handle_t* handle, struct dir
 	}
 }
 
+// like ext2_read_dir, but each directory block is read once for all of its entries
+static enum file_status_t ext2_read_dirs(struct file_handle_t* handle, fs_dir_emit_t emit, void* cntx) {
+	struct ext2_inode_handle_t* inode_handle = (struct ext2_inode_handle_t*)handle;
+	const uint64_t block_size = inode_handle->ext2->block_size;
+	struct ext2_ll_dir_entry_t* entry;
+	enum file_status_t sts = FILE_OK;
+	struct ext2_inode_t inode;
+	struct dir_info_t info;
+	uint64_t block, loaded = 0;
+	void* buffer = 0;
+
+	if (!(inode_handle->ext2_mode & MODE_DIR)) {
+		return FILE_BAD_FLAGS;
+	}
+
+	if (get_inode(inode_handle, &inode)) {
+		return FILE_ERROR;
+	}
+
+	const uint64_t size = (uint64_t)inode.i_size | ((uint64_t)inode.i_dir_acl << 32);
+
+	while ((info.seek_pos = ext2_get_seek(handle)) < size) {
+		if (!buffer || loaded != inode_handle->seek_block) {
+			if (buffer) {
+				kfree(buffer);
+				buffer = 0;
+			}
+
+			switch (get_block(inode_handle, &inode, inode_handle->seek_block, &block)) {
+				case BLOCK_OK:
+					break;
+				case BLOCK_SPARSE:
+					inode_handle->seek_block++;
+					inode_handle->seek = 0;
+					continue;
+				case BLOCK_ERROR:
+					return FILE_ERROR;
+			}
+
+			if (!(buffer = read_block(block, inode_handle->ext2))) {
+				return FILE_ERROR;
+			}
+
+			loaded = inode_handle->seek_block;
+		}
+
+		entry = (struct ext2_ll_dir_entry_t*)((uint64_t)buffer + inode_handle->seek);
+
+		// a zero length record would never advance
+		if (entry->rec_len < sizeof(struct ext2_ll_dir_entry_t) || inode_handle->seek + entry->rec_len > block_size) {
+			sts = FILE_ERROR;
+			break;
+		}
+
+		if (entry->inode != 0) {
+			dir_entry_info(entry, &info);
+
+			if (emit(cntx, &info)) {
+				break;
+			}
+		}
+
+		inode_handle->seek += entry->rec_len;
+		if (inode_handle->seek >= block_size) {
+			inode_handle->seek_block++;
+			inode_handle->seek = 0;
+		}
+	}
+
+	if (buffer) {
+		kfree(buffer);
+	}
+
+	return sts;
+}
+
 static struct ext2_inode_handle_t* ext2_duplicate(struct ext2_inode_handle_t* handle) {
 	struct ext2_inode_handle_t* dup = kmalloc(sizeof(struct ext2_inode_handle_t));
 
 	*dup = *handle;
+	dup->incore = 0;
+	bmap_init(dup);
 	return dup;
 }
 
 static void ext2_close(struct file_handle_t* handle) {
+	struct ext2_inode_handle_t* inode_handle = (struct ext2_inode_handle_t*)handle;
+
+	if (inode_handle->incore) {
+		iput(inode_handle->ext2, inode_handle->incore);
+	}
+
+	bmap_free(inode_handle);
 	kfree(handle);
 }
 
 static const char* reduce_path(struct ext2_t* ext2, const char* path, struct ext2_inode_handle_t** handle_ret) {
+	const struct mount_cntx_t* cntx = (const struct mount_cntx_t*)ext2;
+	enum file_status_t sts;
 	size_t path_len;
-	uint8_t cntrl = 0;
+	uint64_t ino;
 
 	struct ext2_inode_handle_t* handle = kmalloc(sizeof(struct ext2_inode_handle_t));
 	handle->ext2 = ext2;
 	handle->inode_index = EXT2_ROOT_INO;
+	handle->ra_next = 0;
+	handle->ra_end = 0;
+	handle->ra_window = RA_MIN_BLOCKS;
 	handle->ext2_mode = 0;
-
-	struct dir_info_t info;
+	handle->incore = 0;
+	bmap_init(handle);
 
 	while (*path) {
-		if (ext2_open_dir((struct file_handle_t*)handle) != FILE_OK) {
-			break;
-		}
-
 		path_len = path_entry_len(path);
 
-		cntrl = 1;
-		while (ext2_read_dir((struct file_handle_t*)handle, &info) == FILE_OK) {
-			if (path_len == kstrlen(info.name) && kmemcmp(path, info.name, path_len) == 0) {
-				cntrl = 0;
-				ext2_reset_dir((struct file_handle_t*)handle);
-				handle->inode_index = info.inode_num;
-				break;
+		if (dcache_lookup(cntx, handle->inode_index, path, path_len, &ino)) {
+			if (ino == DCACHE_NEGATIVE) {
+				break; // known not to exist
 			}
+
+			handle->inode_index = ino;
 		}
+		else {
+			sts = dir_lookup(handle, path, path_len, &ino);
+
+			if (sts == FILE_DNE) {
+				dcache_insert(cntx, handle->inode_index, path, path_len, DCACHE_NEGATIVE);
+			}
+
+			if (sts != FILE_OK) {
+				break; // file not found
+			}
 
-		if (cntrl) {
-			break; // file not found
+			dcache_insert(cntx, handle->inode_index, path, path_len, ino);
+			handle->inode_index = ino;
 		}
 
 		path += path_len;
@@ -1011,10 +3507,16 @@ static enum file_status_t ext2_create(struct ext2_t* ext2, const char* path, uin
 
 	enum file_status_t sts;
 	struct ext2_inode_handle_t* handle;
+	uint64_t ino;
+
+	if (ext2->read_only) {
+		return FILE_NO_SUPPORT;
+	}
 
 	path = reduce_path(ext2, path, &handle);
 
 	if (!*path) {
+		ext2_close((struct file_handle_t*)handle);
 		return FILE_BUSY;
 	}
 
@@ -1025,50 +3527,51 @@ static enum file_status_t ext2_create(struct ext2_t* ext2, const char* path, uin
 	}
 
 	if (*path == '/') {
+		ext2_close((struct file_handle_t*)handle);
 		return FILE_DNE;
 	}
 
+	const uint64_t name_len = (uint64_t)(path - name);
+
+	if (name_len > EXT2_NAME_LEN) {
+		ext2_close((struct file_handle_t*)handle);
+		return FILE_NO_SUPPORT;
+	}
+
 	struct file_info_t info;
 	if ((sts = ext2_stat((struct file_handle_t*)handle, &info)) != FILE_OK) {
+		ext2_close((struct file_handle_t*)handle);
 		return sts;
 	}
 
 	if (info.type != FILE_TYPE_DIR) {
+		ext2_close((struct file_handle_t*)handle);
 		return FILE_NO_SUPPORT;
 	}
 
-	struct dir_info_t dir_info;
-	struct ext2_inode_handle_t* inode_handle = ext2_duplicate((struct ext2_inode_handle_t*)handle);
-
-	lock_acquire(&ext2->lock);
-
-	ext2_open_dir((struct file_handle_t*)inode_handle);
-
-	while (ext2_read_dir((struct file_handle_t*)inode_handle, &dir_info) == FILE_OK) {
-		if (kstrcmp(dir_info.name, name) == 0) {
-			ext2_reset_dir((struct file_handle_t*)inode_handle);
-
-			lock_release(&inode_handle->ext2->lock);
-
-			ext2_close((struct file_handle_t*)inode_handle);
-			
-			return FILE_BUSY;
-		}
+	struct ext2_incore_t* dir = handle_inode(handle);
+	if (!dir) {
+		ext2_close((struct file_handle_t*)handle);
+		return FILE_ERROR;
 	}
 
-	const uint64_t group = (inode_handle->inode_index - 1) / inode_handle->ext2->superblock->s_inodes_per_group;
-	uint64_t inode_index = alloc_inode(inode_handle->ext2, group);
-	struct ext2_inode_handle_t* parent_handle = ext2_duplicate((struct ext2_inode_handle_t*)handle);
+	// the directory's map lock keeps the lookup and insert atomic
+	update_start(ext2);
+	lock_acquire(&dir->map_lock);
 
-	sts = FILE_OK;
-	if (inode_index == 0) {
-		sts = FILE_ERROR;
-		goto cleanup;
+	if ((sts = dir_lookup(handle, name, name_len, &ino)) != FILE_DNE) {
+		lock_release(&dir->map_lock);
+		update_end(ext2);
+		ext2_close((struct file_handle_t*)handle);
+		return sts == FILE_OK ? FILE_BUSY : sts;
 	}
 
-	struct ext2_inode_t parent_inode;
+	const uint64_t group = (handle->inode_index - 1) / ext2->superblock->s_inodes_per_group;
+	uint64_t inode_index = alloc_inode(ext2, group);
+	struct ext2_inode_handle_t* inode_handle = ext2_duplicate(handle);
 
-	if (get_inode(parent_handle, &parent_inode)) {
+	sts = FILE_OK;
+	if (inode_index == 0 || clear_inode(ext2, inode_index)) {
 		sts = FILE_ERROR;
 		goto cleanup;
 	}
@@ -1098,55 +3601,32 @@ static enum file_status_t ext2_create(struct ext2_t* ext2, const char* path, uin
 		}
 	};
 
+	if (ext2->superblock->s_feature_incompat & EXT2_FEATURE_INCOMPAT_EXTENTS) {
+		// an empty tree in i_block
+		inode.i_flags |= EXT4_EXTENTS_FL;
+		*(struct ext2_extent_header_t*)inode.i_block = (struct ext2_extent_header_t){
+			.eh_magic = EXT4_EXT_MAGIC,
+			.eh_entries = 0,
+			.eh_max = (sizeof(inode.i_block) - sizeof(struct ext2_extent_header_t)) / sizeof(struct ext2_extent_t),
+			.eh_depth = 0,
+			.eh_generation = 0
+		};
+	}
+
 	inode_handle->inode_index = inode_index;
 
 	set_inode(inode_handle, &inode);
 
-	uint64_t block;
-	ext2_open_dir((struct file_handle_t*)parent_handle);
-	//TODO: allocate on an already used block
-	while (1) {
-		switch (get_block(parent_handle->ext2, &parent_inode, parent_handle->seek_block, &block)) {
-			case BLOCK_SPARSE:
-				block = assign_block(parent_handle, parent_handle->seek_block, &parent_inode, 1);
-
-				if (!block) {
-					sts = FILE_ERROR;
-					goto cleanup;
-				}
-
-				struct ext2_ll_dir_entry_t* dir_entry = read_block(block, parent_handle->ext2);
-				*dir_entry = (struct ext2_ll_dir_entry_t){
-					.inode = (uint32_t)inode_index,
-					.rec_len = (uint16_t)parent_handle->ext2->block_size,
-					.name_len = (uint8_t)kstrlen(name),
-					.file_type = EXT2_FT_REG_FILE
-				};
-
-				kmemcpy(&dir_entry->name, name, dir_entry->name_len);
-
-				dir_entry = write_block(block, parent_handle->ext2, dir_entry);
-				kfree(dir_entry);
-
-				parent_inode.i_size += parent_handle->ext2->block_size;
-				set_inode(parent_handle, &parent_inode);
-				goto cleanup;
-			case BLOCK_OK:
-				parent_handle->seek_block++;
-				continue;
-			case BLOCK_ERROR:
-				sts = FILE_ERROR;
-				goto cleanup;	
-		}
+	if ((sts = dir_insert(handle, name, name_len, inode_index)) == FILE_OK) {
+		dcache_insert((const struct mount_cntx_t*)ext2, handle->inode_index, name, name_len, inode_index);
 	}
 
 cleanup:
-	ext2_reset_dir((struct file_handle_t*)inode_handle);
-
-	lock_release(&inode_handle->ext2->lock);
+	lock_release(&dir->map_lock);
+	update_end(ext2);
 
 	ext2_close((struct file_handle_t*)inode_handle);
-	ext2_close((struct file_handle_t*)parent_handle);
+	ext2_close((struct file_handle_t*)handle);
 
 	return sts;
 }
@@ -1154,17 +3634,18 @@ cleanup:
 static struct file_handle_t* ext2_open(struct mount_cntx_t* cntx, const char* path, uint32_t flags, uint32_t mode) {
 	struct ext2_t* ext2 = (struct ext2_t*)cntx;
 	struct ext2_inode_handle_t* handle;
+	const char* full_path = path;
 
 	path = reduce_path(ext2, path, &handle);
 
 	if (*path) {
 		// file not found
-		kfree(handle);
+		ext2_close((struct file_handle_t*)handle);
 
 		if (flags & FILE_FLAGS_CREATE) {
-			enum file_status_t create_sts = ext2_create(ext2, path, mode);
+			enum file_status_t create_sts = ext2_create(ext2, full_path, mode);
 			if (create_sts == FILE_OK) {
-				return ext2_open(cntx, path, flags & FILE_FLAGS_CREATE, mode);
+				return ext2_open(cntx, full_path, flags & ~(uint32_t)FILE_FLAGS_CREATE, mode);
 			}
 		}
 		return 0;
@@ -1197,6 +3678,21 @@ static size_t ext2_read(struct file_handle_t* handle, void* buffer, size_t count
 			break;
 		}
 
+		if (!inode_handle->seek) {
+			uint64_t run = read_run(inode_handle, &inode, (uint8_t*)buffer + write_seek, count, size);
+
+			if (run) {
+				read_len = run * block_size;
+
+				write_seek += read_len;
+				full_seek += read_len;
+				inode_handle->seek_block += run;
+				count -= read_len;
+				read += read_len;
+				continue;
+			}
+		}
+
 		read_len = block_size; // default full block
 
 		if (count < block_size) {
@@ -1209,7 +3705,11 @@ static size_t ext2_read(struct file_handle_t* handle, void* buffer, size_t count
 			read_len = block_size - inode_handle->seek;
 		}
 
-		switch (get_block(inode_handle->ext2, &inode, inode_handle->seek_block, &block)) {
+		if (inode_handle->seek_block != inode_handle->ra_next - 1) {
+			readahead(inode_handle, &inode, size);
+		}
+
+		switch (get_block(inode_handle, &inode, inode_handle->seek_block, &block)) {
 			case BLOCK_OK:
 				block_buffer = read_block(block, inode_handle->ext2);
 
@@ -1262,10 +3762,11 @@ static enum file_status_t ext2_seek(struct file_handle_t* handle, uint64_t seek)
 static size_t ext2_write(struct file_handle_t* handle, const void* buffer, size_t count) {
 	struct ext2_inode_t inode;
 	struct ext2_inode_handle_t* inode_handle = (struct ext2_inode_handle_t*)handle;
+	struct ext2_incore_t* incore;
 	uint8_t* block_buffer = 0;
 	uint64_t block;
 
-	if (!inode_handle || get_inode(inode_handle, &inode)) {
+	if (!inode_handle || inode_handle->ext2->read_only || get_inode(inode_handle, &inode)) {
 		return 0;
 	}
 
@@ -1279,6 +3780,23 @@ static size_t ext2_write(struct file_handle_t* handle, const void* buffer, size_
 
 
 	while (count) {
+		if (!inode_handle->seek && count >= block_size) {
+			uint64_t run = write_run(inode_handle, &inode, (const uint8_t*)buffer + read_seek, count);
+
+			if (!run) {
+				goto update_inode;
+			}
+
+			write_len = run * block_size;
+
+			read_seek += write_len;
+			full_seek += write_len;
+			inode_handle->seek_block += run;
+			count -= write_len;
+			written += write_len;
+			continue;
+		}
+
 		write_len = block_size; // default full block
 
 		if (count < block_size) {
@@ -1291,15 +3809,27 @@ static size_t ext2_write(struct file_handle_t* handle, const void* buffer, size_
 			write_len = block_size - inode_handle->seek;
 		}
 
-		switch (get_block(inode_handle->ext2, &inode, inode_handle->seek_block, &block)) {
+		switch (get_block(inode_handle, &inode, inode_handle->seek_block, &block)) {
 			case BLOCK_SPARSE:
-				block = assign_block(inode_handle, inode_handle->seek_block, &inode, 0);
+				// fresh block, build it in memory and write it once instead of zeroing it first
+				block = assign_block_to(inode_handle, inode_handle->seek_block, &inode, 0, 0, 0);
 
 				if (!block) {
 					goto update_inode;
 				}
 
-				__attribute__((fallthrough));
+				block_buffer = kmalloc(block_size);
+				kmemset(block_buffer, 0, block_size);
+				kmemcpy(block_buffer + inode_handle->seek, (const uint8_t*)buffer + read_seek, write_len);
+
+				block_buffer = write_block(block, inode_handle->ext2, block_buffer);
+
+				if (!block_buffer) {
+					goto update_inode;
+				}
+
+				kfree(block_buffer);
+				break;
 			case BLOCK_OK:
 				block_buffer = read_block(block, inode_handle->ext2);
 
@@ -1334,11 +3864,22 @@ static size_t ext2_write(struct file_handle_t* handle, const void* buffer, size_
 	}
 
 update_inode:
-	if (full_seek > size) {
-		inode.i_size = (uint32_t)full_seek;
-		inode.i_dir_acl = (uint32_t)(full_seek >> 32);
+	if (full_seek > size && (incore = handle_inode(inode_handle))) {
+		// another handle may have mapped blocks meanwhile, so only the size comes from this copy
+		lock_acquire(&incore->map_lock);
+		if (!get_inode(inode_handle, &inode) && full_seek > ((uint64_t)inode.i_size | ((uint64_t)inode.i_dir_acl << 32))) {
+			inode.i_size = (uint32_t)full_seek;
+			inode.i_dir_acl = (uint32_t)(full_seek >> 32);
+
+			set_inode(inode_handle, &inode);
+		}
+		lock_release(&incore->map_lock);
 
-		set_inode(inode_handle, &inode);
+		if (full_seek > INT32_MAX && !(inode_handle->ext2->superblock->s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE)) {
+			// older drivers would take i_dir_acl for a directory acl
+			inode_handle->ext2->superblock->s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+			__atomic_store_n(&inode_handle->ext2->meta_dirty, 1, __ATOMIC_RELEASE);
+		}
 	}
 
 	return written;
@@ -1380,10 +3921,132 @@ static enum file_status_t ext2_unlink(struct file_handle_t* handle) {
 	return FILE_NO_SUPPORT;
 }
 
+static uint64_t ext2_cache_ino(struct file_handle_t* handle) {
+	struct ext2_inode_t inode;
+	struct ext2_inode_handle_t* inode_handle = (struct ext2_inode_handle_t*)handle;
+
+	// directories are rewritten in place by the driver, so only regular file data is cached
+	if (!inode_handle || get_inode(inode_handle, &inode) || (inode.i_mode & EXT2_S_IFMT) != EXT2_S_IFREG) {
+		return 0;
+	}
+
+	return inode_handle->inode_index;
+}
+
+static const struct fs_ops_t ext2_ops = {
+	.open = ext2_open,
+	.close = ext2_close,
+	.stat = ext2_stat,
+	.read = ext2_read,
+	.get_seek = ext2_get_seek,
+	.seek = ext2_seek,
+	.write = ext2_write,
+	.delete_final = ext2_delete_final,
+	.open_dir = ext2_open_dir,
+	.read_dir = ext2_read_dir,
+	.create_dir = ext2_create_dir,
+	.delete_dir = ext2_delete_dir,
+	.truncate = ext2_truncate,
+	.link = ext2_link,
+	.unlink = ext2_unlink,
+	.cache_ino = ext2_cache_ino,
+	.read_dirs = ext2_read_dirs
+};
+
+/* /mnt/<label> for volumes other than the root, numbered if unlabelled */
+static void mount_point(const struct ext2_superblock_t* superblock, char* path) {
+	static uint64_t unlabelled = 0;
+	char digits[20];
+	uint64_t len = sizeof(MOUNT_PREFIX) - 1, n, i;
+
+	kmemcpy(path, MOUNT_PREFIX, len);
+
+	for (i = 0; i < sizeof(superblock->s_volume_name) && superblock->s_volume_name[i]; i++) {
+		// a label is one path component
+		path[len++] = superblock->s_volume_name[i] == '/' ? '_' : (char)superblock->s_volume_name[i];
+	}
+
+	if (!i) {
+		kmemcpy(path + len, MOUNT_UNLABELLED, sizeof(MOUNT_UNLABELLED) - 1);
+		len += sizeof(MOUNT_UNLABELLED) - 1;
+
+		n = __atomic_fetch_add(&unlabelled, 1, __ATOMIC_RELAXED);
+		i = 0;
+		do {
+			digits[i++] = (char)('0' + n % 10);
+			n /= 10;
+		} while (n);
+
+		while (i) {
+			path[len++] = digits[--i];
+		}
+	}
+
+	path[len] = 0;
+}
+
+/* load the journal straight from disk, before anything it may replay is cached */
+static void journal_open(struct ext2_t* ext2) {
+	struct ext2_superblock_t* superblock = ext2->superblock;
+	const uint64_t block_size = ext2->block_size;
+	const uint64_t inode_index = superblock->s_journal_inum;
+	struct ext2_inode_t inode;
+	uint32_t i_block[15];
+	uint8_t replayed;
+
+	if (!(superblock->s_feature_compat & EXT2_FEATURE_COMPAT_HAS_JOURNAL)) {
+		return;
+	}
+
+	if (!inode_index || superblock->s_journal_dev) {
+		logging_log_error("External ext2 journals are not supported");
+		return;
+	}
+
+	const uint64_t lcl_inode_off = (inode_index - 1) % superblock->s_inodes_per_group * superblock->s_inode_size;
+	const uint64_t inode_table_block = bg_desc(ext2, (inode_index - 1) / superblock->s_inodes_per_group)->bg_inode_table
+		+ lcl_inode_off / block_size;
+	void* buffer = kmalloc(block_size);
+
+	if (disk_read(ext2->disk, buffer, ext2->start_lba + inode_table_block * block_size / SECTOR_SIZE,
+				(uint32_t)(block_size / SECTOR_SIZE)) != DISK_OK) {
+		logging_log_error("Failed to read ext2 journal inode");
+		kfree(buffer);
+		return;
+	}
+
+	inode = *(struct ext2_inode_t*)((uint64_t)buffer + lcl_inode_off % block_size);
+	kmemcpy(i_block, inode.i_block, sizeof(i_block));
+	kfree(buffer);
+
+	ext2->journal = ext2_journal_load(ext2->disk, ext2->start_lba, block_size, i_block,
+			(inode.i_flags & EXT4_EXTENTS_FL) != 0, inode.i_size, &replayed);
+	if (!ext2->journal) {
+		logging_log_error("Failed to load ext2 journal, metadata is written in place");
+		return;
+	}
+
+	if (replayed) {
+		// the log may have carried newer copies of both
+		disk_read(ext2->disk, superblock, ext2->start_lba + SUPERBLOCK_LBA, SUPERBLOCK_SECTORS);
+		disk_read(ext2->disk, ext2->bgdt, ext2->bgdt_lba, ext2->bgdt_sectors);
+	}
+
+	if (ext2->read_only) {
+		return;
+	}
+
+	// other drivers must look at the log before trusting the filesystem
+	superblock->s_feature_incompat |= EXT2_FEATURE_INCOMPAT_RECOVER;
+	disk_write(ext2->disk, superblock, ext2->start_lba + SUPERBLOCK_LBA, SUPERBLOCK_SECTORS);
+}
+
 uint8_t ext2_attempt_init(struct disk_t* disk, uint64_t start_lba, uint64_t end_lba) {
 	struct ext2_superblock_t* superblock = kmalloc(sizeof(struct ext2_superblock_t));
 	struct ext2_bg_desc_t* bgdt;
-	uint64_t bgdt_size, adj, bgdt_start_lba;
+	uint64_t bgdt_size, adj, bgdt_start_lba, num_groups, desc_size = EXT2_MIN_DESC_SIZE;
+	uint32_t unsupported;
+	char mount_path[MOUNT_PATH_MAX];
 
 	if (disk_read(disk, superblock, start_lba + SUPERBLOCK_LBA, SUPERBLOCK_SECTORS) != DISK_OK) {
 		logging_log_error("Failed to read disk %lu @ %u/%u", disk_get_id(disk), SUPERBLOCK_LBA, SUPERBLOCK_SECTORS);
@@ -1396,16 +4059,37 @@ uint8_t ext2_attempt_init(struct disk_t* disk, uint64_t start_lba, uint64_t end_
 		return 0;
 	}
 
-	bgdt_start_lba = start_lba + (1u << (1 + superblock->s_log_block_size));
+	if ((unsupported = superblock->s_feature_incompat & ~(uint32_t)EXT2_FEATURE_INCOMPAT_SUPP)) {
+		logging_log_error("Unsupported ext2 features 0x%x on %16.16s", unsupported, superblock->s_volume_name);
+		kfree(superblock);
+		return 0;
+	}
+
+	if (superblock->s_feature_incompat & EXT2_FEATURE_INCOMPAT_64BIT) {
+		desc_size = superblock->s_desc_size;
+
+		if (superblock->s_blocks_count_hi || desc_size < EXT2_MIN_DESC_SIZE || desc_size > EXT2_MAX_DESC_SIZE
+				|| desc_size & (desc_size - 1)) {
+			logging_log_error("Unsupported 64bit ext2 layout on %16.16s", superblock->s_volume_name);
+			kfree(superblock);
+			return 0;
+		}
+	}
+
+	// bgdt is in the block after the superblock
+	bgdt_start_lba = start_lba + ((uint64_t)superblock->s_first_data_block + 1) * (1024u << superblock->s_log_block_size) / SECTOR_SIZE;
 
-	bgdt_size = (1 + superblock->s_blocks_count / superblock->s_blocks_per_group) * sizeof(struct ext2_bg_desc_t);
-	adj = bgdt_size % SECTOR_SIZE;
+	num_groups = (superblock->s_blocks_count - superblock->s_first_data_block + superblock->s_blocks_per_group - 1)
+		/ superblock->s_blocks_per_group;
+	// whole blocks, so the table can be logged as is
+	bgdt_size = num_groups * desc_size;
+	adj = bgdt_size % (1024u << superblock->s_log_block_size);
 	if (adj) {
-		bgdt_size += SECTOR_SIZE - adj;
+		bgdt_size += (1024u << superblock->s_log_block_size) - adj;
 	}
 
 	bgdt = kmalloc(bgdt_size);
-	if (disk_read(disk, bgdt, bgdt_start_lba, (uint16_t)(bgdt_size / SECTOR_SIZE)) != DISK_OK) {
+	if (disk_read(disk, bgdt, bgdt_start_lba, (uint32_t)(bgdt_size / SECTOR_SIZE)) != DISK_OK) {
 		logging_log_error("Failed to read disk %lu @ %u/%u", disk_get_id(disk), SUPERBLOCK_LBA, SUPERBLOCK_SECTORS);
 		kfree(superblock);
 		kfree(bgdt);
@@ -1419,42 +4103,74 @@ uint8_t ext2_attempt_init(struct disk_t* disk, uint64_t start_lba, uint64_t end_
 	ext2->end_lba = end_lba;
 	ext2->superblock = superblock;
 	ext2->bgdt = bgdt;
+	ext2->desc_size = desc_size;
+	ext2->num_groups = num_groups;
+	ext2->groups = kmalloc(num_groups * sizeof(struct ext2_group_t));
+	kmemset(ext2->groups, 0, num_groups * sizeof(struct ext2_group_t));
+	for (uint64_t i = 0; i < num_groups; i++) {
+		lock_init(&ext2->groups[i].lock);
+		lock_init(&ext2->groups[i].itable_lock);
+	}
+	ext2->bgdt_lba = bgdt_start_lba;
+	ext2->bgdt_sectors = (uint32_t)(bgdt_size / SECTOR_SIZE);
+	ext2->meta_dirty = 0;
+	ext2->rsv_head = 0;
+	lock_init(&ext2->rsv_lock);
 	ext2->disk = disk;
 	ext2->block_size = 1024u << superblock->s_log_block_size;
+	ext2->bcache = ext2_bcache_alloc(disk, start_lba, ext2->block_size);
+	ext2->icache = hash_table_alloc(ICACHE_BUCKETS);
+	ext2->icache_head = 0;
+	ext2->icache_tail = 0;
+	ext2->icache_unused = 0;
+	lock_init(&ext2->icache_lock);
+	ext2->dindex = hash_table_alloc(DINDEX_BUCKETS);
+	ext2->dindex_names = 0;
+	ext2->dir_gen = 0;
+	lock_init(&ext2->dindex_lock);
 	lock_init(&ext2->lock);
+	ext2->journal = 0;
+	ext2->updates = 0;
+
+	// metadata checksums and the like would go stale on the first write
+	ext2->read_only = 0;
+	if ((unsupported = superblock->s_feature_ro_compat & ~(uint32_t)EXT2_FEATURE_RO_COMPAT_SUPP)) {
+		logging_log_warning("Mounting ext2 filesystem %16.16s read-only, unsupported features 0x%x",
+				superblock->s_volume_name, unsupported);
+		ext2->read_only = 1;
+	}
+
+	journal_open(ext2);
+
+	ext2->free_blocks = superblock->s_free_blocks_count;
+	ext2->free_inodes = superblock->s_free_inodes_count;
 
 	logging_log_debug("ext2 blocks: 0x%x x 0x%x (0x%lX)",
 			1024u << superblock->s_log_block_size, superblock->s_blocks_count,
 			(uint64_t)(1024u << superblock->s_log_block_size) * (uint64_t)superblock->s_blocks_count);
 
 	if (!kmemcmp(label_rootfs, superblock->s_volume_name, sizeof(superblock->s_volume_name))) {
-		if (fs_mount(
-					"/",
-					(struct mount_cntx_t*)ext2,
-					ext2_open,
-					ext2_close,
-					ext2_stat,
-					ext2_read,
-					ext2_get_seek,
-					ext2_seek,
-					ext2_write,
-					ext2_delete_final,
-					ext2_open_dir,
-					ext2_read_dir,
-					ext2_create_dir,
-					ext2_delete_dir,
-					ext2_truncate,
-					ext2_link,
-					ext2_unlink
-					) != FILE_OK) {
+		if (fs_mount("/", (struct mount_cntx_t*)ext2, &ext2_ops) != FILE_OK) {
 			logging_log_error("Failed to mount rootfs");
 			panic(PANIC_STATE);
 		}
 
 		scheduler_schedule(process_from_func(prepare_userland, 0));
 	}
+	else {
+		mount_point(superblock, mount_path);
+
+		if (fs_mount(mount_path, (struct mount_cntx_t*)ext2, &ext2_ops) != FILE_OK) {
+			logging_log_error("Failed to mount ext2 filesystem at %s", mount_path);
+		}
+		else {
+			logging_log_info("Mounted ext2 filesystem at %s", mount_path);
+		}
+	}
 
-	//TODO: mount other volumes
+	if (!ext2->read_only) {
+		scheduler_schedule(process_from_func(ext2_flusher, ext2));
+	}
 
 	return 1;
 }
@@ -0,0 +1,207 @@
+/* htree.c - ext2 hashed directory index hash functions */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ext2/htree.h>
+
+#define HTREE_EOF				0x7FFFFFFFu
+
+#define TEA_DELTA				0x9E3779B9
+#define TEA_ROUNDS			16
+
+#define MD4_K1					0
+#define MD4_K2					013240474631u
+#define MD4_K3					015666365641u
+
+#define MD4_F(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define MD4_G(x, y, z)	(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define MD4_H(x, y, z)	((x) ^ (y) ^ (z))
+
+#define MD4_ROUND(f, a, b, c, d, x, s)	\
+	(a += f(b, c, d) + (x), a = rol32(a, s))
+
+static inline uint32_t rol32(uint32_t x, uint32_t s) {
+	return (x << s) | (x >> (32 - s));
+}
+
+static void tea_transform(uint32_t buf[4], const uint32_t in[4]) {
+	uint32_t sum = 0;
+	uint32_t b0 = buf[0], b1 = buf[1];
+	const uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+
+	for (uint32_t n = 0; n < TEA_ROUNDS; n++) {
+		sum += TEA_DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	}
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+static void half_md4_transform(uint32_t buf[4], const uint32_t in[8]) {
+	uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	MD4_ROUND(MD4_F, a, b, c, d, in[0] + MD4_K1, 3);
+	MD4_ROUND(MD4_F, d, a, b, c, in[1] + MD4_K1, 7);
+	MD4_ROUND(MD4_F, c, d, a, b, in[2] + MD4_K1, 11);
+	MD4_ROUND(MD4_F, b, c, d, a, in[3] + MD4_K1, 19);
+	MD4_ROUND(MD4_F, a, b, c, d, in[4] + MD4_K1, 3);
+	MD4_ROUND(MD4_F, d, a, b, c, in[5] + MD4_K1, 7);
+	MD4_ROUND(MD4_F, c, d, a, b, in[6] + MD4_K1, 11);
+	MD4_ROUND(MD4_F, b, c, d, a, in[7] + MD4_K1, 19);
+
+	MD4_ROUND(MD4_G, a, b, c, d, in[1] + MD4_K2, 3);
+	MD4_ROUND(MD4_G, d, a, b, c, in[3] + MD4_K2, 5);
+	MD4_ROUND(MD4_G, c, d, a, b, in[5] + MD4_K2, 9);
+	MD4_ROUND(MD4_G, b, c, d, a, in[7] + MD4_K2, 13);
+	MD4_ROUND(MD4_G, a, b, c, d, in[0] + MD4_K2, 3);
+	MD4_ROUND(MD4_G, d, a, b, c, in[2] + MD4_K2, 5);
+	MD4_ROUND(MD4_G, c, d, a, b, in[4] + MD4_K2, 9);
+	MD4_ROUND(MD4_G, b, c, d, a, in[6] + MD4_K2, 13);
+
+	MD4_ROUND(MD4_H, a, b, c, d, in[3] + MD4_K3, 3);
+	MD4_ROUND(MD4_H, d, a, b, c, in[7] + MD4_K3, 9);
+	MD4_ROUND(MD4_H, c, d, a, b, in[2] + MD4_K3, 11);
+	MD4_ROUND(MD4_H, b, c, d, a, in[6] + MD4_K3, 15);
+	MD4_ROUND(MD4_H, a, b, c, d, in[1] + MD4_K3, 3);
+	MD4_ROUND(MD4_H, d, a, b, c, in[5] + MD4_K3, 9);
+	MD4_ROUND(MD4_H, c, d, a, b, in[0] + MD4_K3, 11);
+	MD4_ROUND(MD4_H, b, c, d, a, in[4] + MD4_K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+static inline uint32_t name_char(const char* name, size_t i, uint8_t is_unsigned) {
+	if (is_unsigned) {
+		return (uint32_t)(uint8_t)name[i];
+	}
+
+	// sign extension matches filesystems created on signed char hosts
+	return (uint32_t)(int32_t)(int8_t)name[i];
+}
+
+static uint32_t legacy_hash(const char* name, size_t len, uint8_t is_unsigned) {
+	uint32_t hash, hash0 = 0x12A3FE2D, hash1 = 0x37ABE8F9;
+
+	for (size_t i = 0; i < len; i++) {
+		hash = hash1 + (hash0 ^ (name_char(name, i, is_unsigned) * 7152373));
+
+		if (hash & 0x80000000) {
+			hash -= 0x7FFFFFFF;
+		}
+
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	return hash0 << 1;
+}
+
+/* pack up to num words of the name, padded with the length */
+static void str2hashbuf(const char* name, size_t len, uint32_t* buf, uint32_t num, uint8_t is_unsigned) {
+	uint32_t pad, val;
+	size_t i;
+
+	pad = (uint32_t)len | ((uint32_t)len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > num * 4) {
+		len = num * 4;
+	}
+
+	for (i = 0; i < len; i++) {
+		val = name_char(name, i, is_unsigned) + (val << 8);
+		if (i % 4 == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+
+	if (num) {
+		*buf++ = val;
+		num--;
+	}
+
+	while (num--) {
+		*buf++ = pad;
+	}
+}
+
+uint8_t ext2_htree_hash(const char* name, size_t len, const uint32_t seed[4], uint8_t version, uint32_t* hash) {
+	uint32_t buf[4] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476};
+	uint32_t in[8];
+	uint8_t is_unsigned = 0;
+	size_t step;
+
+	if (seed[0] || seed[1] || seed[2] || seed[3]) {
+		for (uint8_t i = 0; i < 4; i++) {
+			buf[i] = seed[i];
+		}
+	}
+
+	switch (version) {
+		case EXT2_HTREE_LEGACY_UNSIGNED:
+			is_unsigned = 1;
+			[[fallthrough]];
+		case EXT2_HTREE_LEGACY:
+			*hash = legacy_hash(name, len, is_unsigned);
+			break;
+		case EXT2_HTREE_HALF_MD4_UNSIGNED:
+			is_unsigned = 1;
+			[[fallthrough]];
+		case EXT2_HTREE_HALF_MD4:
+			while (len) {
+				step = len < 32 ? len : 32;
+				str2hashbuf(name, len, in, 8, is_unsigned);
+				half_md4_transform(buf, in);
+				name += step;
+				len -= step;
+			}
+			*hash = buf[1];
+			break;
+		case EXT2_HTREE_TEA_UNSIGNED:
+			is_unsigned = 1;
+			[[fallthrough]];
+		case EXT2_HTREE_TEA:
+			while (len) {
+				step = len < 16 ? len : 16;
+				str2hashbuf(name, len, in, 4, is_unsigned);
+				tea_transform(buf, in);
+				name += step;
+				len -= step;
+			}
+			*hash = buf[0];
+			break;
+		default:
+			return 1;
+	}
+
+	*hash &= ~1u;
+	if (*hash == HTREE_EOF << 1) {
+		*hash = (HTREE_EOF - 1) << 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,899 @@
+/* journal.c - ext3 compatible metadata journal implementation */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+
+#include <ext2/journal.h>
+#include <ext2/extent.h>
+
+#include <disk/disk.h>
+
+#include <kernel/core/alloc.h>
+#include <kernel/core/lock.h>
+#include <kernel/core/logging.h>
+
+#include <kernel/lib/hash_table.h>
+#include <kernel/lib/kmemcpy.h>
+#include <kernel/lib/kmemset.h>
+
+#define JBD_MAGIC	0xC03B3998u
+
+#define JBD_DESCRIPTOR_BLOCK	1
+#define JBD_COMMIT_BLOCK			2
+#define JBD_SUPERBLOCK_V1			3
+#define JBD_SUPERBLOCK_V2			4
+#define JBD_REVOKE_BLOCK			5
+
+#define JBD_FLAG_ESCAPE			0x1
+#define JBD_FLAG_SAME_UUID	0x2
+#define JBD_FLAG_LAST_TAG		0x8
+
+#define JBD_FEATURE_INCOMPAT_REVOKE				0x01
+#define JBD_FEATURE_INCOMPAT_64BIT				0x02
+#define JBD_FEATURE_INCOMPAT_ASYNC_COMMIT	0x04
+#define JBD_FEATURE_INCOMPAT_CSUM_V2			0x08
+#define JBD_FEATURE_INCOMPAT_CSUM_V3			0x10
+
+#define JBD_FEATURE_INCOMPAT_SUPP	(JBD_FEATURE_INCOMPAT_REVOKE | JBD_FEATURE_INCOMPAT_64BIT \
+		| JBD_FEATURE_INCOMPAT_ASYNC_COMMIT | JBD_FEATURE_INCOMPAT_CSUM_V2 | JBD_FEATURE_INCOMPAT_CSUM_V3)
+
+// checksums are not generated, so these are dropped once the log is empty
+#define JBD_FEATURE_INCOMPAT_CSUM	(JBD_FEATURE_INCOMPAT_ASYNC_COMMIT \
+		| JBD_FEATURE_INCOMPAT_CSUM_V2 | JBD_FEATURE_INCOMPAT_CSUM_V3)
+#define JBD_FEATURE_COMPAT_CHECKSUM	0x01
+
+#define JBD_UUID_SIZE	16
+
+#define JOURNAL_BUCKETS		1024
+#define JOURNAL_IO_BATCH	16
+
+struct jbd_header_t {
+	uint32_t h_magic;
+	uint32_t h_blocktype;
+	uint32_t h_sequence;
+} __attribute__((packed));
+
+/* all fields big endian */
+struct jbd_superblock_t {
+	struct jbd_header_t s_header;
+	uint32_t s_blocksize;
+	uint32_t s_maxlen;
+	uint32_t s_first;
+	uint32_t s_sequence;
+	uint32_t s_start;
+	uint32_t s_errno;
+
+	/* v2 only */
+	uint32_t s_feature_compat;
+	uint32_t s_feature_incompat;
+	uint32_t s_feature_ro_compat;
+	uint8_t s_uuid[JBD_UUID_SIZE];
+	uint32_t s_nr_users;
+	uint32_t s_dynsuper;
+	uint32_t s_max_transaction;
+	uint32_t s_max_trans_data;
+	uint8_t s_checksum_type;
+	uint8_t s_padding2[3];
+	uint32_t s_num_fc_blks;
+	uint32_t s_head;
+	uint32_t s_padding[40];
+	uint32_t s_checksum;
+	uint8_t s_users[768];
+} __attribute__((packed));
+
+struct jbd_revoke_header_t {
+	struct jbd_header_t r_header;
+	uint32_t r_count;
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct jbd_superblock_t) == 1024, "Bad jbd superblock size");
+
+/* a logged copy of one metadata block */
+struct jbuf_t {
+	uint64_t block;
+	struct jtxn_t* txn;
+	struct jbuf_t* next;
+	uint8_t data[];
+};
+
+struct jtxn_t {
+	uint32_t seq;
+	uint64_t count;
+	uint64_t len;
+	struct jbuf_t* head;
+	struct jbuf_t* tail;
+	struct jtxn_t* next;
+};
+
+struct ext2_journal_t {
+	struct disk_t* disk;
+	uint64_t start_lba;
+	uint64_t block_size;
+	uint32_t* map;
+	uint64_t first;
+	uint64_t last;
+	uint64_t tag_size;
+	uint64_t tags_per_desc;
+	uint64_t max_txn;
+	struct jbd_superblock_t* sb;
+
+	// log space from the oldest committed transaction to head, commit lock held
+	uint64_t head;
+	uint64_t used;
+
+	struct jtxn_t* running;
+	struct jtxn_t* done_head;
+	struct jtxn_t* done_tail;
+	struct hash_table_t* latest;
+	uint8_t lock;
+	uint8_t commit_lock;
+};
+
+/* queued writes, physically adjacent blocks share a request */
+struct journal_io_t {
+	struct disk_request_t* req;
+	struct disk_request_t* reqs[JOURNAL_IO_BATCH];
+	uint64_t num_reqs;
+	uint64_t next_lba;
+	enum disk_prio_t prio;
+	enum disk_error_t status;
+};
+
+enum recover_pass_t {
+	PASS_SCAN,
+	PASS_REVOKE,
+	PASS_REPLAY
+};
+
+static inline uint32_t be32(uint32_t value) {
+	return __builtin_bswap32(value);
+}
+
+static inline uint16_t be16(uint16_t value) {
+	return __builtin_bswap16(value);
+}
+
+static inline uint64_t block_lba(const struct ext2_journal_t* journal, uint64_t block) {
+	return journal->start_lba + block * journal->block_size / SECTOR_SIZE;
+}
+
+static inline uint64_t log_next(const struct ext2_journal_t* journal, uint64_t pos) {
+	return pos + 1 == journal->last ? journal->first : pos + 1;
+}
+
+static uint64_t tag_bytes(uint32_t incompat) {
+	if (incompat & JBD_FEATURE_INCOMPAT_CSUM_V3) {
+		return 16;
+	}
+
+	uint64_t size = incompat & JBD_FEATURE_INCOMPAT_CSUM_V2 ? 14 : 12;
+	return incompat & JBD_FEATURE_INCOMPAT_64BIT ? size : size - 4;
+}
+
+static inline uint32_t incompat_features(const struct jbd_superblock_t* sb) {
+	return be32(sb->s_header.h_blocktype) == JBD_SUPERBLOCK_V2 ? be32(sb->s_feature_incompat) : 0;
+}
+
+static enum disk_error_t read_log(struct ext2_journal_t* journal, uint64_t pos, void* buffer) {
+	return disk_read(journal->disk, buffer, block_lba(journal, journal->map[pos]),
+			(uint32_t)(journal->block_size / SECTOR_SIZE));
+}
+
+static void io_wait(struct journal_io_t* io) {
+	for (uint64_t i = 0; i < io->num_reqs; i++) {
+		if (disk_request_wait(io->reqs[i]) != DISK_OK) {
+			io->status = DISK_ERROR;
+		}
+
+		disk_request_free(io->reqs[i]);
+	}
+
+	io->num_reqs = 0;
+}
+
+static void io_submit(struct ext2_journal_t* journal, struct journal_io_t* io) {
+	if (!io->req) {
+		return;
+	}
+
+	disk_submit(journal->disk, io->req);
+	io->reqs[io->num_reqs++] = io->req;
+	io->req = 0;
+
+	if (io->num_reqs == JOURNAL_IO_BATCH) {
+		io_wait(io);
+	}
+}
+
+/* buffer must stay valid until io_finish */
+static void io_block(struct ext2_journal_t* journal, struct journal_io_t* io, uint64_t block, void* buffer) {
+	const uint64_t lba = block_lba(journal, block);
+	const uint64_t sectors = journal->block_size / SECTOR_SIZE;
+
+	if (io->req && lba == io->next_lba && disk_request_add(io->req, buffer, sectors) == DISK_OK) {
+		io->next_lba += sectors;
+		return;
+	}
+
+	io_submit(journal, io);
+
+	io->req = disk_request_alloc(DISK_OP_WRITE, lba, 0, 0);
+	disk_request_set_prio(io->req, io->prio);
+	disk_request_add(io->req, buffer, sectors);
+	io->next_lba = lba + sectors;
+}
+
+static enum disk_error_t io_finish(struct ext2_journal_t* journal, struct journal_io_t* io) {
+	io_submit(journal, io);
+	io_wait(io);
+
+	return io->status;
+}
+
+static inline void io_init(struct journal_io_t* io, enum disk_prio_t prio) {
+	io->req = 0;
+	io->num_reqs = 0;
+	io->next_lba = 0;
+	io->prio = prio;
+	io->status = DISK_OK;
+}
+
+static struct jtxn_t* txn_alloc(uint32_t seq) {
+	struct jtxn_t* txn = kmalloc(sizeof(struct jtxn_t));
+
+	txn->seq = seq;
+	txn->count = 0;
+	txn->len = 0;
+	txn->head = 0;
+	txn->tail = 0;
+	txn->next = 0;
+
+	return txn;
+}
+
+/* walk one i_block pointer of the journal inode down to its data blocks */
+static uint8_t map_blocks(struct ext2_journal_t* journal, uint32_t block, uint64_t depth, uint64_t* pos, uint64_t count) {
+	uint32_t* buffer;
+	uint8_t status = 0;
+
+	if (!block) {
+		return 1;  // the log can not have holes
+	}
+
+	if (!depth) {
+		journal->map[(*pos)++] = block;
+		return 0;
+	}
+
+	buffer = kmalloc(journal->block_size);
+	if (disk_read(journal->disk, buffer, block_lba(journal, block), (uint32_t)(journal->block_size / SECTOR_SIZE)) != DISK_OK) {
+		kfree(buffer);
+		return 1;
+	}
+
+	for (uint64_t i = 0; i < journal->block_size / sizeof(uint32_t) && *pos < count && !status; i++) {
+		status = map_blocks(journal, buffer[i], depth - 1, pos, count);
+	}
+
+	kfree(buffer);
+	return status;
+}
+
+/* walk an extent tree node of the journal inode down to its data blocks */
+static uint8_t map_extents(struct ext2_journal_t* journal, const struct ext2_extent_header_t* header, uint64_t* pos, uint64_t count) {
+	const struct ext2_extent_t* extents = (const struct ext2_extent_t*)(header + 1);
+	const struct ext2_extent_idx_t* idx = (const struct ext2_extent_idx_t*)(header + 1);
+	struct ext2_extent_header_t* child;
+	uint64_t start;
+	uint8_t status = 0;
+
+	if (header->eh_magic != EXT4_EXT_MAGIC || header->eh_depth > EXT4_EXT_MAX_DEPTH) {
+		return 1;
+	}
+
+	for (uint64_t i = 0; i < header->eh_entries && *pos < count && !status; i++) {
+		if (!header->eh_depth) {
+			// the log can not have holes or unwritten blocks
+			if (extents[i].ee_block != *pos || extents[i].ee_len > EXT4_EXT_INIT_MAX_LEN) {
+				return 1;
+			}
+
+			start = extents[i].ee_start_lo | (uint64_t)extents[i].ee_start_hi << 32;
+			for (uint64_t j = 0; j < extents[i].ee_len && *pos < count; j++) {
+				journal->map[(*pos)++] = (uint32_t)(start + j);
+			}
+			continue;
+		}
+
+		start = idx[i].ei_leaf_lo | (uint64_t)idx[i].ei_leaf_hi << 32;
+		child = kmalloc(journal->block_size);
+		if (disk_read(journal->disk, child, block_lba(journal, start), (uint32_t)(journal->block_size / SECTOR_SIZE)) != DISK_OK
+				|| child->eh_depth + 1u != header->eh_depth) {
+			status = 1;
+		}
+		else {
+			status = map_extents(journal, child, pos, count);
+		}
+		kfree(child);
+	}
+
+	return status;
+}
+
+static uint8_t is_revoked(struct hash_table_t* revoked, uint64_t block, uint32_t seq) {
+	void* out;
+
+	return hash_table_get(revoked, block, &out) && (int32_t)((uint32_t)(uint64_t)out - seq) >= 0;
+}
+
+static void revoke_records(struct ext2_journal_t* journal, const void* buffer, uint32_t seq, struct hash_table_t* revoked) {
+	const struct jbd_revoke_header_t* header = buffer;
+	const uint64_t record = incompat_features(journal->sb) & JBD_FEATURE_INCOMPAT_64BIT ? 8 : 4;
+	uint64_t end = be32(header->r_count);
+	const uint8_t* data = buffer;
+	uint64_t block;
+	void* out;
+
+	if (end > journal->block_size) {
+		end = journal->block_size;
+	}
+
+	for (uint64_t off = sizeof(struct jbd_revoke_header_t); off + record <= end; off += record) {
+		block = be32(*(const uint32_t*)(data + off));
+		if (record == 8) {
+			block = block << 32 | be32(*(const uint32_t*)(data + off + 4));
+		}
+
+		// keep the newest revoke of each block
+		if (!hash_table_get(revoked, block, &out) || (int32_t)(seq - (uint32_t)(uint64_t)out) > 0) {
+			hash_table_insert(revoked, block, (void*)(uint64_t)seq);
+		}
+	}
+}
+
+/* one pass over the log from its tail, the scan pass finds the end of the last complete transaction */
+static uint8_t recover_pass(struct ext2_journal_t* journal, enum recover_pass_t pass, uint32_t* end_seq,
+		struct hash_table_t* revoked) {
+	const uint32_t incompat = incompat_features(journal->sb);
+	const uint64_t tag_size = tag_bytes(incompat);
+	const uint64_t tag_end = journal->block_size - (incompat & (JBD_FEATURE_INCOMPAT_CSUM_V2 | JBD_FEATURE_INCOMPAT_CSUM_V3) ? 4 : 0);
+	uint32_t seq = be32(journal->sb->s_sequence);
+	uint64_t pos = be32(journal->sb->s_start);
+	uint8_t* buffer = kmalloc(journal->block_size);
+	uint32_t* data = kmalloc(journal->block_size);
+	const struct jbd_header_t* header = (const struct jbd_header_t*)buffer;
+	uint64_t off, block;
+	uint16_t flags;
+	uint8_t status = 0;
+
+	while (pass == PASS_SCAN || seq != *end_seq) {
+		if (read_log(journal, pos, buffer) != DISK_OK) {
+			status = 1;
+			break;
+		}
+
+		pos = log_next(journal, pos);
+
+		if (header->h_magic != be32(JBD_MAGIC) || be32(header->h_sequence) != seq) {
+			break;
+		}
+
+		switch (be32(header->h_blocktype)) {
+			case JBD_DESCRIPTOR_BLOCK:
+				off = sizeof(struct jbd_header_t);
+				do {
+					if (off + tag_size > tag_end) {
+						break;
+					}
+
+					block = be32(*(uint32_t*)(buffer + off));
+					if (incompat & JBD_FEATURE_INCOMPAT_64BIT) {
+						block |= (uint64_t)be32(*(uint32_t*)(buffer + off + 8)) << 32;
+					}
+					flags = be16(*(uint16_t*)(buffer + off + 6));
+
+					if (pass == PASS_REPLAY && !is_revoked(revoked, block, seq)) {
+						if (read_log(journal, pos, data) != DISK_OK) {
+							status = 1;
+						}
+						else {
+							if (flags & JBD_FLAG_ESCAPE) {
+								data[0] = be32(JBD_MAGIC);
+							}
+
+							if (disk_write(journal->disk, data, block_lba(journal, block),
+										(uint32_t)(journal->block_size / SECTOR_SIZE)) != DISK_OK) {
+								status = 1;
+							}
+						}
+					}
+
+					pos = log_next(journal, pos);
+					off += tag_size + (flags & JBD_FLAG_SAME_UUID ? 0 : JBD_UUID_SIZE);
+				} while (!(flags & JBD_FLAG_LAST_TAG));
+				continue;
+			case JBD_COMMIT_BLOCK:
+				seq++;
+				continue;
+			case JBD_REVOKE_BLOCK:
+				if (pass == PASS_REVOKE) {
+					revoke_records(journal, buffer, seq, revoked);
+				}
+				continue;
+			default:
+				break;
+		}
+
+		break;
+	}
+
+	if (pass == PASS_SCAN) {
+		*end_seq = seq;
+	}
+
+	kfree(buffer);
+	kfree(data);
+	return status;
+}
+
+static uint8_t write_super(struct ext2_journal_t* journal) {
+	return disk_write(journal->disk, journal->sb, block_lba(journal, journal->map[0]),
+			(uint32_t)(journal->block_size / SECTOR_SIZE)) != DISK_OK;
+}
+
+static uint8_t recover(struct ext2_journal_t* journal, uint8_t* replayed) {
+	const uint32_t start_seq = be32(journal->sb->s_sequence);
+	struct hash_table_t* revoked;
+	uint32_t end_seq = start_seq;
+	uint8_t status;
+
+	*replayed = 0;
+
+	if (!journal->sb->s_start) {
+		return 0;
+	}
+
+	revoked = hash_table_alloc(JOURNAL_BUCKETS);
+	status = recover_pass(journal, PASS_SCAN, &end_seq, revoked)
+		|| recover_pass(journal, PASS_REVOKE, &end_seq, revoked)
+		|| recover_pass(journal, PASS_REPLAY, &end_seq, revoked);
+	hash_table_free(revoked, 0);
+
+	if (status) {
+		logging_log_error("Failed to replay ext2 journal");
+		return 1;
+	}
+
+	logging_log_info("Replayed ext2 journal transactions %u-%u", start_seq, end_seq - 1);
+
+	if (disk_flush(journal->disk) != DISK_OK) {
+		return 1;
+	}
+
+	// skip a sequence number so stale blocks past the end never look valid
+	journal->sb->s_sequence = be32(end_seq + 1);
+	journal->sb->s_start = 0;
+	*replayed = end_seq != start_seq;
+
+	return write_super(journal);
+}
+
+struct ext2_journal_t* ext2_journal_load(struct disk_t* disk, uint64_t start_lba, uint64_t block_size,
+		const uint32_t* i_block, uint8_t extents, uint64_t size, uint8_t* replayed) {
+	struct ext2_journal_t* journal = kmalloc(sizeof(struct ext2_journal_t));
+	const uint64_t count = size / block_size;
+	uint64_t pos = 0;
+	uint32_t incompat;
+
+	journal->disk = disk;
+	journal->start_lba = start_lba;
+	journal->block_size = block_size;
+	journal->map = kmalloc(count * sizeof(uint32_t));
+	journal->sb = 0;
+
+	if (extents) {
+		if (map_extents(journal, (const struct ext2_extent_header_t*)i_block, &pos, count) || pos < count) {
+			logging_log_error("Bad ext2 journal extent tree");
+			goto fail;
+		}
+	}
+
+	for (uint64_t i = 0; !extents && i < 15 && pos < count; i++) {
+		// direct blocks, then one, two and three levels of indirection
+		if (map_blocks(journal, i_block[i], i < 12 ? 0 : i - 11, &pos, count)) {
+			logging_log_error("Bad ext2 journal block map");
+			goto fail;
+		}
+	}
+
+	journal->sb = kmalloc(block_size);
+	if (!count || read_log(journal, 0, journal->sb) != DISK_OK) {
+		goto fail;
+	}
+
+	if (journal->sb->s_header.h_magic != be32(JBD_MAGIC)
+			|| (be32(journal->sb->s_header.h_blocktype) != JBD_SUPERBLOCK_V1
+				&& be32(journal->sb->s_header.h_blocktype) != JBD_SUPERBLOCK_V2)
+			|| be32(journal->sb->s_blocksize) != block_size
+			|| be32(journal->sb->s_maxlen) > count
+			|| !journal->sb->s_first
+			|| be32(journal->sb->s_first) >= be32(journal->sb->s_maxlen)) {
+		logging_log_error("Bad ext2 journal superblock");
+		goto fail;
+	}
+
+	incompat = incompat_features(journal->sb);
+	if (incompat & ~(uint32_t)JBD_FEATURE_INCOMPAT_SUPP) {
+		logging_log_error("Unsupported ext2 journal features 0x%x", incompat & ~(uint32_t)JBD_FEATURE_INCOMPAT_SUPP);
+		goto fail;
+	}
+
+	journal->first = be32(journal->sb->s_first);
+	journal->last = be32(journal->sb->s_maxlen);
+
+	if (recover(journal, replayed)) {
+		goto fail;
+	}
+
+	if (be32(journal->sb->s_header.h_blocktype) == JBD_SUPERBLOCK_V2
+			&& (incompat & JBD_FEATURE_INCOMPAT_CSUM || be32(journal->sb->s_feature_compat) & JBD_FEATURE_COMPAT_CHECKSUM)) {
+		journal->sb->s_feature_incompat = be32(incompat & ~(uint32_t)JBD_FEATURE_INCOMPAT_CSUM);
+		journal->sb->s_feature_compat = be32(be32(journal->sb->s_feature_compat) & ~(uint32_t)JBD_FEATURE_COMPAT_CHECKSUM);
+		journal->sb->s_checksum_type = 0;
+		journal->sb->s_checksum = 0;
+
+		if (write_super(journal)) {
+			goto fail;
+		}
+	}
+
+	journal->tag_size = tag_bytes(incompat_features(journal->sb));
+	journal->tags_per_desc = (block_size - sizeof(struct jbd_header_t) - JBD_UUID_SIZE) / journal->tag_size;
+	journal->max_txn = (journal->last - journal->first) / 4;
+	journal->head = journal->first;
+	journal->used = 0;
+	journal->running = txn_alloc(be32(journal->sb->s_sequence));
+	journal->done_head = 0;
+	journal->done_tail = 0;
+	journal->latest = hash_table_alloc(JOURNAL_BUCKETS);
+	lock_init(&journal->lock);
+	lock_init(&journal->commit_lock);
+
+	return journal;
+
+fail:
+	kfree(journal->map);
+	if (journal->sb) {
+		kfree(journal->sb);
+	}
+	kfree(journal);
+	return 0;
+}
+
+uint8_t ext2_journal_read(struct ext2_journal_t* journal, uint64_t block, void* buffer) {
+	void* out;
+	uint8_t hit;
+
+	lock_acquire(&journal->lock);
+	if ((hit = hash_table_get(journal->latest, block, &out))) {
+		kmemcpy(buffer, ((struct jbuf_t*)out)->data, journal->block_size);
+	}
+	lock_release(&journal->lock);
+
+	return hit;
+}
+
+void ext2_journal_write(struct ext2_journal_t* journal, uint64_t block, const void* buffer) {
+	struct jtxn_t* txn;
+	struct jbuf_t* buf;
+	void* out;
+
+	lock_acquire(&journal->lock);
+	txn = journal->running;
+
+	// a block logged twice in one transaction is only written once
+	if (hash_table_get(journal->latest, block, &out) && ((struct jbuf_t*)out)->txn == txn) {
+		kmemcpy(((struct jbuf_t*)out)->data, buffer, journal->block_size);
+		lock_release(&journal->lock);
+		return;
+	}
+
+	buf = kmalloc(sizeof(struct jbuf_t) + journal->block_size);
+	buf->block = block;
+	buf->txn = txn;
+	buf->next = 0;
+	kmemcpy(buf->data, buffer, journal->block_size);
+
+	if (txn->tail) {
+		txn->tail->next = buf;
+	}
+	else {
+		txn->head = buf;
+	}
+	txn->tail = buf;
+	txn->count++;
+
+	hash_table_insert(journal->latest, block, buf);
+	lock_release(&journal->lock);
+}
+
+uint8_t ext2_journal_full(struct ext2_journal_t* journal) {
+	uint8_t full;
+
+	lock_acquire(&journal->lock);
+	full = journal->running->count >= journal->max_txn;
+	lock_release(&journal->lock);
+
+	return full;
+}
+
+static void block_sort(struct jbuf_t** bufs, uint64_t count) {
+	struct jbuf_t* buf;
+	uint64_t gap, i, j;
+
+	// shell sort by block, older transactions first for equal blocks
+	for (gap = count / 2; gap; gap /= 2) {
+		for (i = gap; i < count; i++) {
+			buf = bufs[i];
+			for (j = i; j >= gap && (bufs[j - gap]->block > buf->block
+						|| (bufs[j - gap]->block == buf->block && (int32_t)(bufs[j - gap]->txn->seq - buf->txn->seq) > 0)); j -= gap) {
+				bufs[j] = bufs[j - gap];
+			}
+			bufs[j] = buf;
+		}
+	}
+}
+
+/* write every committed transaction in place in block order, then empty the log, commit lock held */
+static void checkpoint_locked(struct ext2_journal_t* journal, enum disk_prio_t prio) {
+	struct journal_io_t io;
+	struct jtxn_t* txns;
+	struct jtxn_t* txn;
+	struct jbuf_t** bufs;
+	struct jbuf_t* buf;
+	uint64_t count = 0, i;
+	void* out;
+
+	lock_acquire(&journal->lock);
+	txns = journal->done_head;
+	journal->done_head = 0;
+	journal->done_tail = 0;
+	lock_release(&journal->lock);
+
+	if (!txns) {
+		return;
+	}
+
+	for (txn = txns; txn; txn = txn->next) {
+		count += txn->count;
+	}
+
+	bufs = kmalloc(count * sizeof(struct jbuf_t*));
+	count = 0;
+	for (txn = txns; txn; txn = txn->next) {
+		for (buf = txn->head; buf; buf = buf->next) {
+			bufs[count++] = buf;
+		}
+	}
+
+	block_sort(bufs, count);
+
+	// only the newest committed image of each block needs to reach its home location
+	io_init(&io, prio);
+	for (i = 0; i < count; i++) {
+		if (i + 1 == count || bufs[i + 1]->block != bufs[i]->block) {
+			io_block(journal, &io, bufs[i]->block, bufs[i]->data);
+		}
+	}
+
+	if (io_finish(journal, &io) != DISK_OK || disk_flush(journal->disk) != DISK_OK) {
+		logging_log_error("Failed to checkpoint ext2 journal");
+	}
+	else {
+		lock_acquire(&journal->lock);
+		journal->sb->s_sequence = be32(journal->running->seq);
+		lock_release(&journal->lock);
+
+		journal->sb->s_start = 0;
+		write_super(journal);
+		journal->used = 0;
+	}
+
+	lock_acquire(&journal->lock);
+	for (i = 0; i < count; i++) {
+		if (hash_table_get(journal->latest, bufs[i]->block, &out) && out == bufs[i]) {
+			hash_table_remove(journal->latest, bufs[i]->block, &out);
+		}
+	}
+	lock_release(&journal->lock);
+
+	for (i = 0; i < count; i++) {
+		kfree(bufs[i]);
+	}
+	kfree(bufs);
+
+	while (txns) {
+		txn = txns->next;
+		kfree(txns);
+		txns = txn;
+	}
+}
+
+static void header_init(void* buffer, uint32_t type, uint32_t seq, uint64_t block_size) {
+	struct jbd_header_t* header = buffer;
+
+	kmemset(buffer, 0, block_size);
+	header->h_magic = be32(JBD_MAGIC);
+	header->h_blocktype = be32(type);
+	header->h_sequence = be32(seq);
+}
+
+/* lay out descriptor and data blocks from head, returns the log position after them */
+static uint64_t write_txn(struct ext2_journal_t* journal, struct journal_io_t* io, struct jtxn_t* txn,
+		void** scratch, uint64_t* num_scratch) {
+	const uint64_t block_size = journal->block_size;
+	struct jbuf_t* buf = txn->head;
+	struct jbuf_t* first;
+	uint64_t pos = journal->head;
+	uint64_t off, i;
+	uint8_t* desc;
+	uint8_t* data;
+	uint16_t flags;
+
+	while (buf) {
+		desc = kmalloc(block_size);
+		header_init(desc, JBD_DESCRIPTOR_BLOCK, txn->seq, block_size);
+		scratch[(*num_scratch)++] = desc;
+
+		// the descriptor is complete before it is queued, a request may go out as soon as it is full
+		first = buf;
+		off = sizeof(struct jbd_header_t);
+		for (i = 0; buf && i < journal->tags_per_desc; i++, buf = buf->next) {
+			flags = i ? JBD_FLAG_SAME_UUID : 0;
+
+			if (*(uint32_t*)buf->data == be32(JBD_MAGIC)) {
+				flags |= JBD_FLAG_ESCAPE;
+			}
+
+			if (!buf->next || i + 1 == journal->tags_per_desc) {
+				flags |= JBD_FLAG_LAST_TAG;
+			}
+
+			*(uint32_t*)(desc + off) = be32((uint32_t)buf->block);
+			*(uint16_t*)(desc + off + 6) = be16(flags);
+			off += journal->tag_size;
+
+			if (!i) {
+				kmemcpy(desc + off, journal->sb->s_uuid, JBD_UUID_SIZE);
+				off += JBD_UUID_SIZE;
+			}
+		}
+
+		io_block(journal, io, journal->map[pos], desc);
+		pos = log_next(journal, pos);
+
+		for (; first != buf; first = first->next) {
+			data = first->data;
+
+			if (*(uint32_t*)data == be32(JBD_MAGIC)) {
+				// a logged block must never look like a journal header
+				data = kmalloc(block_size);
+				kmemcpy(data, first->data, block_size);
+				*(uint32_t*)data = 0;
+				scratch[(*num_scratch)++] = data;
+			}
+
+			io_block(journal, io, journal->map[pos], data);
+			pos = log_next(journal, pos);
+		}
+	}
+
+	return pos;
+}
+
+void ext2_journal_commit(struct ext2_journal_t* journal) {
+	struct journal_io_t io;
+	struct jtxn_t* txn;
+	void** scratch;
+	uint64_t num_scratch = 0, ndesc, pos;
+	uint8_t failed;
+
+	lock_acquire(&journal->commit_lock);
+
+	lock_acquire(&journal->lock);
+	txn = journal->running;
+	if (!txn->count) {
+		lock_release(&journal->lock);
+		lock_release(&journal->commit_lock);
+		return;
+	}
+	journal->running = txn_alloc(txn->seq + 1);
+	lock_release(&journal->lock);
+
+	ndesc = (txn->count + journal->tags_per_desc - 1) / journal->tags_per_desc;
+	txn->len = ndesc + txn->count + 1;
+
+	if (txn->len > journal->last - journal->first - journal->used) {
+		// the committer waits on it to make room
+		checkpoint_locked(journal, DISK_PRIO_SYNC);
+	}
+
+	failed = txn->len > journal->last - journal->first;
+	if (failed) {
+		logging_log_warning("ext2 transaction of %lu blocks does not fit the journal", txn->count);
+	}
+	else {
+		scratch = kmalloc((ndesc + txn->count + 1) * sizeof(void*));
+		io_init(&io, DISK_PRIO_SYNC);
+		pos = write_txn(journal, &io, txn, scratch, &num_scratch);
+
+		if (!journal->sb->s_start) {
+			// the log was empty, recovery starts from this transaction
+			journal->sb->s_start = be32((uint32_t)journal->head);
+			journal->sb->s_sequence = be32(txn->seq);
+			io_block(journal, &io, journal->map[0], journal->sb);
+		}
+
+		// the commit block only goes out once everything it covers is on disk
+		failed = io_finish(journal, &io) != DISK_OK || disk_flush(journal->disk) != DISK_OK;
+
+		if (!failed) {
+			scratch[num_scratch] = kmalloc(journal->block_size);
+			header_init(scratch[num_scratch], JBD_COMMIT_BLOCK, txn->seq, journal->block_size);
+			io_block(journal, &io, journal->map[pos], scratch[num_scratch++]);
+			failed = io_finish(journal, &io) != DISK_OK || disk_flush(journal->disk) != DISK_OK;
+			pos = log_next(journal, pos);
+		}
+
+		for (uint64_t i = 0; i < num_scratch; i++) {
+			kfree(scratch[i]);
+		}
+		kfree(scratch);
+
+		if (failed) {
+			logging_log_error("Failed to commit ext2 transaction %u", txn->seq);
+		}
+		else {
+			journal->head = pos;
+			journal->used += txn->len;
+		}
+	}
+
+	lock_acquire(&journal->lock);
+	if (journal->done_tail) {
+		journal->done_tail->next = txn;
+	}
+	else {
+		journal->done_head = txn;
+	}
+	journal->done_tail = txn;
+	lock_release(&journal->lock);
+
+	if (failed) {
+		// not in the log, so it has to go in place right away
+		checkpoint_locked(journal, DISK_PRIO_SYNC);
+	}
+
+	lock_release(&journal->commit_lock);
+}
+
+void ext2_journal_checkpoint(struct ext2_journal_t* journal) {
+	lock_acquire(&journal->commit_lock);
+	// reads are served from the log meanwhile, nobody waits on these
+	checkpoint_locked(journal, DISK_PRIO_BACKGROUND);
+	lock_release(&journal->commit_lock);
+}
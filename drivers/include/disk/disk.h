@@ -25,27 +25,87 @@
 
 #define SECTOR_SIZE	512
 
+#define DISK_REQUEST_SEGMENTS	8
+#define DISK_MAX_DEPTH				32
+
 enum disk_error_t {
 	DISK_OK,
 	DISK_ERROR
 };
 
+enum disk_op_t {
+	DISK_OP_READ,
+	DISK_OP_WRITE,
+	DISK_OP_FLUSH
+};
+
+/* sync requests have a caller blocked on them, background is writeback */
+enum disk_prio_t {
+	DISK_PRIO_SYNC,
+	DISK_PRIO_BACKGROUND,
+	DISK_PRIO_COUNT
+};
+
+enum disk_iosched_t {
+	DISK_IOSCHED_NOOP,
+	DISK_IOSCHED_DEADLINE,
+	DISK_IOSCHED_ELEVATOR
+};
+
+struct disk_stats_t {
+	uint64_t queued;
+	uint64_t max_queued;
+	uint64_t inflight;
+	uint64_t submitted;
+	uint64_t dispatched;
+	uint64_t merged;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t flushes;
+	uint64_t sectors_read;
+	uint64_t sectors_written;
+	uint64_t errors;
+	uint64_t wait_ns;
+};
+
 struct disk_t;
+struct disk_request_t;
+
+/* one contiguous memory run of a request, count in sectors */
+struct disk_sg_t {
+	void* buffer;
+	uint64_t count;
+};
 
-typedef enum disk_error_t (*disk_lba_read_t)(void* cntx, void* buffer, uint64_t lba, uint16_t count);
-typedef enum disk_error_t (*disk_lba_write_t)(void* cntx, void* pbuffer, uint64_t lba, uint16_t count);
+typedef enum disk_error_t (*disk_lba_read_t)(void* cntx, const struct disk_sg_t* sg, uint64_t nsg, uint64_t lba);
+typedef enum disk_error_t (*disk_lba_write_t)(void* cntx, const struct disk_sg_t* sg, uint64_t nsg, uint64_t lba);
 typedef enum disk_error_t (*disk_flush_t)(void* cntx);
 
+/* called from the disk worker on completion, takes ownership of the request */
+typedef void (*disk_callback_t)(struct disk_request_t* req, enum disk_error_t status, void* cntx);
+
 extern void disk_init(void);
 
-extern struct disk_t* disk_add(void* cntx, disk_lba_read_t read, disk_lba_write_t write, disk_flush_t flush);
+extern struct disk_t* disk_add(void* cntx, disk_lba_read_t read, disk_lba_write_t write, disk_flush_t flush,
+		uint32_t max_sectors, uint32_t queue_depth);
 
 extern struct disk_t* disk_get(uint64_t id);
 
-extern enum disk_error_t disk_read(struct disk_t* disk, void* pbuffer, uint64_t lba, uint16_t count);
-extern enum disk_error_t disk_write(struct disk_t* disk, void* pbuffer, uint64_t lba, uint16_t count);
+extern struct disk_request_t* disk_request_alloc(enum disk_op_t op, uint64_t lba, disk_callback_t callback, void* cntx);
+extern enum disk_error_t disk_request_add(struct disk_request_t* req, void* buffer, uint64_t count);
+extern void disk_request_free(struct disk_request_t* req);
+extern void disk_request_set_prio(struct disk_request_t* req, enum disk_prio_t prio);
+
+extern void disk_submit(struct disk_t* disk, struct disk_request_t* req);
+extern enum disk_error_t disk_request_wait(struct disk_request_t* req);
+
+extern enum disk_error_t disk_read(struct disk_t* disk, void* pbuffer, uint64_t lba, uint32_t count);
+extern enum disk_error_t disk_write(struct disk_t* disk, void* pbuffer, uint64_t lba, uint32_t count);
 extern enum disk_error_t disk_flush(struct disk_t* disk);
 
 extern uint64_t disk_get_id(struct disk_t* disk);
 
+extern void disk_set_iosched(struct disk_t* disk, enum disk_iosched_t type);
+extern void disk_get_stats(struct disk_t* disk, struct disk_stats_t* stats);
+
 #endif /* DRIVERS_DISK_DISK_H */
@@ -0,0 +1,84 @@
+/* iosched.h - disk I/O scheduler interface */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef DRIVERS_DISK_IOSCHED_H
+#define DRIVERS_DISK_IOSCHED_H
+
+#include <stdint.h>
+
+#include <disk/disk.h>
+
+#define DISK_DISPATCH_SEGMENTS	32
+
+#define IOSCHED_SYNC_EXPIRE_MS				500
+#define IOSCHED_BACKGROUND_EXPIRE_MS	5000
+
+struct disk_request_t {
+	enum disk_op_t op;
+	enum disk_prio_t prio;
+	enum disk_error_t status;
+	uint64_t lba;
+	uint64_t count;
+	uint64_t num_segs;
+	struct disk_sg_t segs[DISK_REQUEST_SEGMENTS];
+	disk_callback_t callback;
+	void* cntx;
+	struct disk_t* disk;
+	uint64_t seq;
+	uint64_t submit_time;
+	uint64_t deadline;
+	uint8_t done;
+	struct disk_request_t* next;
+	struct disk_request_t* fifo_next;
+};
+
+struct iosched_t;
+
+/* pick the next request to dispatch, writes newer than limit wait for a flush */
+typedef struct disk_request_t* (*iosched_select_t)(struct iosched_t* sched, uint64_t limit);
+
+struct iosched_ops_t {
+	const char* name;
+	iosched_select_t select;
+};
+
+/* queued requests are kept both in submission order and lba order for every class,
+* so schedulers can be swapped with requests in flight */
+struct iosched_t {
+	const struct iosched_ops_t* ops;
+	struct disk_request_t* fifo[DISK_PRIO_COUNT];
+	struct disk_request_t* fifo_tail[DISK_PRIO_COUNT];
+	struct disk_request_t* sorted[DISK_PRIO_COUNT];
+	struct disk_request_t* barriers;
+	struct disk_request_t* barriers_tail;
+	struct disk_request_t* barrier_out; // dispatched flush, nothing else goes out until it completes
+	uint64_t seq;
+	uint64_t pos;
+	uint64_t queued;
+};
+
+extern void iosched_init(struct iosched_t* sched, enum disk_iosched_t type);
+extern void iosched_set(struct iosched_t* sched, enum disk_iosched_t type);
+
+extern void iosched_add(struct iosched_t* sched, struct disk_request_t* req);
+extern struct disk_request_t* iosched_next(struct iosched_t* sched, uint64_t max_sectors,
+		uint64_t* count, uint64_t* merged);
+
+/* report the dispatched flush as done, later requests may go out */
+extern void iosched_complete(struct iosched_t* sched);
+
+#endif /* DRIVERS_DISK_IOSCHED_H */
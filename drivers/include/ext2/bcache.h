@@ -0,0 +1,45 @@
+/* bcache.h - ext2 block cache interface */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef DRIVERS_EXT2_BCACHE_H
+#define DRIVERS_EXT2_BCACHE_H
+
+#include <stdint.h>
+
+#include <drivers/disk/disk.h>
+
+#define EXT2_BCACHE_MAX_BYTES	0x1000000
+
+struct ext2_bcache_t;
+
+extern struct ext2_bcache_t* ext2_bcache_alloc(struct disk_t* disk, uint64_t start_lba, uint64_t block_size);
+
+/* copy a cached block into buffer, returns 1 on hit */
+extern uint8_t ext2_bcache_read(struct ext2_bcache_t* cache, uint64_t block, void* buffer);
+
+/* fill is for data read from disk, dropped if the block was written since gen was sampled */
+extern uint64_t ext2_bcache_gen(struct ext2_bcache_t* cache);
+extern void ext2_bcache_fill(struct ext2_bcache_t* cache, uint64_t block, const void* buffer, uint64_t gen);
+
+/* write through, data must already be on disk */
+extern void ext2_bcache_write(struct ext2_bcache_t* cache, uint64_t block, const void* buffer);
+extern void ext2_bcache_invalidate(struct ext2_bcache_t* cache, uint64_t block, uint64_t count);
+
+/* read count physically contiguous blocks with a single disk request */
+extern void ext2_bcache_readahead(struct ext2_bcache_t* cache, uint64_t block, uint64_t count, uint8_t sync);
+
+#endif /* DRIVERS_EXT2_BCACHE_H */
@@ -0,0 +1,60 @@
+/* extent.h - ext4 extent tree on-disk format */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef DRIVERS_EXT2_EXTENT_H
+#define DRIVERS_EXT2_EXTENT_H
+
+#include <stdint.h>
+
+#define EXT4_EXTENTS_FL					0x00080000
+
+#define EXT4_EXT_MAGIC					0xF30A
+#define EXT4_EXT_MAX_DEPTH			5
+
+// longer extents are unwritten, their length biased by this
+#define EXT4_EXT_INIT_MAX_LEN		0x8000
+
+/* starts the root in i_block and every tree block, followed by eh_max entries */
+struct ext2_extent_header_t {
+	uint16_t eh_magic;
+	uint16_t eh_entries;
+	uint16_t eh_max;
+	uint16_t eh_depth;
+	uint32_t eh_generation;
+} __attribute__((packed));
+
+/* interior entry, ei_block is the first logical block below it */
+struct ext2_extent_idx_t {
+	uint32_t ei_block;
+	uint32_t ei_leaf_lo;
+	uint16_t ei_leaf_hi;
+	uint16_t ei_unused;
+} __attribute__((packed));
+
+/* leaf entry, a run of ee_len logical blocks from ee_block */
+struct ext2_extent_t {
+	uint32_t ee_block;
+	uint16_t ee_len;
+	uint16_t ee_start_hi;
+	uint32_t ee_start_lo;
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct ext2_extent_header_t) == 12, "Bad ext4 extent header size");
+_Static_assert(sizeof(struct ext2_extent_idx_t) == 12, "Bad ext4 extent index size");
+_Static_assert(sizeof(struct ext2_extent_t) == 12, "Bad ext4 extent size");
+
+#endif /* DRIVERS_EXT2_EXTENT_H */
@@ -0,0 +1,34 @@
+/* htree.h - ext2 hashed directory index interface */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef DRIVERS_EXT2_HTREE_H
+#define DRIVERS_EXT2_HTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EXT2_HTREE_LEGACY							0
+#define EXT2_HTREE_HALF_MD4						1
+#define EXT2_HTREE_TEA								2
+#define EXT2_HTREE_LEGACY_UNSIGNED		3
+#define EXT2_HTREE_HALF_MD4_UNSIGNED	4
+#define EXT2_HTREE_TEA_UNSIGNED				5
+
+/* compute the major hash of a name as stored in dx entries, returns 1 on unknown version */
+extern uint8_t ext2_htree_hash(const char* name, size_t len, const uint32_t seed[4], uint8_t version, uint32_t* hash);
+
+#endif /* DRIVERS_EXT2_HTREE_H */
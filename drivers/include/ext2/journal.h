@@ -0,0 +1,47 @@
+/* journal.h - ext3 compatible metadata journal interface */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef DRIVERS_EXT2_JOURNAL_H
+#define DRIVERS_EXT2_JOURNAL_H
+
+#include <stdint.h>
+
+#include <drivers/disk/disk.h>
+
+struct ext2_journal_t;
+
+/* map the journal inode's blocks (an extent tree if extents is set) and replay any committed transactions,
+ * returns 0 if unusable */
+extern struct ext2_journal_t* ext2_journal_load(struct disk_t* disk, uint64_t start_lba, uint64_t block_size,
+		const uint32_t* i_block, uint8_t extents, uint64_t size, uint8_t* replayed);
+
+/* copy the newest logged image of a block into buffer, returns 1 on hit */
+extern uint8_t ext2_journal_read(struct ext2_journal_t* journal, uint64_t block, void* buffer);
+
+/* log a metadata block in the running transaction instead of writing it in place */
+extern void ext2_journal_write(struct ext2_journal_t* journal, uint64_t block, const void* buffer);
+
+/* the running transaction should be committed at the next safe point */
+extern uint8_t ext2_journal_full(struct ext2_journal_t* journal);
+
+/* write the running transaction to the log, caller keeps metadata updates out until it returns */
+extern void ext2_journal_commit(struct ext2_journal_t* journal);
+
+/* write committed blocks in place and free their log space */
+extern void ext2_journal_checkpoint(struct ext2_journal_t* journal);
+
+#endif /* DRIVERS_EXT2_JOURNAL_H */
@@ -0,0 +1,223 @@
+/* dcache.c - directory entry cache */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <core/dcache.h>
+#include <core/alloc.h>
+#include <core/lock.h>
+
+#include <lib/hash.h>
+#include <lib/kmemcmp.h>
+#include <lib/kmemcpy.h>
+
+#define DCACHE_BUCKETS	1024
+
+struct dentry_t {
+	const struct mount_cntx_t* cntx;
+	uint64_t parent;
+	uint64_t ino;
+	uint64_t hash;
+	size_t len;
+	char* name;
+	struct dentry_t* chain;
+	struct dentry_t* prev;
+	struct dentry_t* next;
+};
+
+static struct dentry_t* buckets[DCACHE_BUCKETS];
+static struct dentry_t* lru_head;
+static struct dentry_t* lru_tail;
+static uint64_t num_entries;
+static uint8_t dcache_lock;
+
+static uint64_t dentry_hash(const struct mount_cntx_t* cntx, uint64_t parent, const char* name, size_t len) {
+	return fnv64_1a(name, len) ^ (parent * 0x9E3779B97F4A7C15uLL) ^ (uint64_t)cntx;
+}
+
+static void lru_unlink(struct dentry_t* dentry) {
+	if (dentry->prev) {
+		dentry->prev->next = dentry->next;
+	}
+	else {
+		lru_head = dentry->next;
+	}
+
+	if (dentry->next) {
+		dentry->next->prev = dentry->prev;
+	}
+	else {
+		lru_tail = dentry->prev;
+	}
+}
+
+static void lru_push(struct dentry_t* dentry) {
+	dentry->prev = 0;
+	dentry->next = lru_head;
+
+	if (lru_head) {
+		lru_head->prev = dentry;
+	}
+	else {
+		lru_tail = dentry;
+	}
+
+	lru_head = dentry;
+}
+
+static struct dentry_t** find_dentry(uint64_t hash, const struct mount_cntx_t* cntx, uint64_t parent,
+		const char* name, size_t len) {
+	struct dentry_t** i;
+
+	for (i = &buckets[hash % DCACHE_BUCKETS]; *i; i = &(*i)->chain) {
+		if ((*i)->hash == hash && (*i)->cntx == cntx && (*i)->parent == parent &&
+				(*i)->len == len && !kmemcmp((*i)->name, name, len)) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+static void remove_dentry(struct dentry_t** link) {
+	struct dentry_t* dentry = *link;
+
+	*link = dentry->chain;
+	lru_unlink(dentry);
+	num_entries--;
+
+	kfree(dentry->name);
+	kfree(dentry);
+}
+
+static void remove_matching(const struct mount_cntx_t* cntx, uint64_t parent, uint8_t any_parent) {
+	struct dentry_t** i;
+
+	lock_acquire(&dcache_lock);
+	for (uint64_t b = 0; b < DCACHE_BUCKETS; b++) {
+		for (i = &buckets[b]; *i;) {
+			if ((*i)->cntx == cntx && (any_parent || (*i)->parent == parent)) {
+				remove_dentry(i);
+			}
+			else {
+				i = &(*i)->chain;
+			}
+		}
+	}
+	lock_release(&dcache_lock);
+}
+
+void dcache_init(void) {
+	lock_init(&dcache_lock);
+
+	for (uint64_t i = 0; i < DCACHE_BUCKETS; i++) {
+		buckets[i] = 0;
+	}
+
+	lru_head = 0;
+	lru_tail = 0;
+	num_entries = 0;
+}
+
+uint8_t dcache_lookup(const struct mount_cntx_t* cntx, uint64_t parent, const char* name, size_t len, uint64_t* ino) {
+	const uint64_t hash = dentry_hash(cntx, parent, name, len);
+	struct dentry_t* dentry;
+
+	lock_acquire(&dcache_lock);
+	dentry = *find_dentry(hash, cntx, parent, name, len);
+
+	if (!dentry) {
+		lock_release(&dcache_lock);
+		return 0;
+	}
+
+	*ino = dentry->ino;
+
+	lru_unlink(dentry);
+	lru_push(dentry);
+	lock_release(&dcache_lock);
+
+	return 1;
+}
+
+void dcache_insert(const struct mount_cntx_t* cntx, uint64_t parent, const char* name, size_t len, uint64_t ino) {
+	const uint64_t hash = dentry_hash(cntx, parent, name, len);
+	struct dentry_t** link;
+	struct dentry_t* dentry;
+
+	lock_acquire(&dcache_lock);
+	link = find_dentry(hash, cntx, parent, name, len);
+
+	if (*link) {
+		dentry = *link;
+
+		// a miss found without the directory locked can be older than a create that already inserted
+		if (ino != DCACHE_NEGATIVE) {
+			dentry->ino = ino;
+		}
+
+		lru_unlink(dentry);
+		lru_push(dentry);
+		lock_release(&dcache_lock);
+		return;
+	}
+
+	if (num_entries >= DCACHE_MAX_ENTRIES) {
+		// evict the least recently used entry
+		dentry = lru_tail;
+		remove_dentry(find_dentry(dentry->hash, dentry->cntx, dentry->parent, dentry->name, dentry->len));
+		link = find_dentry(hash, cntx, parent, name, len);
+	}
+
+	dentry = kmalloc(sizeof(struct dentry_t));
+	dentry->cntx = cntx;
+	dentry->parent = parent;
+	dentry->ino = ino;
+	dentry->hash = hash;
+	dentry->len = len;
+	dentry->name = kmalloc(len ? len : 1);
+	kmemcpy(dentry->name, name, len);
+
+	dentry->chain = 0;
+	*link = dentry;
+	lru_push(dentry);
+	num_entries++;
+
+	lock_release(&dcache_lock);
+}
+
+void dcache_invalidate(const struct mount_cntx_t* cntx, uint64_t parent, const char* name, size_t len) {
+	const uint64_t hash = dentry_hash(cntx, parent, name, len);
+	struct dentry_t** link;
+
+	lock_acquire(&dcache_lock);
+	link = find_dentry(hash, cntx, parent, name, len);
+
+	if (*link) {
+		remove_dentry(link);
+	}
+	lock_release(&dcache_lock);
+}
+
+void dcache_invalidate_dir(const struct mount_cntx_t* cntx, uint64_t parent) {
+	remove_matching(cntx, parent, 0);
+}
+
+void dcache_invalidate_mount(const struct mount_cntx_t* cntx) {
+	remove_matching(cntx, 0, 1);
+}
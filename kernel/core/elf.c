@@ -292,6 +292,7 @@ struct pcb_t* elf_load(struct fs_handle_t* file, uint64_t pid, const char* invok
 	pcb->ss = GDT_KERNEL_SS;
 
 	pcb->sched_cntr = SCHED_READY;
+	pcb->io_background = 0;
 	pcb->pid = pid;
 
 	cpu_restore_fx(pcb->fxdata);
@@ -436,7 +437,6 @@ struct pcb_t* elf_load(struct fs_handle_t* file, uint64_t pid, const char* invok
 	}
 
 	memtop += PAGE_SIZE_4K;
-	pcb->mem_top = memtop;
 
 	ph_off = 0;
 	// copy pheaders
@@ -541,12 +541,12 @@ struct pcb_t* elf_load(struct fs_handle_t* file, uint64_t pid, const char* invok
 		}
 	}
 
-	pcb->fd_table = array_list_alloc(FD_INIT_SIZE, FD_GROWTH, 0);
-	pcb->wd = fs_open("/", FILE_FLAGS_READ | FILE_FLAGS_WRITE);
+	pcb->shared = process_shared_alloc(pcb->cr3, memtop, array_list_alloc(FD_INIT_SIZE, FD_GROWTH, 0),
+		fs_open("/", FILE_FLAGS_READ | FILE_FLAGS_WRITE));
 #ifdef SERIAL
-	array_list_push(pcb->fd_table, fs_open("/dev/ttyS0", FILE_FLAGS_READ));
-	array_list_push(pcb->fd_table, fs_open("/dev/ttyS0", FILE_FLAGS_WRITE));
-	array_list_push(pcb->fd_table, fs_open("/dev/ttyS0", FILE_FLAGS_WRITE));
+	array_list_push(pcb->shared->fd_table, fs_open("/dev/ttyS0", FILE_FLAGS_READ));
+	array_list_push(pcb->shared->fd_table, fs_open("/dev/ttyS0", FILE_FLAGS_WRITE));
+	array_list_push(pcb->shared->fd_table, fs_open("/dev/ttyS0", FILE_FLAGS_WRITE));
 #endif /* SERIAL */
 
 restore_cr3:
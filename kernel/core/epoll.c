@@ -0,0 +1,281 @@
+/* epoll.c - readiness interest lists */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+
+#include <core/epoll.h>
+#include <core/fs.h>
+#include <core/signal.h>
+#include <core/syscall_vectors.h>
+#include <core/alloc.h>
+#include <core/lock.h>
+#include <core/time.h>
+#include <core/proc_data.h>
+#include <core/cpu_instr.h>
+
+_Static_assert(EPOLL_IN == FS_POLL_IN && EPOLL_OUT == FS_POLL_OUT, "epoll events are passed through as fs poll bits");
+
+struct epoll_item_t {
+	uint64_t fd;
+	struct fs_handle_t* handle;
+	uint32_t events;
+	uint64_t data;
+	struct epoll_t* epoll;
+	struct epoll_item_t* next;
+
+	// subscription to the source, 0 if its readiness never changes
+	struct poll_head_t* head;
+	struct epoll_item_t* head_prev;
+	struct epoll_item_t* head_next;
+};
+
+struct epoll_t {
+	struct epoll_item_t* items;
+	struct signal_wait_t* wait;
+	uint64_t refs;
+	uint8_t lock;
+};
+
+// heads are notified from interrupt handlers, so they are never held with interrupts on
+static void head_subscribe(struct poll_head_t* head, struct epoll_item_t* item) {
+	item->head = head;
+	item->head_prev = 0;
+
+	cpu_cli_if();
+	lock_acquire(&head->lock);
+	item->head_next = head->items;
+	if (head->items) {
+		head->items->head_prev = item;
+	}
+	head->items = item;
+	lock_release(&head->lock);
+	cpu_sti_if();
+}
+
+static void head_unsubscribe(struct epoll_item_t* item) {
+	struct poll_head_t* head = item->head;
+
+	if (!head) {
+		return;
+	}
+
+	cpu_cli_if();
+	lock_acquire(&head->lock);
+	if (item->head_prev) {
+		item->head_prev->head_next = item->head_next;
+	}
+	else {
+		head->items = item->head_next;
+	}
+
+	if (item->head_next) {
+		item->head_next->head_prev = item->head_prev;
+	}
+	lock_release(&head->lock);
+	cpu_sti_if();
+}
+
+static void item_free(struct epoll_item_t* item) {
+	head_unsubscribe(item);
+	fs_close(item->handle);
+	kfree(item);
+}
+
+static struct epoll_item_t** find_item(struct epoll_t* epoll, uint64_t fd) {
+	struct epoll_item_t** i;
+
+	for (i = &epoll->items; *i; i = &(*i)->next) {
+		if ((*i)->fd == fd) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+static uint64_t collect(struct epoll_t* epoll, struct epoll_event_t* events, uint64_t max) {
+	struct poll_head_t* ign;
+	struct epoll_item_t* i;
+	uint64_t count = 0;
+	uint32_t ready;
+
+	lock_acquire(&epoll->lock);
+	for (i = epoll->items; i && count < max; i = i->next) {
+		if ((ready = fs_poll(i->handle, &ign) & i->events)) {
+			events[count].events = ready;
+			events[count].data = i->data;
+			count++;
+		}
+	}
+	lock_release(&epoll->lock);
+
+	return count;
+}
+
+void poll_head_init(struct poll_head_t* head) {
+	head->items = 0;
+	lock_init(&head->lock);
+}
+
+void poll_notify(struct poll_head_t* head) {
+	lock_acquire(&head->lock);
+	for (struct epoll_item_t* i = head->items; i; i = i->head_next) {
+		signal_awake(i->epoll->wait);
+	}
+	lock_release(&head->lock);
+}
+
+struct epoll_t* epoll_alloc(void) {
+	struct epoll_t* epoll = kmalloc(sizeof(struct epoll_t));
+
+	if (!epoll) {
+		return 0;
+	}
+
+	epoll->items = 0;
+	epoll->wait = signal_wait_alloc();
+	epoll->refs = 1;
+	lock_init(&epoll->lock);
+
+	return epoll;
+}
+
+struct epoll_t* epoll_dup(struct epoll_t* epoll) {
+	__atomic_add_fetch(&epoll->refs, 1, __ATOMIC_RELAXED);
+	return epoll;
+}
+
+void epoll_put(struct epoll_t* epoll) {
+	struct epoll_item_t* next;
+
+	if (__atomic_sub_fetch(&epoll->refs, 1, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+
+	for (struct epoll_item_t* i = epoll->items; i; i = next) {
+		next = i->next;
+		item_free(i);
+	}
+
+	signal_wait_free(epoll->wait);
+	kfree(epoll);
+}
+
+uint8_t epoll_ctl(struct epoll_t* epoll, uint8_t op, uint64_t fd, struct fs_handle_t* handle, uint32_t events, uint64_t data) {
+	struct epoll_item_t** link, * item, * drop = 0;
+	struct poll_head_t* head;
+	uint8_t ret = 0;
+
+	lock_acquire(&epoll->lock);
+	link = find_item(epoll, fd);
+
+	switch (op) {
+		case EPOLL_CTL_ADD:
+			if (*link || !(item = kmalloc(sizeof(struct epoll_item_t)))) {
+				ret = 1;
+				break;
+			}
+
+			item->fd = fd;
+			item->handle = handle;
+			item->events = events;
+			item->data = data;
+			item->epoll = epoll;
+			item->next = 0;
+			item->head = 0;
+
+			fs_poll(handle, &head);
+			if (head) {
+				head_subscribe(head, item);
+			}
+
+			*link = item;
+			break;
+		case EPOLL_CTL_MOD:
+			if (!*link) {
+				ret = 1;
+				break;
+			}
+
+			(*link)->events = events;
+			(*link)->data = data;
+			break;
+		case EPOLL_CTL_DEL:
+			if (!(item = *link)) {
+				ret = 1;
+				break;
+			}
+
+			*link = item->next;
+			drop = item;
+			break;
+		default:
+			ret = 1;
+			break;
+	}
+	lock_release(&epoll->lock);
+
+	// closing the handle can write the file back, so not under the lock
+	if (drop) {
+		item_free(drop);
+	}
+
+	// a waiter may now have something to report
+	if (!ret) {
+		signal_awake(epoll->wait);
+	}
+
+	return ret;
+}
+
+uint64_t epoll_wait(struct epoll_t* epoll, struct epoll_event_t* events, uint64_t max, uint64_t timeout_ns) {
+	const uint64_t now = time_since_init_fs();
+	struct signal_timer_t* timer = 0;
+	uint64_t deadline = ~0uLL, count, seq;
+
+	if (max > EPOLL_MAX_EVENTS) {
+		max = EPOLL_MAX_EVENTS;
+	}
+
+	if (timeout_ns && timeout_ns != ~0uLL) {
+		if (timeout_ns <= (~0uLL - now) / TIME_CONV_NS_TO_FS) {
+			deadline = now + timeout_ns * TIME_CONV_NS_TO_FS;
+		}
+
+		// a saturated deadline never comes, it waits like an infinite timeout
+		if (deadline != ~0uLL && !(timer = signal_timer_start(epoll->wait, deadline))) {
+			return ~0uLL;
+		}
+	}
+
+	while (1) {
+		seq = signal_seq(epoll->wait);
+
+		count = collect(epoll, events, max);
+		if (count || !timeout_ns || time_since_init_fs() >= deadline) {
+			break;
+		}
+
+		signal_wait_seq(epoll->wait, seq);
+	}
+
+	if (timer) {
+		signal_timer_cancel(timer);
+	}
+
+	return count;
+}
@@ -22,10 +22,17 @@
 #include <core/alloc.h>
 #include <core/logging.h>
 #include <core/panic.h>
-#include <core/semaphore.h>
+#include <core/dcache.h>
+#include <core/page_cache.h>
+#include <core/mm.h>
+#include <core/paging.h>
+#include <core/process.h>
+#include <core/scheduler.h>
+#include <core/time.h>
 
 #include <lib/kmemcmp.h>
 #include <lib/kmemcpy.h>
+#include <lib/kmemset.h>
 #include <lib/kstrcmp.h>
 #include <lib/kstrcpy.h>
 #include <lib/kstrlen.h>
@@ -33,8 +40,12 @@
 #include <lib/hash_table.h>
 
 #include <devfs/devfs.h>
+#include <devfs/pipe.h>
 
 #define OPEN_TABLE_BUCKETS		100
+#define PATH_SCRATCH			256
+#define FILL_BATCH				16
+#define FLUSH_INTERVAL_MS		5000
 
 /*
  * Locking conventions:
@@ -48,31 +59,19 @@
  * inode at the same time. It is the actual fs driver's responsibility to ensure consistent access
  * to filesystem metadata such as inode tables and journals
  *
- * Internally, the vfs must guarantee locked access to the open_table via the fs_lock. The vfs must
- * also guarantee locked access to the vfs tree.
+ * Internally, the vfs must guarantee locked access to the open_table via the open_lock. Path walks
+ * read the vfs tree without a lock: mounts are the only writers, serialized by mount_lock, and they
+ * publish fully built nodes with release stores. Nodes are never removed, so a walk racing a mount
+ * sees either the old or the new tree.
  */
 
-static struct semaphore_t* fs_sem;
+static uint8_t open_lock;
+static uint8_t mount_lock;
+static uint8_t writers_lock;
 
 struct vfs_mount_t {
 	struct mount_cntx_t* cntx;
-
-	fs_open_t open;
-	fs_close_t close;
-	fs_stat_t stat;
-	fs_read_t read;
-	fs_get_seek_t get_seek;
-	fs_seek_t seek;
-	fs_write_t write;
-	fs_delete_final_t delete_final;
-	fs_open_dir_t open_dir;
-	fs_read_dir_t read_dir;
-	fs_create_dir_t create_dir;
-	fs_delete_dir_t delete_dir;
-	fs_is_interactive_t is_interactive;
-	fs_truncate_t truncate;
-	fs_link_t link;
-	fs_unlink_t unlink;
+	const struct fs_ops_t* ops;
 };
 
 struct vfs_open_file_t {
@@ -87,7 +86,13 @@ struct fs_handle_t {
 	struct vfs_mount_t* mount;
 	struct file_handle_t* handle;
 	struct vfs_open_file_t* shared;
+	struct cache_file_t* cache; // 0 if reads and writes go straight to the filesystem
+	uint64_t refs;
 	uint32_t flags;
+
+	// writable cached handles, the flusher writes dirty pages back through them
+	struct fs_handle_t* writer_prev;
+	struct fs_handle_t* writer_next;
 };
 
 struct vfs_tree_node_t {
@@ -104,8 +109,9 @@ static struct vfs_tree_node_t dev_root;
 
 static struct hash_table_t* open_table;
 
-static struct vfs_mount_t dev_mount = {
-	.cntx = 0,
+static struct fs_handle_t* writers;
+
+static const struct fs_ops_t dev_ops = {
 	.open = devfs_open,
 	.close = devfs_close,
 	.stat = devfs_stat,
@@ -117,15 +123,16 @@ static struct vfs_mount_t dev_mount = {
 	.open_dir = devfs_open_dir,
 	.read_dir = devfs_read_dir,
 	.is_interactive = devfs_is_interactive,
+	.poll = devfs_poll,
 	.truncate = devfs_truncate,
 	.link = devfs_link,
 	.unlink = devfs_unlink
 };
 
-static uint8_t fs_not_interactive(struct file_handle_t* handle) {
-	(void)handle;
-	return 0;
-}
+static struct vfs_mount_t dev_mount = {
+	.cntx = 0,
+	.ops = &dev_ops
+};
 
 static inline char* path_next(char* path, size_t* len) {
 	*len = 0;
@@ -145,10 +152,11 @@ static inline char* path_next(char* path, size_t* len) {
 static struct vfs_open_file_t* lookup_register(char* path) {
 	size_t path_len = kstrlen(path);
 	uint64_t key = fnv64_1a(path, path_len);
-	struct vfs_open_file_t* file;
+	struct vfs_open_file_t* file = 0, * probe;
 
-	while (hash_table_get(open_table, key, (void**)&file)) {
-		if (kstrcmp(path, file->path + 1) == 0) {
+	while (hash_table_get(open_table, key, (void**)&probe)) {
+		if (kstrcmp(path, probe->path + 1) == 0) {
+			file = probe;
 			break;
 		}
 
@@ -175,6 +183,7 @@ static struct vfs_open_file_t* lookup_register(char* path) {
 	return file;
 }
 
+/* drops a reference, returns 1 if it was the last and the entry left the open_table */
 static uint8_t lookup_close(struct vfs_open_file_t* file) {
 	file->refs--;
 
@@ -182,18 +191,19 @@ static uint8_t lookup_close(struct vfs_open_file_t* file) {
 		return 0;
 	}
 
-	kfree(file->path);
 	void* ign;
 	hash_table_remove(open_table, file->key, &ign);
 
-	uint8_t pending_delete = file->pending_delete;
-
-	kfree(file);
-	return pending_delete;
+	return 1;
 }
 
+static void fs_flusher(void* cntx);
+
 void fs_init(void) {
-	fs_sem = semaphore_alloc(SEMAPHORE_CAP_UNLIM);
+	lock_init(&open_lock);
+	lock_init(&mount_lock);
+	lock_init(&writers_lock);
+	writers = 0;
 
 	vfs_root.co = 0;
 	vfs_root.sub = &dev_root;
@@ -206,70 +216,80 @@ void fs_init(void) {
 	dev_root.mount = &dev_mount;
 
 	open_table = hash_table_alloc(OPEN_TABLE_BUCKETS);
+
+	dcache_init();
+	page_cache_init();
+
+	scheduler_schedule(process_from_func(fs_flusher, 0));
 }
 
-enum file_status_t fs_mount(
-		const char* mountpoint,
-		struct mount_cntx_t* cntx,
-		fs_open_t open,
-		fs_close_t close,
-		fs_stat_t stat,
-		fs_read_t read,
-		fs_get_seek_t get_seek,
-		fs_seek_t seek,
-		fs_write_t write,
-		fs_delete_final_t delete_final,
-		fs_open_dir_t open_dir,
-		fs_read_dir_t read_dir,
-		fs_create_dir_t create_dir,
-		fs_delete_dir_t delete_dir,
-		fs_truncate_t truncate,
-		fs_link_t link,
-		fs_unlink_t unlink
-		) {
-
-	if (kstrcmp(mountpoint, "") && !vfs_root.mount) {
-		vfs_root.mount = kmalloc(sizeof(struct vfs_mount_t));
-
-		if (!vfs_root.mount) {
-			logging_log_error("Failed to mount root");
-			return FILE_ERROR;
-		}
-
-		vfs_root.mount->cntx = cntx;
-		vfs_root.mount->open = open;
-		vfs_root.mount->close = close;
-		vfs_root.mount->stat = stat;
-		vfs_root.mount->read = read;
-		vfs_root.mount->get_seek = get_seek;
-		vfs_root.mount->seek = seek;
-		vfs_root.mount->write = write;
-		vfs_root.mount->delete_final = delete_final;
-		vfs_root.mount->open_dir = open_dir;
-		vfs_root.mount->read_dir = read_dir;
-		vfs_root.mount->create_dir = create_dir;
-		vfs_root.mount->delete_dir = delete_dir;
-		vfs_root.mount->truncate = truncate;
-		vfs_root.mount->link = link;
-		vfs_root.mount->unlink = unlink;
-
-		vfs_root.mount->is_interactive = fs_not_interactive;
-
-		return FILE_OK;
-	}
-
-	//TODO: support non root mount
-	logging_log_error("Can only mount root");
-	return FILE_ERROR;
-}
-
-static const char* find_mount(const char* path, struct vfs_mount_t** mount_out, void** clean_path_out, char** path_write_out) {
+enum file_status_t fs_mount(const char* mountpoint, struct mount_cntx_t* cntx, const struct fs_ops_t* ops) {
+	struct vfs_tree_node_t* node = &vfs_root, * walk;
+	enum file_status_t sts = FILE_OK;
+	const char* name;
+	char* copy;
+	size_t len;
+
+	lock_acquire(&mount_lock);
+
+	// intermediate directories get nodes of their own without a mount
+	while (*mountpoint) {
+		if (*mountpoint == '/') {
+			mountpoint++;
+			continue;
+		}
+
+		name = mountpoint;
+		for (len = 0; *mountpoint && *mountpoint != '/'; mountpoint++) {
+			len++;
+		}
+
+		for (walk = node->sub; walk; walk = walk->co) {
+			if (kstrlen(walk->name) == len && kmemcmp(walk->name, name, len) == 0) {
+				break;
+			}
+		}
+
+		if (!walk) {
+			copy = kmalloc(len + 1);
+			kmemcpy(copy, name, len);
+			copy[len] = 0;
+
+			walk = kmalloc(sizeof(struct vfs_tree_node_t));
+			walk->co = node->sub;
+			walk->sub = 0;
+			walk->name = copy;
+			walk->mount = 0;
+			__atomic_store_n(&node->sub, walk, __ATOMIC_RELEASE);
+		}
+
+		node = walk;
+	}
+
+	if (node->mount) {
+		sts = FILE_BUSY;
+	}
+	else {
+		struct vfs_mount_t* mount = kmalloc(sizeof(struct vfs_mount_t));
+		mount->cntx = cntx;
+		mount->ops = ops;
+		__atomic_store_n(&node->mount, mount, __ATOMIC_RELEASE);
+	}
+
+	lock_release(&mount_lock);
+
+	return sts;
+}
+
+/* normalizes path into scratch, or a kmalloc'd copy returned in clean_path_out if it does not fit */
+static const char* find_mount(const char* path, char* scratch, struct vfs_mount_t** mount_out, void** clean_path_out,
+		char** path_write_out) {
 	struct vfs_tree_node_t* node = &vfs_root, * walk = 0;
 	const char* mount_path = "";
-	struct vfs_mount_t* mount = 0;
+	struct vfs_mount_t* mount = 0, * node_mount;
 
 	size_t len = kstrlen(path);
-	char* clean_path = kmalloc(len + 1);
+	char* clean_path = len < PATH_SCRATCH ? scratch : kmalloc(len + 1);
 
 	uint64_t num_chars = 0;
 	uint64_t skip = 0;
@@ -323,18 +343,17 @@ static const char* find_mount(const char* path, struct vfs_mount_t** mount_out,
 
 	*path_write_out = path_write;
 
-	semaphore_wait(fs_sem);
-
 	do {
-		if (node->mount) {
+		node_mount = __atomic_load_n(&node->mount, __ATOMIC_ACQUIRE);
+		if (node_mount) {
 			mount_path = path_write;
-			mount = node->mount;
+			mount = node_mount;
 		}
 
 		path_read = path_write;
 		path_write = path_next(path_write, &len);
 
-		for (walk = node->sub; walk; walk = walk->co) {
+		for (walk = __atomic_load_n(&node->sub, __ATOMIC_ACQUIRE); walk; walk = walk->co) {
 			if (kstrlen(walk->name) == len && kmemcmp(walk->name, path_read, len) == 0) {
 				node = walk;
 				break;
@@ -343,34 +362,34 @@ static const char* find_mount(const char* path, struct vfs_mount_t** mount_out,
 
 	} while (walk && node == walk);
 
-	semaphore_signal(fs_sem);
-
 	*mount_out = mount;
-	*clean_path_out = clean_path;
+	*clean_path_out = clean_path == scratch ? 0 : clean_path;
 
 	return mount_path;
 }
 
 struct fs_handle_t* fs_open_mode(const char* path, uint32_t flags, uint32_t mode) {
 	struct vfs_mount_t* mount;
+	char scratch[PATH_SCRATCH];
 	void* clean_path;
 	char* path_write;
-	const char* mount_path = find_mount(path, &mount, &clean_path, &path_write);
+	const char* mount_path = find_mount(path, scratch, &mount, &clean_path, &path_write);
 
 	if (!mount) {
 		kfree(clean_path);
 		return 0;
 	}
 
-	struct file_handle_t* handle = mount->open(mount->cntx, mount_path, flags, mode);
+	struct file_handle_t* handle = mount->ops->open(mount->cntx, mount_path, flags, mode);
 
 	if (!handle) {
+		kfree(clean_path);
 		return 0;
 	}
 
-	semaphore_wait(fs_sem);
+	lock_acquire(&open_lock);
 	struct vfs_open_file_t* open_file = lookup_register(path_write);
-	semaphore_signal(fs_sem);
+	lock_release(&open_lock);
 
 	kfree(clean_path);
 
@@ -378,7 +397,28 @@ struct fs_handle_t* fs_open_mode(const char* path, uint32_t flags, uint32_t mode
 	fs_handle->handle = handle;
 	fs_handle->mount = mount;
 	fs_handle->shared = open_file;
+	fs_handle->cache = 0;
+	fs_handle->refs = 1;
 	fs_handle->flags = flags;
+
+	struct file_info_t info;
+	uint64_t ino;
+
+	if (mount->ops->cache_ino && (ino = mount->ops->cache_ino(handle)) && mount->ops->stat(handle, &info) == FILE_OK) {
+		fs_handle->cache = page_cache_open(mount->cntx, ino, info.size);
+	}
+
+	if (fs_handle->cache && (flags & FILE_FLAGS_WRITE)) {
+		lock_acquire(&writers_lock);
+		fs_handle->writer_prev = 0;
+		fs_handle->writer_next = writers;
+		if (writers) {
+			writers->writer_prev = fs_handle;
+		}
+		writers = fs_handle;
+		lock_release(&writers_lock);
+	}
+
 	return fs_handle;
 }
 
@@ -405,30 +445,350 @@ struct fs_handle_t* fs_openat(const char* path, uint32_t flags, struct fs_handle
 	}
 }
 
+static inline size_t min_size(size_t a, size_t b) {
+	return a < b ? a : b;
+}
+
+/* fill the new page at index and up to want - 1 missing pages after it with one filesystem read,
+ * caller holds the shared lock, returns 1 on failure */
+static uint8_t cache_fill(struct fs_handle_t* handle, struct cache_page_t* page, uint64_t index, uint64_t want) {
+	const struct fs_ops_t* ops = handle->mount->ops;
+	struct cache_page_t* pages[FILL_BATCH];
+	struct file_info_t info;
+	uint64_t num = 1, i;
+	size_t len = 0;
+	uint8_t* buffer;
+	uint8_t ret = 0;
+
+	pages[0] = page;
+
+	for (; num < want && num < FILL_BATCH; num++) {
+		if (!(pages[num] = page_cache_get(handle->cache, index + num))) {
+			break;
+		}
+
+		if (page_cache_uptodate(pages[num])) {
+			page_cache_put(pages[num]);
+			break;
+		}
+	}
+
+	// only what the filesystem holds is read, the rest of the file lives in dirty pages or is a hole
+	if (ops->stat(handle->handle, &info) != FILE_OK) {
+		ret = 1;
+		goto done;
+	}
+
+	if (info.size > index * PAGE_CACHE_PAGE_SIZE) {
+		len = min_size(info.size - index * PAGE_CACHE_PAGE_SIZE, num * PAGE_CACHE_PAGE_SIZE);
+	}
+
+	buffer = num == 1 ? 0 : kmalloc(num * PAGE_CACHE_PAGE_SIZE);
+
+	if (!buffer) {
+		// read straight into the first page alone
+		for (; num > 1; num--) {
+			page_cache_put(pages[num - 1]);
+		}
+
+		buffer = page_cache_data(page);
+		len = min_size(len, PAGE_CACHE_PAGE_SIZE);
+	}
+
+	if (len && (ops->seek(handle->handle, index * PAGE_CACHE_PAGE_SIZE) != FILE_OK ||
+				ops->read(handle->handle, buffer, len) != len)) {
+		ret = 1;
+	}
+	else {
+		kmemset(buffer + len, 0, num * PAGE_CACHE_PAGE_SIZE - len);
+
+		for (i = 0; i < num; i++) {
+			if (buffer != page_cache_data(page)) {
+				kmemcpy(page_cache_data(pages[i]), buffer + i * PAGE_CACHE_PAGE_SIZE, PAGE_CACHE_PAGE_SIZE);
+			}
+
+			page_cache_mark_uptodate(pages[i]);
+		}
+	}
+
+	if (buffer != page_cache_data(page)) {
+		kfree(buffer);
+	}
+
+done:
+	for (i = 1; i < num; i++) {
+		page_cache_put(pages[i]);
+	}
+
+	return ret;
+}
+
+/* write every dirty page through handle, caller holds the shared lock, returns 1 on failure */
+static uint8_t cache_writeback(struct fs_handle_t* handle) {
+	const struct fs_ops_t* ops = handle->mount->ops;
+	const uint64_t size = page_cache_size(handle->cache);
+	const uint64_t seek = ops->get_seek(handle->handle);
+	struct cache_page_t* page;
+	uint64_t index = 0, base;
+	uint8_t ret = 0;
+	size_t len;
+
+	while ((page = page_cache_next_dirty(handle->cache, &index))) {
+		base = index * PAGE_CACHE_PAGE_SIZE;
+
+		if (base < size) {
+			len = min_size(size - base, PAGE_CACHE_PAGE_SIZE);
+
+			if (ops->seek(handle->handle, base) != FILE_OK || ops->write(handle->handle, page_cache_data(page), len) != len) {
+				page_cache_put(page);
+				ret = 1;
+				break;
+			}
+		}
+
+		page_cache_mark_clean(page);
+		page_cache_put(page);
+		index++;
+	}
+
+	ops->seek(handle->handle, seek);
+
+	return ret;
+}
+
+/* forget clean cached pages once the filesystem's copy changed under them */
+static void cache_drop(struct fs_handle_t* handle) {
+	struct file_info_t info;
+
+	page_cache_invalidate(handle->cache);
+
+	if (handle->mount->ops->stat(handle->handle, &info) == FILE_OK) {
+		page_cache_set_size(handle->cache, info.size);
+	}
+}
+
+/* read at seek, the filesystem handle's own seek is left wherever a fill moved it */
+static size_t cache_read(struct fs_handle_t* handle, void* buffer, size_t count, uint64_t seek) {
+	const uint64_t size = page_cache_size(handle->cache);
+	struct cache_page_t* page;
+	size_t done = 0, len, off;
+	uint64_t index;
+
+	while (done < count && seek < size) {
+		index = seek / PAGE_CACHE_PAGE_SIZE;
+		off = seek % PAGE_CACHE_PAGE_SIZE;
+		len = min_size(min_size(PAGE_CACHE_PAGE_SIZE - off, count - done), size - seek);
+
+		if (!(page = page_cache_get(handle->cache, index))) {
+			break;
+		}
+
+		// a miss fills as much of the rest of the request as one batch allows
+		if (!page_cache_uptodate(page) &&
+				cache_fill(handle, page, index, (off + min_size(count - done, size - seek) + PAGE_CACHE_PAGE_SIZE - 1) /
+					PAGE_CACHE_PAGE_SIZE)) {
+			page_cache_put(page);
+			break;
+		}
+
+		kmemcpy((uint8_t*)buffer + done, page_cache_data(page) + off, len);
+		page_cache_put(page);
+
+		seek += len;
+		done += len;
+	}
+
+	return done;
+}
+
+/* write at seek, the filesystem handle's own seek is left wherever a fill moved it */
+static size_t cache_write(struct fs_handle_t* handle, const void* buffer, size_t count, uint64_t seek) {
+	uint64_t size = page_cache_size(handle->cache);
+	struct cache_page_t* page;
+	size_t done = 0, len, off;
+	uint64_t index;
+	uint8_t background;
+
+	while (done < count) {
+		index = seek / PAGE_CACHE_PAGE_SIZE;
+		off = seek % PAGE_CACHE_PAGE_SIZE;
+		len = min_size(PAGE_CACHE_PAGE_SIZE - off, count - done);
+
+		if (!(page = page_cache_get(handle->cache, index))) {
+			break;
+		}
+
+		if (!page_cache_uptodate(page)) {
+			// only a partial overwrite of existing data needs the old page
+			if ((off || len < PAGE_CACHE_PAGE_SIZE) && index * PAGE_CACHE_PAGE_SIZE < size) {
+				if (cache_fill(handle, page, index, 1)) {
+					page_cache_put(page);
+					break;
+				}
+			}
+			else {
+				kmemset(page_cache_data(page), 0, PAGE_CACHE_PAGE_SIZE);
+				page_cache_mark_uptodate(page);
+			}
+		}
+
+		if (page_cache_mark_dirty(page)) {
+			page_cache_put(page);
+			break;
+		}
+
+		kmemcpy(page_cache_data(page) + off, (const uint8_t*)buffer + done, len);
+		page_cache_put(page);
+
+		seek += len;
+		done += len;
+
+		if (seek > size) {
+			size = seek;
+			page_cache_set_size(handle->cache, size);
+		}
+	}
+
+	if (page_cache_dirty_count(handle->cache) > PAGE_CACHE_DIRTY_MAX) {
+		background = process_io_background(1);
+		cache_writeback(handle);
+		process_io_background(background);
+	}
+
+	return done;
+}
+
+struct fs_handle_t* fs_dup(struct fs_handle_t* handle) {
+	__atomic_add_fetch(&handle->refs, 1, __ATOMIC_RELAXED);
+
+	return handle;
+}
+
 void fs_close(struct fs_handle_t* handle) {
-	semaphore_wait_full(fs_sem);
-	if (lookup_close(handle->shared)) {
-		handle->mount->delete_final(handle->handle);
+	struct vfs_open_file_t* shared = handle->shared;
+
+	if (__atomic_sub_fetch(&handle->refs, 1, __ATOMIC_ACQ_REL)) {
+		return;
 	}
-	semaphore_signal_full(fs_sem);
 
-	lock_acquire(&handle->shared->lock);
-	handle->mount->close(handle->handle);
-	lock_release(&handle->shared->lock);
+	if (handle->cache && (handle->flags & FILE_FLAGS_WRITE)) {
+		lock_acquire(&writers_lock);
+		if (handle->writer_prev) {
+			handle->writer_prev->writer_next = handle->writer_next;
+		}
+		else {
+			writers = handle->writer_next;
+		}
+
+		if (handle->writer_next) {
+			handle->writer_next->writer_prev = handle->writer_prev;
+		}
+		lock_release(&writers_lock);
+
+		// the pages stay dirty in the cache, a later writer of the file retries them
+		lock_acquire(&shared->lock);
+		if (page_cache_dirty_count(handle->cache) && cache_writeback(handle)) {
+			logging_log_error("Failed to write back cached writes to %s", shared->path);
+		}
+		lock_release(&shared->lock);
+	}
+
+	lock_acquire(&open_lock);
+	uint8_t last = lookup_close(shared);
+	lock_release(&open_lock);
+
+	// nobody else can reach shared once it has left the table
+	if (last && shared->pending_delete) {
+		// the inode may be reused, no page of this one can stay around
+		if (handle->cache) {
+			page_cache_discard(handle->cache);
+		}
+
+		handle->mount->ops->delete_final(handle->handle);
+	}
+
+	if (handle->cache) {
+		page_cache_close(handle->cache);
+	}
+
+	lock_acquire(&shared->lock);
+	handle->mount->ops->close(handle->handle);
+	lock_release(&shared->lock);
+
+	if (last) {
+		kfree(shared->path);
+		kfree(shared);
+	}
 
 	kfree(handle);
 }
 
+/* pin the first writer from handle on that is not being closed, writers_lock held */
+static struct fs_handle_t* writer_pin(struct fs_handle_t* handle) {
+	uint64_t refs;
+
+	for (; handle; handle = handle->writer_next) {
+		refs = __atomic_load_n(&handle->refs, __ATOMIC_RELAXED);
+
+		while (refs && !__atomic_compare_exchange_n(&handle->refs, &refs, refs + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+		}
+
+		if (refs) {
+			return handle;
+		}
+	}
+
+	return 0;
+}
+
+// without it a long lived writer's data only goes out at close or past PAGE_CACHE_DIRTY_MAX
+static void fs_flusher(void* cntx) {
+	struct fs_handle_t* handle, * next;
+
+	(void)cntx;
+
+	process_io_background(1);
+
+	while (1) {
+		time_sleep(FLUSH_INTERVAL_MS);
+
+		lock_acquire(&writers_lock);
+		handle = writer_pin(writers);
+		lock_release(&writers_lock);
+
+		for (; handle; handle = next) {
+			// a failed writeback keeps its pages dirty for the next round
+			lock_acquire(&handle->shared->lock);
+			if (page_cache_dirty_count(handle->cache) && cache_writeback(handle)) {
+				logging_log_error("Failed to write back cached writes to %s", handle->shared->path);
+			}
+			lock_release(&handle->shared->lock);
+
+			// the pin keeps handle on the list until its successor is pinned
+			lock_acquire(&writers_lock);
+			next = writer_pin(handle->writer_next);
+			lock_release(&writers_lock);
+
+			fs_close(handle);
+		}
+	}
+}
+
 enum file_status_t fs_stat(struct fs_handle_t* handle, struct file_info_t* info) {
 
 	lock_acquire(&handle->shared->lock);
-	enum file_status_t ret = handle->mount->stat(handle->handle, info);
+	enum file_status_t ret = handle->mount->ops->stat(handle->handle, info);
+
+	if (ret == FILE_OK && handle->cache && page_cache_size(handle->cache) > info->size) {
+		info->size = page_cache_size(handle->cache);
+	}
 	lock_release(&handle->shared->lock);
 
 	return ret;
 }
 
 size_t fs_read(struct fs_handle_t* handle, void* buffer, size_t count) {
+	uint64_t seek;
 	size_t ret;
 
 	if (!(handle->flags & FILE_FLAGS_READ)) {
@@ -436,7 +796,14 @@ size_t fs_read(struct fs_handle_t* handle, void* buffer, size_t count) {
 	}
 
 	lock_acquire(&handle->shared->lock);
-	ret = handle->mount->read(handle->handle, buffer, count);
+	if (handle->cache) {
+		seek = handle->mount->ops->get_seek(handle->handle);
+		ret = cache_read(handle, buffer, count, seek);
+		handle->mount->ops->seek(handle->handle, seek + ret);
+	}
+	else {
+		ret = handle->mount->ops->read(handle->handle, buffer, count);
+	}
 	lock_release(&handle->shared->lock);
 
 	return ret;
@@ -446,7 +813,7 @@ uint64_t fs_get_seek(struct fs_handle_t* handle) {
 	uint64_t seek;
 
 	lock_acquire(&handle->shared->lock);
-	seek = handle->mount->get_seek(handle->handle);
+	seek = handle->mount->ops->get_seek(handle->handle);
 	lock_release(&handle->shared->lock);
 
 	return seek;
@@ -456,13 +823,14 @@ enum file_status_t fs_seek(struct fs_handle_t* handle, uint64_t seek) {
 	enum file_status_t sts;
 
 	lock_acquire(&handle->shared->lock);
-	sts = handle->mount->seek(handle->handle, seek);
+	sts = handle->mount->ops->seek(handle->handle, seek);
 	lock_release(&handle->shared->lock);
 
 	return sts;
 }
 
 size_t fs_write(struct fs_handle_t* handle, const void* buffer, size_t count) {
+	uint64_t seek;
 	size_t ret;
 
 	if (!(handle->flags & FILE_FLAGS_WRITE)) {
@@ -470,17 +838,397 @@ size_t fs_write(struct fs_handle_t* handle, const void* buffer, size_t count) {
 	}
 
 	lock_acquire(&handle->shared->lock);
-	ret = handle->mount->write(handle->handle, buffer, count);
+	if (handle->cache) {
+		seek = handle->mount->ops->get_seek(handle->handle);
+		ret = cache_write(handle, buffer, count, seek);
+		handle->mount->ops->seek(handle->handle, seek + ret);
+	}
+	else {
+		ret = handle->mount->ops->write(handle->handle, buffer, count);
+	}
+	lock_release(&handle->shared->lock);
+
+	return ret;
+}
+
+size_t fs_preadv(struct fs_handle_t* handle, const struct fs_iovec_t* iov, size_t count, uint64_t offset) {
+	const struct fs_ops_t* ops = handle->mount->ops;
+	size_t ret = 0, seg;
+	uint64_t seek;
+
+	if (!(handle->flags & FILE_FLAGS_READ)) {
+		return 0;
+	}
+
+	lock_acquire(&handle->shared->lock);
+	seek = ops->get_seek(handle->handle);
+
+	// without the page cache the segments go through the filesystem handle's seek
+	if (handle->cache || ops->seek(handle->handle, offset) == FILE_OK) {
+		for (size_t i = 0; i < count; i++) {
+			if (handle->cache) {
+				seg = cache_read(handle, iov[i].base, iov[i].len, offset + ret);
+			}
+			else {
+				seg = ops->read(handle->handle, iov[i].base, iov[i].len);
+			}
+
+			ret += seg;
+
+			if (seg < iov[i].len) {
+				break;
+			}
+		}
+	}
+
+	ops->seek(handle->handle, seek);
+	lock_release(&handle->shared->lock);
+
+	return ret;
+}
+
+size_t fs_pwritev(struct fs_handle_t* handle, const struct fs_iovec_t* iov, size_t count, uint64_t offset) {
+	const struct fs_ops_t* ops = handle->mount->ops;
+	size_t ret = 0, seg;
+	uint64_t seek;
+
+	if (!(handle->flags & FILE_FLAGS_WRITE)) {
+		return 0;
+	}
+
+	lock_acquire(&handle->shared->lock);
+	seek = ops->get_seek(handle->handle);
+
+	if (handle->cache || ops->seek(handle->handle, offset) == FILE_OK) {
+		for (size_t i = 0; i < count; i++) {
+			if (handle->cache) {
+				seg = cache_write(handle, iov[i].base, iov[i].len, offset + ret);
+			}
+			else {
+				seg = ops->write(handle->handle, iov[i].base, iov[i].len);
+			}
+
+			ret += seg;
+
+			if (seg < iov[i].len) {
+				break;
+			}
+		}
+	}
+
+	ops->seek(handle->handle, seek);
 	lock_release(&handle->shared->lock);
 
 	return ret;
 }
 
+size_t fs_copy_range(struct fs_handle_t* in, uint64_t in_off, struct fs_handle_t* out, uint64_t out_off, size_t count) {
+	const struct fs_ops_t* in_ops = in->mount->ops;
+	const struct fs_ops_t* out_ops = out->mount->ops;
+	const uint8_t same = in->shared == out->shared || (in->cache && in->cache == out->cache);
+	struct vfs_open_file_t* first, * second;
+	struct cache_page_t* page = 0;
+	uint64_t in_seek, out_seek, size, off;
+	uint8_t* bounce = 0;
+	size_t done = 0, len, moved;
+	const uint8_t* src;
+
+	if (!(in->flags & FILE_FLAGS_READ) || !(out->flags & FILE_FLAGS_WRITE)) {
+		return 0;
+	}
+
+	if (same && in_off < out_off + count && out_off < in_off + count) {
+		return 0;
+	}
+
+	if (!in->cache && !(bounce = kmalloc(PAGE_CACHE_PAGE_SIZE))) {
+		return 0;
+	}
+
+	// a fixed order keeps two copies running in opposite directions from deadlocking
+	first = in->shared < out->shared ? in->shared : out->shared;
+	second = in->shared < out->shared ? out->shared : in->shared;
+
+	lock_acquire(&first->lock);
+	if (second != first) {
+		lock_acquire(&second->lock);
+	}
+
+	in_seek = in_ops->get_seek(in->handle);
+	out_seek = out_ops->get_seek(out->handle);
+
+	while (done < count) {
+		off = (in_off + done) % PAGE_CACHE_PAGE_SIZE;
+		len = min_size(PAGE_CACHE_PAGE_SIZE - off, count - done);
+
+		if (in->cache) {
+			// cached source pages are handed to the writer as they are
+			size = page_cache_size(in->cache);
+
+			if (in_off + done >= size) {
+				break;
+			}
+
+			len = min_size(len, size - (in_off + done));
+
+			if (!(page = page_cache_get(in->cache, (in_off + done) / PAGE_CACHE_PAGE_SIZE))) {
+				break;
+			}
+
+			if (!page_cache_uptodate(page) &&
+					cache_fill(in, page, (in_off + done) / PAGE_CACHE_PAGE_SIZE,
+						(off + min_size(count - done, size - (in_off + done)) + PAGE_CACHE_PAGE_SIZE - 1) / PAGE_CACHE_PAGE_SIZE)) {
+				page_cache_put(page);
+				break;
+			}
+
+			src = page_cache_data(page) + off;
+		}
+		else {
+			if (in_ops->seek(in->handle, in_off + done) != FILE_OK || !(len = in_ops->read(in->handle, bounce, len))) {
+				break;
+			}
+
+			src = bounce;
+		}
+
+		if (out->cache) {
+			moved = cache_write(out, src, len, out_off + done);
+		}
+		else {
+			moved = out_ops->seek(out->handle, out_off + done) == FILE_OK ? out_ops->write(out->handle, src, len) : 0;
+		}
+
+		if (page) {
+			page_cache_put(page);
+			page = 0;
+		}
+
+		done += moved;
+
+		if (moved < len) {
+			break;
+		}
+	}
+
+	in_ops->seek(in->handle, in_seek);
+	out_ops->seek(out->handle, out_seek);
+
+	if (second != first) {
+		lock_release(&second->lock);
+	}
+	lock_release(&first->lock);
+
+	if (bounce) {
+		kfree(bounce);
+	}
+
+	return done;
+}
+
+// streams such as ttys have no position and are used wherever they are
+static inline uint8_t seek_stream(struct fs_handle_t* handle, uint64_t seek) {
+	const enum file_status_t sts = handle->mount->ops->seek(handle->handle, seek);
+
+	return sts != FILE_OK && sts != FILE_NO_SUPPORT;
+}
+
+static inline struct pipe_t* handle_pipe(struct fs_handle_t* handle, uint8_t* write_end) {
+	return handle->mount == &dev_mount ? devfs_pipe(handle->handle, write_end) : 0;
+}
+
+/* hand a full pipe page to the cache of out at a page aligned off, caller holds the shared lock,
+ * returns 1 if it has to be copied instead */
+static uint8_t splice_adopt(struct fs_handle_t* out, const struct pipe_buf_t* buf, uint64_t off) {
+	struct cache_page_t* page;
+	uint8_t background;
+
+	if (!out->cache || buf->page || buf->offset || buf->len != PAGE_CACHE_PAGE_SIZE || off % PAGE_CACHE_PAGE_SIZE) {
+		return 1;
+	}
+
+	if (!(page = page_cache_get(out->cache, off / PAGE_CACHE_PAGE_SIZE))) {
+		return 1;
+	}
+
+	// dirty first, once replaced the frame belongs to the cache
+	if (page_cache_mark_dirty(page) || page_cache_replace(page, buf->paddr)) {
+		page_cache_put(page);
+		return 1;
+	}
+
+	page_cache_mark_uptodate(page);
+	page_cache_put(page);
+
+	if (off + PAGE_CACHE_PAGE_SIZE > page_cache_size(out->cache)) {
+		page_cache_set_size(out->cache, off + PAGE_CACHE_PAGE_SIZE);
+	}
+
+	if (page_cache_dirty_count(out->cache) > PAGE_CACHE_DIRTY_MAX) {
+		background = process_io_background(1);
+		cache_writeback(out);
+		process_io_background(background);
+	}
+
+	return 0;
+}
+
+static size_t splice_from_pipe(struct fs_handle_t* in, struct pipe_t* pipe, struct fs_handle_t* out, struct pipe_t* out_pipe,
+		uint64_t out_off, size_t count) {
+	const struct fs_ops_t* out_ops = out->mount->ops;
+	struct pipe_buf_t buf;
+	size_t done = 0, len, moved;
+	uint64_t seek;
+	uint8_t stolen;
+
+	// readers of the pipe are serialized, so the peeked buffer stays the oldest until consumed
+	lock_acquire(&in->shared->lock);
+
+	// only the first buffer is waited for
+	while (done < count && !pipe_peek(pipe, &buf, !done)) {
+		len = min_size(buf.len, count - done);
+		stolen = 0;
+
+		if (out_pipe) {
+			// whole buffers change pipes as they are
+			if (len == buf.len) {
+				moved = pipe_push(out_pipe, &buf) ? 0 : len;
+				stolen = moved != 0;
+			}
+			else {
+				moved = pipe_write(out_pipe, buf.data + buf.offset, len);
+			}
+		}
+		else {
+			lock_acquire(&out->shared->lock);
+			if (len == buf.len && !splice_adopt(out, &buf, out_off + done)) {
+				moved = len;
+				stolen = 1;
+			}
+			else if (out->cache) {
+				moved = cache_write(out, buf.data + buf.offset, len, out_off + done);
+			}
+			else {
+				seek = out_ops->get_seek(out->handle);
+				moved = seek_stream(out, out_off + done) ? 0 : out_ops->write(out->handle, buf.data + buf.offset, len);
+				out_ops->seek(out->handle, seek);
+			}
+			lock_release(&out->shared->lock);
+		}
+
+		pipe_consume(pipe, moved, stolen);
+		done += moved;
+
+		if (moved < len) {
+			break;
+		}
+	}
+
+	lock_release(&in->shared->lock);
+
+	return done;
+}
+
+static size_t splice_to_pipe(struct fs_handle_t* in, uint64_t in_off, struct pipe_t* pipe, size_t count) {
+	const struct fs_ops_t* in_ops = in->mount->ops;
+	struct pipe_buf_t buf;
+	uint64_t size, off, seek;
+	size_t done = 0, len;
+
+	while (done < count) {
+		off = (in_off + done) % PAGE_CACHE_PAGE_SIZE;
+		len = min_size(PAGE_CACHE_PAGE_SIZE - off, count - done);
+
+		lock_acquire(&in->shared->lock);
+		if (in->cache) {
+			// the pipe holds a pin on the cache page instead of a copy
+			size = page_cache_size(in->cache);
+
+			if (in_off + done >= size || !(buf.page = page_cache_get(in->cache, (in_off + done) / PAGE_CACHE_PAGE_SIZE))) {
+				lock_release(&in->shared->lock);
+				break;
+			}
+
+			len = min_size(len, size - (in_off + done));
+
+			if (!page_cache_uptodate(buf.page) &&
+					cache_fill(in, buf.page, (in_off + done) / PAGE_CACHE_PAGE_SIZE,
+						(off + min_size(count - done, size - (in_off + done)) + PAGE_CACHE_PAGE_SIZE - 1) / PAGE_CACHE_PAGE_SIZE)) {
+				page_cache_put(buf.page);
+				lock_release(&in->shared->lock);
+				break;
+			}
+
+			buf.paddr = page_cache_paddr(buf.page);
+			buf.data = page_cache_data(buf.page);
+			buf.offset = (uint32_t)off;
+			buf.len = (uint32_t)len;
+		}
+		else {
+			if (!(buf.paddr = mm_alloc_p(PIPE_BUF_SIZE))) {
+				lock_release(&in->shared->lock);
+				break;
+			}
+
+			buf.data = (uint8_t*)paging_ident(buf.paddr);
+			buf.page = 0;
+			buf.offset = 0;
+
+			seek = in_ops->get_seek(in->handle);
+			buf.len = seek_stream(in, in_off + done) ? 0 : (uint32_t)in_ops->read(in->handle, buf.data, len);
+			in_ops->seek(in->handle, seek);
+
+			if (!buf.len) {
+				mm_free_p(buf.paddr, PIPE_BUF_SIZE);
+				lock_release(&in->shared->lock);
+				break;
+			}
+		}
+		lock_release(&in->shared->lock);
+
+		if (pipe_push(pipe, &buf)) {
+			pipe_buf_release(&buf);
+			break;
+		}
+
+		done += buf.len;
+
+		if (buf.len < len) {
+			break;
+		}
+	}
+
+	return done;
+}
+
+size_t fs_splice(struct fs_handle_t* in, uint64_t in_off, struct fs_handle_t* out, uint64_t out_off, size_t count) {
+	struct pipe_t* in_pipe, * out_pipe;
+	uint8_t in_write = 0, out_write = 1;
+
+	if (!(in->flags & FILE_FLAGS_READ) || !(out->flags & FILE_FLAGS_WRITE)) {
+		return 0;
+	}
+
+	in_pipe = handle_pipe(in, &in_write);
+	out_pipe = handle_pipe(out, &out_write);
+
+	// one side has to be a pipe, used from the right end, and a pipe cannot feed itself
+	if (in_pipe == out_pipe || in_write || !out_write) {
+		return 0;
+	}
+
+	if (in_pipe) {
+		return splice_from_pipe(in, in_pipe, out, out_pipe, out_off, count);
+	}
+
+	return splice_to_pipe(in, in_off, out_pipe, count);
+}
+
 struct fs_handle_t* fs_open_dir(struct fs_handle_t* handle) {
 	enum file_status_t sts;
 
 	lock_acquire(&handle->shared->lock);
-	sts = handle->mount->open_dir(handle->handle);
+	sts = handle->mount->ops->open_dir(handle->handle);
 	lock_release(&handle->shared->lock);
 
 	if (sts != FILE_OK) {
@@ -494,7 +1242,7 @@ enum file_status_t fs_create_dir(struct fs_handle_t* handle) {
 	enum file_status_t sts;
 
 	lock_acquire(&handle->shared->lock);
-	sts = handle->mount->create_dir(handle->handle);
+	sts = handle->mount->ops->create_dir(handle->handle);
 	lock_release(&handle->shared->lock);
 
 	return sts;
@@ -504,7 +1252,7 @@ enum file_status_t fs_delete_dir(struct fs_handle_t* handle) {
 	enum file_status_t sts;
 
 	lock_acquire(&handle->shared->lock);
-	sts = handle->mount->delete_dir(handle->handle);
+	sts = handle->mount->ops->delete_dir(handle->handle);
 	lock_release(&handle->shared->lock);
 
 	return sts;
@@ -514,7 +1262,21 @@ enum file_status_t fs_read_dir(struct fs_handle_t* handle, struct dir_info_t* in
 	enum file_status_t sts;
 
 	lock_acquire(&handle->shared->lock);
-	sts = handle->mount->read_dir(handle->handle, info);
+	sts = handle->mount->ops->read_dir(handle->handle, info);
+	lock_release(&handle->shared->lock);
+
+	return sts;
+}
+
+enum file_status_t fs_read_dirs(struct fs_handle_t* handle, fs_dir_emit_t emit, void* cntx) {
+	enum file_status_t sts;
+
+	if (!handle->mount->ops->read_dirs) {
+		return FILE_NO_SUPPORT;
+	}
+
+	lock_acquire(&handle->shared->lock);
+	sts = handle->mount->ops->read_dirs(handle->handle, emit, cntx);
 	lock_release(&handle->shared->lock);
 
 	return sts;
@@ -524,7 +1286,16 @@ enum file_status_t fs_truncate(struct fs_handle_t* handle, size_t size) {
 	enum file_status_t sts;
 
 	lock_acquire(&handle->shared->lock);
-	sts = handle->mount->truncate(handle->handle, size);
+	if (handle->cache && page_cache_dirty_count(handle->cache) && cache_writeback(handle)) {
+		lock_release(&handle->shared->lock);
+		return FILE_ERROR;
+	}
+
+	sts = handle->mount->ops->truncate(handle->handle, size);
+
+	if (handle->cache && sts == FILE_OK) {
+		cache_drop(handle);
+	}
 	lock_release(&handle->shared->lock);
 
 	return sts;
@@ -539,7 +1310,7 @@ enum file_status_t fs_link(struct fs_handle_t* handle, struct fs_handle_t* repla
 	}
 
 	lock_acquire(&handle->shared->lock);
-	sts = handle->mount->link(handle->handle, replace->handle);
+	sts = handle->mount->ops->link(handle->handle, replace->handle);
 	lock_release(&handle->shared->lock);
 
 	return sts;
@@ -549,7 +1320,7 @@ enum file_status_t fs_unlink(struct fs_handle_t* handle) {
 	enum file_status_t sts;
 
 	lock_acquire(&handle->shared->lock);
-	sts = handle->mount->unlink(handle->handle);
+	sts = handle->mount->ops->unlink(handle->handle);
 	lock_release(&handle->shared->lock);
 
 	return sts;
@@ -561,5 +1332,20 @@ void fs_path(struct fs_handle_t* handle, size_t max_len, char* buf) {
 }
 
 uint8_t fs_is_interactive(struct fs_handle_t* handle) {
-	return handle->mount->is_interactive(handle->handle);
+	if (!handle->mount->ops->is_interactive) {
+		return 0;
+	}
+
+	return handle->mount->ops->is_interactive(handle->handle);
+}
+
+uint32_t fs_poll(struct fs_handle_t* handle, struct poll_head_t** head) {
+	*head = 0;
+
+	if (!handle->mount->ops->poll) {
+		return FS_POLL_IN | FS_POLL_OUT;
+	}
+
+	// no file lock, a blocked reader holds it until the data this waits for arrives
+	return handle->mount->ops->poll(handle->handle, head);
 }
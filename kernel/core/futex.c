@@ -0,0 +1,259 @@
+/* futex.c - userland wait queues keyed by address */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+
+#include <core/futex.h>
+#include <core/signal.h>
+#include <core/alloc.h>
+#include <core/lock.h>
+#include <core/time.h>
+
+enum waiter_state_t {
+	WAITER_WAITING,
+	WAITER_WOKEN,
+	WAITER_TIMEOUT
+};
+
+struct futex_waiter_t {
+	uint64_t space;
+	uint32_t* uaddr;
+	struct signal_wait_t* wait;
+	uint8_t state;
+	struct futex_waiter_t* prev;
+	struct futex_waiter_t* next;
+};
+
+struct futex_bucket_t {
+	struct futex_waiter_t* head;
+	struct futex_waiter_t* tail;
+	uint8_t lock;
+};
+
+static struct futex_bucket_t buckets[FUTEX_BUCKETS];
+
+static inline struct futex_bucket_t* bucket_of(uint64_t space, const uint32_t* uaddr) {
+	return &buckets[((((uint64_t)uaddr >> 2) ^ space) * 0x9E3779B97F4A7C15uLL) >> 58];
+}
+
+_Static_assert(FUTEX_BUCKETS == 64, "bucket_of keeps the top six bits of the hash");
+
+static void bucket_push(struct futex_bucket_t* bucket, struct futex_waiter_t* waiter) {
+	waiter->next = 0;
+	waiter->prev = bucket->tail;
+
+	if (bucket->tail) {
+		bucket->tail->next = waiter;
+	}
+	else {
+		bucket->head = waiter;
+	}
+
+	bucket->tail = waiter;
+}
+
+static void bucket_unlink(struct futex_bucket_t* bucket, struct futex_waiter_t* waiter) {
+	if (waiter->prev) {
+		waiter->prev->next = waiter->next;
+	}
+	else {
+		bucket->head = waiter->next;
+	}
+
+	if (waiter->next) {
+		waiter->next->prev = waiter->prev;
+	}
+	else {
+		bucket->tail = waiter->prev;
+	}
+}
+
+static void lock_pair(struct futex_bucket_t* a, struct futex_bucket_t* b) {
+	if (a == b) {
+		lock_acquire(&a->lock);
+	}
+	else if (a < b) {
+		lock_acquire(&a->lock);
+		lock_acquire(&b->lock);
+	}
+	else {
+		lock_acquire(&b->lock);
+		lock_acquire(&a->lock);
+	}
+}
+
+static void release_pair(struct futex_bucket_t* a, struct futex_bucket_t* b) {
+	lock_release(&a->lock);
+
+	if (a != b) {
+		lock_release(&b->lock);
+	}
+}
+
+// requeue can move a waiter, so its bucket is only known once locked
+static struct futex_bucket_t* lock_waiter(struct futex_waiter_t* waiter) {
+	struct futex_bucket_t* bucket;
+	uint32_t* uaddr;
+
+	while (1) {
+		uaddr = __atomic_load_n(&waiter->uaddr, __ATOMIC_ACQUIRE);
+		bucket = bucket_of(waiter->space, uaddr);
+
+		lock_acquire(&bucket->lock);
+		if (waiter->uaddr == uaddr) {
+			return bucket;
+		}
+		lock_release(&bucket->lock);
+	}
+}
+
+static void waiter_free(struct futex_waiter_t* waiter) {
+	signal_wait_free(waiter->wait);
+	kfree(waiter);
+}
+
+// call with the waiter's bucket held
+static void waiter_finish(struct futex_bucket_t* bucket, struct futex_waiter_t* waiter, enum waiter_state_t state) {
+	bucket_unlink(bucket, waiter);
+	__atomic_store_n(&waiter->state, state, __ATOMIC_RELEASE);
+	signal_awake(waiter->wait);
+}
+
+void futex_init(void) {
+	for (uint64_t i = 0; i < FUTEX_BUCKETS; i++) {
+		buckets[i].head = 0;
+		buckets[i].tail = 0;
+		lock_init(&buckets[i].lock);
+	}
+}
+
+enum futex_status_t futex_wait(uint64_t space, uint32_t* uaddr, uint32_t val, uint64_t timeout_ns) {
+	struct futex_bucket_t* bucket = bucket_of(space, uaddr);
+	const uint64_t now = time_since_init_fs();
+	struct signal_timer_t* timer = 0;
+	struct futex_waiter_t* waiter;
+	uint64_t deadline, seq;
+	uint8_t state;
+
+	waiter = kmalloc(sizeof(struct futex_waiter_t));
+	if (!waiter) {
+		return FUTEX_NO_MEM;
+	}
+
+	waiter->space = space;
+	waiter->uaddr = uaddr;
+	waiter->wait = signal_wait_alloc();
+	waiter->state = WAITER_WAITING;
+
+	// long timeouts saturate instead of wrapping into the past, and a saturated one never fires
+	deadline = timeout_ns > (~0uLL - now) / TIME_CONV_NS_TO_FS ?
+		~0uLL : now + timeout_ns * TIME_CONV_NS_TO_FS;
+
+	if (timeout_ns && deadline != ~0uLL && !(timer = signal_timer_start(waiter->wait, deadline))) {
+		waiter_free(waiter);
+		return FUTEX_NO_MEM;
+	}
+
+	// a waker changes the value before taking the bucket, so checking under the lock cannot miss it
+	lock_acquire(&bucket->lock);
+	if (__atomic_load_n(uaddr, __ATOMIC_ACQUIRE) != val) {
+		lock_release(&bucket->lock);
+
+		if (timer) {
+			signal_timer_cancel(timer);
+		}
+
+		waiter_free(waiter);
+		return FUTEX_AGAIN;
+	}
+
+	bucket_push(bucket, waiter);
+	lock_release(&bucket->lock);
+
+	while (1) {
+		seq = signal_seq(waiter->wait);
+
+		if ((state = __atomic_load_n(&waiter->state, __ATOMIC_ACQUIRE)) != WAITER_WAITING) {
+			break;
+		}
+
+		// the timer only awakes us, leaving the bucket is up to the waiter
+		if (timer && time_since_init_fs() >= deadline) {
+			bucket = lock_waiter(waiter);
+			if (waiter->state == WAITER_WAITING) {
+				waiter_finish(bucket, waiter, WAITER_TIMEOUT);
+			}
+			lock_release(&bucket->lock);
+			continue;
+		}
+
+		signal_wait_seq(waiter->wait, seq);
+	}
+
+	// whoever finished the wait signals under the bucket lock, let it leave before the record can go
+	bucket = lock_waiter(waiter);
+	lock_release(&bucket->lock);
+
+	if (timer) {
+		signal_timer_cancel(timer);
+	}
+
+	waiter_free(waiter);
+
+	return state == WAITER_WOKEN ? FUTEX_WOKEN : FUTEX_TIMEOUT;
+}
+
+uint64_t futex_wake(uint64_t space, uint32_t* uaddr, uint64_t count) {
+	return futex_requeue(space, uaddr, count, uaddr, 0);
+}
+
+uint64_t futex_requeue(uint64_t space, uint32_t* uaddr, uint64_t count, uint32_t* uaddr2, uint64_t requeue) {
+	struct futex_bucket_t* bucket = bucket_of(space, uaddr);
+	struct futex_bucket_t* target = bucket_of(space, uaddr2);
+	struct futex_waiter_t* i, * next;
+	uint64_t woken = 0, moved = 0;
+
+	lock_pair(bucket, target);
+
+	for (i = bucket->head; i && (woken < count || moved < requeue); i = next) {
+		next = i->next;
+
+		if (i->space != space || i->uaddr != uaddr) {
+			continue;
+		}
+
+		if (woken < count) {
+			waiter_finish(bucket, i, WAITER_WOKEN);
+			woken++;
+			continue;
+		}
+
+		// requeueing onto the same address changes nothing
+		if (uaddr2 == uaddr) {
+			break;
+		}
+
+		bucket_unlink(bucket, i);
+		__atomic_store_n(&i->uaddr, uaddr2, __ATOMIC_RELEASE);
+		bucket_push(target, i);
+		moved++;
+	}
+
+	release_pair(bucket, target);
+
+	return woken;
+}
@@ -0,0 +1,354 @@
+/* io_ring.c - asynchronous submission and completion rings */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <core/io_ring.h>
+#include <core/process.h>
+#include <core/scheduler.h>
+#include <core/signal.h>
+#include <core/syscall_dispatch.h>
+#include <core/proc_data.h>
+#include <core/cpu_instr.h>
+#include <core/alloc.h>
+#include <core/lock.h>
+#include <core/paging.h>
+#include <core/mm.h>
+#include <core/fs.h>
+
+#include <lib/kmemset.h>
+
+struct io_ring_t {
+	struct proc_shared_t* shared; // 0 once another thread's ring won the setup race
+	uint64_t cr3;
+
+	// pages shared with userland, header then sqes then cqes
+	uint64_t paddr;
+	uint64_t size;
+	struct io_ring_header_t* header;
+	struct io_ring_sqe_t* sqes;
+	struct io_ring_cqe_t* cqes;
+	uint32_t entries;
+	uint32_t sq_head;
+	uint32_t cq_tail;
+
+	// submissions copied out of shared memory, waiting for a worker
+	struct io_ring_sqe_t* queue;
+	uint32_t queue_head;
+	uint32_t queue_tail;
+
+	uint32_t inflight;
+	uint32_t workers;
+	uint8_t dying;
+	uint8_t lock;
+
+	struct signal_wait_t* pending;
+	struct signal_wait_t* complete;
+};
+
+struct userland_stat_t {
+	size_t st_size;
+};
+
+static inline uint64_t ring_size(uint32_t entries) {
+	const uint64_t size = sizeof(struct io_ring_header_t) +
+		entries * sizeof(struct io_ring_sqe_t) +
+		2 * entries * sizeof(struct io_ring_cqe_t);
+
+	return (size + PAGE_SIZE_4K - 1) & ~(uint64_t)(PAGE_SIZE_4K - 1);
+}
+
+// completions the process has not consumed, a bogus cq_head counts as a full queue
+static inline uint32_t cq_ready(struct io_ring_t* ring) {
+	const uint32_t ready = __atomic_load_n(&ring->cq_tail, __ATOMIC_ACQUIRE) -
+		__atomic_load_n(&ring->header->cq_head, __ATOMIC_ACQUIRE);
+
+	return ready > 2 * ring->entries ? 2 * ring->entries : ready;
+}
+
+static void ring_free(struct io_ring_t* ring) {
+	signal_wait_free(ring->pending);
+	signal_wait_free(ring->complete);
+	kfree(ring->queue);
+	mm_free_p(ring->paddr, ring->size);
+	kfree(ring);
+}
+
+// runs on a worker borrowing the process's shared state
+static uint64_t ring_execute(const struct io_ring_sqe_t* sqe) {
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	struct fs_handle_t* handle, * at;
+	struct file_info_t info;
+	struct fs_iovec_t iov;
+	uint64_t res = SYSCALL_STS_FAIL;
+
+	switch (sqe->op) {
+		case IO_RING_OP_NOP:
+			return SYSCALL_STS_OK;
+		case IO_RING_OP_OPENAT:
+			at = sqe->fd == USERLAND_AT_FDCWD ? process_wd_get(pcb) : process_fd_get(pcb, (uint64_t)sqe->fd);
+
+			if (!at) {
+				return SYSCALL_STS_FAIL;
+			}
+
+			handle = fs_openat((const char*)sqe->addr, (uint32_t)sqe->len, at, (uint32_t)sqe->off);
+			fs_close(at);
+
+			return handle ? process_fd_add(pcb, handle) : SYSCALL_STS_FAIL;
+		case IO_RING_OP_CLOSE:
+			if (!(handle = process_fd_remove(pcb, (uint64_t)sqe->fd))) {
+				return SYSCALL_STS_FAIL;
+			}
+
+			fs_close(handle);
+			return SYSCALL_STS_OK;
+	}
+
+	if (!(handle = process_fd_get(pcb, (uint64_t)sqe->fd))) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	iov.base = (void*)sqe->addr;
+	iov.len = sqe->len;
+
+	switch (sqe->op) {
+		case IO_RING_OP_READ:
+			res = sqe->off == USERLAND_SEEK_OFF ? fs_read(handle, iov.base, iov.len) : fs_preadv(handle, &iov, 1, sqe->off);
+			break;
+		case IO_RING_OP_WRITE:
+			res = sqe->off == USERLAND_SEEK_OFF ? fs_write(handle, iov.base, iov.len) : fs_pwritev(handle, &iov, 1, sqe->off);
+			break;
+		case IO_RING_OP_STAT:
+			if (fs_stat(handle, &info) == FILE_OK) {
+				((struct userland_stat_t*)sqe->addr)->st_size = info.size;
+				res = SYSCALL_STS_OK;
+			}
+			break;
+	}
+
+	fs_close(handle);
+
+	return res;
+}
+
+static void ring_worker(void* cntx) {
+	struct io_ring_t* ring = cntx;
+	struct pcb_t* self = proc_data_get()->current_process;
+	struct proc_shared_t* own = self->shared;
+	struct proc_shared_t* orphan;
+	struct io_ring_cqe_t* cqe;
+	struct io_ring_sqe_t sqe;
+	uint64_t seq, res;
+	uint8_t last;
+
+	// user buffers and handles are reached through the process's own mappings and tables
+	self->shared = ring->shared;
+	self->cr3 = ring->cr3;
+	cpu_set_cr3(ring->cr3);
+
+	while (1) {
+		seq = signal_seq(ring->pending);
+
+		lock_acquire(&ring->lock);
+		if (ring->dying) {
+			break;
+		}
+
+		if (ring->queue_head == ring->queue_tail) {
+			lock_release(&ring->lock);
+			signal_wait_seq(ring->pending, seq);
+			continue;
+		}
+
+		sqe = ring->queue[ring->queue_head++ & (2 * ring->entries - 1)];
+		lock_release(&ring->lock);
+
+		res = ring_execute(&sqe);
+
+		// enter never takes more than the completion queue has room for
+		lock_acquire(&ring->lock);
+		cqe = &ring->cqes[ring->cq_tail & (2 * ring->entries - 1)];
+		cqe->user_data = sqe.user_data;
+		cqe->res = res;
+		__atomic_store_n(&ring->cq_tail, ring->cq_tail + 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&ring->header->cq_tail, ring->cq_tail, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&ring->inflight, 1, __ATOMIC_RELEASE);
+		lock_release(&ring->lock);
+
+		signal_awake(ring->complete);
+	}
+
+	last = !--ring->workers;
+	orphan = ring->shared;
+	lock_release(&ring->lock);
+
+	// the address space belongs to the process, not to this worker
+	self->shared = own;
+	self->cr3 = 0;
+
+	if (last) {
+		ring_free(ring);
+
+		// only a ring that was set up is stopped by the process exiting
+		if (orphan) {
+			orphan->ring = 0;
+			process_shared_free(orphan);
+		}
+	}
+}
+
+uint64_t io_ring_setup(struct pcb_t* pcb, uint32_t entries) {
+	struct proc_shared_t* shared = pcb->shared;
+	struct io_ring_t* ring;
+	struct pcb_t* worker;
+	uint64_t paddr, size, vaddr;
+
+	if (shared->ring || !entries || entries > IO_RING_MAX_ENTRIES || (entries & (entries - 1))) {
+		return 0;
+	}
+
+	size = ring_size(entries);
+
+	if (!(paddr = mm_alloc_p(size))) {
+		return 0;
+	}
+
+	if (!(ring = kmalloc(sizeof(struct io_ring_t)))) {
+		mm_free_p(paddr, size);
+		return 0;
+	}
+
+	ring->paddr = paddr;
+	ring->size = size;
+	ring->queue = kmalloc(2 * entries * sizeof(struct io_ring_sqe_t));
+	ring->pending = signal_wait_alloc();
+	ring->complete = signal_wait_alloc();
+
+	// ring_free takes the pages and whatever else was allocated
+	if (!ring->queue || !ring->pending || !ring->complete) {
+		ring_free(ring);
+		return 0;
+	}
+
+	ring->shared = shared;
+	ring->cr3 = shared->cr3;
+	ring->header = (struct io_ring_header_t*)paging_ident(paddr);
+	ring->sqes = (struct io_ring_sqe_t*)((uint64_t)ring->header + sizeof(struct io_ring_header_t));
+	ring->cqes = (struct io_ring_cqe_t*)((uint64_t)ring->sqes + entries * sizeof(struct io_ring_sqe_t));
+	ring->entries = entries;
+	ring->sq_head = 0;
+	ring->cq_tail = 0;
+	ring->queue_head = 0;
+	ring->queue_tail = 0;
+	ring->inflight = 0;
+	ring->workers = 0;
+	ring->dying = 0;
+	lock_init(&ring->lock);
+
+	kmemset(ring->header, 0, size);
+	ring->header->entries = entries;
+	ring->header->sq_offset = sizeof(struct io_ring_header_t);
+	ring->header->cq_offset = (uint32_t)((uint64_t)ring->cqes - (uint64_t)ring->header);
+
+	for (uint32_t i = 0; i < IO_RING_WORKERS; i++) {
+		if (!(worker = process_from_func(ring_worker, ring))) {
+			break;
+		}
+
+		ring->workers++;
+		scheduler_schedule(worker);
+	}
+
+	if (!ring->workers) {
+		ring_free(ring);
+		return 0;
+	}
+
+	lock_acquire(&shared->lock);
+	if (shared->ring) {
+		lock_release(&shared->lock);
+
+		// another thread set up a ring first, the last worker out frees the memory
+		lock_acquire(&ring->lock);
+		ring->shared = 0;
+		lock_release(&ring->lock);
+
+		io_ring_exit(ring);
+		return 0;
+	}
+
+	shared->ring = ring;
+	vaddr = shared->mem_top;
+
+	for (uint64_t i = 0; i < size; i += PAGE_SIZE_4K) {
+		paging_map_proc(vaddr + i, paddr + i, PAGE_PRESENT | PAGE_RW | PAGE_US | PAGE_XD, PAGE_4K, (uint64_t*)shared->cr3);
+	}
+
+	shared->mem_top += size;
+	lock_release(&shared->lock);
+
+	return vaddr;
+}
+
+uint64_t io_ring_enter(struct io_ring_t* ring, uint32_t count, uint32_t min_complete) {
+	const uint32_t mask = ring->entries - 1;
+	uint32_t taken = 0, avail;
+	uint64_t seq;
+
+	lock_acquire(&ring->lock);
+
+	avail = __atomic_load_n(&ring->header->sq_tail, __ATOMIC_ACQUIRE) - ring->sq_head;
+	if (avail > ring->entries) {
+		avail = ring->entries;
+	}
+
+	// every submission taken has a completion slot waiting for it
+	for (; taken < count && taken < avail && ring->inflight + cq_ready(ring) < 2 * ring->entries; taken++) {
+		ring->queue[ring->queue_tail++ & (2 * ring->entries - 1)] = ring->sqes[ring->sq_head++ & mask];
+		__atomic_add_fetch(&ring->inflight, 1, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&ring->header->sq_head, ring->sq_head, __ATOMIC_RELEASE);
+	lock_release(&ring->lock);
+
+	if (taken) {
+		signal_awake(ring->pending);
+	}
+
+	while (1) {
+		seq = signal_seq(ring->complete);
+
+		// nothing left in flight can satisfy a larger wait
+		if (cq_ready(ring) >= min_complete || !__atomic_load_n(&ring->inflight, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+
+		signal_wait_seq(ring->complete, seq);
+	}
+
+	return taken;
+}
+
+void io_ring_exit(struct io_ring_t* ring) {
+	lock_acquire(&ring->lock);
+	ring->dying = 1;
+	lock_release(&ring->lock);
+
+	signal_awake(ring->pending);
+}
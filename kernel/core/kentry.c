@@ -28,6 +28,9 @@
 #include <core/time.h>
 #include <core/proc_data.h>
 #include <core/scheduler.h>
+#include <core/signal.h>
+#include <core/futex.h>
+#include <core/shm.h>
 #include <core/process.h>
 #include <core/lock.h>
 #include <core/fs.h>
@@ -42,6 +45,7 @@
 #include <lib/kmemcpy.h>
 
 #include <devfs/tty.h>
+#include <devfs/pipe.h>
 
 #ifdef MEM_TEST
 #include <mem_test/alloc_test.h>
@@ -100,6 +104,9 @@ void kentry(void) {
 	idt_init();
 	paging_ensure_mapped();
 	scheduler_init();
+	signal_timer_init();
+	futex_init();
+	shm_init();
 
 	init_done = 0;
 	lock_init(&prepare_userland_lock);
@@ -137,6 +144,7 @@ void kentry(void) {
 	fs_init();
 	mm_transaction_init();
 	tty_init();
+	pipe_init();
 	pcie_init();
 	pcie_enumerate();
 	logging_log_debug("Early PCIE init done");
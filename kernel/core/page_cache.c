@@ -0,0 +1,442 @@
+/* page_cache.c - file data page cache */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <core/page_cache.h>
+#include <core/alloc.h>
+#include <core/lock.h>
+#include <core/mm.h>
+#include <core/paging.h>
+
+#include <lib/radix_tree.h>
+
+#define PAGE_CACHE_BUCKETS	256
+#define RECLAIM_BATCH		32
+
+_Static_assert(PAGE_CACHE_PAGE_SIZE == PAGE_SIZE_4K, "cache pages must be mappable as single pages");
+
+struct cache_file_t {
+	const struct mount_cntx_t* cntx;
+	uint64_t ino;
+	uint64_t refs;
+	uint64_t size;
+	struct radix_tree_t* pages;
+	struct radix_tree_t* dirty;
+	struct cache_file_t* chain;
+};
+
+struct cache_page_t {
+	struct cache_file_t* file;
+	uint64_t index;
+	uint64_t paddr;
+	uint8_t* data;
+	uint64_t pins;
+	uint8_t uptodate;
+	uint8_t dirty;
+	struct cache_page_t* prev;
+	struct cache_page_t* next;
+};
+
+static struct cache_file_t* buckets[PAGE_CACHE_BUCKETS];
+static struct cache_page_t* lru_head;
+static struct cache_page_t* lru_tail;
+static uint64_t num_pages;
+static uint8_t cache_lock;
+
+static inline uint64_t file_hash(const struct mount_cntx_t* cntx, uint64_t ino) {
+	return (ino * 0x9E3779B97F4A7C15uLL) ^ (uint64_t)cntx;
+}
+
+static void lru_unlink(struct cache_page_t* page) {
+	if (page->prev) {
+		page->prev->next = page->next;
+	}
+	else {
+		lru_head = page->next;
+	}
+
+	if (page->next) {
+		page->next->prev = page->prev;
+	}
+	else {
+		lru_tail = page->prev;
+	}
+}
+
+static void lru_push(struct cache_page_t* page) {
+	page->prev = 0;
+	page->next = lru_head;
+
+	if (lru_head) {
+		lru_head->prev = page;
+	}
+	else {
+		lru_tail = page;
+	}
+
+	lru_head = page;
+}
+
+static struct cache_file_t** find_file(const struct mount_cntx_t* cntx, uint64_t ino) {
+	struct cache_file_t** i;
+
+	for (i = &buckets[file_hash(cntx, ino) % PAGE_CACHE_BUCKETS]; *i; i = &(*i)->chain) {
+		if ((*i)->cntx == cntx && (*i)->ino == ino) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+// files stay around while they have pages so a reopen finds them warm
+static void release_file(struct cache_file_t* file) {
+	struct cache_file_t** link;
+
+	if (file->refs || radix_tree_count(file->pages)) {
+		return;
+	}
+
+	link = find_file(file->cntx, file->ino);
+	*link = file->chain;
+
+	radix_tree_free(file->pages, 0);
+	radix_tree_free(file->dirty, 0);
+	kfree(file);
+}
+
+static void free_page(struct cache_page_t* page) {
+	void* ign;
+
+	radix_tree_remove(page->file->pages, page->index, &ign);
+
+	if (page->dirty) {
+		radix_tree_remove(page->file->dirty, page->index, &ign);
+	}
+
+	lru_unlink(page);
+	num_pages--;
+
+	mm_free_p(page->paddr, PAGE_SIZE_4K);
+	kfree(page);
+}
+
+static uint64_t reclaim(uint64_t count) {
+	struct cache_page_t* page, * prev;
+	struct cache_file_t* file;
+	uint64_t freed = 0;
+
+	for (page = lru_tail; page && freed < count; page = prev) {
+		prev = page->prev;
+
+		// dirty pages wait for their writeback
+		if (page->pins || page->dirty) {
+			continue;
+		}
+
+		file = page->file;
+		free_page(page);
+		release_file(file);
+		freed++;
+	}
+
+	return freed;
+}
+
+void page_cache_init(void) {
+	lock_init(&cache_lock);
+
+	for (uint64_t i = 0; i < PAGE_CACHE_BUCKETS; i++) {
+		buckets[i] = 0;
+	}
+
+	lru_head = 0;
+	lru_tail = 0;
+	num_pages = 0;
+}
+
+struct cache_file_t* page_cache_open(const struct mount_cntx_t* cntx, uint64_t ino, uint64_t size) {
+	struct cache_file_t** link;
+	struct cache_file_t* file;
+
+	lock_acquire(&cache_lock);
+	link = find_file(cntx, ino);
+
+	if (*link) {
+		file = *link;
+		file->refs++;
+
+		// without dirty pages the filesystem holds the newest size
+		if (!radix_tree_count(file->dirty)) {
+			file->size = size;
+		}
+
+		lock_release(&cache_lock);
+		return file;
+	}
+
+	file = kmalloc(sizeof(struct cache_file_t));
+
+	if (!file) {
+		lock_release(&cache_lock);
+		return 0;
+	}
+
+	file->pages = radix_tree_alloc();
+	file->dirty = radix_tree_alloc();
+
+	if (!file->pages || !file->dirty) {
+		if (file->pages) {
+			radix_tree_free(file->pages, 0);
+		}
+
+		if (file->dirty) {
+			radix_tree_free(file->dirty, 0);
+		}
+
+		kfree(file);
+		lock_release(&cache_lock);
+		return 0;
+	}
+
+	file->cntx = cntx;
+	file->ino = ino;
+	file->refs = 1;
+	file->size = size;
+	file->chain = 0;
+	*link = file;
+
+	lock_release(&cache_lock);
+
+	return file;
+}
+
+void page_cache_close(struct cache_file_t* file) {
+	lock_acquire(&cache_lock);
+	file->refs--;
+	release_file(file);
+	lock_release(&cache_lock);
+}
+
+uint64_t page_cache_size(struct cache_file_t* file) {
+	uint64_t size;
+
+	lock_acquire(&cache_lock);
+	size = file->size;
+	lock_release(&cache_lock);
+
+	return size;
+}
+
+void page_cache_set_size(struct cache_file_t* file, uint64_t size) {
+	lock_acquire(&cache_lock);
+	file->size = size;
+	lock_release(&cache_lock);
+}
+
+uint64_t page_cache_dirty_count(struct cache_file_t* file) {
+	uint64_t count;
+
+	lock_acquire(&cache_lock);
+	count = radix_tree_count(file->dirty);
+	lock_release(&cache_lock);
+
+	return count;
+}
+
+struct cache_page_t* page_cache_get(struct cache_file_t* file, uint64_t index) {
+	struct cache_page_t* page;
+	uint64_t paddr;
+
+	lock_acquire(&cache_lock);
+
+	if (radix_tree_get(file->pages, index, (void**)&page)) {
+		page->pins++;
+
+		lru_unlink(page);
+		lru_push(page);
+		lock_release(&cache_lock);
+		return page;
+	}
+
+	if (num_pages >= PAGE_CACHE_MAX_PAGES) {
+		reclaim(1);
+	}
+
+	paddr = mm_alloc_p(PAGE_SIZE_4K);
+
+	if (!paddr) {
+		// memory pressure, give back a batch of cold pages and retry once
+		reclaim(RECLAIM_BATCH);
+		paddr = mm_alloc_p(PAGE_SIZE_4K);
+	}
+
+	page = paddr ? kmalloc(sizeof(struct cache_page_t)) : 0;
+
+	if (!page) {
+		if (paddr) {
+			mm_free_p(paddr, PAGE_SIZE_4K);
+		}
+
+		lock_release(&cache_lock);
+		return 0;
+	}
+
+	page->file = file;
+	page->index = index;
+	page->paddr = paddr;
+	page->data = (uint8_t*)paging_ident(paddr);
+	page->pins = 1;
+	page->uptodate = 0;
+	page->dirty = 0;
+
+	if (radix_tree_insert(file->pages, index, page) != page) {
+		mm_free_p(paddr, PAGE_SIZE_4K);
+		kfree(page);
+		lock_release(&cache_lock);
+		return 0;
+	}
+
+	lru_push(page);
+	num_pages++;
+
+	lock_release(&cache_lock);
+
+	return page;
+}
+
+struct cache_page_t* page_cache_next_dirty(struct cache_file_t* file, uint64_t* index) {
+	struct cache_page_t* page = 0;
+
+	lock_acquire(&cache_lock);
+	if (radix_tree_next(file->dirty, index, (void**)&page)) {
+		page->pins++;
+	}
+	lock_release(&cache_lock);
+
+	return page;
+}
+
+void page_cache_put(struct cache_page_t* page) {
+	lock_acquire(&cache_lock);
+	page->pins--;
+	lock_release(&cache_lock);
+}
+
+uint8_t page_cache_replace(struct cache_page_t* page, uint64_t paddr) {
+	uint64_t old;
+
+	lock_acquire(&cache_lock);
+
+	// other pins may still be reading the old frame
+	if (page->pins != 1) {
+		lock_release(&cache_lock);
+		return 1;
+	}
+
+	old = page->paddr;
+	page->paddr = paddr;
+	page->data = (uint8_t*)paging_ident(paddr);
+	lock_release(&cache_lock);
+
+	mm_free_p(old, PAGE_SIZE_4K);
+
+	return 0;
+}
+
+uint8_t* page_cache_data(struct cache_page_t* page) {
+	return page->data;
+}
+
+uint64_t page_cache_paddr(struct cache_page_t* page) {
+	return page->paddr;
+}
+
+uint8_t page_cache_uptodate(struct cache_page_t* page) {
+	return __atomic_load_n(&page->uptodate, __ATOMIC_ACQUIRE);
+}
+
+void page_cache_mark_uptodate(struct cache_page_t* page) {
+	__atomic_store_n(&page->uptodate, 1, __ATOMIC_RELEASE);
+}
+
+uint8_t page_cache_mark_dirty(struct cache_page_t* page) {
+	uint8_t ret = 0;
+
+	lock_acquire(&cache_lock);
+	if (!page->dirty) {
+		if (radix_tree_insert(page->file->dirty, page->index, page) == page) {
+			page->dirty = 1;
+		}
+		else {
+			ret = 1;
+		}
+	}
+	lock_release(&cache_lock);
+
+	return ret;
+}
+
+void page_cache_mark_clean(struct cache_page_t* page) {
+	void* ign;
+
+	lock_acquire(&cache_lock);
+	if (page->dirty) {
+		radix_tree_remove(page->file->dirty, page->index, &ign);
+		page->dirty = 0;
+	}
+	lock_release(&cache_lock);
+}
+
+static void drop_pages(struct cache_file_t* file, uint8_t dirty) {
+	struct cache_page_t* page;
+	uint64_t index = 0;
+
+	lock_acquire(&cache_lock);
+	while (radix_tree_next(file->pages, &index, (void**)&page)) {
+		if (!page->pins && (dirty || !page->dirty)) {
+			free_page(page);
+		}
+
+		if (index == ~0uLL) {
+			break;
+		}
+
+		index++;
+	}
+	lock_release(&cache_lock);
+}
+
+void page_cache_invalidate(struct cache_file_t* file) {
+	drop_pages(file, 0);
+}
+
+void page_cache_discard(struct cache_file_t* file) {
+	drop_pages(file, 1);
+}
+
+uint64_t page_cache_reclaim(uint64_t count) {
+	uint64_t freed;
+
+	lock_acquire(&cache_lock);
+	freed = reclaim(count);
+	lock_release(&cache_lock);
+
+	return freed;
+}
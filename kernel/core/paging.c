@@ -218,6 +218,33 @@ uint64_t paging_ident(uint64_t paddr) {
 	return paddr + IDENT_BASE;
 }
 
+uint64_t paging_translate(uint64_t vaddr, uint64_t* pml4) {
+	uint64_t* access;
+	uint64_t entry;
+
+	lock_acquire(&paging_lock);
+	enum page_size_t lvl = page_walk(vaddr, &access, pml4);
+	entry = *access;
+	lock_release(&paging_lock);
+
+	if (!(entry & PAGE_PRESENT)) {
+		return 0;
+	}
+
+	switch (lvl) {
+		case PAGE_4K:
+			return (entry & PAGE_ADDR_MASK) | (vaddr & (PAGE_SIZE_4K - 1));
+		case PAGE_2M:
+			return (entry & PAGE_ADDR_PAT_MASK & ~(uint64_t)(PAGE_SIZE_2M - 1)) | (vaddr & (PAGE_SIZE_2M - 1));
+		case PAGE_1G:
+			return (entry & PAGE_ADDR_PAT_MASK & ~(uint64_t)(PAGE_SIZE_1G - 1)) | (vaddr & (PAGE_SIZE_1G - 1));
+		case _PAGE_512G:
+			break;
+	}
+
+	return 0;
+}
+
 void paging_install_guard(uint64_t vaddr) {
 	uint64_t* access;
 	lock_acquire(&paging_lock);
@@ -30,6 +30,10 @@
 #include <core/mm.h>
 #include <core/time.h>
 #include <core/fs.h>
+#include <core/io_ring.h>
+#include <core/epoll.h>
+#include <core/shm.h>
+#include <core/syscall.h>
 
 #include <lib/kmemset.h>
 #include <lib/array_list.h>
@@ -71,8 +75,8 @@ void process_init_ap(uint64_t init_rsp_vaddr, uint64_t init_rsp_paddr) {
 	pcb->init_k_rsp_vaddr = init_rsp_vaddr;
 	pcb->init_k_rsp_paddr = init_rsp_paddr;
 	pcb->sched_cntr = SCHED_SKIP;
-	pcb->fd_table = array_list_alloc(1, 1, 0);
-	pcb->wd = 0;
+	pcb->io_background = 0;
+	pcb->shared = process_shared_alloc(0, 0, array_list_alloc(1, 1, 0), 0);
 	proc_data_get()->current_process = pcb;
 	proc_data_get()->current_process->pid = process_assign_pid();
 	proc_data_get()->current_process->cr3 = 0;
@@ -123,13 +127,13 @@ struct pcb_t* process_from_vaddr(uint64_t vaddr) {
 	pcb->ss = GDT_KERNEL_SS;
 
 	pcb->sched_cntr = SCHED_READY;
+	pcb->io_background = 0;
 
 	pcb->cr3 = 0;
 
 	pcb->pid = process_assign_pid();
 
-	pcb->fd_table = array_list_alloc(1, 1, 0);
-	pcb->wd = fs_open("/", FILE_FLAGS_READ | FILE_FLAGS_WRITE);
+	pcb->shared = process_shared_alloc(0, 0, array_list_alloc(1, 1, 0), fs_open("/", FILE_FLAGS_READ | FILE_FLAGS_WRITE));
 
 	return pcb;
 }
@@ -147,6 +151,80 @@ struct pcb_t* process_from_func(process_function_t func, void* cntx) {
 	return pcb;
 }
 
+uint8_t process_io_background(uint8_t background) {
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	const uint8_t prev = pcb->io_background;
+
+	pcb->io_background = background;
+
+	return prev;
+}
+
+struct pcb_t* process_thread_from(struct pcb_t* parent, uint64_t rip, uint64_t rsp, uint64_t fsbase) {
+	uint64_t stack_paddr, stack_vaddr, k_rsp;
+	struct pcb_t* pcb;
+
+	// sysret faults in ring 0 on a non-canonical rip, and loading such an fsbase faults too.
+	// a stack may start right at the top since pushes go below it
+	if (rip >= CANON_LOW_END || rsp > CANON_LOW_END || fsbase >= CANON_LOW_END) {
+		return 0;
+	}
+
+	if (process_create_guarded_stack(&stack_vaddr, &stack_paddr, &k_rsp)) {
+		logging_log_error("Failed to allocate stack");
+		return 0;
+	}
+
+	pcb = kmalloc(sizeof(struct pcb_t));
+
+	pcb->rax =
+		pcb->rbx =
+		pcb->rcx =
+		pcb->rbp =
+		pcb->r8 =
+		pcb->r9 =
+		pcb->r10 =
+		pcb->r11 =
+		pcb->r12 =
+		pcb->r13 =
+		pcb->r14 =
+		pcb->r15 = 0;
+
+	pcb->rsp = k_rsp;
+	pcb->init_k_rsp_vaddr = stack_vaddr;
+	pcb->init_k_rsp_paddr = stack_paddr;
+
+	pcb->k_rsp_lo = (uint32_t)k_rsp;
+	pcb->k_rsp_hi = (uint32_t)(k_rsp >> 32);
+
+	// same fpu control state as the creating thread
+	cpu_save_fx(pcb->fxdata);
+
+	pcb->fsbase = fsbase;
+
+	// starts by returning to userland the way a new process does
+	pcb->rdi = rip;
+	pcb->rsi = INIT_RFLG;
+	pcb->rdx = rsp;
+
+	pcb->rflags = INIT_RFLG;
+	pcb->rip = (uint64_t)syscall_return;
+	pcb->cs = GDT_KERNEL_CS;
+	pcb->ss = GDT_KERNEL_SS;
+
+	pcb->sched_cntr = SCHED_READY;
+	pcb->io_background = 0;
+
+	pcb->cr3 = parent->shared->cr3;
+	pcb->pid = process_assign_pid();
+	pcb->exit_code = 0;
+
+	__atomic_add_fetch(&parent->shared->refs, 1, __ATOMIC_RELAXED);
+	pcb->shared = parent->shared;
+
+	return pcb;
+}
+
 void process_kill_current(void) {
 	lock_acquire(&lock_proc);
 	struct pcb_t* pcb = proc_data_get()->current_process;
@@ -160,6 +238,14 @@ static void close_fd(void* handle) {
 	fs_close(handle);
 }
 
+static void put_epoll(void* epoll) {
+	epoll_put(epoll);
+}
+
+static void put_shm(void* shm) {
+	shm_put(shm);
+}
+
 void process_discard(struct pcb_t* pcb) {
 	_Static_assert(INIT_STACK_SIZE == 4 * PAGE_SIZE_4K, "stack size must be page size multiple of four");
 	paging_unmap(pcb->init_k_rsp_vaddr + 1 * PAGE_SIZE_4K, PAGE_4K);
@@ -171,18 +257,57 @@ void process_discard(struct pcb_t* pcb) {
 	mm_free_v(pcb->init_k_rsp_vaddr, INIT_STACK_SIZE + PAGE_SIZE_4K);
 	mm_free_p(pcb->init_k_rsp_paddr, INIT_STACK_SIZE);
 
-	if (pcb->cr3) {
-		paging_free_userspace((uint64_t*)pcb->cr3);
+	logging_log_debug("Killed %lu (%ld)", pcb->pid, pcb->exit_code);
+
+	process_shared_put(pcb->shared);
+	kfree(pcb);
+}
+
+struct proc_shared_t* process_shared_alloc(uint64_t cr3, uint64_t mem_top, struct array_list_t* fd_table, struct fs_handle_t* wd) {
+	struct proc_shared_t* shared = kmalloc(sizeof(struct proc_shared_t));
+
+	shared->refs = 1;
+	shared->cr3 = cr3;
+	shared->mem_top = mem_top;
+	shared->wd = wd;
+	shared->fd_table = fd_table;
+	shared->epoll_table = array_list_alloc(1, 1, 0);
+	shared->shm_table = array_list_alloc(1, 1, 0);
+	lock_init(&shared->lock);
+	shared->ring = 0;
+
+	return shared;
+}
+
+void process_shared_put(struct proc_shared_t* shared) {
+	if (__atomic_sub_fetch(&shared->refs, 1, __ATOMIC_ACQ_REL)) {
+		return;
 	}
 
-	array_list_clear(pcb->fd_table, close_fd);
-	if (pcb->wd) {
-		fs_close(pcb->wd);
+	if (shared->ring) {
+		// the ring's last worker frees the process once nothing uses its memory
+		io_ring_exit(shared->ring);
+		return;
 	}
 
-	logging_log_debug("Killed %lu (%ld)", pcb->pid, pcb->exit_code);
+	process_shared_free(shared);
+}
 
-	kfree(pcb);
+void process_shared_free(struct proc_shared_t* shared) {
+	if (shared->cr3) {
+		paging_free_userspace((uint64_t*)shared->cr3);
+	}
+
+	// only safe once no page table maps the frames
+	array_list_free(shared->shm_table, put_shm);
+
+	array_list_free(shared->epoll_table, put_epoll);
+	array_list_free(shared->fd_table, close_fd);
+	if (shared->wd) {
+		fs_close(shared->wd);
+	}
+
+	kfree(shared);
 }
 
 void process_preempt_entry(struct preempt_frame_t* context) {
@@ -265,3 +390,98 @@ void process_set_callback(void (*callback)(struct pcb_t*)) {
 	current->sleep_state.callback = callback;
 	current->sched_cntr = SCHED_CALLBACK;
 }
+
+struct fs_handle_t* process_fd_get(struct pcb_t* pcb, uint64_t fd) {
+	struct fs_handle_t* handle;
+
+	lock_acquire(&pcb->shared->lock);
+	handle = array_list_get(pcb->shared->fd_table, fd);
+	if (handle) {
+		fs_dup(handle);
+	}
+	lock_release(&pcb->shared->lock);
+
+	return handle;
+}
+
+uint64_t process_fd_add(struct pcb_t* pcb, struct fs_handle_t* handle) {
+	uint64_t fd;
+
+	lock_acquire(&pcb->shared->lock);
+	fd = array_list_push(pcb->shared->fd_table, handle);
+	lock_release(&pcb->shared->lock);
+
+	return fd;
+}
+
+struct fs_handle_t* process_fd_remove(struct pcb_t* pcb, uint64_t fd) {
+	struct fs_handle_t* handle;
+
+	lock_acquire(&pcb->shared->lock);
+	handle = array_list_get(pcb->shared->fd_table, fd);
+	if (handle) {
+		array_list_remove(pcb->shared->fd_table, fd);
+	}
+	lock_release(&pcb->shared->lock);
+
+	return handle;
+}
+
+struct fs_handle_t* process_wd_get(struct pcb_t* pcb) {
+	struct fs_handle_t* handle;
+
+	lock_acquire(&pcb->shared->lock);
+	handle = pcb->shared->wd ? fs_dup(pcb->shared->wd) : 0;
+	lock_release(&pcb->shared->lock);
+
+	return handle;
+}
+
+void process_wd_set(struct pcb_t* pcb, struct fs_handle_t* handle) {
+	struct fs_handle_t* old;
+
+	lock_acquire(&pcb->shared->lock);
+	old = pcb->shared->wd;
+	pcb->shared->wd = handle;
+	lock_release(&pcb->shared->lock);
+
+	if (old) {
+		fs_close(old);
+	}
+}
+
+struct epoll_t* process_epoll_get(struct pcb_t* pcb, uint64_t id) {
+	struct epoll_t* epoll;
+
+	lock_acquire(&pcb->shared->lock);
+	epoll = array_list_get(pcb->shared->epoll_table, id);
+	if (epoll) {
+		epoll_dup(epoll);
+	}
+	lock_release(&pcb->shared->lock);
+
+	return epoll;
+}
+
+uint64_t process_epoll_add(struct pcb_t* pcb, struct epoll_t* epoll) {
+	uint64_t id;
+
+	lock_acquire(&pcb->shared->lock);
+	id = array_list_push(pcb->shared->epoll_table, epoll);
+	lock_release(&pcb->shared->lock);
+
+	return id;
+}
+
+struct epoll_t* process_epoll_remove(struct pcb_t* pcb, uint64_t id) {
+	struct epoll_t* epoll;
+
+	lock_acquire(&pcb->shared->lock);
+	epoll = array_list_get(pcb->shared->epoll_table, id);
+	if (epoll) {
+		array_list_remove(pcb->shared->epoll_table, id);
+	}
+	lock_release(&pcb->shared->lock);
+
+	return epoll;
+}
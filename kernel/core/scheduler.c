@@ -23,6 +23,7 @@
 #include <core/cpu_instr.h>
 #include <core/alloc.h>
 #include <core/proc_data.h>
+#include <core/signal.h>
 #include <core/gdt.h>
 #include <core/time.h>
 #include <core/logging.h>
@@ -80,7 +81,7 @@ void scheduler_run(void) {
 				lock_acquire(&lock_sched);
 				struct pcb_t* i = sleep_queue, **prev = &sleep_queue;
 
-				for (; i && current_pcb->sleep_state.wake_time < i->sleep_state.wake_time; i = i->next) {
+				for (; i && i->sleep_state.wake_time <= current_pcb->sleep_state.wake_time; i = i->next) {
 					prev = &i->next;
 				}
 				
@@ -99,10 +100,13 @@ void scheduler_run(void) {
 		}
 	}
 
+	// timers awake their waits, which takes lock_sched
+	const uint64_t now = time_since_init_fs();
+	signal_timer_run(now);
+
 	lock_acquire(&lock_sched);
 
 	// wakup sleeping processes
-	const uint64_t now = time_since_init_fs();
 	struct pcb_t* i, * next;
 	for (i = sleep_queue; i && i->sleep_state.wake_time <= now; i = next) {
 		next = i->next;
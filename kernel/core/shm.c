@@ -0,0 +1,206 @@
+/* shm.c - named shared memory objects */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+
+#include <core/shm.h>
+#include <core/process.h>
+#include <core/syscall_vectors.h>
+#include <core/alloc.h>
+#include <core/lock.h>
+#include <core/mm.h>
+#include <core/paging.h>
+
+#include <lib/kmemcpy.h>
+#include <lib/kmemset.h>
+#include <lib/kstrcmp.h>
+#include <lib/kstrlen.h>
+#include <lib/array_list.h>
+
+struct shm_t {
+	char* name;
+	uint64_t size;
+	uint64_t frame_size;
+	uint64_t num_frames;
+	uint64_t* frames;
+	uint64_t refs; // the name while linked and every holder
+	struct shm_t* next;
+};
+
+static struct shm_t* objects;
+static uint8_t shm_lock;
+
+static struct shm_t** find_object(const char* name) {
+	struct shm_t** i;
+
+	for (i = &objects; *i; i = &(*i)->next) {
+		if (!kstrcmp((*i)->name, name)) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+static void free_object(struct shm_t* shm) {
+	for (uint64_t i = 0; i < shm->num_frames; i++) {
+		mm_free_p(shm->frames[i], shm->frame_size);
+	}
+
+	kfree(shm->frames);
+	kfree(shm->name);
+	kfree(shm);
+}
+
+static struct shm_t* alloc_object(const char* name, size_t name_len, uint64_t size, uint32_t flags) {
+	const uint64_t frame_size = flags & SHM_HUGE ? PAGE_SIZE_2M : PAGE_SIZE_4K;
+	struct shm_t* shm = kmalloc(sizeof(struct shm_t));
+
+	if (!shm) {
+		return 0;
+	}
+
+	shm->frame_size = frame_size;
+	shm->num_frames = (size + frame_size - 1) / frame_size;
+	shm->size = shm->num_frames * frame_size;
+	shm->refs = 2;
+	shm->name = kmalloc(name_len + 1);
+	shm->frames = kmalloc(shm->num_frames * sizeof(uint64_t));
+
+	if (!shm->name || !shm->frames) {
+		if (shm->name) {
+			kfree(shm->name);
+		}
+
+		if (shm->frames) {
+			kfree(shm->frames);
+		}
+
+		kfree(shm);
+		return 0;
+	}
+
+	kmemcpy(shm->name, name, name_len + 1);
+
+	// frames may come from anywhere, every process maps them one by one
+	for (uint64_t i = 0; i < shm->num_frames; i++) {
+		shm->frames[i] = frame_size == PAGE_SIZE_2M ? mm_alloc_palign(frame_size, frame_size) : mm_alloc_p(frame_size);
+
+		if (!shm->frames[i]) {
+			shm->num_frames = i;
+			free_object(shm);
+			return 0;
+		}
+
+		kmemset((void*)paging_ident(shm->frames[i]), 0, frame_size);
+	}
+
+	return shm;
+}
+
+void shm_init(void) {
+	objects = 0;
+	lock_init(&shm_lock);
+}
+
+struct shm_t* shm_open(const char* name, uint64_t size, uint32_t flags) {
+	const size_t name_len = kstrlen(name);
+	struct shm_t** link, * shm;
+
+	// also keeps rounding up to whole frames from wrapping
+	if (!name_len || name_len >= SHM_NAME_MAX || size > SHM_SIZE_MAX) {
+		return 0;
+	}
+
+	lock_acquire(&shm_lock);
+	link = find_object(name);
+
+	if ((shm = *link)) {
+		if (size > shm->size) {
+			shm = 0;
+		}
+		else {
+			shm->refs++;
+		}
+	}
+	else if ((flags & SHM_CREATE) && size) {
+		// created under the lock so two openers cannot both create one
+		if ((shm = alloc_object(name, name_len, size, flags))) {
+			shm->next = 0;
+			*link = shm;
+		}
+	}
+	lock_release(&shm_lock);
+
+	return shm;
+}
+
+void shm_put(struct shm_t* shm) {
+	uint64_t refs;
+
+	lock_acquire(&shm_lock);
+	refs = --shm->refs;
+	lock_release(&shm_lock);
+
+	if (!refs) {
+		free_object(shm);
+	}
+}
+
+uint8_t shm_unlink(const char* name) {
+	struct shm_t** link, * shm;
+
+	lock_acquire(&shm_lock);
+	link = find_object(name);
+
+	if (!(shm = *link)) {
+		lock_release(&shm_lock);
+		return 1;
+	}
+
+	*link = shm->next;
+	lock_release(&shm_lock);
+
+	shm_put(shm);
+
+	return 0;
+}
+
+uint64_t shm_map(struct shm_t* shm, struct proc_shared_t* shared) {
+	const enum page_size_t page_size = shm->frame_size == PAGE_SIZE_2M ? PAGE_2M : PAGE_4K;
+	uint64_t vaddr;
+
+	lock_acquire(&shared->lock);
+
+	// huge frames need a huge aligned address
+	vaddr = (shared->mem_top + shm->frame_size - 1) & ~(shm->frame_size - 1);
+
+	// user pages are never unmapped, so even a partial mapping keeps its frames alive
+	array_list_push(shared->shm_table, shm);
+	shared->mem_top = vaddr + shm->size;
+
+	for (uint64_t i = 0; i < shm->num_frames; i++) {
+		if (!paging_map_proc(vaddr + i * shm->frame_size, shm->frames[i], PAGE_PRESENT | PAGE_RW | PAGE_US | PAGE_XD, page_size,
+					(uint64_t*)shared->cr3)) {
+			vaddr = 0;
+			break;
+		}
+	}
+	lock_release(&shared->lock);
+
+	return vaddr;
+}
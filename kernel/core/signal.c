@@ -27,13 +27,34 @@
 
 struct signal_wait_t {
 	struct pcb_t* queue;
+	uint64_t seq;
 	uint8_t lock;
 };
 
+struct signal_timer_t {
+	struct signal_wait_t* wait;
+	uint64_t wake_time;
+	struct signal_timer_t* next;
+	uint8_t armed; // still on the timer list
+};
+
+// sorted by wake_time, fired from scheduler_run so it is never held with interrupts on
+static struct signal_timer_t* timer_list;
+static uint8_t timer_lock;
+
 static void signal_wait_callback(struct pcb_t* pcb) {
 	struct signal_wait_t* wait = pcb->meta[0];
 
 	lock_acquire(&wait->lock);
+	if (wait->seq != (uint64_t)pcb->meta[1]) {
+		// awoken before we made it onto the queue
+		lock_release(&wait->lock);
+
+		pcb->sched_cntr = SCHED_SIGNAL_READY;
+		scheduler_schedule(pcb);
+		return;
+	}
+
 	pcb->next = wait->queue;
 	wait->queue = pcb;
 	lock_release(&wait->lock);
@@ -42,16 +63,34 @@ static void signal_wait_callback(struct pcb_t* pcb) {
 struct signal_wait_t* signal_wait_alloc(void) {
 	struct signal_wait_t* ret = kmalloc(sizeof(struct signal_wait_t));
 
+	if (!ret) {
+		return 0;
+	}
+
 	lock_init(&ret->lock);
 	ret->queue = 0;
+	ret->seq = 0;
 
 	return ret;
 }
 
+void signal_wait_free(struct signal_wait_t* wait) {
+	kfree(wait);
+}
+
+uint64_t signal_seq(struct signal_wait_t* wait) {
+	return __atomic_load_n(&wait->seq, __ATOMIC_ACQUIRE);
+}
+
 void signal_wait(struct signal_wait_t* wait) {
+	signal_wait_seq(wait, signal_seq(wait));
+}
+
+void signal_wait_seq(struct signal_wait_t* wait, uint64_t seq) {
 	struct pcb_t* current = proc_data_get()->current_process;
 
 	current->meta[0] = wait;
+	current->meta[1] = (void*)seq;
 	process_set_callback(signal_wait_callback);
 
 	while (current->sched_cntr != SCHED_SIGNAL_READY) {
@@ -66,6 +105,7 @@ void signal_awake(struct signal_wait_t* wait) {
 	lock_acquire(&wait->lock);
 	i = wait->queue;
 	wait->queue = 0;
+	__atomic_store_n(&wait->seq, wait->seq + 1, __ATOMIC_RELEASE);
 	lock_release(&wait->lock);
 
 	for (; i; i = next) {
@@ -75,3 +115,65 @@ void signal_awake(struct signal_wait_t* wait) {
 		scheduler_schedule(i);
 	}
 }
+
+void signal_timer_init(void) {
+	timer_list = 0;
+	lock_init(&timer_lock);
+}
+
+void signal_timer_run(uint64_t now) {
+	struct signal_timer_t* timer;
+
+	// fired under the lock, so a cancel that gets the lock after us sees the timer done
+	lock_acquire(&timer_lock);
+	while ((timer = timer_list) && timer->wake_time <= now) {
+		timer_list = timer->next;
+		timer->armed = 0;
+		signal_awake(timer->wait);
+	}
+	lock_release(&timer_lock);
+}
+
+struct signal_timer_t* signal_timer_start(struct signal_wait_t* wait, uint64_t wake_time) {
+	struct signal_timer_t* timer = kmalloc(sizeof(struct signal_timer_t));
+	struct signal_timer_t** prev = &timer_list;
+
+	if (!timer) {
+		return 0;
+	}
+
+	timer->wait = wait;
+	timer->wake_time = wake_time;
+	timer->armed = 1;
+
+	cpu_cli_if();
+	lock_acquire(&timer_lock);
+	while (*prev && (*prev)->wake_time <= wake_time) {
+		prev = &(*prev)->next;
+	}
+
+	timer->next = *prev;
+	*prev = timer;
+	lock_release(&timer_lock);
+	cpu_sti_if();
+
+	return timer;
+}
+
+void signal_timer_cancel(struct signal_timer_t* timer) {
+	struct signal_timer_t** prev = &timer_list;
+
+	cpu_cli_if();
+	lock_acquire(&timer_lock);
+	if (timer->armed) {
+		while (*prev != timer) {
+			prev = &(*prev)->next;
+		}
+
+		*prev = timer->next;
+	}
+	lock_release(&timer_lock);
+	cpu_sti_if();
+
+	kfree(timer);
+}
@@ -28,8 +28,17 @@
 #include <core/proc_data.h>
 #include <core/process.h>
 #include <core/time.h>
+#include <core/io_ring.h>
+#include <core/futex.h>
+#include <core/epoll.h>
+#include <core/shm.h>
+#include <devfs/pipe.h>
+#include <core/scheduler.h>
+#include <core/lock.h>
 
 #include <lib/kmemset.h>
+#include <lib/kmemcpy.h>
+#include <lib/kstrlen.h>
 #include <lib/array_list.h>
 
 #define ARGC_0 \
@@ -67,7 +76,58 @@
 
 #define ARGC_6
 
-#define USERLAND_AT_FDCWD -100
+#define USERLAND_DT_UNKNOWN	0
+#define USERLAND_DT_DIR			4
+#define USERLAND_DT_REG			8
+
+struct userland_dirent_t {
+	uint64_t d_ino;
+	int64_t d_off;
+	uint16_t d_reclen;
+	uint8_t d_type;
+	char d_name[];
+};
+
+struct dirent_fill_t {
+	uint8_t* buffer;
+	size_t max;
+	size_t used;
+	uint8_t full;
+};
+
+// pack one entry after the last, records stay 8 byte aligned
+static uint8_t dirent_emit(void* cntx, const struct dir_info_t* info) {
+	struct dirent_fill_t* fill = cntx;
+	const size_t name_len = kstrlen(info->name);
+	const size_t reclen = (sizeof(struct userland_dirent_t) + name_len + 1 + 7) & ~7uLL;
+
+	if (fill->used + reclen > fill->max) {
+		fill->full = 1;
+		return 1;
+	}
+
+	struct userland_dirent_t* dirent = (struct userland_dirent_t*)(fill->buffer + fill->used);
+	dirent->d_ino = info->inode_num;
+	dirent->d_off = (int64_t)info->seek_pos;
+	dirent->d_reclen = (uint16_t)reclen;
+
+	switch (info->type) {
+		case FILE_INFO_REG:
+			dirent->d_type = USERLAND_DT_REG;
+			break;
+		case FILE_INFO_DIR:
+			dirent->d_type = USERLAND_DT_DIR;
+			break;
+		default:
+			dirent->d_type = USERLAND_DT_UNKNOWN;
+			break;
+	}
+
+	kmemcpy(dirent->d_name, info->name, name_len + 1);
+	fill->used += reclen;
+
+	return 0;
+}
 
 DECLARE_SYSCALL(exit) {
 	ARGC_1;
@@ -85,10 +145,10 @@ DECLARE_SYSCALL(openat) {
 	struct fs_handle_t* at;
 
 	if ((int32_t)arg3 == USERLAND_AT_FDCWD) {
-		at = pcb->wd;
+		at = process_wd_get(pcb);
 	}
 	else {
-		at = array_list_get(pcb->fd_table, arg1);
+		at = process_fd_get(pcb, arg3);
 	}
 
 	if (!at) {
@@ -96,25 +156,26 @@ DECLARE_SYSCALL(openat) {
 	}
 
 	struct fs_handle_t* handle = fs_openat((const char*)arg1, (uint32_t)arg2, at, (uint32_t)arg4);
+	fs_close(at);
+
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return array_list_push(pcb->fd_table, handle);
+	return process_fd_add(pcb, handle);
 }
 
 DECLARE_SYSCALL(close) {
 	ARGC_1;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_remove(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
 	fs_close(handle);
-	array_list_remove(pcb->fd_table, arg1);
 
 	return SYSCALL_STS_OK;
 }
@@ -123,26 +184,32 @@ DECLARE_SYSCALL(read) {
 	ARGC_3;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return fs_read(handle, (void*)arg2, (size_t)arg3);
+	const size_t ret = fs_read(handle, (void*)arg2, (size_t)arg3);
+	fs_close(handle);
+
+	return ret;
 }
 
 DECLARE_SYSCALL(write) {
 	ARGC_3;
 	
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return fs_write(handle, (void*)arg2, (size_t)arg3);
+	const size_t ret = fs_write(handle, (void*)arg2, (size_t)arg3);
+	fs_close(handle);
+
+	return ret;
 }
 
 DECLARE_SYSCALL(alloc) {
@@ -159,7 +226,9 @@ DECLARE_SYSCALL(alloc) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	uint64_t vaddr = pcb->mem_top;
+	// threads allocating together must not be handed the same range
+	lock_acquire(&pcb->shared->lock);
+	uint64_t vaddr = pcb->shared->mem_top;
 
 	for (uint64_t i = 0; i < arg1; i += PAGE_SIZE_4K) {
 		paging_map_proc(vaddr + i,
@@ -168,7 +237,8 @@ DECLARE_SYSCALL(alloc) {
 										(uint64_t*)proc_data_get()->current_process->cr3);
 	}
 
-	pcb->mem_top += arg1;
+	pcb->shared->mem_top += arg1;
+	lock_release(&pcb->shared->lock);
 
 	return vaddr;
 }
@@ -177,90 +247,125 @@ DECLARE_SYSCALL(open_dir) {
 	ARGC_1;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return (uint64_t)fs_open_dir(handle);
+	const uint64_t ret = fs_open_dir(handle) ? arg1 : SYSCALL_STS_FAIL;
+	fs_close(handle);
+
+	return ret;
 }
 
 DECLARE_SYSCALL(read_dir) {
 	ARGC_3;
 
-	(void)arg1;
-	(void)arg2;
-	(void)arg3;
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
+
+	if (!handle) {
+		return SYSCALL_STS_FAIL;
+	}
 
-	//TODO
-	return SYSCALL_STS_FAIL;
+	struct dirent_fill_t fill = {
+		.buffer = (uint8_t*)arg2,
+		.max = arg3,
+		.used = 0,
+		.full = 0
+	};
+
+	const enum file_status_t sts = fs_read_dirs(handle, dirent_emit, &fill);
+	fs_close(handle);
+
+	// entries already packed are returned even if a later block failed
+	if (!fill.used && (sts != FILE_OK || fill.full)) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	return fill.used;
 }
 
 DECLARE_SYSCALL(truncate) {
 	ARGC_2;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return (fs_truncate(handle, (size_t)arg2) == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
+	const enum file_status_t sts = fs_truncate(handle, (size_t)arg2);
+	fs_close(handle);
+
+	return (sts == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
 }
 
 DECLARE_SYSCALL(seek) {
 	ARGC_2;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
 	fs_seek(handle, (uint64_t)arg2);
-	return fs_get_seek(handle);
+	const uint64_t ret = fs_get_seek(handle);
+	fs_close(handle);
+
+	return ret;
 }
 
 DECLARE_SYSCALL(tell) {
 	ARGC_1;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return fs_get_seek(handle);
+	const uint64_t ret = fs_get_seek(handle);
+	fs_close(handle);
+
+	return ret;
 }
 
 DECLARE_SYSCALL(create_dir) {
 	ARGC_1;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return (fs_create_dir(handle) == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
+	const enum file_status_t sts = fs_create_dir(handle);
+	fs_close(handle);
+
+	return (sts == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
 }
 
 DECLARE_SYSCALL(delete_dir) {
 	ARGC_1;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return (fs_delete_dir(handle) == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
+	const enum file_status_t sts = fs_delete_dir(handle);
+	fs_close(handle);
+
+	return (sts == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
 }
 
 DECLARE_SYSCALL(epoch_time) {
@@ -273,21 +378,30 @@ DECLARE_SYSCALL(is_a_tty) {
 	ARGC_1;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return fs_is_interactive(handle);
+	const uint8_t ret = fs_is_interactive(handle);
+	fs_close(handle);
+
+	return ret;
 }
 
 DECLARE_SYSCALL(gcwd) {
 	ARGC_2;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
+	struct fs_handle_t* wd = process_wd_get(pcb);
 
-	fs_path(pcb->wd, (size_t)arg2, (char*)arg1);
+	if (!wd) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	fs_path(wd, (size_t)arg2, (char*)arg1);
+	fs_close(wd);
 
 	return SYSCALL_STS_FAIL;
 }
@@ -296,13 +410,14 @@ DECLARE_SYSCALL(ccwd) {
 	ARGC_1;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	pcb->wd = handle;
+	// the working directory keeps its own reference once the fd is closed
+	process_wd_set(pcb, handle);
 
 	return SYSCALL_STS_OK;
 }
@@ -311,39 +426,47 @@ DECLARE_SYSCALL(link) {
 	ARGC_2;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle1 = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle1 = process_fd_get(pcb, arg1);
 
 	if (!handle1) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	struct fs_handle_t* handle2 = array_list_get(pcb->fd_table, arg2);
+	struct fs_handle_t* handle2 = process_fd_get(pcb, arg2);
 
 	if (!handle2) {
+		fs_close(handle1);
 		return SYSCALL_STS_FAIL;
 	}
 
-	return (fs_link(handle1, handle2) == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
+	const enum file_status_t sts = fs_link(handle1, handle2);
+	fs_close(handle1);
+	fs_close(handle2);
+
+	return (sts == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
 }
 
 DECLARE_SYSCALL(unlink) {
 	ARGC_1;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
 	}
 
-	return (fs_unlink(handle) == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
+	const enum file_status_t sts = fs_unlink(handle);
+	fs_close(handle);
+
+	return (sts == FILE_OK) ? SYSCALL_STS_OK : SYSCALL_STS_FAIL;
 }
 
 DECLARE_SYSCALL(stat) {
 	ARGC_2;
 
 	struct pcb_t* pcb = proc_data_get()->current_process;
-	struct fs_handle_t* handle = array_list_get(pcb->fd_table, arg1);
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
 
 	if (!handle) {
 		return SYSCALL_STS_FAIL;
@@ -354,7 +477,10 @@ DECLARE_SYSCALL(stat) {
 	};
 
 	struct file_info_t info;
-	if (fs_stat(handle, &info) != FILE_OK) {
+	const enum file_status_t sts = fs_stat(handle, &info);
+	fs_close(handle);
+
+	if (sts != FILE_OK) {
 		return SYSCALL_STS_FAIL;
 	}
 
@@ -363,3 +489,312 @@ DECLARE_SYSCALL(stat) {
 
 	return SYSCALL_STS_OK;
 }
+
+DECLARE_SYSCALL(preadv) {
+	ARGC_4;
+
+	struct pcb_t* pcb = proc_data_get()->current_process;
+
+	if (arg3 > FS_IOV_MAX) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
+
+	if (!handle) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	const size_t ret = fs_preadv(handle, (const struct fs_iovec_t*)arg2, arg3, arg4);
+	fs_close(handle);
+
+	return ret;
+}
+
+DECLARE_SYSCALL(pwritev) {
+	ARGC_4;
+
+	struct pcb_t* pcb = proc_data_get()->current_process;
+
+	if (arg3 > FS_IOV_MAX) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	struct fs_handle_t* handle = process_fd_get(pcb, arg1);
+
+	if (!handle) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	const size_t ret = fs_pwritev(handle, (const struct fs_iovec_t*)arg2, arg3, arg4);
+	fs_close(handle);
+
+	return ret;
+}
+
+DECLARE_SYSCALL(copy_range) {
+	ARGC_5;
+
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	struct fs_handle_t* in = process_fd_get(pcb, arg1);
+
+	if (!in) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	struct fs_handle_t* out = process_fd_get(pcb, arg2);
+
+	if (!out) {
+		fs_close(in);
+		return SYSCALL_STS_FAIL;
+	}
+
+	const uint64_t in_off = arg4 == USERLAND_SEEK_OFF ? fs_get_seek(in) : arg4;
+	const uint64_t out_off = arg5 == USERLAND_SEEK_OFF ? fs_get_seek(out) : arg5;
+	const size_t ret = fs_copy_range(in, in_off, out, out_off, arg3);
+
+	if (arg4 == USERLAND_SEEK_OFF) {
+		fs_seek(in, in_off + ret);
+	}
+
+	if (arg5 == USERLAND_SEEK_OFF) {
+		fs_seek(out, out_off + ret);
+	}
+
+	fs_close(in);
+	fs_close(out);
+
+	return ret;
+}
+
+DECLARE_SYSCALL(ring_setup) {
+	ARGC_1;
+
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	const uint64_t ring = io_ring_setup(pcb, (uint32_t)arg1);
+
+	return ring ? ring : SYSCALL_STS_FAIL;
+}
+
+DECLARE_SYSCALL(ring_enter) {
+	ARGC_2;
+
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	struct io_ring_t* ring = __atomic_load_n(&pcb->shared->ring, __ATOMIC_ACQUIRE);
+
+	if (!ring) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	return io_ring_enter(ring, (uint32_t)arg1, (uint32_t)arg2);
+}
+
+DECLARE_SYSCALL(futex) {
+	ARGC_5;
+
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	enum futex_status_t sts;
+
+	if (arg1 & 3) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	switch (arg2) {
+		case FUTEX_OP_WAIT:
+			sts = futex_wait(pcb->cr3, (uint32_t*)arg1, (uint32_t)arg3, arg4);
+			return sts == FUTEX_NO_MEM ? SYSCALL_STS_FAIL : (uint64_t)sts;
+		case FUTEX_OP_WAKE:
+			return futex_wake(pcb->cr3, (uint32_t*)arg1, arg3);
+		case FUTEX_OP_REQUEUE:
+			if (arg5 & 3) {
+				return SYSCALL_STS_FAIL;
+			}
+
+			return futex_requeue(pcb->cr3, (uint32_t*)arg1, arg3, (uint32_t*)arg5, arg4);
+		default:
+			return SYSCALL_STS_FAIL;
+	}
+}
+
+DECLARE_SYSCALL(thread_create) {
+	ARGC_3;
+
+	struct pcb_t* thread = process_thread_from(proc_data_get()->current_process, arg1, arg2, arg3);
+	uint64_t tid;
+
+	if (!thread) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	// the thread may already be gone by the time schedule returns
+	tid = thread->pid;
+	scheduler_schedule(thread);
+
+	return tid;
+}
+
+DECLARE_SYSCALL(epoll_create) {
+	ARGC_0;
+
+	struct epoll_t* epoll = epoll_alloc();
+
+	if (!epoll) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	return process_epoll_add(proc_data_get()->current_process, epoll);
+}
+
+DECLARE_SYSCALL(epoll_ctl) {
+	ARGC_5;
+
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	struct epoll_t* epoll = process_epoll_get(pcb, arg1);
+	struct fs_handle_t* handle = 0;
+	uint8_t ret;
+
+	if (!epoll) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	if (arg2 == EPOLL_CTL_ADD && !(handle = process_fd_get(pcb, arg3))) {
+		epoll_put(epoll);
+		return SYSCALL_STS_FAIL;
+	}
+
+	ret = epoll_ctl(epoll, (uint8_t)arg2, arg3, handle, (uint32_t)arg4, arg5);
+	if (ret && handle) {
+		fs_close(handle);
+	}
+
+	epoll_put(epoll);
+
+	return ret ? SYSCALL_STS_FAIL : SYSCALL_STS_OK;
+}
+
+DECLARE_SYSCALL(epoll_wait) {
+	ARGC_4;
+
+	struct epoll_t* epoll = process_epoll_get(proc_data_get()->current_process, arg1);
+	uint64_t ret;
+
+	if (!epoll) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	ret = epoll_wait(epoll, (struct epoll_event_t*)arg2, arg3, arg4);
+	epoll_put(epoll);
+
+	return ret;
+}
+
+DECLARE_SYSCALL(epoll_close) {
+	ARGC_1;
+
+	struct epoll_t* epoll = process_epoll_remove(proc_data_get()->current_process, arg1);
+
+	if (!epoll) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	epoll_put(epoll);
+
+	return SYSCALL_STS_OK;
+}
+
+DECLARE_SYSCALL(pipe) {
+	ARGC_1;
+
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	struct pipe_t* pipe = pipe_alloc();
+	struct fs_handle_t* read, * write;
+	char path[PIPE_PATH_MAX];
+	int32_t* fds = (int32_t*)arg1;
+
+	if (!pipe) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	pipe_path(pipe, 0, path);
+	read = fs_open(path, FILE_FLAGS_READ);
+	pipe_path(pipe, 1, path);
+	write = fs_open(path, FILE_FLAGS_WRITE);
+
+	// the open ends keep the pipe alive from here
+	pipe_put(pipe);
+
+	if (!read || !write) {
+		if (read) {
+			fs_close(read);
+		}
+
+		if (write) {
+			fs_close(write);
+		}
+
+		return SYSCALL_STS_FAIL;
+	}
+
+	fds[0] = (int32_t)process_fd_add(pcb, read);
+	fds[1] = (int32_t)process_fd_add(pcb, write);
+
+	return SYSCALL_STS_OK;
+}
+
+DECLARE_SYSCALL(splice) {
+	ARGC_5;
+
+	struct pcb_t* pcb = proc_data_get()->current_process;
+	struct fs_handle_t* in = process_fd_get(pcb, arg1);
+
+	if (!in) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	struct fs_handle_t* out = process_fd_get(pcb, arg2);
+
+	if (!out) {
+		fs_close(in);
+		return SYSCALL_STS_FAIL;
+	}
+
+	const uint64_t in_off = arg4 == USERLAND_SEEK_OFF ? fs_get_seek(in) : arg4;
+	const uint64_t out_off = arg5 == USERLAND_SEEK_OFF ? fs_get_seek(out) : arg5;
+	const size_t ret = fs_splice(in, in_off, out, out_off, arg3);
+
+	// pipes have no seek to advance
+	if (arg4 == USERLAND_SEEK_OFF) {
+		fs_seek(in, in_off + ret);
+	}
+
+	if (arg5 == USERLAND_SEEK_OFF) {
+		fs_seek(out, out_off + ret);
+	}
+
+	fs_close(in);
+	fs_close(out);
+
+	return ret;
+}
+
+DECLARE_SYSCALL(shm_map) {
+	ARGC_3;
+
+	struct shm_t* shm = shm_open((const char*)arg1, arg2, (uint32_t)arg3);
+	uint64_t vaddr;
+
+	if (!shm) {
+		return SYSCALL_STS_FAIL;
+	}
+
+	// the process holds the reference from here, even if mapping fails part way
+	vaddr = shm_map(shm, proc_data_get()->current_process->shared);
+
+	return vaddr ? vaddr : SYSCALL_STS_FAIL;
+}
+
+DECLARE_SYSCALL(shm_unlink) {
+	ARGC_1;
+
+	return shm_unlink((const char*)arg1) ? SYSCALL_STS_FAIL : SYSCALL_STS_OK;
+}
@@ -20,6 +20,7 @@
 
 #include <devfs/devfs.h>
 #include <devfs/tty.h>
+#include <devfs/pipe.h>
 
 #include <core/alloc.h>
 #include <core/fs.h>
@@ -29,10 +30,13 @@
 struct dev_handle_t {
 	union {
 		struct tty_handle_t* tty;
+		struct pipe_t* pipe;
 	} dev_handle;
 	enum {
-		DEV_TYPE_TTY
+		DEV_TYPE_TTY,
+		DEV_TYPE_PIPE
 	} type;
+	uint8_t write_end;
 };
 
 struct file_handle_t* devfs_open(struct mount_cntx_t* cntx, const char* path, uint32_t flags, uint32_t mode) {
@@ -56,6 +60,27 @@ struct file_handle_t* devfs_open(struct mount_cntx_t* cntx, const char* path, ui
 		return (struct file_handle_t*)dev_handle;
 	}
 
+	// pipe ends
+	if (!kmemcmp(path, "pipe", 4)) {
+		uint8_t write_end;
+		struct pipe_t* pipe = pipe_open(path + 4, &write_end);
+		if (!pipe) {
+			return 0;
+		}
+
+		dev_handle = kmalloc(sizeof(struct dev_handle_t));
+		if (!dev_handle) {
+			pipe_close(pipe, write_end);
+			return 0;
+		}
+
+		dev_handle->type = DEV_TYPE_PIPE;
+		dev_handle->dev_handle.pipe = pipe;
+		dev_handle->write_end = write_end;
+
+		return (struct file_handle_t*)dev_handle;
+	}
+
 	return 0;
 }
 
@@ -69,6 +94,9 @@ void devfs_close(struct file_handle_t* handle) {
 	switch (dev_handle->type) {
 		case DEV_TYPE_TTY:
 			break;
+		case DEV_TYPE_PIPE:
+			pipe_close(dev_handle->dev_handle.pipe, dev_handle->write_end);
+			break;
 	}
 
 	kfree(dev_handle);
@@ -86,6 +114,10 @@ enum file_status_t devfs_stat(struct file_handle_t* handle, struct file_info_t*
 			info->type = FILE_TYPE_CHAR;
 			info->size = TTY_READ_BUFFER_SIZE;
 			return FILE_OK;
+		case DEV_TYPE_PIPE:
+			info->type = FILE_TYPE_CHAR;
+			info->size = PIPE_BUFS * PIPE_BUF_SIZE;
+			return FILE_OK;
 	}
 }
 
@@ -99,6 +131,8 @@ size_t devfs_read(struct file_handle_t* handle, void* buffer, size_t count) {
 	switch (dev_handle->type) {
 		case DEV_TYPE_TTY:
 			return tty_read(dev_handle->dev_handle.tty, buffer, count);
+		case DEV_TYPE_PIPE:
+			return dev_handle->write_end ? 0 : pipe_read(dev_handle->dev_handle.pipe, buffer, count);
 	}
 }
 
@@ -111,6 +145,7 @@ uint64_t devfs_get_seek(struct file_handle_t* handle) {
 
 	switch (dev_handle->type) {
 		case DEV_TYPE_TTY:
+		case DEV_TYPE_PIPE:
 			return 0;
 	}
 }
@@ -127,6 +162,7 @@ enum file_status_t devfs_seek(struct file_handle_t* handle, uint64_t seek) {
 
 	switch (dev_handle->type) {
 		case DEV_TYPE_TTY:
+		case DEV_TYPE_PIPE:
 			return FILE_NO_SUPPORT;
 	}
 }
@@ -142,6 +178,8 @@ size_t devfs_write(struct file_handle_t* handle, const void* buffer, size_t coun
 		case DEV_TYPE_TTY:
 			tty_write(dev_handle->dev_handle.tty, buffer, count);
 			return count;
+		case DEV_TYPE_PIPE:
+			return dev_handle->write_end ? pipe_write(dev_handle->dev_handle.pipe, buffer, count) : 0;
 	}
 }
 
@@ -203,5 +241,33 @@ uint8_t devfs_is_interactive(struct file_handle_t* handle) {
 	switch (dev_handle->type) {
 		case DEV_TYPE_TTY:
 			return 1;
+		case DEV_TYPE_PIPE:
+			return 0;
 	}
 }
+
+uint32_t devfs_poll(struct file_handle_t* handle, struct poll_head_t** head) {
+	struct dev_handle_t* dev_handle = (struct dev_handle_t*)handle;
+
+	if (!dev_handle) {
+		return 0;
+	}
+
+	switch (dev_handle->type) {
+		case DEV_TYPE_TTY:
+			return tty_poll(dev_handle->dev_handle.tty, head);
+		case DEV_TYPE_PIPE:
+			return pipe_poll(dev_handle->dev_handle.pipe, dev_handle->write_end, head);
+	}
+}
+
+struct pipe_t* devfs_pipe(struct file_handle_t* handle, uint8_t* write_end) {
+	struct dev_handle_t* dev_handle = (struct dev_handle_t*)handle;
+
+	if (!dev_handle || dev_handle->type != DEV_TYPE_PIPE) {
+		return 0;
+	}
+
+	*write_end = dev_handle->write_end;
+	return dev_handle->dev_handle.pipe;
+}
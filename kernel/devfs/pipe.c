@@ -0,0 +1,427 @@
+/* pipe.c - anonymous pipes */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <devfs/pipe.h>
+
+#include <core/alloc.h>
+#include <core/lock.h>
+#include <core/mm.h>
+#include <core/paging.h>
+#include <core/signal.h>
+#include <core/epoll.h>
+#include <core/fs.h>
+#include <core/page_cache.h>
+
+#include <lib/kmemcpy.h>
+
+#define PIPE_TABLE_BUCKETS	64
+
+#define SLOT(p, i)		(&(p)->bufs[(i) % PIPE_BUFS])
+#define EMPTY(p)			((p)->head == (p)->tail)
+#define FULL(p)				((p)->head - (p)->tail == PIPE_BUFS)
+
+_Static_assert(PIPE_BUF_SIZE == PAGE_CACHE_PAGE_SIZE, "spliced buffers are whole cache pages");
+
+struct pipe_t {
+	uint64_t id;
+	struct pipe_buf_t bufs[PIPE_BUFS];
+	uint32_t head; // next slot to fill
+	uint32_t tail; // oldest queued slot
+	uint64_t readers;
+	uint64_t writers;
+	uint64_t refs; // open ends and the creator
+	struct signal_wait_t* readable;
+	struct signal_wait_t* writable;
+	struct poll_head_t poll;
+	struct pipe_t* chain;
+	uint8_t lock;
+};
+
+static struct pipe_t* table[PIPE_TABLE_BUCKETS];
+static uint64_t next_id;
+static uint8_t table_lock;
+
+static void wake_readers(struct pipe_t* pipe) {
+	signal_awake(pipe->readable);
+	poll_notify(&pipe->poll);
+}
+
+static void wake_writers(struct pipe_t* pipe) {
+	signal_awake(pipe->writable);
+	poll_notify(&pipe->poll);
+}
+
+void pipe_init(void) {
+	for (uint64_t i = 0; i < PIPE_TABLE_BUCKETS; i++) {
+		table[i] = 0;
+	}
+
+	next_id = 0;
+	lock_init(&table_lock);
+}
+
+struct pipe_t* pipe_alloc(void) {
+	struct pipe_t* pipe = kmalloc(sizeof(struct pipe_t));
+
+	if (!pipe) {
+		return 0;
+	}
+
+	pipe->head = 0;
+	pipe->tail = 0;
+	pipe->readers = 0;
+	pipe->writers = 0;
+	pipe->refs = 1;
+	pipe->readable = signal_wait_alloc();
+	pipe->writable = signal_wait_alloc();
+	poll_head_init(&pipe->poll);
+	lock_init(&pipe->lock);
+
+	lock_acquire(&table_lock);
+	pipe->id = next_id++;
+	pipe->chain = table[pipe->id % PIPE_TABLE_BUCKETS];
+	table[pipe->id % PIPE_TABLE_BUCKETS] = pipe;
+	lock_release(&table_lock);
+
+	return pipe;
+}
+
+void pipe_put(struct pipe_t* pipe) {
+	struct pipe_t** link;
+
+	lock_acquire(&table_lock);
+	if (--pipe->refs) {
+		lock_release(&table_lock);
+		return;
+	}
+
+	for (link = &table[pipe->id % PIPE_TABLE_BUCKETS]; *link != pipe; link = &(*link)->chain);
+	*link = pipe->chain;
+	lock_release(&table_lock);
+
+	for (; !EMPTY(pipe); pipe->tail++) {
+		pipe_buf_release(SLOT(pipe, pipe->tail));
+	}
+
+	signal_wait_free(pipe->readable);
+	signal_wait_free(pipe->writable);
+	kfree(pipe);
+}
+
+void pipe_path(struct pipe_t* pipe, uint8_t write_end, char* buffer) {
+	static const char prefix[] = "/dev/pipe";
+	char digits[20];
+	uint64_t id = pipe->id;
+	uint64_t n = 0;
+
+	do {
+		digits[n++] = (char)('0' + id % 10);
+		id /= 10;
+	} while (id);
+
+	kmemcpy(buffer, prefix, sizeof(prefix) - 1);
+	buffer += sizeof(prefix) - 1;
+
+	while (n) {
+		*buffer++ = digits[--n];
+	}
+
+	*buffer++ = write_end ? 'w' : 'r';
+	*buffer = 0;
+}
+
+struct pipe_t* pipe_open(const char* name, uint8_t* write_end) {
+	struct pipe_t* pipe;
+	uint64_t id = 0;
+
+	if (*name < '0' || *name > '9') {
+		return 0;
+	}
+
+	for (; *name >= '0' && *name <= '9'; name++) {
+		id = id * 10 + (uint64_t)(*name - '0');
+	}
+
+	if ((*name != 'r' && *name != 'w') || name[1]) {
+		return 0;
+	}
+
+	*write_end = *name == 'w';
+
+	lock_acquire(&table_lock);
+	for (pipe = table[id % PIPE_TABLE_BUCKETS]; pipe && pipe->id != id; pipe = pipe->chain);
+
+	if (pipe) {
+		pipe->refs++;
+
+		lock_acquire(&pipe->lock);
+		if (*write_end) {
+			pipe->writers++;
+		}
+		else {
+			pipe->readers++;
+		}
+		lock_release(&pipe->lock);
+	}
+	lock_release(&table_lock);
+
+	return pipe;
+}
+
+void pipe_close(struct pipe_t* pipe, uint8_t write_end) {
+	lock_acquire(&pipe->lock);
+	if (write_end) {
+		pipe->writers--;
+	}
+	else {
+		pipe->readers--;
+	}
+	lock_release(&pipe->lock);
+
+	// the other side may be waiting on an end that is now gone
+	wake_readers(pipe);
+	signal_awake(pipe->writable);
+
+	pipe_put(pipe);
+}
+
+size_t pipe_read(struct pipe_t* pipe, void* buffer, size_t count) {
+	struct pipe_buf_t* slot;
+	uint8_t* write = buffer;
+	size_t read = 0, n;
+	uint64_t seq;
+
+	if (!count) {
+		return 0;
+	}
+
+	while (1) {
+		seq = signal_seq(pipe->readable);
+
+		lock_acquire(&pipe->lock);
+		if (!EMPTY(pipe) || !pipe->writers) {
+			break;
+		}
+		lock_release(&pipe->lock);
+
+		signal_wait_seq(pipe->readable, seq);
+	}
+
+	while (count && !EMPTY(pipe)) {
+		slot = SLOT(pipe, pipe->tail);
+		n = slot->len < count ? slot->len : count;
+
+		kmemcpy(write, slot->data + slot->offset, n);
+		slot->offset += (uint32_t)n;
+		slot->len -= (uint32_t)n;
+
+		write += n;
+		read += n;
+		count -= n;
+
+		if (!slot->len) {
+			pipe_buf_release(slot);
+			pipe->tail++;
+		}
+	}
+	lock_release(&pipe->lock);
+
+	if (read) {
+		wake_writers(pipe);
+	}
+
+	return read;
+}
+
+size_t pipe_write(struct pipe_t* pipe, const void* buffer, size_t count) {
+	const uint8_t* read = buffer;
+	struct pipe_buf_t* slot;
+	size_t written = 0, n;
+	uint64_t seq, paddr;
+
+	while (written < count) {
+		seq = signal_seq(pipe->writable);
+
+		lock_acquire(&pipe->lock);
+		if (!pipe->readers) {
+			lock_release(&pipe->lock);
+			break;
+		}
+
+		slot = EMPTY(pipe) ? 0 : SLOT(pipe, pipe->head - 1);
+
+		// top up the newest page before taking another
+		if (!slot || !slot->merge || slot->offset + slot->len == PIPE_BUF_SIZE) {
+			if (FULL(pipe)) {
+				lock_release(&pipe->lock);
+				signal_wait_seq(pipe->writable, seq);
+				continue;
+			}
+
+			if (!(paddr = mm_alloc_p(PIPE_BUF_SIZE))) {
+				lock_release(&pipe->lock);
+				break;
+			}
+
+			slot = SLOT(pipe, pipe->head);
+			slot->paddr = paddr;
+			slot->data = (uint8_t*)paging_ident(paddr);
+			slot->page = 0;
+			slot->offset = 0;
+			slot->len = 0;
+			slot->merge = 1;
+			pipe->head++;
+		}
+
+		n = PIPE_BUF_SIZE - slot->offset - slot->len;
+		if (n > count - written) {
+			n = count - written;
+		}
+
+		kmemcpy(slot->data + slot->offset + slot->len, read, n);
+		slot->len += (uint32_t)n;
+		lock_release(&pipe->lock);
+
+		read += n;
+		written += n;
+
+		wake_readers(pipe);
+	}
+
+	return written;
+}
+
+uint32_t pipe_poll(struct pipe_t* pipe, uint8_t write_end, struct poll_head_t** head) {
+	uint32_t ready = 0;
+
+	*head = &pipe->poll;
+
+	lock_acquire(&pipe->lock);
+	if (write_end) {
+		// a write with no readers left fails instead of blocking
+		if (!FULL(pipe) || !pipe->readers) {
+			ready = FS_POLL_OUT;
+		}
+	}
+	else if (!EMPTY(pipe) || !pipe->writers) {
+		ready = FS_POLL_IN;
+	}
+	lock_release(&pipe->lock);
+
+	return ready;
+}
+
+uint8_t pipe_peek(struct pipe_t* pipe, struct pipe_buf_t* buf, uint8_t block) {
+	struct pipe_buf_t* slot;
+	uint64_t seq;
+
+	while (1) {
+		seq = signal_seq(pipe->readable);
+
+		lock_acquire(&pipe->lock);
+		if (!EMPTY(pipe)) {
+			break;
+		}
+
+		if (!pipe->writers || !block) {
+			lock_release(&pipe->lock);
+			return 1;
+		}
+		lock_release(&pipe->lock);
+
+		signal_wait_seq(pipe->readable, seq);
+	}
+
+	// the buffer may be handed over whole, so it must stop growing
+	slot = SLOT(pipe, pipe->tail);
+	slot->merge = 0;
+	*buf = *slot;
+	lock_release(&pipe->lock);
+
+	return 0;
+}
+
+void pipe_consume(struct pipe_t* pipe, size_t count, uint8_t stolen) {
+	struct pipe_buf_t* slot;
+
+	if (!count && !stolen) {
+		return;
+	}
+
+	lock_acquire(&pipe->lock);
+	slot = SLOT(pipe, pipe->tail);
+
+	if (stolen) {
+		pipe->tail++;
+	}
+	else {
+		slot->offset += (uint32_t)count;
+		slot->len -= (uint32_t)count;
+
+		if (!slot->len) {
+			pipe_buf_release(slot);
+			pipe->tail++;
+		}
+	}
+	lock_release(&pipe->lock);
+
+	wake_writers(pipe);
+}
+
+uint8_t pipe_push(struct pipe_t* pipe, const struct pipe_buf_t* buf) {
+	struct pipe_buf_t* slot;
+	uint64_t seq;
+
+	while (1) {
+		seq = signal_seq(pipe->writable);
+
+		lock_acquire(&pipe->lock);
+		if (!pipe->readers) {
+			lock_release(&pipe->lock);
+			return 1;
+		}
+
+		if (!FULL(pipe)) {
+			break;
+		}
+		lock_release(&pipe->lock);
+
+		signal_wait_seq(pipe->writable, seq);
+	}
+
+	slot = SLOT(pipe, pipe->head);
+	*slot = *buf;
+	slot->merge = 0;
+	pipe->head++;
+	lock_release(&pipe->lock);
+
+	wake_readers(pipe);
+
+	return 0;
+}
+
+void pipe_buf_release(const struct pipe_buf_t* buf) {
+	if (buf->page) {
+		page_cache_put(buf->page);
+	}
+	else {
+		mm_free_p(buf->paddr, PIPE_BUF_SIZE);
+	}
+}
@@ -26,6 +26,8 @@
 #include <core/mm.h>
 #include <core/paging.h>
 #include <core/signal.h>
+#include <core/epoll.h>
+#include <core/fs.h>
 
 #include <lib/kstrcmp.h>
 #include <lib/kmemcpy.h>
@@ -52,7 +54,9 @@ struct tty_handle_t {
 	uint8_t* read_buffer;
 	uint16_t write_index;
 	uint16_t read_index;
+	uint16_t lines; // newlines in the ring, a cooked read returns at the first one
 	struct signal_wait_t* signal;
+	struct poll_head_t poll;
 	enum {
 		TTY_MODE_COOKED,
 		TTY_MODE_RAW
@@ -73,14 +77,18 @@ void tty_init(void) {
 	com1.read_buffer = (uint8_t*)paging_ident(mm_alloc_p(TTY_READ_BUFFER_SIZE));
 	com1.write_index = 0;
 	com1.read_index = 0;
+	com1.lines = 0;
 	com1.signal = signal_wait_alloc();
+	poll_head_init(&com1.poll);
 	lock_init(&com1.lock);
 
 	com2.writer = serial_write_com2;
 	com2.read_buffer = (uint8_t*)paging_ident(mm_alloc_p(TTY_READ_BUFFER_SIZE));
 	com2.write_index = 0;
 	com2.read_index = 0;
+	com2.lines = 0;
 	com2.signal = signal_wait_alloc();
+	poll_head_init(&com2.poll);
 	lock_init(&com2.lock);
 
 	serial_init_interrupts();
@@ -130,9 +138,13 @@ size_t tty_read(struct tty_handle_t* tty, void* buffer, size_t count) {
 			count--;
 			read++;
 
-			if (*write == '\n' && tty->tty_mode == TTY_MODE_COOKED) {
-				// cooked mode must return early on newline
-				count = 0;
+			if (*write == '\n') {
+				__atomic_sub_fetch(&tty->lines, 1, __ATOMIC_RELEASE);
+
+				if (tty->tty_mode == TTY_MODE_COOKED) {
+					// cooked mode must return early on newline
+					count = 0;
+				}
 			}
 
 			write++;
@@ -174,6 +186,10 @@ uint8_t tty_queue_read(struct tty_handle_t* tty, uint8_t byte) {
 	tty->write_index++;
 	tty->write_index &= TTY_RING_MASK;
 
+	if (byte == '\n') {
+		__atomic_add_fetch(&tty->lines, 1, __ATOMIC_RELEASE);
+	}
+
 	if (tty->tty_mode == TTY_MODE_COOKED) {
 		// echoback on cooked
 		switch (byte) {
@@ -187,6 +203,25 @@ uint8_t tty_queue_read(struct tty_handle_t* tty, uint8_t byte) {
 	}
 
 	signal_awake(tty->signal);
+	poll_notify(&tty->poll);
 
 	return 1;
 }
+
+uint32_t tty_poll(struct tty_handle_t* tty, struct poll_head_t** head) {
+	const uint16_t read_index = __atomic_load_n(&tty->read_index, __ATOMIC_ACQUIRE);
+	const uint16_t write_index = __atomic_load_n(&tty->write_index, __ATOMIC_ACQUIRE);
+	uint8_t ready;
+
+	*head = &tty->poll;
+
+	if (tty->tty_mode == TTY_MODE_COOKED) {
+		// a cooked read blocks until a whole line is in, or until no more input fits
+		ready = __atomic_load_n(&tty->lines, __ATOMIC_ACQUIRE) || FULL(read_index, write_index);
+	}
+	else {
+		ready = !EMPTY(read_index, write_index);
+	}
+
+	return (ready ? FS_POLL_IN : 0) | FS_POLL_OUT;
+}
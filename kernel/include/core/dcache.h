@@ -0,0 +1,43 @@
+/* dcache.h - directory entry cache interface */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef KERNEL_CORE_DCACHE_H
+#define KERNEL_CORE_DCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kernel/core/fs.h>
+
+#define DCACHE_MAX_ENTRIES	4096
+
+/* inode number stored for a name known not to exist */
+#define DCACHE_NEGATIVE			0
+
+extern void dcache_init(void);
+
+/* returns 1 on hit, *ino is DCACHE_NEGATIVE for a cached miss */
+extern uint8_t dcache_lookup(const struct mount_cntx_t* cntx, uint64_t parent, const char* name, size_t len, uint64_t* ino);
+
+/* a negative insert never replaces a positive entry, removals go through dcache_invalidate */
+extern void dcache_insert(const struct mount_cntx_t* cntx, uint64_t parent, const char* name, size_t len, uint64_t ino);
+
+extern void dcache_invalidate(const struct mount_cntx_t* cntx, uint64_t parent, const char* name, size_t len);
+extern void dcache_invalidate_dir(const struct mount_cntx_t* cntx, uint64_t parent);
+extern void dcache_invalidate_mount(const struct mount_cntx_t* cntx);
+
+#endif /* KERNEL_CORE_DCACHE_H */
@@ -0,0 +1,60 @@
+/* epoll.h - readiness interest lists */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef KERNEL_CORE_EPOLL_H
+#define KERNEL_CORE_EPOLL_H
+
+#include <stdint.h>
+
+#include <kernel/core/fs.h>
+
+#define EPOLL_MAX_EVENTS	256
+
+struct epoll_item_t;
+
+struct epoll_t;
+
+/* kept by a source whose readiness changes, see fs_poll_t */
+struct poll_head_t {
+	struct epoll_item_t* items;
+	uint8_t lock;
+};
+
+/* laid out like struct epoll_event */
+struct epoll_event_t {
+	uint32_t events;
+	uint64_t data;
+} __attribute__((packed));
+
+extern void poll_head_init(struct poll_head_t* head);
+
+/* wake every instance watching head, safe from interrupt handlers */
+extern void poll_notify(struct poll_head_t* head);
+
+extern struct epoll_t* epoll_alloc(void);
+
+/* another reference to the same instance, each one is dropped with epoll_put */
+extern struct epoll_t* epoll_dup(struct epoll_t* epoll);
+extern void epoll_put(struct epoll_t* epoll);
+
+/* a successful add takes over the reference to handle, returns 1 on failure */
+extern uint8_t epoll_ctl(struct epoll_t* epoll, uint8_t op, uint64_t fd, struct fs_handle_t* handle, uint32_t events, uint64_t data);
+
+/* fill up to max ready events, waiting up to timeout_ns, ~0 waits forever */
+extern uint64_t epoll_wait(struct epoll_t* epoll, struct epoll_event_t* events, uint64_t max, uint64_t timeout_ns);
+
+#endif /* KERNEL_CORE_EPOLL_H */
@@ -30,12 +30,17 @@
 #define FILE_INFO_REG			1
 #define FILE_INFO_DIR			2
 
+#define FS_POLL_IN				0x1
+#define FS_POLL_OUT				0x4
+
 struct mount_cntx_t;
 
 struct file_handle_t;
 
 struct fs_handle_t;
 
+struct poll_head_t;
+
 enum file_status_t {
 	FILE_OK,
 	FILE_ERROR,
@@ -55,6 +60,14 @@ struct file_info_t {
 	uint64_t size;
 };
 
+/* one segment of a vectored transfer, laid out like struct iovec */
+struct fs_iovec_t {
+	void* base;
+	size_t len;
+};
+
+#define FS_IOV_MAX	1024
+
 struct dir_info_t {
 	uint64_t inode_num;
 	uint64_t seek_pos;
@@ -77,6 +90,12 @@ typedef enum file_status_t (*fs_open_dir_t)(struct file_handle_t*);
 
 typedef enum file_status_t (*fs_read_dir_t)(struct file_handle_t*, struct dir_info_t*);
 
+/* takes one entry, returns 1 to stop with the entry left unread */
+typedef uint8_t (*fs_dir_emit_t)(void*, const struct dir_info_t*);
+
+/* hands entries to emit until it stops or the directory ends */
+typedef enum file_status_t (*fs_read_dirs_t)(struct file_handle_t*, fs_dir_emit_t, void*);
+
 typedef enum file_status_t (*fs_create_dir_t)(struct file_handle_t*);
 typedef enum file_status_t (*fs_delete_dir_t)(struct file_handle_t*);
 
@@ -86,32 +105,47 @@ typedef enum file_status_t (*fs_unlink_t)(struct file_handle_t*);
 
 typedef uint8_t (*fs_is_interactive_t)(struct file_handle_t*);
 
+/* inode number keying the file's data in the page cache, 0 if it must not be cached */
+typedef uint64_t (*fs_cache_ino_t)(struct file_handle_t*);
+
+/* FS_POLL_* bits ready now, head is notified whenever they may have changed */
+typedef uint32_t (*fs_poll_t)(struct file_handle_t*, struct poll_head_t**);
+
+/* operations of one filesystem type, shared by all of its mounts */
+struct fs_ops_t {
+	fs_open_t open;
+	fs_close_t close;
+	fs_stat_t stat;
+	fs_read_t read;
+	fs_get_seek_t get_seek;
+	fs_seek_t seek;
+	fs_write_t write;
+	fs_delete_final_t delete_final;
+	fs_open_dir_t open_dir;
+	fs_read_dir_t read_dir;
+	fs_create_dir_t create_dir;
+	fs_delete_dir_t delete_dir;
+	fs_truncate_t truncate;
+	fs_link_t link;
+	fs_unlink_t unlink;
+	fs_is_interactive_t is_interactive; // optional
+	fs_cache_ino_t cache_ino; // optional
+	fs_read_dirs_t read_dirs; // optional
+	fs_poll_t poll; // optional, files without it are always ready
+};
+
 void fs_init(void);
 
-enum file_status_t fs_mount(
-		const char* mountpoint,
-		struct mount_cntx_t* cntx,
-		fs_open_t open,
-		fs_close_t close,
-		fs_stat_t stat,
-		fs_read_t read,
-		fs_get_seek_t get_seek,
-		fs_seek_t seek,
-		fs_write_t write,
-		fs_delete_final_t delete_final,
-		fs_open_dir_t open_dir,
-		fs_read_dir_t read_dir,
-		fs_create_dir_t create_dir,
-		fs_delete_dir_t delete_dir,
-		fs_truncate_t truncate,
-		fs_link_t link,
-		fs_unlink_t unlink
-		);
+/* attach a filesystem at an absolute path, FILE_BUSY if something is already mounted there */
+enum file_status_t fs_mount(const char* mountpoint, struct mount_cntx_t* cntx, const struct fs_ops_t* ops);
 
 extern struct fs_handle_t* fs_open_mode(const char* path, uint32_t flags, uint32_t mode);
 extern struct fs_handle_t* fs_open(const char* path, uint32_t flags);
 extern void fs_close(struct fs_handle_t* handle);
 
+/* another reference to the same open file, each one is dropped with fs_close */
+extern struct fs_handle_t* fs_dup(struct fs_handle_t* handle);
+
 extern struct fs_handle_t* fs_openat(const char* path, uint32_t flags, struct fs_handle_t* at, uint32_t mode);
 
 extern enum file_status_t fs_stat(struct fs_handle_t* handle, struct file_info_t* info);
@@ -120,9 +154,23 @@ extern uint64_t fs_get_seek(struct fs_handle_t* handle);
 extern enum file_status_t fs_seek(struct fs_handle_t* handle, uint64_t seek);
 extern size_t fs_write(struct fs_handle_t* handle, const void* buffer, size_t count);
 
+/* transfer every segment in order starting at offset, the handle's seek is left where it was */
+extern size_t fs_preadv(struct fs_handle_t* handle, const struct fs_iovec_t* iov, size_t count, uint64_t offset);
+extern size_t fs_pwritev(struct fs_handle_t* handle, const struct fs_iovec_t* iov, size_t count, uint64_t offset);
+
+/* copy count bytes from in at in_off to out at out_off inside the kernel, neither seek moves,
+ * overlapping ranges of one file copy nothing */
+extern size_t fs_copy_range(struct fs_handle_t* in, uint64_t in_off, struct fs_handle_t* out, uint64_t out_off, size_t count);
+
+/* move up to count bytes between a pipe and a file or another pipe, offsets only apply to files and neither seek moves,
+ * cached file pages are lent to the pipe and full pipe pages taken into the cache instead of copied,
+ * waits only while the source pipe is empty */
+extern size_t fs_splice(struct fs_handle_t* in, uint64_t in_off, struct fs_handle_t* out, uint64_t out_off, size_t count);
+
 extern struct fs_handle_t* fs_open_dir(struct fs_handle_t* handle); // invalidates old handle
 
 extern enum file_status_t fs_read_dir(struct fs_handle_t* handle, struct dir_info_t* info);
+extern enum file_status_t fs_read_dirs(struct fs_handle_t* handle, fs_dir_emit_t emit, void* cntx);
 
 extern enum file_status_t fs_create_dir(struct fs_handle_t* handle);
 extern enum file_status_t fs_delete_dir(struct fs_handle_t* handle);
@@ -133,6 +181,9 @@ extern enum file_status_t fs_unlink(struct fs_handle_t* handle);
 
 extern uint8_t fs_is_interactive(struct fs_handle_t* handle);
 
+/* FS_POLL_* bits ready now, head is set to 0 if they never change */
+extern uint32_t fs_poll(struct fs_handle_t* handle, struct poll_head_t** head);
+
 extern void fs_path(struct fs_handle_t* handle, size_t max_len, char* buf);
 
 #endif /* KERNEL_CORE_FS_H */
@@ -0,0 +1,43 @@
+/* futex.h - userland wait queues keyed by address */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef KERNEL_CORE_FUTEX_H
+#define KERNEL_CORE_FUTEX_H
+
+#include <stdint.h>
+
+#define FUTEX_BUCKETS	64
+
+enum futex_status_t {
+	FUTEX_WOKEN,
+	FUTEX_AGAIN,
+	FUTEX_TIMEOUT,
+	FUTEX_NO_MEM
+};
+
+extern void futex_init(void);
+
+/* sleep on (space, uaddr) while *uaddr holds val, timeout_ns of 0 waits forever */
+extern enum futex_status_t futex_wait(uint64_t space, uint32_t* uaddr, uint32_t val, uint64_t timeout_ns);
+
+/* wake up to count waiters, returns the number woken */
+extern uint64_t futex_wake(uint64_t space, uint32_t* uaddr, uint64_t count);
+
+/* wake up to count waiters and move up to requeue of the rest onto uaddr2, returns the number woken */
+extern uint64_t futex_requeue(uint64_t space, uint32_t* uaddr, uint64_t count, uint32_t* uaddr2, uint64_t requeue);
+
+#endif /* KERNEL_CORE_FUTEX_H */
@@ -0,0 +1,67 @@
+/* io_ring.h - asynchronous submission and completion rings */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef KERNEL_CORE_IO_RING_H
+#define KERNEL_CORE_IO_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kernel/core/process.h>
+
+#define IO_RING_MAX_ENTRIES	256
+#define IO_RING_WORKERS			4
+
+/* start of the memory shared with the process, the kernel only writes sq_head and cq_tail */
+struct io_ring_header_t {
+	uint32_t sq_head;
+	uint32_t sq_tail;
+	uint32_t cq_head;
+	uint32_t cq_tail;
+	uint32_t entries; // completion queue holds twice as many
+	uint32_t sq_offset;
+	uint32_t cq_offset;
+	uint32_t rsv;
+};
+
+struct io_ring_sqe_t {
+	uint8_t op;
+	uint8_t rsv[3];
+	int32_t fd;
+	uint64_t addr;
+	uint64_t len;
+	uint64_t off;
+	uint64_t user_data;
+};
+
+struct io_ring_cqe_t {
+	uint64_t user_data;
+	uint64_t res;
+};
+
+struct io_ring_t;
+
+/* map a ring of entries submissions into pcb and start its workers, returns the user address or 0 */
+extern uint64_t io_ring_setup(struct pcb_t* pcb, uint32_t entries);
+
+/* queue up to count new submissions, then wait for min_complete completions, returns submissions taken */
+extern uint64_t io_ring_enter(struct io_ring_t* ring, uint32_t count, uint32_t min_complete);
+
+/* stop the ring of an exiting process, its last worker then frees the process state */
+extern void io_ring_exit(struct io_ring_t* ring);
+
+#endif /* KERNEL_CORE_IO_RING_H */
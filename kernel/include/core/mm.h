@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#define CANON_LOW_END		0x0000800000000000
 #define CANON_HIGH			0xFFFF800000000000
 #define VIRTUAL_LIMIT		IDENT_BASE
 
@@ -0,0 +1,80 @@
+/* page_cache.h - file data page cache interface */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef KERNEL_CORE_PAGE_CACHE_H
+#define KERNEL_CORE_PAGE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <kernel/core/fs.h>
+
+#define PAGE_CACHE_PAGE_SIZE	0x1000
+#define PAGE_CACHE_MAX_PAGES	4096
+
+/* dirty pages a file may hold before writers have to write them back */
+#define PAGE_CACHE_DIRTY_MAX	256
+
+struct cache_file_t;
+struct cache_page_t;
+
+extern void page_cache_init(void);
+
+/* reference to the cached data of an inode, size is the file size the filesystem has stored,
+ * returns 0 if out of memory */
+extern struct cache_file_t* page_cache_open(const struct mount_cntx_t* cntx, uint64_t ino, uint64_t size);
+extern void page_cache_close(struct cache_file_t* file);
+
+/* file size including data only held in dirty pages */
+extern uint64_t page_cache_size(struct cache_file_t* file);
+extern void page_cache_set_size(struct cache_file_t* file, uint64_t size);
+
+extern uint64_t page_cache_dirty_count(struct cache_file_t* file);
+
+/* pinned page at index, a new page on a miss, returns 0 if out of memory */
+extern struct cache_page_t* page_cache_get(struct cache_file_t* file, uint64_t index);
+
+/* pinned first dirty page at or after *index, which is updated to its index */
+extern struct cache_page_t* page_cache_next_dirty(struct cache_file_t* file, uint64_t* index);
+
+extern void page_cache_put(struct cache_page_t* page);
+
+/* swap in a full page frame taken over by the cache, only while the caller holds the sole pin,
+ * returns 1 if the page is shared, in which case paddr stays with the caller */
+extern uint8_t page_cache_replace(struct cache_page_t* page, uint64_t paddr);
+
+extern uint8_t* page_cache_data(struct cache_page_t* page);
+extern uint64_t page_cache_paddr(struct cache_page_t* page);
+
+/* contents match the file, set once a new page has been filled */
+extern uint8_t page_cache_uptodate(struct cache_page_t* page);
+extern void page_cache_mark_uptodate(struct cache_page_t* page);
+
+/* returns 1 if out of memory, in which case the page stays clean */
+extern uint8_t page_cache_mark_dirty(struct cache_page_t* page);
+extern void page_cache_mark_clean(struct cache_page_t* page);
+
+/* drop every clean unpinned page of the file, dirty pages wait for their writeback */
+extern void page_cache_invalidate(struct cache_file_t* file);
+
+/* drop every unpinned page of the file, dirty or not, for a file that is gone */
+extern void page_cache_discard(struct cache_file_t* file);
+
+/* free up to count clean unpinned pages, least recently used first, returns pages freed */
+extern uint64_t page_cache_reclaim(uint64_t count);
+
+#endif /* KERNEL_CORE_PAGE_CACHE_H */
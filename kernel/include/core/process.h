@@ -27,9 +27,26 @@
 
 #include <kernel/lib/array_list.h>
 
-#define MAX_META		1
+#define MAX_META		2
 
 struct pcb_t;
+struct io_ring_t;
+struct epoll_t;
+
+/* state shared by every thread of a process */
+struct proc_shared_t {
+	uint64_t refs;
+	uint64_t cr3;
+	uint64_t mem_top;
+
+	struct fs_handle_t* wd;
+	struct array_list_t* fd_table;
+	struct array_list_t* epoll_table;
+	struct array_list_t* shm_table; // shared memory mapped into cr3, held until it is freed
+	uint8_t lock; // guards wd, fd_table, epoll_table, shm_table and mem_top
+
+	struct io_ring_t* ring;
+};
 
 struct pcb_t {
 	// order is important
@@ -63,7 +80,6 @@ struct pcb_t {
 	uint64_t init_k_rsp_vaddr;
 	uint64_t init_k_rsp_paddr;
 	uint64_t fsbase;
-	uint64_t mem_top;
 
 	uint64_t cr3;
 
@@ -71,8 +87,10 @@ struct pcb_t {
 
 	uint64_t exit_code;
 
-	struct fs_handle_t* wd;
-	struct array_list_t* fd_table;
+	// disk requests it allocates queue behind foreground ones
+	uint8_t io_background;
+
+	struct proc_shared_t* shared;
 
 	uint8_t fxdata[512] __attribute__((aligned(16)));
 
@@ -131,6 +149,21 @@ extern struct pcb_t* process_from_vaddr(uint64_t vaddr);
 
 extern struct pcb_t* process_from_func(process_function_t func, void* cntx);
 
+/* mark the calling thread's disk requests as background writeback or not, returns the previous setting */
+extern uint8_t process_io_background(uint8_t background);
+
+/* new thread of parent entering userland at rip, returns 0 on failure or if rip, rsp or fsbase leave the user half */
+extern struct pcb_t* process_thread_from(struct pcb_t* parent, uint64_t rip, uint64_t rsp, uint64_t fsbase);
+
+/* takes over fd_table and the reference to wd */
+extern struct proc_shared_t* process_shared_alloc(uint64_t cr3, uint64_t mem_top, struct array_list_t* fd_table, struct fs_handle_t* wd);
+
+/* drop a thread's reference, the last one tears the process down */
+extern void process_shared_put(struct proc_shared_t* shared);
+
+/* free the address space, handles and shared state */
+extern void process_shared_free(struct proc_shared_t* shared);
+
 extern void process_resume(struct pcb_t* pcb) __attribute__((noreturn));
 
 extern void process_kill_current(void) __attribute__((noreturn));
@@ -145,4 +178,24 @@ extern void process_sleep(uint64_t wake_time);
 
 extern void process_set_callback(void (*callback)(struct pcb_t*));
 
+/* open handle at fd with a reference for the caller to fs_close, 0 if fd is not open */
+extern struct fs_handle_t* process_fd_get(struct pcb_t* pcb, uint64_t fd);
+
+/* takes over the caller's reference, returns the new fd */
+extern uint64_t process_fd_add(struct pcb_t* pcb, struct fs_handle_t* handle);
+
+/* the table's reference to the handle at fd, 0 if fd is not open */
+extern struct fs_handle_t* process_fd_remove(struct pcb_t* pcb, uint64_t fd);
+
+/* working directory with a reference for the caller to fs_close */
+extern struct fs_handle_t* process_wd_get(struct pcb_t* pcb);
+
+/* takes over the caller's reference and drops the old working directory */
+extern void process_wd_set(struct pcb_t* pcb, struct fs_handle_t* handle);
+
+/* epoll instances live in their own table and follow the same reference rules as fds */
+extern struct epoll_t* process_epoll_get(struct pcb_t* pcb, uint64_t id);
+extern uint64_t process_epoll_add(struct pcb_t* pcb, struct epoll_t* epoll);
+extern struct epoll_t* process_epoll_remove(struct pcb_t* pcb, uint64_t id);
+
 #endif /* KERNEL_CORE_PROCESS_H */
@@ -0,0 +1,44 @@
+/* shm.h - named shared memory objects */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef KERNEL_CORE_SHM_H
+#define KERNEL_CORE_SHM_H
+
+#include <stdint.h>
+
+#include <kernel/core/process.h>
+
+#define SHM_NAME_MAX	64
+#define SHM_SIZE_MAX	0x100000000uLL
+
+struct shm_t;
+
+extern void shm_init(void);
+
+/* reference to the object called name, created with size bytes if missing and flags has SHM_CREATE,
+ * SHM_HUGE backs a new object with 2M frames, returns 0 on failure or if size is above SHM_SIZE_MAX */
+extern struct shm_t* shm_open(const char* name, uint64_t size, uint32_t flags);
+extern void shm_put(struct shm_t* shm);
+
+/* drop the name, the frames go once the last mapping does */
+extern uint8_t shm_unlink(const char* name);
+
+/* map every frame of shm into the process, which keeps the reference until its address space is freed,
+ * returns the user address or 0 */
+extern uint64_t shm_map(struct shm_t* shm, struct proc_shared_t* shared);
+
+#endif /* KERNEL_CORE_SHM_H */
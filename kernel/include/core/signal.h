@@ -15,10 +15,34 @@
 * along with this program.  If not, see <https://www.gnu.org/licenses/>
 */
 
+#ifndef KERNEL_CORE_SIGNAL_H
+#define KERNEL_CORE_SIGNAL_H
+
 #include <stdint.h>
 
 struct signal_wait_t;
 
+/* 0 when out of memory */
 extern struct signal_wait_t* signal_wait_alloc(void);
+extern void signal_wait_free(struct signal_wait_t* wait);
 extern void signal_wait(struct signal_wait_t* wait);
 extern void signal_awake(struct signal_wait_t* wait);
+
+/* sleep only if no signal_awake happened since seq was sampled */
+extern uint64_t signal_seq(struct signal_wait_t* wait);
+extern void signal_wait_seq(struct signal_wait_t* wait, uint64_t seq);
+
+struct signal_timer_t;
+
+extern void signal_timer_init(void);
+
+/* fire every timer due by now, called from scheduler_run with interrupts off */
+extern void signal_timer_run(uint64_t now);
+
+/* signal_awake wait once time_since_init_fs reaches wake_time, 0 if no timer could be started */
+extern struct signal_timer_t* signal_timer_start(struct signal_wait_t* wait, uint64_t wake_time);
+
+/* takes the timer off the list and frees it, its wait is no longer touched once this returns */
+extern void signal_timer_cancel(struct signal_timer_t* timer);
+
+#endif /* KERNEL_CORE_SIGNAL_H */
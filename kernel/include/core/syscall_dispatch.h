@@ -22,6 +22,9 @@
 
 #include <kernel/core/syscall_vectors.h>
 
+#define USERLAND_AT_FDCWD -100
+#define USERLAND_SEEK_OFF ~0uLL
+
 #define DECLARE_SYSCALL(name) \
 	uint64_t syscall_dispatch_##name ( \
 			uint64_t arg1, \
@@ -64,5 +67,20 @@ extern DECLARE_SYSCALL(ccwd);
 extern DECLARE_SYSCALL(link);
 extern DECLARE_SYSCALL(unlink);
 extern DECLARE_SYSCALL(stat);
+extern DECLARE_SYSCALL(preadv);
+extern DECLARE_SYSCALL(pwritev);
+extern DECLARE_SYSCALL(copy_range);
+extern DECLARE_SYSCALL(ring_setup);
+extern DECLARE_SYSCALL(ring_enter);
+extern DECLARE_SYSCALL(futex);
+extern DECLARE_SYSCALL(thread_create);
+extern DECLARE_SYSCALL(epoll_create);
+extern DECLARE_SYSCALL(epoll_ctl);
+extern DECLARE_SYSCALL(epoll_wait);
+extern DECLARE_SYSCALL(epoll_close);
+extern DECLARE_SYSCALL(pipe);
+extern DECLARE_SYSCALL(splice);
+extern DECLARE_SYSCALL(shm_map);
+extern DECLARE_SYSCALL(shm_unlink);
 
 #endif /* KERNEL_CORE_SYSCALL_DISPATCH_H */
@@ -96,9 +96,9 @@
 
 /*
  * rdi: handle (int)
- * rsi: info buffer (void*)
+ * rsi: info buffer (struct dirent*)
  * rdx: max_size (size_t)
- * ret: size (size_t)
+ * ret: size of the packed entries, 0 at the end (size_t)
  */
 #define SYSCALL_READ_DIR		9
 
@@ -178,6 +178,160 @@
  */
 #define SYSCALL_STAT				21
 
-#define SYSCALL_MAX					22
+/*
+ * rdi: handle (int)
+ * rsi: segments (const struct iovec*)
+ * rdx: segment count (int)
+ * r8 : offset (long int)
+ * ret: bytes read (size_t)
+ */
+#define SYSCALL_PREADV			22
+
+/*
+ * rdi: handle (int)
+ * rsi: segments (const struct iovec*)
+ * rdx: segment count (int)
+ * r8 : offset (long int)
+ * ret: bytes written (size_t)
+ */
+#define SYSCALL_PWRITEV			23
+
+/*
+ * rdi: in handle (int)
+ * rsi: out handle (int)
+ * rdx: count (size_t)
+ * r8 : in offset, -1 for the in seek which is advanced (long int)
+ * r9 : out offset, -1 for the out seek which is advanced (long int)
+ * ret: bytes copied (size_t)
+ */
+#define SYSCALL_COPY_RANGE	24
+
+/*
+ * rdi: entries, a power of two up to 256 (int)
+ * ret: ring (void*)
+ *
+ * the ring starts with sq_head, sq_tail, cq_head, cq_tail, entries, sq offset and cq offset (uint32_t)
+ * submissions are op (uint8_t), fd (int at 4), addr, len, off and user_data (uint64_t from 8)
+ * completions are user_data and res (uint64_t), the completion queue holds 2 * entries
+ *
+ * read/write: addr buffer, len count, off -1 for the seek
+ * openat: fd at, addr path, len flags, off mode
+ * stat: addr statbuf
+ */
+#define SYSCALL_RING_SETUP	25
+
+/*
+ * rdi: submissions to take (int)
+ * rsi: completions to wait for (int)
+ * ret: submissions taken (int)
+ */
+#define SYSCALL_RING_ENTER	26
+
+/*
+ * rdi: futex word, 4 byte aligned (int*)
+ * rsi: op (int)
+ * rdx: wait: expected value, wake/requeue: waiters to wake (int)
+ * r8 : wait: timeout in nanoseconds, 0 for none, requeue: waiters to move (size_t)
+ * r9 : requeue: futex word to move waiters onto (int*)
+ * ret: wait: 0 woken, 1 value differed, 2 timed out, wake/requeue: waiters woken (int)
+ */
+#define SYSCALL_FUTEX				27
+
+/*
+ * rdi: entry point (void*)
+ * rsi: stack (void*)
+ * rdx: thread pointer loaded into fsbase (void*)
+ * ret: thread id (int)
+ *
+ * the thread shares the address space, handles and working directory of its creator
+ * and exits through SYSCALL_EXIT, the process ends with its last thread,
+ * fails if any of the three points outside the user half
+ */
+#define SYSCALL_THREAD_CREATE	28
+
+/*
+ * ret: epoll instance (int)
+ */
+#define SYSCALL_EPOLL_CREATE	29
+
+/*
+ * rdi: epoll instance (int)
+ * rsi: op (int)
+ * rdx: handle (int)
+ * r8 : events (uint32_t)
+ * r9 : data reported with the events (uint64_t)
+ * ret: status (int)
+ */
+#define SYSCALL_EPOLL_CTL		30
+
+/*
+ * rdi: epoll instance (int)
+ * rsi: events, laid out like struct epoll_event (void*)
+ * rdx: max events (int)
+ * r8 : timeout in nanoseconds, 0 to poll, -1 to wait forever (size_t)
+ * ret: events ready (int)
+ */
+#define SYSCALL_EPOLL_WAIT	31
+
+/*
+ * rdi: epoll instance (int)
+ * ret: status (int)
+ */
+#define SYSCALL_EPOLL_CLOSE	32
+
+/*
+ * rdi: read end and write end (int[2])
+ * ret: status (int)
+ */
+#define SYSCALL_PIPE				33
+
+/*
+ * rdi: in handle (int)
+ * rsi: out handle (int)
+ * rdx: count (size_t)
+ * r8 : in offset, -1 for the in seek which is advanced, ignored for pipes (long int)
+ * r9 : out offset, -1 for the out seek which is advanced, ignored for pipes (long int)
+ * ret: bytes moved (size_t)
+ */
+#define SYSCALL_SPLICE			34
+
+/*
+ * rdi: name (const char*)
+ * rsi: size in bytes, rounded up to the frame size, 0 to map an existing object whole (size_t)
+ * rdx: flags (int)
+ * ret: address of the mapping (void*)
+ *
+ * the mapping stays until the process exits
+ */
+#define SYSCALL_SHM_MAP			35
+
+/*
+ * rdi: name (const char*)
+ * ret: status (int)
+ */
+#define SYSCALL_SHM_UNLINK	36
+
+#define SYSCALL_MAX					37
+
+#define IO_RING_OP_NOP			0
+#define IO_RING_OP_READ			1
+#define IO_RING_OP_WRITE		2
+#define IO_RING_OP_OPENAT		3
+#define IO_RING_OP_CLOSE		4
+#define IO_RING_OP_STAT			5
+
+#define FUTEX_OP_WAIT				0
+#define FUTEX_OP_WAKE				1
+#define FUTEX_OP_REQUEUE		2
+
+#define EPOLL_CTL_ADD				0
+#define EPOLL_CTL_MOD				1
+#define EPOLL_CTL_DEL				2
+
+#define EPOLL_IN						0x1
+#define EPOLL_OUT						0x4
+
+#define SHM_CREATE					0x1
+#define SHM_HUGE						0x2
 
 
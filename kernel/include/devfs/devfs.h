@@ -46,4 +46,11 @@ extern enum file_status_t devfs_unlink(struct file_handle_t* handle);
 
 extern uint8_t devfs_is_interactive(struct file_handle_t* handle);
 
+extern uint32_t devfs_poll(struct file_handle_t* handle, struct poll_head_t** head);
+
+struct pipe_t;
+
+/* the pipe behind handle, 0 for any other device */
+extern struct pipe_t* devfs_pipe(struct file_handle_t* handle, uint8_t* write_end);
+
 #endif /* KERNEL_DEVFS_DEVFS_H */
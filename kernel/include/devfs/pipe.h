@@ -0,0 +1,76 @@
+/* pipe.h - anonymous pipes */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef KERNEL_DEVFS_PIPE_H
+#define KERNEL_DEVFS_PIPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PIPE_BUFS				16
+#define PIPE_BUF_SIZE		0x1000
+#define PIPE_PATH_MAX		32
+
+struct pipe_t;
+
+struct poll_head_t;
+
+struct cache_page_t;
+
+/* one page of queued data */
+struct pipe_buf_t {
+	uint64_t paddr;
+	uint8_t* data;
+	struct cache_page_t* page; // pinned cache page lending its frame, 0 if the pipe owns paddr
+	uint32_t offset;
+	uint32_t len;
+	uint8_t merge; // writes may still append, cleared once splice looks at the buffer
+};
+
+extern void pipe_init(void);
+
+/* new pipe with no ends open, held until pipe_put, returns 0 if out of memory */
+extern struct pipe_t* pipe_alloc(void);
+extern void pipe_put(struct pipe_t* pipe);
+
+/* devfs path of one end of pipe, buffer holds PIPE_PATH_MAX */
+extern void pipe_path(struct pipe_t* pipe, uint8_t write_end, char* buffer);
+
+/* open the end named by "<id>r" or "<id>w" */
+extern struct pipe_t* pipe_open(const char* name, uint8_t* write_end);
+extern void pipe_close(struct pipe_t* pipe, uint8_t write_end);
+
+/* blocks until data or end of file */
+extern size_t pipe_read(struct pipe_t* pipe, void* buffer, size_t count);
+
+/* blocks while full, stops short once every read end is closed */
+extern size_t pipe_write(struct pipe_t* pipe, const void* buffer, size_t count);
+
+extern uint32_t pipe_poll(struct pipe_t* pipe, uint8_t write_end, struct poll_head_t** head);
+
+/* copy out the oldest buffer, waiting for one if block is set, returns 1 at end of file or while empty */
+extern uint8_t pipe_peek(struct pipe_t* pipe, struct pipe_buf_t* buf, uint8_t block);
+
+/* drop count bytes of the oldest buffer, stolen hands the whole buffer to the caller instead */
+extern void pipe_consume(struct pipe_t* pipe, size_t count, uint8_t stolen);
+
+/* queue buf as is, blocks while full, returns 1 if no read end is open and buf was not taken */
+extern uint8_t pipe_push(struct pipe_t* pipe, const struct pipe_buf_t* buf);
+
+extern void pipe_buf_release(const struct pipe_buf_t* buf);
+
+#endif /* KERNEL_DEVFS_PIPE_H */
@@ -25,6 +25,8 @@
 
 struct tty_handle_t;
 
+struct poll_head_t;
+
 extern void tty_init(void);
 
 #ifdef SERIAL
@@ -38,4 +40,7 @@ extern size_t tty_read(struct tty_handle_t* tty, void* buffer, size_t count);
 extern uint8_t tty_queue_read(struct tty_handle_t* tty, uint8_t byte);
 extern void tty_write(struct tty_handle_t* tty, const void* buffer, size_t count);
 
+/* FS_POLL_IN while input is buffered, writes never block */
+extern uint32_t tty_poll(struct tty_handle_t* tty, struct poll_head_t** head);
+
 #endif /* KERNEL_DEVFS_TTY_H */
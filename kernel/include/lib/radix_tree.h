@@ -0,0 +1,44 @@
+/* radix_tree.h - radix tree interface */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef KERNEL_LIB_RADIX_TREE_H
+#define KERNEL_LIB_RADIX_TREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct radix_tree_t;
+
+extern struct radix_tree_t* radix_tree_alloc(void);
+
+/* values must be non null, returns the replaced value or value itself */
+extern void* radix_tree_insert(struct radix_tree_t* tree, uint64_t key, void* value);
+
+extern uint8_t radix_tree_get(struct radix_tree_t* tree, uint64_t key, void** out);
+
+extern uint8_t radix_tree_remove(struct radix_tree_t* tree, uint64_t key, void** out);
+
+/* first entry with a key at or above *key, which is updated to the key found */
+extern uint8_t radix_tree_next(struct radix_tree_t* tree, uint64_t* key, void** out);
+
+extern void radix_tree_clear(struct radix_tree_t* tree, void (*free_func)(void*));
+
+extern void radix_tree_free(struct radix_tree_t* tree, void (*free_func)(void*));
+
+extern size_t radix_tree_count(struct radix_tree_t* tree);
+
+#endif /* KERNEL_LIB_RADIX_TREE_H */
@@ -0,0 +1,273 @@
+/* radix_tree.c - radix tree implementation */
+/* Copyright (C) 2026  Ebrahim Aleem
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <lib/radix_tree.h>
+#include <lib/kmemset.h>
+
+#include <core/alloc.h>
+
+#define RADIX_BITS			6
+#define RADIX_SLOTS			(1 << RADIX_BITS)
+#define RADIX_MASK			(RADIX_SLOTS - 1)
+#define RADIX_MAX_HEIGHT	((64 + RADIX_BITS - 1) / RADIX_BITS)
+
+struct radix_node_t {
+	void* slots[RADIX_SLOTS];
+	uint64_t used;
+};
+
+struct radix_tree_t {
+	struct radix_node_t* root;
+	uint64_t height; // 0 iff there is no root
+	size_t num_elems;
+};
+
+static inline uint64_t slot_of(uint64_t key, uint64_t level) {
+	return (key >> (level * RADIX_BITS)) & RADIX_MASK;
+}
+
+// keys below the given level, all of them if the shift would overflow
+static inline uint64_t span_mask(uint64_t level) {
+	if (level * RADIX_BITS >= 64) {
+		return ~0uLL;
+	}
+
+	return (1uLL << (level * RADIX_BITS)) - 1;
+}
+
+static struct radix_node_t* node_alloc(void) {
+	struct radix_node_t* node = kmalloc(sizeof(struct radix_node_t));
+
+	if (node) {
+		kmemset(node, 0, sizeof(struct radix_node_t));
+	}
+
+	return node;
+}
+
+static void node_free(struct radix_node_t* node, uint64_t level, void (*free_func)(void*)) {
+	for (uint64_t i = 0; i < RADIX_SLOTS; i++) {
+		if (!node->slots[i]) {
+			continue;
+		}
+
+		if (level) {
+			node_free(node->slots[i], level - 1, free_func);
+		}
+		else if (free_func) {
+			free_func(node->slots[i]);
+		}
+	}
+
+	kfree(node);
+}
+
+static uint8_t node_next(struct radix_node_t* node, uint64_t level, uint64_t key, uint64_t* found, void** out) {
+	const uint64_t high = ~span_mask(level + 1);
+
+	for (uint64_t i = slot_of(key, level); i < RADIX_SLOTS; i++) {
+		if (!node->slots[i]) {
+			continue;
+		}
+
+		// slots past the one key falls in start from their lowest key
+		const uint64_t base = (key & high) | (i << (level * RADIX_BITS));
+		const uint64_t from = i == slot_of(key, level) ? key : base;
+
+		if (!level) {
+			*found = base;
+			*out = node->slots[i];
+			return 1;
+		}
+
+		if (node_next(node->slots[i], level - 1, from, found, out)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+struct radix_tree_t* radix_tree_alloc(void) {
+	struct radix_tree_t* tree = kmalloc(sizeof(struct radix_tree_t));
+
+	if (!tree) {
+		return 0;
+	}
+
+	tree->root = 0;
+	tree->height = 0;
+	tree->num_elems = 0;
+
+	return tree;
+}
+
+void* radix_tree_insert(struct radix_tree_t* tree, uint64_t key, void* value) {
+	struct radix_node_t* node;
+	void** slot;
+
+	// grow until key fits, the old root becomes the first child
+	while (!tree->root || key > span_mask(tree->height)) {
+		node = node_alloc();
+
+		if (!node) {
+			return 0;
+		}
+
+		if (tree->root) {
+			node->slots[0] = tree->root;
+			node->used = 1;
+		}
+
+		tree->root = node;
+		tree->height++;
+	}
+
+	node = tree->root;
+	for (uint64_t level = tree->height - 1; level > 0; level--) {
+		slot = &node->slots[slot_of(key, level)];
+
+		if (!*slot) {
+			*slot = node_alloc();
+
+			if (!*slot) {
+				return 0;
+			}
+
+			node->used++;
+		}
+
+		node = *slot;
+	}
+
+	slot = &node->slots[slot_of(key, 0)];
+
+	if (*slot) {
+		void* old = *slot;
+		*slot = value;
+		return old;
+	}
+
+	*slot = value;
+	node->used++;
+	tree->num_elems++;
+
+	return value;
+}
+
+uint8_t radix_tree_get(struct radix_tree_t* tree, uint64_t key, void** out) {
+	struct radix_node_t* node = tree->root;
+
+	if (!node || key > span_mask(tree->height)) {
+		return 0;
+	}
+
+	for (uint64_t level = tree->height - 1; level > 0; level--) {
+		node = node->slots[slot_of(key, level)];
+
+		if (!node) {
+			return 0;
+		}
+	}
+
+	if (!node->slots[slot_of(key, 0)]) {
+		return 0;
+	}
+
+	*out = node->slots[slot_of(key, 0)];
+	return 1;
+}
+
+uint8_t radix_tree_remove(struct radix_tree_t* tree, uint64_t key, void** out) {
+	struct radix_node_t* path[RADIX_MAX_HEIGHT];
+	struct radix_node_t* node = tree->root;
+	uint64_t level;
+
+	if (!node || key > span_mask(tree->height)) {
+		return 0;
+	}
+
+	for (level = tree->height - 1; level > 0; level--) {
+		path[level] = node;
+		node = node->slots[slot_of(key, level)];
+
+		if (!node) {
+			return 0;
+		}
+	}
+
+	path[0] = node;
+
+	if (!node->slots[slot_of(key, 0)]) {
+		return 0;
+	}
+
+	*out = node->slots[slot_of(key, 0)];
+	node->slots[slot_of(key, 0)] = 0;
+	tree->num_elems--;
+
+	// free nodes left empty, bottom up
+	for (level = 0; level < tree->height; level++) {
+		if (--path[level]->used) {
+			break;
+		}
+
+		kfree(path[level]);
+
+		if (level + 1 < tree->height) {
+			path[level + 1]->slots[slot_of(key, level + 1)] = 0;
+		}
+		else {
+			tree->root = 0;
+			tree->height = 0;
+			break;
+		}
+	}
+
+	return 1;
+}
+
+uint8_t radix_tree_next(struct radix_tree_t* tree, uint64_t* key, void** out) {
+	if (!tree->root || *key > span_mask(tree->height)) {
+		return 0;
+	}
+
+	return node_next(tree->root, tree->height - 1, *key, key, out);
+}
+
+void radix_tree_clear(struct radix_tree_t* tree, void (*free_func)(void*)) {
+	if (tree->root) {
+		node_free(tree->root, tree->height - 1, free_func);
+	}
+
+	tree->root = 0;
+	tree->height = 0;
+	tree->num_elems = 0;
+}
+
+void radix_tree_free(struct radix_tree_t* tree, void (*free_func)(void*)) {
+	radix_tree_clear(tree, free_func);
+
+	kfree(tree);
+}
+
+size_t radix_tree_count(struct radix_tree_t* tree) {
+	return tree->num_elems;
+}
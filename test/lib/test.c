@@ -30,6 +30,7 @@
 #include <kernel/lib/kstrcmp.h>
 #include <kernel/lib/hash.h>
 #include <kernel/lib/hash_table.h>
+#include <kernel/lib/radix_tree.h>
 #include <kernel/lib/array_list.h>
 
 #define MEM_TEST_SIZE	256
@@ -215,6 +216,89 @@ TEST("hash_table") {
 	hash_table_free(table2, 0);
 }
 
+TEST("radix_tree") {
+	struct radix_tree_t* tree = radix_tree_alloc();
+	void* tmp = 0;
+	uint64_t key;
+
+	ASSERT_FALSE(radix_tree_get(tree, 0, &tmp), "fails radix_tree_get on empty tree");
+	key = 0;
+	ASSERT_FALSE(radix_tree_next(tree, &key, &tmp), "fails radix_tree_next on empty tree");
+
+	ASSERT_TRUE(radix_tree_insert(tree, 5, (void*)1) == (void*)1, "fails radix_tree_insert");
+	ASSERT_TRUE(radix_tree_insert(tree, 64, (void*)2) == (void*)2, "fails radix_tree_insert");
+	ASSERT_TRUE(radix_tree_insert(tree, 1uLL << 40, (void*)3) == (void*)3, "fails radix_tree_insert");
+	ASSERT_TRUE(radix_tree_insert(tree, ~0uLL, (void*)4) == (void*)4, "fails radix_tree_insert");
+	ASSERT_TRUE(radix_tree_insert(tree, 5, (void*)5) == (void*)1, "fails radix_tree_insert");
+
+	ASSERT_TRUE(radix_tree_count(tree) == 4, "fails radix_tree_count");
+
+	ASSERT_TRUE(radix_tree_get(tree, 5, &tmp), "fails radix_tree_get");
+	ASSERT_TRUE(tmp == (void*)5, "fails radix_tree_get");
+
+	ASSERT_TRUE(radix_tree_get(tree, 64, &tmp), "fails radix_tree_get");
+	ASSERT_TRUE(tmp == (void*)2, "fails radix_tree_get");
+
+	ASSERT_TRUE(radix_tree_get(tree, 1uLL << 40, &tmp), "fails radix_tree_get");
+	ASSERT_TRUE(tmp == (void*)3, "fails radix_tree_get");
+
+	ASSERT_TRUE(radix_tree_get(tree, ~0uLL, &tmp), "fails radix_tree_get");
+	ASSERT_TRUE(tmp == (void*)4, "fails radix_tree_get");
+
+	ASSERT_FALSE(radix_tree_get(tree, 6, &tmp), "fails radix_tree_get");
+	ASSERT_FALSE(radix_tree_get(tree, 1uLL << 39, &tmp), "fails radix_tree_get");
+
+	key = 0;
+	ASSERT_TRUE(radix_tree_next(tree, &key, &tmp), "fails radix_tree_next");
+	ASSERT_TRUE(key == 5 && tmp == (void*)5, "fails radix_tree_next");
+
+	key = 6;
+	ASSERT_TRUE(radix_tree_next(tree, &key, &tmp), "fails radix_tree_next");
+	ASSERT_TRUE(key == 64 && tmp == (void*)2, "fails radix_tree_next");
+
+	key = 65;
+	ASSERT_TRUE(radix_tree_next(tree, &key, &tmp), "fails radix_tree_next");
+	ASSERT_TRUE(key == 1uLL << 40 && tmp == (void*)3, "fails radix_tree_next");
+
+	key = (1uLL << 40) + 1;
+	ASSERT_TRUE(radix_tree_next(tree, &key, &tmp), "fails radix_tree_next");
+	ASSERT_TRUE(key == ~0uLL && tmp == (void*)4, "fails radix_tree_next");
+
+	ASSERT_TRUE(radix_tree_remove(tree, ~0uLL, &tmp), "fails radix_tree_remove");
+	ASSERT_TRUE(tmp == (void*)4, "fails radix_tree_remove");
+	ASSERT_FALSE(radix_tree_remove(tree, ~0uLL, &tmp), "fails radix_tree_remove");
+
+	key = (1uLL << 40) + 1;
+	ASSERT_FALSE(radix_tree_next(tree, &key, &tmp), "fails radix_tree_next after remove");
+
+	ASSERT_TRUE(radix_tree_remove(tree, 5, &tmp), "fails radix_tree_remove");
+	ASSERT_TRUE(radix_tree_remove(tree, 64, &tmp), "fails radix_tree_remove");
+	ASSERT_TRUE(radix_tree_remove(tree, 1uLL << 40, &tmp), "fails radix_tree_remove");
+	ASSERT_TRUE(radix_tree_count(tree) == 0, "fails radix_tree_count after remove");
+
+	key = 0;
+	ASSERT_FALSE(radix_tree_next(tree, &key, &tmp), "fails radix_tree_next after remove");
+
+	for (uint64_t i = 0; i < 1000; i++) {
+		radix_tree_insert(tree, i * 3, (void*)(i + 1));
+	}
+
+	ASSERT_TRUE(radix_tree_count(tree) == 1000, "fails radix_tree_count");
+
+	key = 0;
+	for (uint64_t i = 0; i < 1000; i++) {
+		ASSERT_TRUE(radix_tree_next(tree, &key, &tmp), "fails radix_tree_next walk");
+		ASSERT_TRUE(key == i * 3 && tmp == (void*)(i + 1), "fails radix_tree_next walk");
+		key++;
+	}
+
+	radix_tree_clear(tree, 0);
+	ASSERT_TRUE(radix_tree_count(tree) == 0, "fails radix_tree_count after clear");
+	ASSERT_FALSE(radix_tree_get(tree, 3, &tmp), "fails radix_tree_get after clear");
+
+	radix_tree_free(tree, 0);
+}
+
 static void* array_list_dup_fun(void* value) {
 	return (void*)((uint64_t)value + 1);
 }
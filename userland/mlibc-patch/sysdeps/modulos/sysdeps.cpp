@@ -42,6 +42,11 @@ struct file_info_t {
 	} type;
 	uint64_t size;
 };
+
+struct io_segment_t {
+	void *base;
+	size_t len;
+};
 }
 
 namespace mlibc {
@@ -74,14 +79,37 @@ int sys_tcb_set(void *pointer) {
 // locking
 
 int sys_futex_wait(int *pointer, int expected, const struct timespec *time) {
-	(void)pointer;
-	(void)expected;
-	(void)time;
-	return 0;
+	uint64_t ns = 0;
+
+	if (time) {
+		if (time->tv_sec < 0 || time->tv_nsec < 0 || time->tv_nsec >= 1000000000) {
+			return EINVAL;
+		}
+
+		// a zero timeout still has to time out, not wait forever
+		ns = (uint64_t)time->tv_sec * 1000000000 + (uint64_t)time->tv_nsec;
+		if (!ns) {
+			ns = 1;
+		}
+	}
+
+	switch (syscall_4((uint64_t)pointer, FUTEX_OP_WAIT, (uint32_t)expected, SYSCALL_FUTEX, ns)) {
+		case 0:
+			return 0;
+		case 1:
+			return EAGAIN;
+		case 2:
+			return ETIMEDOUT;
+		default:
+			return EINVAL;
+	}
 }
 
 int sys_futex_wake(int *pointer) {
-	(void)pointer;
+	if (syscall_3((uint64_t)pointer, FUTEX_OP_WAKE, ~0uLL, SYSCALL_FUTEX) == SYSCALL_STS_FAIL) {
+		return EINVAL;
+	}
+
 	return 0;
 }
 
@@ -162,7 +190,7 @@ int sys_seek(int fd, off_t offset, int whence, off_t *new_offset) {
 		case SEEK_SET:
 set:
 			new_off = syscall_2(fd, (uint64_t)offset, 0, SYSCALL_SEEK);
-			if ((uint64_t)*new_offset == SYSCALL_STS_FAIL) {
+			if ((uint64_t)new_off == SYSCALL_STS_FAIL) {
 				return EACCES;
 			}
 
@@ -200,6 +228,20 @@ int sys_write(int fd, const void *buf, size_t count, ssize_t *bytes_written) {
 	return 0;
 }
 
+int sys_pread(int fd, void *buf, size_t n, off_t off, ssize_t *bytes_read) {
+	struct io_segment_t seg = { buf, n };
+	*bytes_read = (ssize_t)syscall_4((uint64_t)fd, (uint64_t)&seg, 1, SYSCALL_PREADV, (uint64_t)off);
+
+	return 0;
+}
+
+int sys_pwrite(int fd, const void *buf, size_t n, off_t off, ssize_t *bytes_written) {
+	struct io_segment_t seg = { const_cast<void *>(buf), n };
+	*bytes_written = (ssize_t)syscall_4((uint64_t)fd, (uint64_t)&seg, 1, SYSCALL_PWRITEV, (uint64_t)off);
+
+	return 0;
+}
+
 int sys_open_dir(const char *path, int *handle) {
 	int fd;
 	int sts;
@@ -221,13 +263,14 @@ int sys_open_dir(const char *path, int *handle) {
 
 int sys_read_entries(int handle, void *buffer, size_t max_size,
 		size_t *bytes_read) {
-	(void)handle;
-	(void)buffer;
-	(void)max_size;
-	(void)bytes_read;
+	uint64_t size = syscall_3((uint64_t)handle, (uint64_t)buffer, (uint64_t)max_size, SYSCALL_READ_DIR);
 
-	//TODO
-	return ENOSYS;
+	if (size == SYSCALL_STS_FAIL) {
+		return EINVAL;
+	}
+
+	*bytes_read = (size_t)size;
+	return 0;
 }
 
 int sys_isatty(int fd) {